@@ -151,6 +151,16 @@ ssize_t skel_pwrite(vfs_handle_struct *handle, struct files_struct *fsp, int fd,
 	return vfswrap_pwrite(NULL, fsp, fd, data, n, offset);
 }
 
+static ssize_t skel_preadv(vfs_handle_struct *handle, struct files_struct *fsp, int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T offset)
+{
+	return vfswrap_preadv(NULL, fsp, fd, iov, iovcnt, offset);
+}
+
+static ssize_t skel_pwritev(vfs_handle_struct *handle, struct files_struct *fsp, int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T offset)
+{
+	return vfswrap_pwritev(NULL, fsp, fd, iov, iovcnt, offset);
+}
+
 static SMB_OFF_T skel_lseek(vfs_handle_struct *handle, files_struct *fsp, int filedes, SMB_OFF_T offset, int whence)
 {
 	return vfswrap_lseek(NULL, fsp, filedes, offset, whence);
@@ -594,6 +604,8 @@ static vfs_op_tuple skel_op_tuples[] = {
 	{SMB_VFS_OP(skel_pread),			SMB_VFS_OP_PREAD,		SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(skel_write),			SMB_VFS_OP_WRITE,		SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(skel_pwrite),			SMB_VFS_OP_PWRITE,		SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(skel_preadv),			SMB_VFS_OP_PREADV,		SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(skel_pwritev),			SMB_VFS_OP_PWRITEV,		SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(skel_lseek),			SMB_VFS_OP_LSEEK,		SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(skel_rename),			SMB_VFS_OP_RENAME,		SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(skel_fsync),			SMB_VFS_OP_FSYNC,		SMB_VFS_LAYER_OPAQUE},
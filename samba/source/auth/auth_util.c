@@ -989,7 +989,6 @@ NTSTATUS create_local_token(auth_serversupplied_info *server_info)
 {
 	TALLOC_CTX *mem_ctx;
 	NTSTATUS status;
-	size_t i;
 	
 
 	mem_ctx = talloc_new(NULL);
@@ -1034,19 +1033,15 @@ NTSTATUS create_local_token(auth_serversupplied_info *server_info)
 	server_info->n_groups = 0;
 	server_info->groups = NULL;
 
-	/* Start at index 1, where the groups start. */
-
-	for (i=1; i<server_info->ptok->num_sids; i++) {
-		gid_t gid;
-		DOM_SID *sid = &server_info->ptok->user_sids[i];
+	/* Start at index 1, where the groups start. Users can be in
+	   hundreds of groups, so ask winbind about them all at once. */
 
-		if (!sid_to_gid(sid, &gid)) {
-			DEBUG(10, ("Could not convert SID %s to gid, "
-				   "ignoring it\n", sid_string_static(sid)));
-			continue;
-		}
-		add_gid_to_array_unique(server_info, gid, &server_info->groups,
-					&server_info->n_groups);
+	if ((server_info->ptok->num_sids > 1) &&
+	    !sids_to_gids(server_info, &server_info->ptok->user_sids[1],
+			  server_info->ptok->num_sids - 1,
+			  &server_info->groups, &server_info->n_groups)) {
+		TALLOC_FREE(mem_ctx);
+		return NT_STATUS_NO_MEMORY;
 	}
 	
 	debug_nt_user_token(DBGC_AUTH, 10, server_info->ptok);
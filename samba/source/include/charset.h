@@ -38,6 +38,49 @@ struct charset_functions {
 	struct charset_functions *prev, *next;
 };
 
+/*
+ * Word at a time scanning for runs of plain ASCII. A word "stops" the
+ * run if any byte (or UTF-16 unit) in it is NUL or not 7 bit ASCII.
+ */
+
+#define ASCII_ONES	((uint64)0x0101010101010101ULL)
+#define ASCII_HIGHS	((uint64)0x8080808080808080ULL)
+#define ASCII_STOP(w)	(((w) & ASCII_HIGHS) | (((w) - ASCII_ONES) & ~(w) & ASCII_HIGHS))
+
+#define UCS2_ONES	((uint64)0x0001000100010001ULL)
+#define UCS2_HIGHS	((uint64)0x8000800080008000ULL)
+#ifdef WORDS_BIGENDIAN
+#define UCS2_NONASCII	((uint64)0x80FF80FF80FF80FFULL)
+#else
+#define UCS2_NONASCII	((uint64)0xFF80FF80FF80FF80ULL)
+#endif
+#define UCS2_STOP(w)	(((w) & UCS2_NONASCII) | (((w) - UCS2_ONES) & ~(w) & UCS2_HIGHS))
+
+/*
+ * Case folding of a word that has already been checked to hold only
+ * 7 bit ASCII: lanes in 'a'..'z' get their 0x20 bit cleared, which is
+ * what toupper_ascii() and the upcase table do for plain ASCII.
+ */
+
+#define ASCII_LOWER(w)	(((w) + (0x80 - 'a') * ASCII_ONES) & \
+			 ~((w) + (0x80 - 'z' - 1) * ASCII_ONES) & ASCII_HIGHS)
+#define ASCII_UPPER(w)	((w) ^ (ASCII_LOWER(w) >> 2))
+
+/* UTF-16 units are little endian in memory, so the lane value is
+   shifted up a byte on big endian hosts */
+#ifdef WORDS_BIGENDIAN
+#define UCS2_LANES(c)	((uint64)((c) << 8) * UCS2_ONES)
+#else
+#define UCS2_LANES(c)	((uint64)(c) * UCS2_ONES)
+#endif
+#define UCS2_LOWER(w)	(((w) + UCS2_LANES(0x80 - 'a')) & \
+			 ~((w) + UCS2_LANES(0x80 - 'z' - 1)) & UCS2_LANES(0x80))
+#define UCS2_UPPER(w)	((w) ^ (UCS2_LOWER(w) >> 2))
+
+/* one FNV-1a style step of the case folded name hashes, fed one
+   upper cased UTF-16 unit value at a time */
+#define STR_HASH_STEP(h, c)	(((h) ^ (uint32)(c)) * 0x01000193)
+
 /*
  * This is auxiliary struct used by source/script/gen-8-bit-gap.sh script
  * during generation of an encoding table for charset module
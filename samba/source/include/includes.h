@@ -760,6 +760,10 @@ struct functable2 {
 
 struct printjob;
 
+/* forward declaration from smbprofile.h, which needs proto.h first */
+
+struct profile_stats;
+
 /* forward declarations from smbldap.c */
 
 #include "smbldap.h"
@@ -779,6 +783,8 @@ enum flush_reason_enum {
     CLOSE_FLUSH,
     SYNC_FLUSH,
     SIZECHANGE_FLUSH,
+    IDLE_FLUSH,
+    BUDGET_FLUSH,
     /* NUM_FLUSH_REASONS must remain the last value in the enumeration. */
     NUM_FLUSH_REASONS};
 
@@ -112,8 +112,9 @@
 #define PAGER "more"
 #endif
 
-/* the size of the uid cache used to reduce valid user checks */
-#define VUID_CACHE_SIZE 32
+/* the size of the uid cache used to reduce valid user checks. A vuid
+   has its slot in it, vuids are handed out in sequence. */
+#define VUID_CACHE_SIZE 256
 
 /* the following control timings of various actions. Don't change 
    them unless you know what you are doing. These are all in seconds */
@@ -224,6 +225,14 @@
 /* Max number of simultaneous winbindd socket connections. */
 #define WINBINDD_MAX_SIMULTANEOUS_CLIENTS 200
 
+/* Requests a pipelined winbindd client may have outstanding before we
+   stop reading from it */
+#define WINBINDD_MAX_PIPELINED 256
+
+/* Times a request is handed to another winbindd child after the one
+   working on it died, before it is answered with an error */
+#define WINBINDD_CHILD_RETRIES 1
+
 /* Buffer size to use when printing backtraces */
 #define BACKTRACE_STACK_SIZE 64
 
@@ -247,6 +256,10 @@
 /* Default hash size for the winbindd cache. */
 #define WINBINDD_CACHE_TDB_DEFAULT_HASH_SIZE 5000
 
+/* tdb hash size for the samlogon cache, it holds a record and a name
+   index entry for each user who ever logged on. */
+#define NETSAMLOGON_CACHE_TDB_HASH_SIZE 10007
+
 /* Windows minimum lock resolution timeout in ms */
 #define WINDOWS_MINIMUM_LOCK_TIMEOUT_MS 200
 
@@ -302,6 +302,28 @@ typedef struct net_user_info_3 {
 	uint32 *other_sids_attrib;
 } NET_USER_INFO_3;
 
+/* linearized size of the largest sid */
+#define NETSAMLOGON_SID_SIZE	(8 + MAXSUBAUTHS * 4)
+
+/* A cached NET_USER_INFO_3 as seen by netsamlogon_cache_parse(). The
+ * pointers point into the record and are only valid in the callback:
+ * groups are num_groups times rid and attributes, other_sids are
+ * num_other_sids times attributes and a NETSAMLOGON_SID_SIZE byte sid,
+ * all numbers little endian. */
+struct netsamlogon_cache_entry {
+	time_t stored;
+	uint32 user_rid;
+	uint32 group_rid;
+	DOM_SID domain_sid;
+	uint32 num_groups;
+	const uint8 *groups;
+	uint32 num_other_sids;
+	const uint8 *other_sids;
+	const uint8 *strings;
+	const uint8 *record;
+	size_t len;
+};
+
 
 /* NETLOGON_INFO_1 - pdc status info, i presume */
 typedef struct netlogon_1_info {
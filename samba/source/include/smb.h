@@ -414,12 +414,26 @@ typedef struct {
 	BOOL  wr_discard; /* discard all further data */
 } write_bmpx_struct;
 
+/* One run of cached write data. */
+struct write_cache_extent {
+	struct write_cache_extent *next, *prev;
+	SMB_OFF_T offset;
+	size_t size;
+	char *data;		/* points into buf */
+	char *buf;
+	size_t alloc;		/* size of buf */
+};
+
 typedef struct write_cache {
+	struct write_cache *next, *prev;	/* on the list of caches holding data */
+	struct files_struct *fsp;
 	SMB_OFF_T file_size;
-	SMB_OFF_T offset;
-	size_t alloc_size;
-	size_t data_size;
-	char *data;
+	size_t alloc_size;	/* most data held for this file */
+	size_t data_size;	/* data held now */
+	unsigned int num_extents;
+	struct write_cache_extent *extents;	/* sorted, never overlapping */
+	struct timed_event *flush_event;
+	int flush_errno;	/* from a flush no client call waited for */
 } write_cache;
 
 typedef struct {
@@ -450,6 +464,7 @@ struct event_context;
 struct fd_event;
 struct timed_event;
 struct idle_event;
+struct ms_wildcard;
 struct share_mode_entry;
 struct uuid;
 
@@ -577,8 +592,7 @@ struct vuid_cache_entry {
 };
 
 struct vuid_cache {
-	unsigned int entries;
-	struct vuid_cache_entry array[VUID_CACHE_SIZE];
+	struct vuid_cache_entry array[VUID_CACHE_SIZE];	/* by vuid */
 };
 
 typedef struct {
@@ -641,6 +655,39 @@ struct share_iterator {
 	int next_id;
 };
 
+/*
+ * Share parameters that are consulted on (nearly) every SMB. They are
+ * copied out of the service table by conn_set_share_cache() when the
+ * connection is made and after every reload, so the fast paths read
+ * them directly instead of going through the lp_*() accessors.
+ */
+struct share_cache {
+	unsigned store_dos_attributes:1;
+	unsigned hide_dot_files:1;
+	unsigned dos_filemode:1;
+	unsigned dos_filetimes:1;
+	unsigned map_archive:1;
+	unsigned map_hidden:1;
+	unsigned map_system:1;
+	unsigned inherit_perms:1;
+	unsigned dmapi_support:1;
+	unsigned widelinks:1;
+	unsigned symlinks:1;
+	unsigned hide_unreadable:1;
+	unsigned hide_unwriteable:1;
+	unsigned hide_special:1;
+	unsigned msdfs_root:1;
+	unsigned ea_support:1;
+	unsigned strict_allocate:1;
+	unsigned strict_sync:1;
+	unsigned sync_always:1;
+	int map_readonly;
+	int default_case;
+	int write_cache_size;
+	int aio_read_size;
+	int aio_write_size;
+};
+
 typedef struct connection_struct {
 	struct connection_struct *next, *prev;
 	TALLOC_CTX *mem_ctx; /* long-lived memory context for things hanging off this struct. */
@@ -681,6 +728,7 @@ typedef struct connection_struct {
 	BOOL used;
 	int num_files_open;
 	unsigned int num_smb_operations; /* Count of smb operations on this tree. */
+	int profile_share; /* latency histogram slot last used for this share */
 
 	/* Semantics requested by the client or forced by the server config. */
 	BOOL case_sensitive;
@@ -690,6 +738,8 @@ typedef struct connection_struct {
 	/* Semantics provided by the underlying filesystem. */
 	int fs_capabilities;
 
+	struct share_cache share_cache;
+
 	name_compare_entry *hide_list; /* Per-share list of files to return as hidden. */
 	name_compare_entry *veto_list; /* Per-share list of files to veto (never show). */
 	name_compare_entry *veto_oplock_list; /* Per-share list of files to refuse oplocks on. */       
@@ -117,9 +117,9 @@
 #define GUEST_ONLY(snum)   (VALID_SNUM(snum) && lp_guest_only(snum))
 #define CAN_SETDIR(snum)   (!lp_no_set_dir(snum))
 #define CAN_PRINT(conn)    ((conn) && lp_print_ok(SNUM(conn)))
-#define MAP_HIDDEN(conn)   ((conn) && lp_map_hidden(SNUM(conn)))
-#define MAP_SYSTEM(conn)   ((conn) && lp_map_system(SNUM(conn)))
-#define MAP_ARCHIVE(conn)   ((conn) && lp_map_archive(SNUM(conn)))
+#define MAP_HIDDEN(conn)   ((conn) && (conn)->share_cache.map_hidden)
+#define MAP_SYSTEM(conn)   ((conn) && (conn)->share_cache.map_system)
+#define MAP_ARCHIVE(conn)   ((conn) && (conn)->share_cache.map_archive)
 #define IS_HIDDEN_PATH(conn,path)  ((conn) && is_in_path((path),(conn)->hide_list,(conn)->case_sensitive))
 #define IS_VETO_PATH(conn,path)  ((conn) && is_in_path((path),(conn)->veto_list,(conn)->case_sensitive))
 #define IS_VETO_OPLOCK_PATH(conn,path)  ((conn) && is_in_path((path),(conn)->veto_oplock_list,(conn)->case_sensitive))
@@ -37,7 +37,7 @@
 
 #define PROF_SHMEM_KEY ((key_t)0x07021999)
 #define PROF_SHM_MAGIC 0x6349985
-#define PROF_SHM_VERSION 11
+#define PROF_SHM_VERSION 18
 
 /* time values in the following structure are in microseconds */
 
@@ -733,10 +733,36 @@ enum profile_stats_values
 
 const char * profile_value_name(enum profile_stats_values val);
 
+/* Latency histograms are kept for each SMB and each trans2 and nttrans
+   subcommand, measured across the whole of switch_message(), in total
+   and for the first PR_HIST_SHARES shares used. */
+#define PR_HIST_FIRST PR_VALUE_SMBMKDIR
+#define PR_HIST_LAST PR_VALUE_NT_TRANSACT_SET_USER_QUOTA
+#define PR_HIST_VALUES (PR_HIST_LAST - PR_HIST_FIRST + 1)
+
+/* bucket 0 counts calls taking under 1 usec, bucket n those taking from
+   2^(n-1) up to 2^n usec. The last bucket also takes anything slower. */
+#define PR_HIST_BUCKETS 24
+
+#define PR_HIST_SHARES 32
+
+struct profile_latency {
+	unsigned buckets[PR_HIST_VALUES][PR_HIST_BUCKETS];
+};
+
+struct profile_share_latency {
+	fstring name; /* empty for an unused slot */
+	struct profile_latency latency;
+};
+
 struct profile_stats {
 /* general counters */
 	unsigned smb_count; /* how many SMB packets we have processed */
 	unsigned uid_changes; /* how many times we change our effective uid */
+	unsigned param_lookups; /* how many per-share lp_*() lookups we did */
+	unsigned sec_ctx_switches; /* how many times we changed the security context */
+	unsigned setgroups_calls; /* how many times we set the supplementary groups */
+	unsigned setgroups_skipped; /* how many times the kernel had them already */
 
 /* system call and protocol operation counters and cumulative times */
 	unsigned count[PR_VALUE_MAX];
@@ -754,6 +780,15 @@ struct profile_stats {
 	unsigned statcache_misses;
 	unsigned statcache_hits;
 
+/* dosattr cache counters */
+	unsigned dosattr_cache_hits;
+	unsigned dosattr_cache_misses;
+
+/* mangle prefix cache counters */
+	unsigned mangle_cache_hits;
+	unsigned mangle_cache_shared_hits;
+	unsigned mangle_cache_misses;
+
 /* write cache counters */
 	unsigned writecache_read_hits;
 	unsigned writecache_abutted_writes;
@@ -763,14 +798,43 @@ struct profile_stats {
 	unsigned writecache_init_writes;
 	unsigned writecache_flushed_writes[NUM_FLUSH_REASONS];
 	unsigned writecache_num_perfect_writes;
+	unsigned writecache_gathered_writes;
 	unsigned writecache_num_write_caches;
 	unsigned writecache_allocated_write_caches;
+
+/* latency histograms */
+	struct profile_latency latency;
+	unsigned latency_untracked_shares; /* SMBs on shares that got no slot */
+};
+
+/* Readers add struct profile_stats up one unsigned at a time, so it must
+   contain nothing else. */
+
+/*
+ * Each smbd forked by the main daemon counts into a slab of its own, so
+ * busy processes neither fight over cache lines nor lose each other's
+ * increments. Anything without a slab, the main daemon included, counts
+ * into the shared one. When a process goes its counts are added to the
+ * retired slab and its slab is reused.
+ */
+#define PROF_SLAB_RETIRED 0
+#define PROF_SLAB_SHARED 1
+#define PROF_SLAB_FIRST 2	/* first slab for a single process */
+
+/* slabs start on this boundary, so no two share a cache line (or the
+   pair of lines some CPUs fetch together) */
+#define PROF_SLAB_ALIGN 128
+
+struct profile_slab {
+	pid_t pid; /* the process counting here, 0 if unused */
+	struct profile_stats stats;
 };
 
 struct profile_header {
 	int prof_shm_magic;
 	int prof_shm_version;
-	struct profile_stats stats;
+	int prof_shm_slabs; /* number of slabs following the header */
+	struct profile_share_latency share_latency[PR_HIST_SHARES];
 };
 
 extern struct profile_header *profile_h;
@@ -863,6 +927,32 @@ static inline SMB_BIG_UINT profile_timestamp(void)
 		    profile_timestamp() - __profstamp_##x); \
 	}
 
+/* Time a whole SMB in switch_message() for the latency histograms.
+   The share is looked up first as handling the SMB can close it. */
+#define START_PROFILE_LATENCY(conn) \
+	SMB_BIG_UINT __latency_start = 0; \
+	int __latency_share = -1; \
+	if (do_profile_times) { \
+		__latency_start = profile_latency_start(conn, &__latency_share); \
+	}
+
+#define END_PROFILE_LATENCY(type, name) \
+	if (__latency_start != 0) { \
+		profile_latency_end(__latency_start, type, name, __latency_share); \
+	}
+
+/* Note the subcommand of the trans2 or nttrans being handled, so its
+   latency is counted against the subcommand as well as the SMB. */
+#define PROFILE_TRANS2_SUBCOMMAND(call) \
+	if (do_profile_times) { \
+		profile_trans2_subcommand(call); \
+	}
+
+#define PROFILE_NTTRANS_SUBCOMMAND(call) \
+	if (do_profile_times) { \
+		profile_nttrans_subcommand(call); \
+	}
+
 
 #else /* WITH_PROFILE */
 
@@ -873,6 +963,10 @@ static inline SMB_BIG_UINT profile_timestamp(void)
 #define START_PROFILE(x)
 #define START_PROFILE_BYTES(x,n)
 #define END_PROFILE(x)
+#define START_PROFILE_LATENCY(conn)
+#define END_PROFILE_LATENCY(type, name)
+#define PROFILE_TRANS2_SUBCOMMAND(call)
+#define PROFILE_NTTRANS_SUBCOMMAND(call)
 
 #endif /* WITH_PROFILE */
 
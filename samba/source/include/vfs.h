@@ -72,7 +72,9 @@
 /* Changed to version21 to add chflags operation -- jpeach */
 /* Changed to version22 to add lchown operation -- jra */
 /* Changed to version 23 to add the streaminfo call. -- jpeach */
-#define SMB_VFS_INTERFACE_VERSION 23
+/* Changed to version 24 to add the preadv/pwritev calls. */
+/* Changed to version 25, the vuid cache in connection_struct is indexed by vuid. */
+#define SMB_VFS_INTERFACE_VERSION 25
 
 
 /* to bug old modules which are trying to compile with the old functions */
@@ -135,6 +137,8 @@ typedef enum _vfs_op_type {
 	SMB_VFS_OP_PREAD,
 	SMB_VFS_OP_WRITE,
 	SMB_VFS_OP_PWRITE,
+	SMB_VFS_OP_PREADV,
+	SMB_VFS_OP_PWRITEV,
 	SMB_VFS_OP_LSEEK,
 	SMB_VFS_OP_SENDFILE,
 	SMB_VFS_OP_RENAME,
@@ -265,6 +269,8 @@ struct vfs_ops {
 		ssize_t (*pread)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, void *data, size_t n, SMB_OFF_T offset);
 		ssize_t (*write)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, const void *data, size_t n);
 		ssize_t (*pwrite)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, const void *data, size_t n, SMB_OFF_T offset);
+		ssize_t (*preadv)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T offset);
+		ssize_t (*pwritev)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T offset);
 		SMB_OFF_T (*lseek)(struct vfs_handle_struct *handle, struct files_struct *fsp, int fd, SMB_OFF_T offset, int whence);
 		ssize_t (*sendfile)(struct vfs_handle_struct *handle, int tofd, files_struct *fsp, int fromfd, const DATA_BLOB *header, SMB_OFF_T offset, size_t count);
 		int (*rename)(struct vfs_handle_struct *handle, const char *oldname, const char *newname);
@@ -394,6 +400,8 @@ struct vfs_ops {
 		struct vfs_handle_struct *pread;
 		struct vfs_handle_struct *write;
 		struct vfs_handle_struct *pwrite;
+		struct vfs_handle_struct *preadv;
+		struct vfs_handle_struct *pwritev;
 		struct vfs_handle_struct *lseek;
 		struct vfs_handle_struct *sendfile;
 		struct vfs_handle_struct *rename;
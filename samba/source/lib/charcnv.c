@@ -482,6 +482,84 @@ static size_t pull_ucs2_path_darwin(
 
 #endif /* DARWINOS */
 
+/**
+ * Return how many of the first len bytes of src are ASCII and not NUL.
+ *
+ * len may be (size_t)-1 for a NUL terminated string. Words are then
+ * only read when aligned, so we never touch the page after the
+ * terminator.
+ **/
+
+size_t ascii_prefix_len(const void *src, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)src;
+	size_t n = 0;
+	uint64 w;
+
+	if (len == (size_t)-1) {
+		while (((unsigned long)(p + n) & (sizeof(w) - 1)) != 0) {
+			if (p[n] == 0 || (p[n] & 0x80))
+				return n;
+			n++;
+		}
+		for (;; n += sizeof(w)) {
+			memcpy(&w, p + n, sizeof(w));
+			if (ASCII_STOP(w))
+				break;
+		}
+	} else {
+		for (; len - n >= sizeof(w); n += sizeof(w)) {
+			memcpy(&w, p + n, sizeof(w));
+			if (ASCII_STOP(w))
+				break;
+		}
+	}
+
+	while (n < len && p[n] != 0 && !(p[n] & 0x80))
+		n++;
+
+	return n;
+}
+
+/**
+ * As ascii_prefix_len() for a UTF-16LE string. len is in bytes, the
+ * result in characters.
+ **/
+
+size_t ucs2_ascii_prefix_len(const void *src, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)src;
+	size_t n = 0;
+	uint64 w;
+
+	if (len == (size_t)-1) {
+		if (((unsigned long)p & 1) == 0) {
+			while (((unsigned long)(p + n) & (sizeof(w) - 1)) != 0) {
+				if (p[n] == 0 || (p[n] & 0x80) || p[n+1] != 0)
+					return n / 2;
+				n += 2;
+			}
+			for (;; n += sizeof(w)) {
+				memcpy(&w, p + n, sizeof(w));
+				if (UCS2_STOP(w))
+					break;
+			}
+		}
+	} else {
+		len &= ~1;
+		for (; len - n >= sizeof(w); n += sizeof(w)) {
+			memcpy(&w, p + n, sizeof(w));
+			if (UCS2_STOP(w))
+				break;
+		}
+	}
+
+	while (n < len && p[n] != 0 && !(p[n] & 0x80) && p[n+1] == 0)
+		n += 2;
+
+	return n / 2;
+}
+
 /**
  * Convert string from one encoding to another, making error checking etc
  * Fast path version - handles ASCII first.
@@ -523,6 +601,21 @@ size_t convert_string(charset_t from, charset_t to,
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
 		size_t retval = 0;
+		size_t run;
+
+		/* Copy the leading plain ASCII a word at a time. */
+		run = ascii_prefix_len(p, slen);
+		if (run > dlen)
+			run = dlen;
+		memcpy(q, p, run);
+		p += run;
+		q += run;
+		if (slen != (size_t)-1)
+			slen -= run;
+		dlen -= run;
+		retval += run;
+		if (run)
+			lastp = p[-1];
 
 		/* If all characters are ascii, fast path here. */
 		while (slen && dlen) {
@@ -558,6 +651,22 @@ size_t convert_string(charset_t from, charset_t to,
 		size_t slen = srclen;
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
+		size_t i, run;
+
+		/* Narrow the leading plain ASCII, found a word at a time. */
+		run = ucs2_ascii_prefix_len(p, slen);
+		if (run > dlen)
+			run = dlen;
+		for (i = 0; i < run; i++)
+			q[i] = p[2*i];
+		p += 2*run;
+		q += run;
+		if (slen != (size_t)-1)
+			slen -= 2*run;
+		dlen -= run;
+		retval += run;
+		if (run)
+			lastp = q[-1];
 
 		/* If all characters are ascii, fast path here. */
 		while (((slen == (size_t)-1) || (slen >= 2)) && dlen) {
@@ -594,6 +703,24 @@ size_t convert_string(charset_t from, charset_t to,
 		size_t slen = srclen;
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
+		size_t i, run;
+
+		/* Widen the leading plain ASCII, found a word at a time. */
+		run = ascii_prefix_len(p, slen);
+		if (run > dlen/2)
+			run = dlen/2;
+		for (i = 0; i < run; i++) {
+			q[2*i] = p[i];
+			q[2*i+1] = '\0';
+		}
+		p += run;
+		q += 2*run;
+		if (slen != (size_t)-1)
+			slen -= run;
+		dlen -= 2*run;
+		retval += 2*run;
+		if (run)
+			lastp = p[-1];
 
 		/* If all characters are ascii, fast path here. */
 		while (slen && (dlen >= 2)) {
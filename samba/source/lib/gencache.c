@@ -26,13 +26,48 @@
 #undef  DBGC_CLASS
 #define DBGC_CLASS DBGC_TDB
 
-#define TIMEOUT_LEN 12
-#define CACHE_DATA_FMT	"%12u/%s"
-#define READ_CACHE_DATA_FMT_TEMPLATE "%%12u/%%%us"
+/*
+ * A record is a GENCACHE_HDR_LEN byte header followed by the value and
+ * its terminating 0. The header starts with GENCACHE_MARKER, which no
+ * record of the older "%12u/%s" text format starts with, and holds the
+ * timeout as 64 bit little endian number at offset 4. Records in the
+ * text format are still read.
+ */
+
+#define GENCACHE_HDR_LEN 12
+#define GENCACHE_MARKER 0xff
+
+/*
+ * Each process keeps the entries it looked up last, including the ones
+ * it did not find. They are all dropped when the sequence number of
+ * gencache.tdb moves, that is when anybody changed anything in it.
+ */
+
+#define GENCACHE_LRU_SIZE 128
+
+/*
+ * Expired records are not deleted when they are read, that would turn
+ * every read into a write. A process that writes to the cache anyway
+ * sweeps them out every so often.
+ */
+
+#define GENCACHE_SWEEP_INTERVAL 900
 
 static TDB_CONTEXT *cache;
 static BOOL cache_readonly;
 
+static struct gencache_lru {
+	struct gencache_lru *prev, *next;
+	int hash;
+	char *key;
+	char *value;		/* NULL if there is no such record */
+	time_t timeout;
+} *lru_head;
+
+static size_t lru_count;
+static int lru_seqnum = -1;
+static time_t next_sweep;
+
 /**
  * @file gencache.c
  * @brief Generic, persistent and shared between processes cache mechanism
@@ -60,11 +95,12 @@ BOOL gencache_init(void)
 
 	DEBUG(5, ("Opening cache file at %s\n", cache_fname));
 
-	cache = tdb_open_log(cache_fname, 0, TDB_DEFAULT,
+	cache = tdb_open_log(cache_fname, 0, TDB_DEFAULT|TDB_SEQNUM,
 	                     O_RDWR|O_CREAT, 0644);
 
 	if (!cache && (errno == EACCES)) {
-		cache = tdb_open_log(cache_fname, 0, TDB_DEFAULT, O_RDONLY, 0644);
+		cache = tdb_open_log(cache_fname, 0, TDB_DEFAULT|TDB_SEQNUM,
+				     O_RDONLY, 0644);
 		if (cache) {
 			cache_readonly = True;
 			DEBUG(5, ("gencache_init: Opening cache file %s read-only.\n", cache_fname));
@@ -75,10 +111,167 @@ BOOL gencache_init(void)
 		DEBUG(5, ("Attempt to open gencache.tdb has failed.\n"));
 		return False;
 	}
+
+	next_sweep = time(NULL) + GENCACHE_SWEEP_INTERVAL;
 	return True;
 }
 
 
+/**
+ * Forget all entries looked up so far.
+ **/
+
+static void gencache_lru_flush(void)
+{
+	struct gencache_lru *e, *next;
+
+	for (e = lru_head; e; e = next) {
+		next = e->next;
+		DLIST_REMOVE(lru_head, e);
+		SAFE_FREE(e->key);
+		SAFE_FREE(e->value);
+		SAFE_FREE(e);
+	}
+	lru_count = 0;
+}
+
+
+/**
+ * Find the entry for a key, after dropping all of them if
+ * gencache.tdb has changed since they were looked up.
+ **/
+
+static struct gencache_lru *gencache_lru_find(const char *keystr, int hash)
+{
+	struct gencache_lru *e;
+	int seqnum;
+
+	seqnum = tdb_get_seqnum(cache);
+	if (seqnum != lru_seqnum) {
+		gencache_lru_flush();
+		lru_seqnum = seqnum;
+		return NULL;
+	}
+
+	for (e = lru_head; e; e = e->next) {
+		if ((e->hash == hash) && (strcmp(e->key, keystr) == 0)) {
+			DLIST_PROMOTE(lru_head, e);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Remember what was found for a key, value is NULL if nothing was.
+ * Must come after a gencache_lru_find() for the key that was done
+ * before the record was read.
+ **/
+
+static void gencache_lru_add(const char *keystr, int hash,
+			     const char *value, time_t timeout)
+{
+	struct gencache_lru *e;
+
+	if (lru_count >= GENCACHE_LRU_SIZE) {
+		for (e = lru_head; e->next; e = e->next)
+			;
+		DLIST_REMOVE(lru_head, e);
+		SAFE_FREE(e->key);
+		SAFE_FREE(e->value);
+		lru_count--;
+	} else {
+		e = SMB_MALLOC_P(struct gencache_lru);
+		if (e == NULL) {
+			return;
+		}
+	}
+
+	e->hash = hash;
+	e->key = SMB_STRDUP(keystr);
+	e->value = NULL;
+	e->timeout = timeout;
+	if ((e->key == NULL) ||
+	    ((value != NULL) && ((e->value = SMB_STRDUP(value)) == NULL))) {
+		SAFE_FREE(e->key);
+		SAFE_FREE(e);
+		return;
+	}
+
+	DLIST_ADD(lru_head, e);
+	lru_count++;
+}
+
+
+/**
+ * Split a record into its timeout and value.
+ **/
+
+static BOOL gencache_parse(TDB_DATA data, time_t *timeout, const char **value)
+{
+	SMB_BIG_UINT t;
+	char *endptr;
+
+	if ((data.dptr == NULL) || (data.dsize == 0) ||
+	    (data.dptr[data.dsize-1] != '\0')) {
+		return False;
+	}
+
+	if (CVAL(data.dptr, 0) == GENCACHE_MARKER) {
+		if (data.dsize <= GENCACHE_HDR_LEN) {
+			return False;
+		}
+		t = ((SMB_BIG_UINT)IVAL(data.dptr, 8) << 32) |
+			IVAL(data.dptr, 4);
+		*timeout = (time_t)(SMB_BIG_INT)t;
+		*value = data.dptr + GENCACHE_HDR_LEN;
+		return True;
+	}
+
+	*timeout = strtol(data.dptr, &endptr, 10);
+	if ((endptr == NULL) || (*endptr != '/')) {
+		return False;
+	}
+	*value = endptr + 1;
+	return True;
+}
+
+
+static int gencache_sweep_fn(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA data,
+			     void *private_data)
+{
+	time_t now = *(time_t *)private_data;
+	time_t timeout;
+	const char *value;
+
+	if (gencache_parse(data, &timeout, &value) && (timeout <= now)) {
+		DEBUG(10, ("Deleting expired cache entry (key = %.*s)\n",
+			   (int)key.dsize, key.dptr));
+		tdb_delete(tdb, key);
+	}
+	return 0;
+}
+
+
+/**
+ * Delete the expired records if that has not been done for a while.
+ **/
+
+static void gencache_sweep(void)
+{
+	time_t now = time(NULL);
+
+	if (now < next_sweep) {
+		return;
+	}
+	next_sweep = now + GENCACHE_SWEEP_INTERVAL;
+
+	DEBUG(10, ("Sweeping expired cache entries\n"));
+	tdb_traverse(cache, gencache_sweep_fn, &now);
+}
+
+
 /**
  * Cache shutdown function. Closes opened cache tdb file.
  *
@@ -92,6 +285,8 @@ BOOL gencache_shutdown(void)
 	/* tdb_close routine returns -1 on error */
 	if (!cache) return False;
 	DEBUG(5, ("Closing cache file\n"));
+	gencache_lru_flush();
+	lru_seqnum = -1;
 	ret = tdb_close(cache);
 	cache = NULL;
 	cache_readonly = False;
@@ -115,7 +310,8 @@ BOOL gencache_set(const char *keystr, const char *value, time_t timeout)
 {
 	int ret;
 	TDB_DATA keybuf, databuf;
-	char* valstr = NULL;
+	SMB_BIG_UINT t = (SMB_BIG_UINT)(SMB_BIG_INT)timeout;
+	size_t len;
 	
 	/* fail completely if get null pointers passed */
 	SMB_ASSERT(keystr && value);
@@ -126,21 +322,29 @@ BOOL gencache_set(const char *keystr, const char *value, time_t timeout)
 		return False;
 	}
 
-	asprintf(&valstr, CACHE_DATA_FMT, (int)timeout, value);
-	if (!valstr)
+	len = strlen(value) + 1;
+	databuf.dsize = GENCACHE_HDR_LEN + len;
+	databuf.dptr = (char *)SMB_MALLOC(databuf.dsize);
+	if (!databuf.dptr)
 		return False;
 
+	memset(databuf.dptr, 0, GENCACHE_HDR_LEN);
+	SCVAL(databuf.dptr, 0, GENCACHE_MARKER);
+	SIVAL(databuf.dptr, 4, t & 0xffffffff);
+	SIVAL(databuf.dptr, 8, t >> 32);
+	memcpy(databuf.dptr + GENCACHE_HDR_LEN, value, len);
+
 	keybuf.dptr = CONST_DISCARD(char *, keystr);
 	keybuf.dsize = strlen(keystr)+1;
-	databuf.dptr = valstr;
-	databuf.dsize = strlen(valstr)+1;
 	DEBUG(10, ("Adding cache entry with key = %s; value = %s and timeout ="
 	           " %s (%d seconds %s)\n", keybuf.dptr, value,ctime(&timeout),
 		   (int)(timeout - time(NULL)), 
 		   timeout > time(NULL) ? "ahead" : "in the past"));
 
 	ret = tdb_store(cache, keybuf, databuf, 0);
-	SAFE_FREE(valstr);
+	SAFE_FREE(databuf.dptr);
+
+	gencache_sweep();
 	
 	return ret == 0;
 }
@@ -193,8 +397,10 @@ BOOL gencache_del(const char *keystr)
 BOOL gencache_get(const char *keystr, char **valstr, time_t *timeout)
 {
 	TDB_DATA keybuf, databuf;
-	time_t t;
-	char *endptr;
+	struct gencache_lru *e;
+	const char *value = NULL;
+	time_t t = 0;
+	int hash;
 
 	/* fail completely if get null pointers passed */
 	SMB_ASSERT(keystr);
@@ -202,40 +408,45 @@ BOOL gencache_get(const char *keystr, char **valstr, time_t *timeout)
 	if (!gencache_init()) {
 		return False;
 	}
-	
-	keybuf.dptr = CONST_DISCARD(char *, keystr);
-	keybuf.dsize = strlen(keystr)+1;
-	databuf = tdb_fetch(cache, keybuf);
 
-	if (databuf.dptr == NULL) {
-		DEBUG(10, ("Cache entry with key = %s couldn't be found\n",
-			   keystr));
-		return False;
+	hash = str_checksum(keystr);
+	databuf.dptr = NULL;
+
+	if ((e = gencache_lru_find(keystr, hash)) != NULL) {
+		value = e->value;
+		t = e->timeout;
+	} else {
+		keybuf.dptr = CONST_DISCARD(char *, keystr);
+		keybuf.dsize = strlen(keystr)+1;
+		databuf = tdb_fetch(cache, keybuf);
+
+		if ((databuf.dptr != NULL) &&
+		    !gencache_parse(databuf, &t, &value)) {
+			DEBUG(2, ("Invalid gencache data format for key %s\n",
+				  keystr));
+		}
+		gencache_lru_add(keystr, hash, value, t);
 	}
 
-	t = strtol(databuf.dptr, &endptr, 10);
-
-	if ((endptr == NULL) || (*endptr != '/')) {
-		DEBUG(2, ("Invalid gencache data format: %s\n", databuf.dptr));
+	if (value == NULL) {
+		DEBUG(10, ("Cache entry with key = %s couldn't be found\n",
+			   keystr));
 		SAFE_FREE(databuf.dptr);
 		return False;
 	}
 
 	DEBUG(10, ("Returning %s cache entry: key = %s, value = %s, "
 		   "timeout = %s", t > time(NULL) ? "valid" :
-		   "expired", keystr, endptr+1, ctime(&t)));
+		   "expired", keystr, value, ctime(&t)));
 
 	if (t <= time(NULL)) {
-
-		/* We're expired, delete the entry */
-		tdb_delete(cache, keybuf);
-
+		/* Expired, left for gencache_sweep() */
 		SAFE_FREE(databuf.dptr);
 		return False;
 	}
 
 	if (valstr) {
-		*valstr = SMB_STRDUP(endptr+1);
+		*valstr = SMB_STRDUP(value);
 		if (*valstr == NULL) {
 			SAFE_FREE(databuf.dptr);
 			DEBUG(0, ("strdup failed\n"));
@@ -269,10 +480,9 @@ void gencache_iterate(void (*fn)(const char* key, const char *value, time_t time
 {
 	TDB_LIST_NODE *node, *first_node;
 	TDB_DATA databuf;
-	char *keystr = NULL, *valstr = NULL, *entry = NULL;
+	char *keystr = NULL, *valstr = NULL;
+	const char *value;
 	time_t timeout = 0;
-	int status;
-	unsigned u;
 
 	/* fail completely if get null pointers passed */
 	SMB_ASSERT(fn && keystr_pattern);
@@ -284,8 +494,6 @@ void gencache_iterate(void (*fn)(const char* key, const char *value, time_t time
 	first_node = node;
 	
 	while (node) {
-		char *fmt;
-
 		/* ensure null termination of the key string */
 		keystr = SMB_STRNDUP(node->node_key.dptr, node->node_key.dsize);
 		if (!keystr) {
@@ -297,49 +505,25 @@ void gencache_iterate(void (*fn)(const char* key, const char *value, time_t time
 		 * all of the entries. Validity verification is up to fn routine.
 		 */
 		databuf = tdb_fetch(cache, node->node_key);
-		if (!databuf.dptr || databuf.dsize <= TIMEOUT_LEN) {
+		if (!gencache_parse(databuf, &timeout, &value)) {
 			SAFE_FREE(databuf.dptr);
 			SAFE_FREE(keystr);
 			node = node->next;
 			continue;
 		}
-		entry = SMB_STRNDUP(databuf.dptr, databuf.dsize);
-		if (!entry) {
-			SAFE_FREE(databuf.dptr);
-			SAFE_FREE(keystr);
-			break;
-		}
 
+		valstr = SMB_STRDUP(value);
 		SAFE_FREE(databuf.dptr);
-
-		valstr = (char *)SMB_MALLOC(databuf.dsize + 1 - TIMEOUT_LEN);
 		if (!valstr) {
-			SAFE_FREE(entry);
 			SAFE_FREE(keystr);
 			break;
 		}
 
-		asprintf(&fmt, READ_CACHE_DATA_FMT_TEMPLATE, (unsigned int)databuf.dsize - TIMEOUT_LEN);
-		if (!fmt) {
-			SAFE_FREE(valstr);
-			SAFE_FREE(entry);
-			SAFE_FREE(keystr);
-			break;
-		}
-		status = sscanf(entry, fmt, &u, valstr);
-		SAFE_FREE(fmt);
-
-		if ( status != 2 ) {
-			DEBUG(0,("gencache_iterate: invalid return from sscanf %d\n",status));
-		}
-		timeout = u;
-		
 		DEBUG(10, ("Calling function with arguments (key = %s, value = %s, timeout = %s)\n",
 		           keystr, valstr, ctime(&timeout)));
 		fn(keystr, valstr, timeout, data);
 		
 		SAFE_FREE(valstr);
-		SAFE_FREE(entry);
 		SAFE_FREE(keystr);
 		node = node->next;
 	}
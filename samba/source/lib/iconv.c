@@ -547,12 +547,20 @@ static size_t utf8_pull(void *cd, const char **inbuf, size_t *inbytesleft,
 		unsigned int codepoint;
 
 		if ((c[0] & 0x80) == 0) {
-			uc[0] = c[0];
-			uc[1] = 0;
-			c  += 1;
-			in_left  -= 1;
-			out_left -= 2;
-			uc += 2;
+			/* widen a whole run of plain ASCII at once */
+			size_t i, run = ascii_prefix_len(c, MIN(in_left, out_left/2));
+
+			if (run == 0) {
+				run = 1; /* a NUL */
+			}
+			for (i = 0; i < run; i++) {
+				uc[2*i] = c[i];
+				uc[2*i+1] = 0;
+			}
+			c  += run;
+			in_left  -= run;
+			out_left -= 2*run;
+			uc += 2*run;
 			continue;
 		}
 
@@ -671,12 +679,22 @@ static size_t utf8_push(void *cd, const char **inbuf, size_t *inbytesleft,
 		unsigned int codepoint;
 
 		if (uc[1] == 0 && !(uc[0] & 0x80)) {
-			/* simplest case */
-			c[0] = uc[0];
-			in_left  -= 2;
-			out_left -= 1;
-			uc += 2;
-			c  += 1;
+			/* simplest case - narrow a whole run of ASCII at once */
+			size_t i, run = ucs2_ascii_prefix_len(uc, in_left);
+
+			if (run > out_left) {
+				run = out_left;
+			}
+			if (run == 0) {
+				run = 1; /* a NUL */
+			}
+			for (i = 0; i < run; i++) {
+				c[i] = uc[2*i];
+			}
+			in_left  -= 2*run;
+			out_left -= run;
+			uc += 2*run;
+			c  += run;
 			continue;
 		}
 
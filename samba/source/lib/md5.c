@@ -24,6 +24,10 @@
 
 static void MD5Transform(uint32 buf[4], uint32 const in[16]);
 
+#ifndef WORDS_BIGENDIAN
+/* MD5 is little-endian already, there is nothing to reverse. */
+#define byteReverse(buf, len)	/* Nothing */
+#else
 /*
  * Note: this code is harmless on little-endian machines.
  */
@@ -37,6 +41,7 @@ static void byteReverse(unsigned char *buf, unsigned longs)
 	buf += 4;
     } while (--longs);
 }
+#endif
 
 /*
  * Start MD5 accumulation.  Set bit count to 0 and buffer to mysterious
@@ -88,6 +93,18 @@ void MD5Update(struct MD5Context *ctx, unsigned char const *buf, unsigned len)
     }
     /* Process data in 64-byte chunks */
 
+#ifndef WORDS_BIGENDIAN
+    /* Aligned input can be transformed in place, saving a copy of
+       every block - this is the common case for signing packets. */
+    if ((((unsigned long)buf) & (sizeof(uint32) - 1)) == 0) {
+	while (len >= 64) {
+	    MD5Transform(ctx->buf, (uint32 const *) buf);
+	    buf += 64;
+	    len -= 64;
+	}
+    }
+#endif
+
     while (len >= 64) {
 	memmove(ctx->in, buf, 64);
 	byteReverse(ctx->in, 16);
@@ -158,6 +175,13 @@ void MD5Final(unsigned char digest[16], struct MD5Context *ctx)
 #define MD5STEP(f, w, x, y, z, data, s) \
 	( w += f(x, y, z) + data,  w = w<<s | w>>(32-s),  w += x )
 
+/*
+ * Round 2 variant: the two halves of F2 have no bits in common so they
+ * can be added separately, which shortens the dependency chain on w.
+ */
+#define MD5STEP2(w, x, y, z, data, s) \
+	( w += data + (y & ~z),  w += (x & z),  w = w<<s | w>>(32-s),  w += x )
+
 /*
  * The core of the MD5 algorithm, this alters an existing MD5 hash to
  * reflect the addition of 16 longwords of new data.  MD5Update blocks
@@ -189,22 +213,22 @@ static void MD5Transform(uint32 buf[4], uint32 const in[16])
     MD5STEP(F1, c, d, a, b, in[14] + 0xa679438e, 17);
     MD5STEP(F1, b, c, d, a, in[15] + 0x49b40821, 22);
 
-    MD5STEP(F2, a, b, c, d, in[1] + 0xf61e2562, 5);
-    MD5STEP(F2, d, a, b, c, in[6] + 0xc040b340, 9);
-    MD5STEP(F2, c, d, a, b, in[11] + 0x265e5a51, 14);
-    MD5STEP(F2, b, c, d, a, in[0] + 0xe9b6c7aa, 20);
-    MD5STEP(F2, a, b, c, d, in[5] + 0xd62f105d, 5);
-    MD5STEP(F2, d, a, b, c, in[10] + 0x02441453, 9);
-    MD5STEP(F2, c, d, a, b, in[15] + 0xd8a1e681, 14);
-    MD5STEP(F2, b, c, d, a, in[4] + 0xe7d3fbc8, 20);
-    MD5STEP(F2, a, b, c, d, in[9] + 0x21e1cde6, 5);
-    MD5STEP(F2, d, a, b, c, in[14] + 0xc33707d6, 9);
-    MD5STEP(F2, c, d, a, b, in[3] + 0xf4d50d87, 14);
-    MD5STEP(F2, b, c, d, a, in[8] + 0x455a14ed, 20);
-    MD5STEP(F2, a, b, c, d, in[13] + 0xa9e3e905, 5);
-    MD5STEP(F2, d, a, b, c, in[2] + 0xfcefa3f8, 9);
-    MD5STEP(F2, c, d, a, b, in[7] + 0x676f02d9, 14);
-    MD5STEP(F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20);
+    MD5STEP2(a, b, c, d, in[1] + 0xf61e2562, 5);
+    MD5STEP2(d, a, b, c, in[6] + 0xc040b340, 9);
+    MD5STEP2(c, d, a, b, in[11] + 0x265e5a51, 14);
+    MD5STEP2(b, c, d, a, in[0] + 0xe9b6c7aa, 20);
+    MD5STEP2(a, b, c, d, in[5] + 0xd62f105d, 5);
+    MD5STEP2(d, a, b, c, in[10] + 0x02441453, 9);
+    MD5STEP2(c, d, a, b, in[15] + 0xd8a1e681, 14);
+    MD5STEP2(b, c, d, a, in[4] + 0xe7d3fbc8, 20);
+    MD5STEP2(a, b, c, d, in[9] + 0x21e1cde6, 5);
+    MD5STEP2(d, a, b, c, in[14] + 0xc33707d6, 9);
+    MD5STEP2(c, d, a, b, in[3] + 0xf4d50d87, 14);
+    MD5STEP2(b, c, d, a, in[8] + 0x455a14ed, 20);
+    MD5STEP2(a, b, c, d, in[13] + 0xa9e3e905, 5);
+    MD5STEP2(d, a, b, c, in[2] + 0xfcefa3f8, 9);
+    MD5STEP2(c, d, a, b, in[7] + 0x676f02d9, 14);
+    MD5STEP2(b, c, d, a, in[12] + 0x8d2a4c8a, 20);
 
     MD5STEP(F3, a, b, c, d, in[5] + 0xfffa3942, 4);
     MD5STEP(F3, d, a, b, c, in[8] + 0x8771f681, 11);
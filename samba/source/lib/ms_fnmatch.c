@@ -220,6 +220,201 @@ int ms_fnmatch(const char *pattern, const char *string, BOOL translate_pattern,
 }
 
 
+/*
+  A wildcard compiled once for matching against many names, as in a
+  directory search. The common shapes are matched directly against the
+  unix charset name; anything else (and any name that isn't pure ASCII)
+  goes through ms_fnmatch() so the result is always the same.
+*/
+
+enum ms_wildcard_type {
+	MS_WILDCARD_GENERIC,	/* anything else - use ms_fnmatch() */
+	MS_WILDCARD_ALL,	/* "*" */
+	MS_WILDCARD_SUFFIX,	/* "*.ext" */
+	MS_WILDCARD_PREFIX,	/* "name*" */
+	MS_WILDCARD_LITERAL	/* no wildcards at all */
+};
+
+struct ms_wildcard {
+	enum ms_wildcard_type type;
+	char *pattern;
+	char *fixed;		/* the part without wildcards, upper cased
+				   unless case sensitive */
+	size_t fixed_len;
+	BOOL translate_pattern;
+	BOOL is_case_sensitive;
+};
+
+#define MS_WILD_CHARS "<>*?\""
+
+static BOOL ms_wildcard_fixed(struct ms_wildcard *w, const char *fixed,
+			      size_t len)
+{
+	size_t i;
+
+	if (len == 0) {
+		return False;
+	}
+
+	for (i = 0; i < len; i++) {
+		if ((unsigned char)fixed[i] & 0x80) {
+			return False;
+		}
+		if (strchr(MS_WILD_CHARS, fixed[i])) {
+			return False;
+		}
+	}
+
+	/* For the old protocols a '.' next to a '*' or at the end
+	   changes meaning when the pattern is translated. */
+	if (w->translate_pattern && (fixed[0] == '.' || fixed[len-1] == '.')) {
+		return False;
+	}
+
+	w->fixed = talloc_strndup(w, fixed, len);
+	if (w->fixed == NULL) {
+		return False;
+	}
+	w->fixed_len = len;
+
+	if (!w->is_case_sensitive) {
+		for (i = 0; i < len; i++) {
+			w->fixed[i] = toupper_ascii(w->fixed[i]);
+		}
+	}
+
+	return True;
+}
+
+struct ms_wildcard *ms_wildcard_compile(TALLOC_CTX *mem_ctx,
+					const char *pattern,
+					BOOL translate_pattern,
+					BOOL is_case_sensitive)
+{
+	struct ms_wildcard *w;
+	size_t len = strlen(pattern);
+
+	w = TALLOC_ZERO_P(mem_ctx, struct ms_wildcard);
+	if (w == NULL) {
+		return NULL;
+	}
+
+	w->pattern = talloc_strdup(w, pattern);
+	if (w->pattern == NULL) {
+		TALLOC_FREE(w);
+		return NULL;
+	}
+	w->translate_pattern = translate_pattern;
+	w->is_case_sensitive = is_case_sensitive;
+	w->type = MS_WILDCARD_GENERIC;
+
+	if (strcmp(pattern, "*") == 0) {
+		w->type = MS_WILDCARD_ALL;
+	} else if (strpbrk(pattern, MS_WILD_CHARS) == NULL) {
+		if (ms_wildcard_fixed(w, pattern, len)) {
+			w->type = MS_WILDCARD_LITERAL;
+		}
+	} else if (pattern[0] == '*' &&
+		   ms_wildcard_fixed(w, pattern + 1, len - 1)) {
+		w->type = MS_WILDCARD_SUFFIX;
+	} else if (len > 1 && pattern[len-1] == '*' &&
+		   ms_wildcard_fixed(w, pattern, len - 1)) {
+		w->type = MS_WILDCARD_PREFIX;
+	}
+
+	return w;
+}
+
+/* Was w compiled from this pattern with these flags ? */
+BOOL ms_wildcard_same(const struct ms_wildcard *w, const char *pattern,
+		      BOOL translate_pattern, BOOL is_case_sensitive)
+{
+	return w->translate_pattern == translate_pattern &&
+		w->is_case_sensitive == is_case_sensitive &&
+		strcmp(w->pattern, pattern) == 0;
+}
+
+static BOOL ms_wildcard_equal(const struct ms_wildcard *w, const char *s)
+{
+	const char *f = w->fixed;
+	size_t i;
+
+	if (w->is_case_sensitive) {
+		return memcmp(s, f, w->fixed_len) == 0;
+	}
+
+	for (i = 0; i < w->fixed_len; i++) {
+		char c = s[i];
+
+		if (c >= 'a' && c <= 'z') {
+			c -= 'a' - 'A';
+		}
+		if (c != f[i]) {
+			return False;
+		}
+	}
+	return True;
+}
+
+/*
+  Returns 0 on a match like ms_fnmatch(), with the pattern and flags
+  given to ms_wildcard_compile().
+*/
+int ms_wildcard_match(const struct ms_wildcard *w, const char *string)
+{
+	const unsigned char *p;
+	unsigned char high = 0;
+	size_t len;
+
+	if (w->type == MS_WILDCARD_ALL) {
+		return 0;
+	}
+
+	if (w->type == MS_WILDCARD_GENERIC) {
+		return ms_fnmatch(w->pattern, string, w->translate_pattern,
+				  w->is_case_sensitive);
+	}
+
+	if (strcmp(string, "..") == 0) {
+		string = ".";
+	}
+
+	for (p = (const unsigned char *)string; *p; p++) {
+		high |= *p;
+	}
+	len = p - (const unsigned char *)string;
+
+	/* Case folding beyond ASCII needs the full treatment. */
+	if (high & 0x80) {
+		return ms_fnmatch(w->pattern, string, w->translate_pattern,
+				  w->is_case_sensitive);
+	}
+
+	switch (w->type) {
+	case MS_WILDCARD_LITERAL:
+		if (len == w->fixed_len && ms_wildcard_equal(w, string)) {
+			return 0;
+		}
+		return -1;
+	case MS_WILDCARD_SUFFIX:
+		if (len >= w->fixed_len &&
+		    ms_wildcard_equal(w, string + len - w->fixed_len)) {
+			return 0;
+		}
+		return -1;
+	case MS_WILDCARD_PREFIX:
+		if (len >= w->fixed_len && ms_wildcard_equal(w, string)) {
+			return 0;
+		}
+		return -1;
+	default:
+		break;
+	}
+
+	return ms_fnmatch(w->pattern, string, w->translate_pattern,
+			  w->is_case_sensitive);
+}
+
 /* a generic fnmatch function - uses for non-CIFS pattern matching */
 int gen_fnmatch(const char *pattern, const char *string)
 {
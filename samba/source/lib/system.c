@@ -186,6 +186,46 @@ ssize_t sys_pwrite(int fd, const void *buf, size_t count, SMB_OFF_T off)
 }
 #endif
 
+/*******************************************************************
+A preadv wrapper that will deal with EINTR and 64-bit file offsets.
+********************************************************************/
+
+#if defined(HAVE_PREADV) || defined(HAVE_PREADV64)
+ssize_t sys_preadv(int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T off)
+{
+	ssize_t ret;
+
+	do {
+#if defined(HAVE_EXPLICIT_LARGEFILE_SUPPORT) && defined(HAVE_OFF64_T) && defined(HAVE_PREADV64)
+		ret = preadv64(fd, iov, iovcnt, off);
+#else
+		ret = preadv(fd, iov, iovcnt, off);
+#endif
+	} while (ret == -1 && errno == EINTR);
+	return ret;
+}
+#endif
+
+/*******************************************************************
+A pwritev wrapper that will deal with EINTR and 64-bit file offsets.
+********************************************************************/
+
+#if defined(HAVE_PWRITEV) || defined(HAVE_PWRITEV64)
+ssize_t sys_pwritev(int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T off)
+{
+	ssize_t ret;
+
+	do {
+#if defined(HAVE_EXPLICIT_LARGEFILE_SUPPORT) && defined(HAVE_OFF64_T) && defined(HAVE_PWRITEV64)
+		ret = pwritev64(fd, iov, iovcnt, off);
+#else
+		ret = pwritev(fd, iov, iovcnt, off);
+#endif
+	} while (ret == -1 && errno == EINTR);
+	return ret;
+}
+#endif
+
 /*******************************************************************
 A send wrapper that will deal with EINTR.
 ********************************************************************/
@@ -724,6 +724,51 @@ ssize_t write_data_at_offset(int fd, const char *buffer, size_t N, SMB_OFF_T pos
 #endif
 }
 
+/*******************************************************************
+ Write several buffers into an fd, one after the other from a given
+ offset, in one call where possible. Ignore seek errors.
+********************************************************************/
+
+ssize_t writev_data_at_offset(int fd, const struct iovec *iov, int iovcnt, SMB_OFF_T pos)
+{
+	size_t total=0, skip=0;
+	ssize_t ret;
+	int i;
+
+#if defined(HAVE_PWRITEV) || defined(HAVE_PWRITEV64)
+	if (pos != (SMB_OFF_T)-1) {
+		ret = sys_pwritev(fd, iov, iovcnt, pos);
+		if (ret == -1 && errno != ESPIPE) {
+			DEBUG(0,("writev_data_at_offset: write failure. Error = %s\n", strerror(errno) ));
+			return -1;
+		}
+		if (ret != -1) {
+			total = skip = ret;
+		}
+	}
+#endif
+
+	/* Write whatever is left a buffer at a time. */
+	for (i = 0; i < iovcnt; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip -= iov[i].iov_len;
+			continue;
+		}
+		ret = write_data_at_offset(fd, (const char *)iov[i].iov_base + skip,
+					   iov[i].iov_len - skip,
+					   pos == (SMB_OFF_T)-1 ? pos : pos + total);
+		if (ret == -1) {
+			return -1;
+		}
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len - skip) {
+			break;
+		}
+		skip = 0;
+	}
+	return (ssize_t)total;
+}
+
 /****************************************************************************
  Set a fd into blocking/nonblocking mode. Uses POSIX O_NONBLOCK if available,
  else
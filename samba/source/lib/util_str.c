@@ -218,10 +218,27 @@ int StrCaseCmp(const char *s, const char *t)
 	size_t size;
 	smb_ucs2_t *buffer_s, *buffer_t;
 	int ret;
+	BOOL words = (((unsigned long)s ^ (unsigned long)t) & (sizeof(uint64) - 1)) == 0;
 
 	for (ps = s, pt = t; ; ps++, pt++) {
 		char us, ut;
 
+		/* With both strings sharing an alignment, skip equal
+		 * ASCII a word at a time.  Aligned loads never cross into
+		 * a page past the terminator.  Whatever stopped the word
+		 * loop is sorted out a byte at a time below. */
+		if (words && ((unsigned long)ps & (sizeof(uint64) - 1)) == 0) {
+			uint64 ws, wt;
+			for (;; ps += sizeof(ws), pt += sizeof(wt)) {
+				memcpy(&ws, ps, sizeof(ws));
+				memcpy(&wt, pt, sizeof(wt));
+				if (ASCII_STOP(ws) | ASCII_STOP(wt))
+					break;
+				if (ws != wt && ASCII_UPPER(ws) != ASCII_UPPER(wt))
+					break;
+			}
+		}
+
 		if (!*ps && !*pt)
 			return 0; /* both ended */
  		else if (!*ps)
@@ -264,6 +281,48 @@ int StrCaseCmp(const char *s, const char *t)
 }
 
 
+/**
+ * Hash a string so that strings StrCaseCmp() finds equal hash the
+ * same; a cheap first test before comparing names.  The hash is over
+ * upper cased UTF-16 units, the same as strhash_upper_w().
+ **/
+uint32 str_hash_upper(const char *s)
+{
+	uint32 h = 0;
+	size_t n = ascii_prefix_len(s, (size_t)-1);
+	smb_ucs2_t *buffer;
+	uint64 w;
+	size_t i;
+
+	for (; n >= sizeof(w); n -= sizeof(w), s += sizeof(w)) {
+		uint8 buf[sizeof(w)];
+		memcpy(&w, s, sizeof(w));
+		w = ASCII_UPPER(w);
+		memcpy(buf, &w, sizeof(buf));
+		for (i = 0; i < sizeof(buf); i++) {
+			h = STR_HASH_STEP(h, buf[i]);
+		}
+	}
+	for (; n > 0; n--, s++) {
+		h = STR_HASH_STEP(h, toupper_ascii(*s));
+	}
+
+	if (!*s) {
+		return h;
+	}
+
+	if (push_ucs2_allocate(&buffer, s) == (size_t)-1) {
+		/* as with StrCaseCmp(), close enough */
+		for (; *s; s++) {
+			h = STR_HASH_STEP(h, (unsigned char)*s);
+		}
+		return h;
+	}
+	h = strhash_upper_w(buffer, h);
+	SAFE_FREE(buffer);
+	return h;
+}
+
 /**
  Case insensitive string compararison, length limited.
 **/
@@ -620,11 +620,33 @@ BOOL strupper_w(smb_ucs2_t *s)
 {
 	smb_ucs2_t cp;
 	BOOL ret = False;
-	while (*(COPY_UCS2_CHAR(&cp,s))) {
-		smb_ucs2_t v = toupper_w(cp);
-		if (v != cp) {
-			COPY_UCS2_CHAR(s,&v);
-			ret = True;
+	uint64 w, u;
+
+	while (True) {
+		/* plain ASCII is upper cased 4 units at a time from an
+		   aligned word, which can never run off the end of the
+		   page the terminator lives in */
+		if (((unsigned long)s & (sizeof(w) - 1)) == 0) {
+			for (;; s += sizeof(w) / 2) {
+				memcpy(&w, s, sizeof(w));
+				if (UCS2_STOP(w))
+					break;
+				u = UCS2_UPPER(w);
+				if (u != w) {
+					memcpy(s, &u, sizeof(u));
+					ret = True;
+				}
+			}
+		}
+		if (!*(COPY_UCS2_CHAR(&cp,s))) {
+			break;
+		}
+		{
+			smb_ucs2_t v = toupper_w(cp);
+			if (v != cp) {
+				COPY_UCS2_CHAR(s,&v);
+				ret = True;
+			}
 		}
 		s++;
 	}
@@ -678,8 +700,26 @@ int strncmp_w(const smb_ucs2_t *a, const smb_ucs2_t *b, size_t len)
 int strcasecmp_w(const smb_ucs2_t *a, const smb_ucs2_t *b)
 {
 	smb_ucs2_t cpa, cpb;
-
-	while ((*COPY_UCS2_CHAR(&cpb,b)) && toupper_w(*(COPY_UCS2_CHAR(&cpa,a))) == toupper_w(cpb)) {
+	BOOL words = (((unsigned long)a ^ (unsigned long)b) & (sizeof(uint64) - 1)) == 0;
+
+	while (True) {
+		/* when both strings share an alignment, compare ASCII 4
+		   units at a time and let the loop below find the
+		   difference within the word that stopped us */
+		if (words && ((unsigned long)a & (sizeof(uint64) - 1)) == 0) {
+			uint64 wa, wb;
+			for (;; a += 4, b += 4) {
+				memcpy(&wa, a, sizeof(wa));
+				memcpy(&wb, b, sizeof(wb));
+				if (UCS2_STOP(wa) | UCS2_STOP(wb))
+					break;
+				if (wa != wb && UCS2_UPPER(wa) != UCS2_UPPER(wb))
+					break;
+			}
+		}
+		if (!*COPY_UCS2_CHAR(&cpb,b) || toupper_w(*(COPY_UCS2_CHAR(&cpa,a))) != toupper_w(cpb)) {
+			break;
+		}
 		a++;
 		b++;
 	}
@@ -694,8 +734,26 @@ int strncasecmp_w(const smb_ucs2_t *a, const smb_ucs2_t *b, size_t len)
 {
 	smb_ucs2_t cpa, cpb;
 	size_t n = 0;
-
-	while ((n < len) && *COPY_UCS2_CHAR(&cpb,b) && (toupper_w(*(COPY_UCS2_CHAR(&cpa,a))) == toupper_w(cpb))) {
+	BOOL words = (((unsigned long)a ^ (unsigned long)b) & (sizeof(uint64) - 1)) == 0;
+
+	while (n < len) {
+		if (words && ((unsigned long)a & (sizeof(uint64) - 1)) == 0) {
+			uint64 wa, wb;
+			for (; len - n >= 4; a += 4, b += 4, n += 4) {
+				memcpy(&wa, a, sizeof(wa));
+				memcpy(&wb, b, sizeof(wb));
+				if (UCS2_STOP(wa) | UCS2_STOP(wb))
+					break;
+				if (wa != wb && UCS2_UPPER(wa) != UCS2_UPPER(wb))
+					break;
+			}
+			if (n == len) {
+				break;
+			}
+		}
+		if (!*COPY_UCS2_CHAR(&cpb,b) || toupper_w(*(COPY_UCS2_CHAR(&cpa,a))) != toupper_w(cpb)) {
+			break;
+		}
 		a++;
 		b++;
 		n++;
@@ -719,6 +777,42 @@ BOOL strequal_w(const smb_ucs2_t *s1, const smb_ucs2_t *s2)
 	return(strcasecmp_w(s1,s2)==0);
 }
 
+/*******************************************************************
+ Hash a string case insensitively: strings that strcasecmp_w() calls
+ equal hash the same, so callers can compare hashes before strings.
+ h is the hash of any preceding part of the name, or 0.
+********************************************************************/
+
+uint32 strhash_upper_w(const smb_ucs2_t *s, uint32 h)
+{
+	smb_ucs2_t cp;
+	uint64 w;
+
+	while (True) {
+		if (((unsigned long)s & (sizeof(w) - 1)) == 0) {
+			for (;; s += 4) {
+				uint8 buf[sizeof(w)];
+				memcpy(&w, s, sizeof(w));
+				if (UCS2_STOP(w))
+					break;
+				w = UCS2_UPPER(w);
+				memcpy(buf, &w, sizeof(buf));
+				h = STR_HASH_STEP(h, SVAL(buf, 0));
+				h = STR_HASH_STEP(h, SVAL(buf, 2));
+				h = STR_HASH_STEP(h, SVAL(buf, 4));
+				h = STR_HASH_STEP(h, SVAL(buf, 6));
+			}
+		}
+		if (!*(COPY_UCS2_CHAR(&cp,s))) {
+			break;
+		}
+		cp = toupper_w(cp);
+		h = STR_HASH_STEP(h, SVAL(&cp, 0));
+		s++;
+	}
+	return h;
+}
+
 /*******************************************************************
  Compare 2 strings up to and including the nth char.
 ******************************************************************/
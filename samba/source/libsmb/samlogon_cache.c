@@ -25,6 +25,57 @@
 
 #define NETSAMLOGON_TDB	"netsamlogon_cache.tdb"
 
+/*
+ * A record is keyed by the user's SID string and laid out so that it
+ * can be read in place, see netsamlogon_cache_parse(). All numbers are
+ * little endian.
+ *
+ *	  0	NETSAMLOGON_CACHE_MAGIC
+ *	  4	time stored
+ *	  8	logon, logoff, kickoff, password last set, can change
+ *		and must change times, 8 bytes each
+ *	 56	logon count, bad password count, 2 bytes each
+ *	 60	user rid, group rid, user flags, account flags
+ *	 76	user session key, 16 bytes
+ *	 92	lm session key, 8 bytes
+ *	100	unknown[7]
+ *	128	number of groups, number of other sids
+ *	136	domain sid, NETSAMLOGON_SID_SIZE bytes
+ *	204	length and max length of the NSC_NUM_STRINGS strings,
+ *		2 bytes each
+ *	236	the groups, rid and attributes each
+ *		the other sids, attributes and NETSAMLOGON_SID_SIZE bytes
+ *		of sid each
+ *		the strings, in UCS2 as in their UNISTR2 buffers
+ *
+ * "NAME/DOMAIN\USER" points to the SID string of the record for the
+ * user, there is at most one for each record. Records written by
+ * earlier versions are a timestamp followed by the prs marshalled
+ * NET_USER_INFO_3. They are converted when first read.
+ */
+
+#define NETSAMLOGON_CACHE_MAGIC		0xfffe0001
+
+#define NSC_OFS_TIME		4
+#define NSC_OFS_NTTIMES		8
+#define NSC_OFS_COUNTS		56
+#define NSC_OFS_RIDS		60
+#define NSC_OFS_USER_SESS_KEY	76
+#define NSC_OFS_LM_SESS_KEY	92
+#define NSC_OFS_UNKNOWN		100
+#define NSC_OFS_NUMS		128
+#define NSC_OFS_DOM_SID		136
+#define NSC_OFS_STRLENS		204
+#define NSC_HDR_SIZE		236
+
+#define NSC_NUM_STRINGS		8
+#define NSC_OTHER_SID_SIZE	(4 + NETSAMLOGON_SID_SIZE)
+
+#define NSC_NAME_PREFIX		"NAME/"
+
+#define NSC_NTTIME_VAL(p, ofs) \
+	((NTTIME)IVAL(p, ofs) | ((NTTIME)IVAL(p, (ofs) + 4) << 32))
+
 static TDB_CONTEXT *netsamlogon_tdb = NULL;
 
 /***********************************************************************
@@ -34,8 +85,9 @@ static TDB_CONTEXT *netsamlogon_tdb = NULL;
 BOOL netsamlogon_cache_init(void)
 {
 	if (!netsamlogon_tdb) {
-		netsamlogon_tdb = tdb_open_log(lock_path(NETSAMLOGON_TDB), 0,
-						   TDB_DEFAULT, O_RDWR | O_CREAT, 0600);
+		netsamlogon_tdb = tdb_open_log(lock_path(NETSAMLOGON_TDB),
+					       NETSAMLOGON_CACHE_TDB_HASH_SIZE,
+					       TDB_DEFAULT, O_RDWR | O_CREAT, 0600);
 	}
 
 	return (netsamlogon_tdb != NULL);
@@ -48,8 +100,11 @@ BOOL netsamlogon_cache_init(void)
 
 BOOL netsamlogon_cache_shutdown(void)
 {
-	if(netsamlogon_tdb)
-		return (tdb_close(netsamlogon_tdb) == 0);
+	if(netsamlogon_tdb) {
+		int ret = tdb_close(netsamlogon_tdb);
+		netsamlogon_tdb = NULL;
+		return (ret == 0);
+	}
 		
 	return True;
 }
@@ -100,6 +155,437 @@ void netsamlogon_clear_cached_user(TDB_CONTEXT *tdb, NET_USER_INFO_3 *user)
 		tdb_close(tdb);
 }
 
+/* Keys are stored with their terminating zero, as tdb_fetch_bystring()
+   expects */
+
+static TDB_DATA nsc_tdb_key(const char *keystr)
+{
+	return make_tdb_data(keystr, strlen(keystr) + 1);
+}
+
+/* The strings of an info3 in the order they are stored */
+
+static void nsc_strings(NET_USER_INFO_3 *user, UNISTR2 **str, UNIHDR **hdr)
+{
+	str[0] = &user->uni_user_name;		hdr[0] = &user->hdr_user_name;
+	str[1] = &user->uni_full_name;		hdr[1] = &user->hdr_full_name;
+	str[2] = &user->uni_logon_script;	hdr[2] = &user->hdr_logon_script;
+	str[3] = &user->uni_profile_path;	hdr[3] = &user->hdr_profile_path;
+	str[4] = &user->uni_home_dir;		hdr[4] = &user->hdr_home_dir;
+	str[5] = &user->uni_dir_drive;		hdr[5] = &user->hdr_dir_drive;
+	str[6] = &user->uni_logon_srv;		hdr[6] = &user->hdr_logon_srv;
+	str[7] = &user->uni_logon_dom;		hdr[7] = &user->hdr_logon_dom;
+}
+
+/***********************************************************************
+ Check a record and fill in the entry describing it. Returns False for
+ anything but a sane record in the current format.
+***********************************************************************/
+
+static BOOL nsc_entry_init(struct netsamlogon_cache_entry *entry,
+			   const uint8 *data, size_t len)
+{
+	size_t ofs;
+	int i;
+
+	if ((len < NSC_HDR_SIZE) || (IVAL(data, 0) != NETSAMLOGON_CACHE_MAGIC)) {
+		return False;
+	}
+
+	ZERO_STRUCTP(entry);
+	entry->record = data;
+	entry->len = len;
+	entry->stored = (time_t)IVAL(data, NSC_OFS_TIME);
+	entry->user_rid = IVAL(data, NSC_OFS_RIDS);
+	entry->group_rid = IVAL(data, NSC_OFS_RIDS + 4);
+	entry->num_groups = IVAL(data, NSC_OFS_NUMS);
+	entry->num_other_sids = IVAL(data, NSC_OFS_NUMS + 4);
+
+	if (!sid_parse((const char *)data + NSC_OFS_DOM_SID,
+		       NETSAMLOGON_SID_SIZE, &entry->domain_sid)) {
+		return False;
+	}
+
+	/* Bound the counts before multiplying with them */
+
+	if ((entry->num_groups > len / 8) ||
+	    (entry->num_other_sids > len / NSC_OTHER_SID_SIZE)) {
+		return False;
+	}
+
+	ofs = NSC_HDR_SIZE;
+	entry->groups = data + ofs;
+	ofs += entry->num_groups * 8;
+	entry->other_sids = data + ofs;
+	ofs += entry->num_other_sids * NSC_OTHER_SID_SIZE;
+	entry->strings = data + ofs;
+
+	for (i = 0; i < NSC_NUM_STRINGS; i++) {
+		ofs += SVAL(data, NSC_OFS_STRLENS + i * 4) * 2;
+	}
+
+	return (ofs == len);
+}
+
+/***********************************************************************
+ Put together a record, in memory allocated from mem_ctx
+***********************************************************************/
+
+static uint8 *nsc_marshall(TALLOC_CTX *mem_ctx, NET_USER_INFO_3 *user,
+			   time_t t, size_t *plen)
+{
+	UNISTR2 *str[NSC_NUM_STRINGS];
+	UNIHDR *hdr[NSC_NUM_STRINGS];
+	NTTIME times[6];
+	uint8 *data, *p;
+	size_t len;
+	uint32 i;
+
+	nsc_strings(user, str, hdr);
+
+	len = NSC_HDR_SIZE + user->num_groups * 8 +
+		user->num_other_sids * NSC_OTHER_SID_SIZE;
+	for (i = 0; i < NSC_NUM_STRINGS; i++) {
+		if (str[i]->buffer == NULL) {
+			continue;
+		}
+		if (str[i]->uni_str_len > 0xffff) {
+			return NULL;
+		}
+		len += str[i]->uni_str_len * 2;
+	}
+
+	if ((user->num_groups != 0 && user->gids == NULL) ||
+	    (user->num_other_sids != 0 && user->other_sids == NULL)) {
+		return NULL;
+	}
+
+	if ((data = TALLOC_ZERO_ARRAY(mem_ctx, uint8, len)) == NULL) {
+		return NULL;
+	}
+
+	SIVAL(data, 0, NETSAMLOGON_CACHE_MAGIC);
+	SIVAL(data, NSC_OFS_TIME, (uint32)t);
+
+	times[0] = user->logon_time;
+	times[1] = user->logoff_time;
+	times[2] = user->kickoff_time;
+	times[3] = user->pass_last_set_time;
+	times[4] = user->pass_can_change_time;
+	times[5] = user->pass_must_change_time;
+	for (i = 0; i < 6; i++) {
+		SIVAL(data, NSC_OFS_NTTIMES + i * 8, times[i] & 0xffffffff);
+		SIVAL(data, NSC_OFS_NTTIMES + i * 8 + 4, times[i] >> 32);
+	}
+
+	SSVAL(data, NSC_OFS_COUNTS, user->logon_count);
+	SSVAL(data, NSC_OFS_COUNTS + 2, user->bad_pw_count);
+	SIVAL(data, NSC_OFS_RIDS, user->user_rid);
+	SIVAL(data, NSC_OFS_RIDS + 4, user->group_rid);
+	SIVAL(data, NSC_OFS_RIDS + 8, user->user_flgs);
+	SIVAL(data, NSC_OFS_RIDS + 12, user->acct_flags);
+	memcpy(data + NSC_OFS_USER_SESS_KEY, user->user_sess_key, 16);
+	memcpy(data + NSC_OFS_LM_SESS_KEY, user->lm_sess_key, 8);
+	for (i = 0; i < 7; i++) {
+		SIVAL(data, NSC_OFS_UNKNOWN + i * 4, user->unknown[i]);
+	}
+	SIVAL(data, NSC_OFS_NUMS, user->num_groups);
+	SIVAL(data, NSC_OFS_NUMS + 4, user->num_other_sids);
+	sid_linearize((char *)data + NSC_OFS_DOM_SID, NETSAMLOGON_SID_SIZE,
+		      &user->dom_sid.sid);
+
+	p = data + NSC_HDR_SIZE;
+
+	for (i = 0; i < user->num_groups; i++, p += 8) {
+		SIVAL(p, 0, user->gids[i].g_rid);
+		SIVAL(p, 4, user->gids[i].attr);
+	}
+
+	for (i = 0; i < user->num_other_sids; i++, p += NSC_OTHER_SID_SIZE) {
+		SIVAL(p, 0, user->other_sids_attrib ?
+		      user->other_sids_attrib[i] : 0);
+		sid_linearize((char *)p + 4, NETSAMLOGON_SID_SIZE,
+			      &user->other_sids[i].sid);
+	}
+
+	/* The UNISTR2 buffers are little endian already */
+
+	for (i = 0; i < NSC_NUM_STRINGS; i++) {
+		if (str[i]->buffer == NULL) {
+			continue;
+		}
+		SSVAL(data, NSC_OFS_STRLENS + i * 4, str[i]->uni_str_len);
+		SSVAL(data, NSC_OFS_STRLENS + i * 4 + 2, str[i]->uni_max_len);
+		memcpy(p, str[i]->buffer, str[i]->uni_str_len * 2);
+		p += str[i]->uni_str_len * 2;
+	}
+
+	*plen = len;
+	return data;
+}
+
+/***********************************************************************
+ Turn a record back into a NET_USER_INFO_3
+***********************************************************************/
+
+static NET_USER_INFO_3 *nsc_unmarshall(TALLOC_CTX *mem_ctx,
+				       const struct netsamlogon_cache_entry *entry)
+{
+	const uint8 *data = entry->record;
+	const uint8 *p;
+	UNISTR2 *str[NSC_NUM_STRINGS];
+	UNIHDR *hdr[NSC_NUM_STRINGS];
+	NET_USER_INFO_3 *user;
+	NTTIME times[6];
+	DOM_SID sid;
+	uint32 i;
+
+	if ((user = TALLOC_ZERO_P(mem_ctx, NET_USER_INFO_3)) == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < 6; i++) {
+		times[i] = NSC_NTTIME_VAL(data, NSC_OFS_NTTIMES + i * 8);
+	}
+	user->logon_time = times[0];
+	user->logoff_time = times[1];
+	user->kickoff_time = times[2];
+	user->pass_last_set_time = times[3];
+	user->pass_can_change_time = times[4];
+	user->pass_must_change_time = times[5];
+
+	user->ptr_user_info = 1;
+	user->logon_count = SVAL(data, NSC_OFS_COUNTS);
+	user->bad_pw_count = SVAL(data, NSC_OFS_COUNTS + 2);
+	user->user_rid = entry->user_rid;
+	user->group_rid = entry->group_rid;
+	user->user_flgs = IVAL(data, NSC_OFS_RIDS + 8);
+	user->acct_flags = IVAL(data, NSC_OFS_RIDS + 12);
+	memcpy(user->user_sess_key, data + NSC_OFS_USER_SESS_KEY, 16);
+	memcpy(user->lm_sess_key, data + NSC_OFS_LM_SESS_KEY, 8);
+	for (i = 0; i < 7; i++) {
+		user->unknown[i] = IVAL(data, NSC_OFS_UNKNOWN + i * 4);
+	}
+
+	user->buffer_dom_id = 1;
+	init_dom_sid2(&user->dom_sid, &entry->domain_sid);
+
+	user->num_groups = user->num_groups2 = entry->num_groups;
+	if (entry->num_groups != 0) {
+		user->buffer_groups = 1;
+		user->gids = TALLOC_ARRAY(user, DOM_GID, entry->num_groups);
+		if (user->gids == NULL) {
+			goto fail;
+		}
+		for (i = 0, p = entry->groups; i < entry->num_groups; i++, p += 8) {
+			user->gids[i].g_rid = IVAL(p, 0);
+			user->gids[i].attr = IVAL(p, 4);
+		}
+	}
+
+	user->num_other_sids = entry->num_other_sids;
+	if (entry->num_other_sids != 0) {
+		user->buffer_other_sids = 1;
+		user->other_sids = TALLOC_ARRAY(user, DOM_SID2,
+						entry->num_other_sids);
+		user->other_sids_attrib = TALLOC_ARRAY(user, uint32,
+						       entry->num_other_sids);
+		if ((user->other_sids == NULL) ||
+		    (user->other_sids_attrib == NULL)) {
+			goto fail;
+		}
+		for (i = 0, p = entry->other_sids; i < entry->num_other_sids;
+		     i++, p += NSC_OTHER_SID_SIZE) {
+			user->other_sids_attrib[i] = IVAL(p, 0);
+			if (!sid_parse((const char *)p + 4,
+				       NETSAMLOGON_SID_SIZE, &sid)) {
+				goto fail;
+			}
+			init_dom_sid2(&user->other_sids[i], &sid);
+		}
+	}
+
+	nsc_strings(user, str, hdr);
+
+	for (i = 0, p = entry->strings; i < NSC_NUM_STRINGS; i++) {
+		uint32 len = SVAL(data, NSC_OFS_STRLENS + i * 4);
+		uint32 max_len = SVAL(data, NSC_OFS_STRLENS + i * 4 + 2);
+
+		if (len == 0 && max_len == 0) {
+			continue;
+		}
+
+		/* one more to always have the terminator */
+
+		str[i]->buffer = TALLOC_ZERO_ARRAY(user, uint16, len + 1);
+		if (str[i]->buffer == NULL) {
+			goto fail;
+		}
+		memcpy(str[i]->buffer, p, len * 2);
+		str[i]->uni_str_len = len;
+		str[i]->uni_max_len = max_len;
+		str[i]->offset = 0;
+		init_uni_hdr(hdr[i], str[i]);
+		p += len * 2;
+	}
+
+	return user;
+
+ fail:
+	TALLOC_FREE(user);
+	return NULL;
+}
+
+/***********************************************************************
+ Read a string of a record into an fstring
+***********************************************************************/
+
+static void nsc_entry_string(const struct netsamlogon_cache_entry *entry,
+			     int which, fstring out)
+{
+	const uint8 *p = entry->strings;
+	int i;
+
+	/* pull_ucs2() writes nothing for an empty string */
+	out[0] = '\0';
+
+	for (i = 0; i < which; i++) {
+		p += SVAL(entry->record, NSC_OFS_STRLENS + i * 4) * 2;
+	}
+	pull_ucs2(NULL, out, p, sizeof(fstring),
+		  SVAL(entry->record, NSC_OFS_STRLENS + which * 4) * 2,
+		  STR_NOALIGN);
+}
+
+/* The name index key of a user */
+
+static void nsc_name_key(const char *domain, const char *name, pstring key)
+{
+	pstr_sprintf(key, NSC_NAME_PREFIX "%s\\%s", domain, name);
+	strupper_m(key);
+}
+
+static void nsc_entry_name_key(const struct netsamlogon_cache_entry *entry,
+			       pstring key)
+{
+	fstring domain, name;
+
+	nsc_entry_string(entry, 7, domain);
+	nsc_entry_string(entry, 0, name);
+
+	if (name[0] == '\0') {
+		key[0] = '\0';
+		return;
+	}
+	nsc_name_key(domain, name, key);
+}
+
+/***********************************************************************
+ Store a record and keep the name index pointing to it. With claim_name
+ False the name is only indexed if no other record has it.
+***********************************************************************/
+
+struct nsc_name_state {
+	pstring key;
+};
+
+struct nsc_owner_state {
+	const char *keystr;
+	BOOL mine;
+};
+
+static int nsc_owner_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct nsc_owner_state *state = (struct nsc_owner_state *)private_data;
+
+	state->mine = (data.dsize == strlen(state->keystr) + 1) &&
+		(memcmp(data.dptr, state->keystr, data.dsize) == 0);
+	return 0;
+}
+
+/* Remove the index entry of a record's old name, unless another user
+   (a new account with that name, or one renamed to it) has taken it
+   over since */
+
+static void nsc_delete_name_key(const char *name_key, const char *keystr)
+{
+	struct nsc_owner_state state;
+
+	state.keystr = keystr;
+	state.mine = False;
+
+	tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(name_key),
+			 nsc_owner_fn, &state);
+	if (state.mine) {
+		tdb_delete_bystring(netsamlogon_tdb, name_key);
+	}
+}
+
+static int nsc_old_name_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct nsc_name_state *state = (struct nsc_name_state *)private_data;
+	struct netsamlogon_cache_entry entry;
+
+	if (nsc_entry_init(&entry, (const uint8 *)data.dptr, data.dsize)) {
+		nsc_entry_name_key(&entry, state->key);
+	}
+	return 0;
+}
+
+static BOOL nsc_store(const char *keystr, NET_USER_INFO_3 *user, time_t t,
+		      BOOL claim_name)
+{
+	struct netsamlogon_cache_entry entry;
+	struct nsc_name_state old;
+	pstring name_key;
+	TDB_DATA data;
+	uint8 *buf;
+	size_t len;
+	BOOL result = False;
+
+	if ((buf = nsc_marshall(NULL, user, t, &len)) == NULL) {
+		DEBUG(0,("netsamlogon_cache_store: could not marshall info3\n"));
+		return False;
+	}
+
+	if (!nsc_entry_init(&entry, buf, len)) {
+		DEBUG(0,("netsamlogon_cache_store: inconsistent record\n"));
+		TALLOC_FREE(buf);
+		return False;
+	}
+	nsc_entry_name_key(&entry, name_key);
+
+	/* A user renamed since the last logon leaves an index entry
+	   behind */
+
+	old.key[0] = '\0';
+	tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(keystr),
+			 nsc_old_name_fn, &old);
+
+	data.dptr = (char *)buf;
+	data.dsize = len;
+
+	if (tdb_store_bystring(netsamlogon_tdb, keystr, data, TDB_REPLACE) != -1) {
+		result = True;
+	}
+	TALLOC_FREE(buf);
+
+	if (!result) {
+		return False;
+	}
+
+	if ((old.key[0] != '\0') && (strcmp(old.key, name_key) != 0)) {
+		nsc_delete_name_key(old.key, keystr);
+	}
+	if (name_key[0] != '\0') {
+		tdb_store_bystring(netsamlogon_tdb, name_key,
+				   nsc_tdb_key(keystr),
+				   claim_name ? TDB_REPLACE : TDB_INSERT);
+	}
+
+	return True;
+}
+
 /***********************************************************************
  Store a NET_USER_INFO_3 structure in a tdb for later user 
  username should be in UTF-8 format
@@ -107,14 +593,8 @@ void netsamlogon_clear_cached_user(TDB_CONTEXT *tdb, NET_USER_INFO_3 *user)
 
 BOOL netsamlogon_cache_store( const char *username, NET_USER_INFO_3 *user )
 {
-	TDB_DATA 	data;
         fstring 	keystr;
-	prs_struct 	ps;
-	BOOL 		result = False;
 	DOM_SID		user_sid;
-	time_t		t = time(NULL);
-	TALLOC_CTX 	*mem_ctx;
-	
 
 	if (!netsamlogon_cache_init()) {
 		DEBUG(0,("netsamlogon_cache_store: cannot open %s for write!\n", NETSAMLOGON_TDB));
@@ -136,121 +616,242 @@ BOOL netsamlogon_cache_store( const char *username, NET_USER_INFO_3 *user )
 		init_unistr2( &user->uni_user_name, username, UNI_STR_TERMINATE );
 		init_uni_hdr( &user->hdr_user_name, &user->uni_user_name );
 	}
-		
-	/* Prepare data */
-	
-	if ( !(mem_ctx = TALLOC_P( NULL, int )) ) {
-		DEBUG(0,("netsamlogon_cache_store: talloc() failed!\n"));
-		return False;
+
+	return nsc_store(keystr, user, time(NULL), True);
+}
+
+/***********************************************************************
+ Read a record as written by earlier versions, and store it again in
+ the current format
+***********************************************************************/
+
+static NET_USER_INFO_3 *nsc_convert(TALLOC_CTX *mem_ctx, const char *keystr)
+{
+	NET_USER_INFO_3	*user = NULL;
+	TDB_DATA 	data;
+	prs_struct	ps;
+	uint32		t;
+
+	data = tdb_fetch_bystring( netsamlogon_tdb, keystr );
+	if (data.dptr == NULL) {
+		return NULL;
 	}
 
-	prs_init( &ps, RPC_MAX_PDU_FRAG_LEN, mem_ctx, MARSHALL);
-	
-	{
-		uint32 ts = (uint32)t;
-		if ( !prs_uint32( "timestamp", &ps, 0, &ts ) )
-			return False;
+	user = TALLOC_ZERO_P(mem_ctx, NET_USER_INFO_3);
+	if (user == NULL) {
+		SAFE_FREE(data.dptr);
+		return NULL;
 	}
-	
-	if ( net_io_user_info3("", user, &ps, 0, 3, 0) ) 
-	{
-		data.dsize = prs_offset( &ps );
-		data.dptr = prs_data_p( &ps );
 
-		if (tdb_store_bystring(netsamlogon_tdb, keystr, data, TDB_REPLACE) != -1)
-			result = True;
-		
+	prs_init( &ps, 0, mem_ctx, UNMARSHALL );
+	prs_give_memory( &ps, data.dptr, data.dsize, True );
+
+	if ( !prs_uint32( "timestamp", &ps, 0, &t ) ||
+	     !net_io_user_info3("", user, &ps, 0, 3, 0) ) {
+		DEBUG(1,("netsamlogon_cache_get: could not parse record for "
+			 "%s\n", keystr));
 		prs_mem_free( &ps );
+		TALLOC_FREE( user );
+		return NULL;
 	}
 
-	TALLOC_FREE( mem_ctx );
-		
-	return result;
+	prs_mem_free( &ps );
+
+	DEBUG(10,("netsamlogon_cache_get: converting record for %s\n",
+		  keystr));
+
+	/* The record may be older than whoever has the name now */
+	nsc_store(keystr, user, (time_t)t, False);
+
+	return user;
 }
 
 /***********************************************************************
- Retrieves a NET_USER_INFO_3 structure from a tdb.  Caller must 
- free the user_info struct (malloc()'d memory)
+ Look at the cached info3 of a user in place, without copying or
+ unmarshalling it. fn is called with the record, unless it is NULL.
+ Returns False if the user is not in the cache, else what fn returned.
 ***********************************************************************/
 
-NET_USER_INFO_3* netsamlogon_cache_get( TALLOC_CTX *mem_ctx, const DOM_SID *user_sid)
+struct nsc_parse_state {
+	BOOL (*fn)(const struct netsamlogon_cache_entry *entry,
+		   void *private_data);
+	void *private_data;
+	BOOL found;
+	BOOL legacy;
+	BOOL result;
+};
+
+static int nsc_parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
 {
-	NET_USER_INFO_3	*user = NULL;
-	TDB_DATA 	data, key;
-	prs_struct	ps;
-        fstring 	keystr;
-	uint32		t;
-	
+	struct nsc_parse_state *state = (struct nsc_parse_state *)private_data;
+	struct netsamlogon_cache_entry entry;
+
+	if (!nsc_entry_init(&entry, (const uint8 *)data.dptr, data.dsize)) {
+		state->legacy = True;
+		return 0;
+	}
+
+	state->found = True;
+	state->result = (state->fn != NULL) ?
+		state->fn(&entry, state->private_data) : True;
+	return 0;
+}
+
+BOOL netsamlogon_cache_parse(const DOM_SID *user_sid,
+			     BOOL (*fn)(const struct netsamlogon_cache_entry *entry,
+					void *private_data),
+			     void *private_data)
+{
+	struct nsc_parse_state state;
+	TALLOC_CTX *mem_ctx;
+	fstring keystr;
+
 	if (!netsamlogon_cache_init()) {
-		DEBUG(0,("netsamlogon_cache_get: cannot open %s for write!\n", NETSAMLOGON_TDB));
+		DEBUG(0,("netsamlogon_cache_parse: cannot open %s!\n", NETSAMLOGON_TDB));
 		return False;
 	}
 
-	/* Prepare key as DOMAIN-SID/USER-RID string */
-	slprintf(keystr, sizeof(keystr), "%s", sid_string_static(user_sid));
-	DEBUG(10,("netsamlogon_cache_get: SID [%s]\n", keystr));
-	key.dptr = keystr;
-	key.dsize = strlen(keystr)+1;
-	data = tdb_fetch( netsamlogon_tdb, key );
-	
-	if ( data.dptr ) {
+	sid_to_string(keystr, user_sid);
 
-		user = TALLOC_ZERO_P(mem_ctx, NET_USER_INFO_3);
-		if (user == NULL) {
-			return NULL;
-		}
+	state.fn = fn;
+	state.private_data = private_data;
+	state.found = False;
+	state.legacy = False;
+	state.result = False;
 
-		prs_init( &ps, 0, mem_ctx, UNMARSHALL );
-		prs_give_memory( &ps, data.dptr, data.dsize, True );
-		
-		if ( !prs_uint32( "timestamp", &ps, 0, &t ) ) {
-			prs_mem_free( &ps );
-			TALLOC_FREE(user);
-			return False;
-		}
-		
-		if ( !net_io_user_info3("", user, &ps, 0, 3, 0) ) {
-			TALLOC_FREE( user );
-		}
-			
-		prs_mem_free( &ps );
+	tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(keystr),
+			 nsc_parse_fn, &state);
+	if (!state.legacy) {
+		return state.found && state.result;
+	}
 
-#if 0	/* The netsamlogon cache needs to hang around.  Something about 
-	   this feels wrong, but it is the only way we can get all of the
-	   groups.  The old universal groups cache didn't expire either.
-	   --jerry */
-	{
-		time_t		now = time(NULL);
-		uint32		time_diff;
-	   
-		/* is the entry expired? */
-		time_diff = now - t;
-		
-		if ( (time_diff < 0 ) || (time_diff > lp_winbind_cache_time()) ) {
-			DEBUG(10,("netsamlogon_cache_get: cache entry expired \n"));
-			tdb_delete( netsamlogon_tdb, key );
-			TALLOC_FREE( user );
-		}
-#endif
+	/* There is a record, but not one we can read in place */
+
+	if ((mem_ctx = talloc_init("netsamlogon_cache_parse")) == NULL) {
+		return False;
 	}
-	
-	return user;
+	if (nsc_convert(mem_ctx, keystr) != NULL) {
+		state.legacy = False;
+		tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(keystr),
+				 nsc_parse_fn, &state);
+	}
+	talloc_destroy(mem_ctx);
+
+	return state.found && state.result;
+}
+
+/***********************************************************************
+ Retrieves a NET_USER_INFO_3 structure from a tdb.  Caller must 
+ free the user_info struct (talloc()'d memory)
+***********************************************************************/
+
+struct nsc_get_state {
+	TALLOC_CTX *mem_ctx;
+	NET_USER_INFO_3 *user;
+};
+
+static BOOL nsc_get_fn(const struct netsamlogon_cache_entry *entry,
+		       void *private_data)
+{
+	struct nsc_get_state *state = (struct nsc_get_state *)private_data;
+
+	state->user = nsc_unmarshall(state->mem_ctx, entry);
+	return (state->user != NULL);
+}
+
+NET_USER_INFO_3* netsamlogon_cache_get( TALLOC_CTX *mem_ctx, const DOM_SID *user_sid)
+{
+	struct nsc_get_state state;
+
+	DEBUG(10,("netsamlogon_cache_get: SID [%s]\n",
+		  sid_string_static(user_sid)));
+
+	state.mem_ctx = mem_ctx;
+	state.user = NULL;
+
+	if (!netsamlogon_cache_parse(user_sid, nsc_get_fn, &state)) {
+		return NULL;
+	}
+
+	/* The netsamlogon cache needs to hang around, the entries don't
+	   expire. It is the only way we can get all of the groups. */
+
+	return state.user;
 }
 
 BOOL netsamlogon_cache_have(const DOM_SID *user_sid)
 {
-	TALLOC_CTX *mem_ctx = talloc_init("netsamlogon_cache_have");
-	NET_USER_INFO_3 *user = NULL;
-	BOOL result;
+	return netsamlogon_cache_parse(user_sid, NULL, NULL);
+}
+
+/***********************************************************************
+ Find the SID of a user who logged on before, by name
+***********************************************************************/
 
-	if (!mem_ctx)
+struct nsc_sid_state {
+	DOM_SID *sid;
+	BOOL found;
+};
+
+static int nsc_sid_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct nsc_sid_state *state = (struct nsc_sid_state *)private_data;
+	fstring sid_str;
+
+	if ((data.dsize == 0) || (data.dsize > sizeof(sid_str)) ||
+	    (data.dptr[data.dsize - 1] != '\0')) {
+		return 0;
+	}
+	memcpy(sid_str, data.dptr, data.dsize);
+
+	state->found = string_to_sid(state->sid, sid_str);
+	return 0;
+}
+
+BOOL netsamlogon_cache_sid_byname(const char *domain, const char *name,
+				  DOM_SID *sid)
+{
+	struct nsc_sid_state state;
+	pstring key;
+
+	if (!netsamlogon_cache_init()) {
 		return False;
+	}
 
-	user = netsamlogon_cache_get(mem_ctx, user_sid);
+	nsc_name_key(domain, name, key);
 
-	result = (user != NULL);
+	state.sid = sid;
+	state.found = False;
 
-	talloc_destroy(mem_ctx);
+	tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(key), nsc_sid_fn, &state);
+	if (!state.found) {
+		return False;
+	}
+
+	return netsamlogon_cache_have(sid);
+}
+
+/***********************************************************************
+ Forget a user
+***********************************************************************/
+
+BOOL netsamlogon_cache_delete(const DOM_SID *user_sid)
+{
+	struct nsc_name_state old;
+	fstring keystr;
+
+	if (!netsamlogon_cache_init()) {
+		return False;
+	}
+
+	sid_to_string(keystr, user_sid);
+
+	old.key[0] = '\0';
+	tdb_parse_record(netsamlogon_tdb, nsc_tdb_key(keystr),
+			 nsc_old_name_fn, &old);
+	if (old.key[0] != '\0') {
+		nsc_delete_name_key(old.key, keystr);
+	}
 
-	return result;
+	return (tdb_delete_bystring(netsamlogon_tdb, keystr) == 0);
 }
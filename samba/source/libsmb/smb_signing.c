@@ -32,6 +32,16 @@ struct smb_basic_signing_context {
 	DATA_BLOB mac_key;
 	uint32 send_seq_num;
 	struct outstanding_packet_lookup *outstanding_packet_list;
+
+	/* A reply being signed while its data is produced. */
+	struct MD5Context reply_md5_ctx;
+	BOOL reply_in_progress;
+	uint32 reply_seq_num;
+	BOOL reply_seq_deferred;
+
+	/* A reply signed that way, which send_smb() must leave alone. */
+	const char *presigned_outbuf;
+	size_t presigned_len;
 };
 
 static BOOL store_sequence_for_reply(struct outstanding_packet_lookup **list, 
@@ -243,16 +253,18 @@ static BOOL signing_good(char *inbuf, struct smb_sign_info *si, BOOL good, uint3
 }	
 
 /***********************************************************
- SMB signing - Simple implementation - calculate a MAC on the packet
+ SMB signing - Simple implementation - start the MAC of a packet,
+ covering everything up to hdr_len. The rest of the packet is fed in
+ with MD5Update() as it becomes available.
 ************************************************************/
 
-static void simple_packet_signature(struct smb_basic_signing_context *data, 
-				    const uchar *buf, uint32 seq_number, 
-				    unsigned char calc_md5_mac[16])
+static void simple_packet_signature_start(struct smb_basic_signing_context *data, 
+					  const uchar *buf, size_t hdr_len,
+					  uint32 seq_number,
+					  struct MD5Context *md5_ctx)
 {
 	const size_t offset_end_of_sig = (smb_ss_field + 8);
 	unsigned char sequence_buf[8];
-	struct MD5Context md5_ctx;
 #if 0
         /* JRA - apparently this is incorrect. */
 	unsigned char key_buf[16];
@@ -275,10 +287,10 @@ static void simple_packet_signature(struct smb_basic_signing_context *data,
 	   
 	   This makes for a bit of fussing about, but it's not too bad.
 	*/
-	MD5Init(&md5_ctx);
+	MD5Init(md5_ctx);
 
 	/* intialise with the key */
-	MD5Update(&md5_ctx, data->mac_key.data, data->mac_key.length); 
+	MD5Update(md5_ctx, data->mac_key.data, data->mac_key.length); 
 #if 0
 	/* JRA - apparently this is incorrect. */
 	/* NB. When making and verifying SMB signatures, Windows apparently
@@ -286,19 +298,33 @@ static void simple_packet_signature(struct smb_basic_signing_context *data,
 		From Nalin Dahyabhai <nalin@redhat.com> */
 	if (data->mac_key.length < sizeof(key_buf)) {
 		memset(key_buf, 0, sizeof(key_buf));
-		MD5Update(&md5_ctx, key_buf, sizeof(key_buf) - data->mac_key.length);
+		MD5Update(md5_ctx, key_buf, sizeof(key_buf) - data->mac_key.length);
 	}
 #endif
 
 	/* copy in the first bit of the SMB header */
-	MD5Update(&md5_ctx, buf + 4, smb_ss_field - 4);
+	MD5Update(md5_ctx, buf + 4, smb_ss_field - 4);
 
 	/* copy in the sequence number, instead of the signature */
-	MD5Update(&md5_ctx, sequence_buf, sizeof(sequence_buf));
+	MD5Update(md5_ctx, sequence_buf, sizeof(sequence_buf));
+
+	/* copy in the rest of the header, skipping the signature */
+	MD5Update(md5_ctx, buf + offset_end_of_sig, 
+		  hdr_len - offset_end_of_sig);
+}
+
+/***********************************************************
+ SMB signing - Simple implementation - calculate a MAC on the packet
+************************************************************/
+
+static void simple_packet_signature(struct smb_basic_signing_context *data, 
+				    const uchar *buf, uint32 seq_number, 
+				    unsigned char calc_md5_mac[16])
+{
+	struct MD5Context md5_ctx;
 
-	/* copy in the rest of the packet in, skipping the signature */
-	MD5Update(&md5_ctx, buf + offset_end_of_sig, 
-		  smb_len(buf) - (offset_end_of_sig - 4));
+	simple_packet_signature_start(data, buf, smb_len(buf) + 4,
+				      seq_number, &md5_ctx);
 
 	/* calculate the MD5 sig */ 
 	MD5Final(calc_md5_mac, &md5_ctx);
@@ -604,6 +630,14 @@ static void srv_sign_outgoing_message(char *outbuf, struct smb_sign_info *si)
 		return;
 	}
 
+	/* Already signed by srv_sign_reply_finish(). */
+	if (data->presigned_outbuf == outbuf &&
+	    data->presigned_len == smb_len(outbuf)) {
+		data->presigned_outbuf = NULL;
+		return;
+	}
+	data->presigned_outbuf = NULL;
+
 	/* JRA Paranioa test - we should be able to get rid of this... */
 	if (smb_len(outbuf) < (smb_ss_field + 8 - 4)) {
 		DEBUG(1, ("srv_sign_outgoing_message: Logic error. Can't send signature on short packet! smb_len = %u\n",
@@ -655,6 +689,10 @@ static BOOL srv_check_incoming_message(char *inbuf, struct smb_sign_info *si, BO
 	/* We always increment the sequence number. */
 	data->send_seq_num += 2;
 
+	/* Anything signed ahead for the previous request has been sent. */
+	data->presigned_outbuf = NULL;
+	data->reply_in_progress = False;
+
 	saved_seq = reply_seq_number;
 	simple_packet_signature(data, (const unsigned char *)inbuf, reply_seq_number, calc_md5_mac);
 
@@ -749,6 +787,150 @@ void srv_calculate_sign_mac(char *outbuf)
 	srv_sign_info.sign_outgoing_message(outbuf, &srv_sign_info);
 }
 
+/***********************************************************
+ Start signing a reply whose trailing data is produced after its
+ header. outbuf must already carry the final header and length; the
+ first hdr_len bytes are hashed now and the data that follows is fed
+ in with srv_sign_reply_data() while it is being read, so it need not
+ be walked again when the packet is sent. Returns False if the reply
+ doesn't need signing.
+************************************************************/
+
+BOOL srv_sign_reply_begin(char *outbuf, size_t hdr_len)
+{
+	struct smb_basic_signing_context *data;
+	uint32 seq_num;
+	struct outstanding_packet_lookup *t;
+
+	if (!srv_sign_info.doing_signing ||
+	    srv_sign_info.sign_outgoing_message != srv_sign_outgoing_message)
+		return False;
+
+	data = (struct smb_basic_signing_context *)srv_sign_info.signing_context;
+	if (!data)
+		return False;
+
+	data->reply_seq_deferred = False;
+
+	if (hdr_len < smb_ss_field + 8 || hdr_len > smb_len(outbuf) + 4)
+		return False;
+
+	mark_packet_signed(outbuf);
+
+	/* Look for a deferred sequence number, but leave it in place
+	   until the reply is finished. */
+	seq_num = data->send_seq_num - 1;
+	for (t = data->outstanding_packet_list; t; t = t->next) {
+		if (t->mid == SVAL(outbuf, smb_mid)) {
+			seq_num = t->reply_seq_num;
+			data->reply_seq_deferred = True;
+			break;
+		}
+	}
+
+	simple_packet_signature_start(data, (const unsigned char *)outbuf,
+				      hdr_len, seq_num, &data->reply_md5_ctx);
+	data->reply_seq_num = seq_num;
+	data->reply_in_progress = True;
+	data->presigned_outbuf = NULL;
+
+	return True;
+}
+
+/***********************************************************
+ Add the next piece of the reply data to the MAC.
+************************************************************/
+
+void srv_sign_reply_data(const char *buf, size_t len)
+{
+	struct smb_basic_signing_context *data =
+		(struct smb_basic_signing_context *)srv_sign_info.signing_context;
+
+	if (!data || !data->reply_in_progress)
+		return;
+
+	MD5Update(&data->reply_md5_ctx, (const unsigned char *)buf, len);
+}
+
+/***********************************************************
+ Put the MAC of a reply started with srv_sign_reply_begin() into the
+ packet. The caller must have fed in exactly the data that follows the
+ header. send_smb() will then send outbuf as it is. If the reply isn't
+ sent with send_smb() (sendfile) the caller must say so with
+ via_send_smb == False.
+************************************************************/
+
+void srv_sign_reply_finish(char *outbuf, BOOL via_send_smb)
+{
+	struct smb_basic_signing_context *data =
+		(struct smb_basic_signing_context *)srv_sign_info.signing_context;
+	unsigned char calc_md5_mac[16];
+	uint32 dummy_seq;
+
+	if (!data || !data->reply_in_progress)
+		return;
+
+	data->reply_in_progress = False;
+
+	MD5Final(calc_md5_mac, &data->reply_md5_ctx);
+
+	/* Now the deferred sequence number (if any) is used up. */
+	get_sequence_for_reply(&data->outstanding_packet_list,
+			       SVAL(outbuf, smb_mid), &dummy_seq);
+
+	DEBUG(10, ("srv_sign_reply_finish: seq %u: sent SMB signature of\n",
+		   (unsigned int)data->reply_seq_num));
+	dump_data(10, (const char *)calc_md5_mac, 8);
+
+	memcpy(&outbuf[smb_ss_field], calc_md5_mac, 8);
+
+	if (via_send_smb) {
+		data->presigned_outbuf = outbuf;
+		data->presigned_len = smb_len(outbuf);
+	}
+}
+
+/***********************************************************
+ Drop a reply started with srv_sign_reply_begin(). It will be signed
+ in full when sent.
+************************************************************/
+
+void srv_sign_reply_cancel(void)
+{
+	struct smb_basic_signing_context *data =
+		(struct smb_basic_signing_context *)srv_sign_info.signing_context;
+
+	if (data) {
+		data->reply_in_progress = False;
+		data->reply_seq_deferred = False;
+	}
+}
+
+/***********************************************************
+ Undo srv_sign_reply_finish() for a reply that was never sent
+ (sendfile returned ENOSYS). A deferred sequence number it used up
+ is put back, so the reply that is sent instead gets signed with it.
+************************************************************/
+
+void srv_sign_reply_rewind(const char *outbuf)
+{
+	struct smb_basic_signing_context *data =
+		(struct smb_basic_signing_context *)srv_sign_info.signing_context;
+
+	if (!data)
+		return;
+
+	data->reply_in_progress = False;
+	data->presigned_outbuf = NULL;
+
+	if (data->reply_seq_deferred) {
+		store_sequence_for_reply(&data->outstanding_packet_list,
+					 SVAL(outbuf, smb_mid),
+					 data->reply_seq_num);
+		data->reply_seq_deferred = False;
+	}
+}
+
 /***********************************************************
  Called by server to defer an outgoing packet.
 ************************************************************/
@@ -0,0 +1,235 @@
+/*
+ * Sequential read stream detection for readahead.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "includes.h"
+#include "modules/prefetch.h"
+
+/*
+ * Each open file tracks a few read streams. A stream is a run of reads
+ * a fixed distance (the stride) apart: stride == count is a plain
+ * sequential read, a negative stride reads backwards, anything else
+ * walks a record or a column at a time. A read the stream predicted
+ * grows its window and asks for the data the next reads will want;
+ * an unpredicted read starts a new stream and asks for nothing.
+ *
+ * This file only decides; the caller issues the readahead and drops,
+ * so the same logic can be replayed outside smbd.
+ */
+
+static BOOL stream_contiguous(const struct prefetch_stream *s, size_t count)
+{
+	SMB_OFF_T c = (SMB_OFF_T)count;
+
+	return (s->stride > 0 && s->stride <= c) ||
+		(s->stride < 0 && s->stride >= -c);
+}
+
+static void add_range(struct prefetch_advice *advice, SMB_OFF_T offset, SMB_OFF_T len)
+{
+	if (offset < 0) {
+		len += offset;
+		offset = 0;
+	}
+	if (len <= 0 || advice->num_ranges == PREFETCH_MAX_RANGES) {
+		return;
+	}
+	advice->ranges[advice->num_ranges].offset = offset;
+	advice->ranges[advice->num_ranges].len = len;
+	advice->num_ranges++;
+}
+
+/*
+ * Keep [end, end + window) read ahead of a forward stream, topping it
+ * up only once half a window has been used so each call is large.
+ */
+
+static void advise_forward(struct prefetch_stream *s, SMB_OFF_T end,
+			   struct prefetch_advice *advice)
+{
+	SMB_OFF_T target = end + s->window;
+
+	if (s->ra_next < end) {
+		s->ra_next = end;
+	}
+	if (target - s->ra_next >= s->window / 2) {
+		add_range(advice, s->ra_next, target - s->ra_next);
+		s->ra_next = target;
+	}
+}
+
+/* The same for a backward stream, where ra_next is the lowest offset
+   already read ahead. */
+
+static void advise_backward(struct prefetch_stream *s, SMB_OFF_T start,
+			    struct prefetch_advice *advice)
+{
+	SMB_OFF_T target = MAX(start - s->window, 0);
+
+	if (s->ra_next > start) {
+		s->ra_next = start;
+	}
+	if (s->ra_next - target >= s->window / 2 ||
+	    (target == 0 && s->ra_next > 0)) {
+		add_range(advice, target, s->ra_next - target);
+		s->ra_next = target;
+	}
+}
+
+/*
+ * For a stride larger than the reads, read ahead the individual
+ * records, keeping as many records queued as fit in the window.
+ */
+
+static void advise_strided(struct prefetch_stream *s, SMB_OFF_T offset, size_t count,
+			   struct prefetch_advice *advice)
+{
+	SMB_OFF_T depth = MAX(s->window / (SMB_OFF_T)count, 1);
+	SMB_OFF_T ahead;
+
+	depth = MIN(depth, PREFETCH_MAX_RANGES);
+
+	ahead = (s->ra_next - offset) / s->stride;
+	if (ahead < 1 || (s->ra_next - offset) % s->stride != 0) {
+		s->ra_next = offset + s->stride;
+		ahead = 1;
+	}
+	for (; ahead <= depth && s->ra_next >= 0; ahead++) {
+		add_range(advice, s->ra_next, (SMB_OFF_T)count);
+		s->ra_next += s->stride;
+	}
+}
+
+/*
+ * Once a forward stream is well established, drop what it has left
+ * more than a window behind, so streaming a large file doesn't push
+ * everything else out of the page cache.
+ */
+
+static void drop_behind(struct prefetch_stream *s, const struct prefetch_params *params,
+			SMB_OFF_T offset, struct prefetch_advice *advice)
+{
+	SMB_OFF_T drop_end = offset - s->window;
+
+	if (drop_end - s->dropped >= params->initial_window) {
+		advice->drop.offset = s->dropped;
+		advice->drop.len = drop_end - s->dropped;
+		s->dropped = drop_end;
+	}
+}
+
+void prefetch_observe(struct prefetch_state *state,
+		      const struct prefetch_params *params,
+		      SMB_OFF_T offset, size_t count,
+		      struct prefetch_advice *advice)
+{
+	struct prefetch_stream *s = NULL, *lru = NULL, *near = NULL;
+	SMB_OFF_T stride;
+	int i;
+
+	advice->num_ranges = 0;
+	advice->drop.offset = 0;
+	advice->drop.len = 0;
+
+	if (count == 0) {
+		return;
+	}
+
+	if (++state->clock == 0) {
+		state->clock = 1;
+	}
+
+	for (i = 0; i < PREFETCH_STREAMS; i++) {
+		struct prefetch_stream *t = &state->streams[i];
+
+		if (t->last_used == 0) {
+			if (lru == NULL || lru->last_used != 0) {
+				lru = t;
+			}
+			continue;
+		}
+		if ((t->stride != 0 && offset == t->last_offset + t->stride) ||
+		    offset == t->next_offset) {
+			s = t;
+			break;
+		}
+		if (t->hits == 0 && near == NULL &&
+		    offset != t->last_offset &&
+		    offset > t->last_offset - params->max_window &&
+		    offset < t->last_offset + params->max_window) {
+			near = t;
+		}
+		if (lru == NULL || (lru->last_used != 0 && t->last_used < lru->last_used)) {
+			lru = t;
+		}
+	}
+
+	if (s == NULL) {
+		/* start a new stream. If the read is close to one that
+		   only just started, guess the distance is a stride and
+		   let the next read confirm it; the old stream is kept in
+		   case it was another reader instead. */
+		SMB_OFF_T guess = near ? offset - near->last_offset : 0;
+
+		s = lru;
+		ZERO_STRUCTP(s);
+		s->stride = guess;
+		s->dropped = offset;
+		s->last_offset = offset;
+		s->next_offset = offset + count;
+		s->last_used = state->clock;
+		return;
+	}
+
+	stride = offset - s->last_offset;
+	if (stride == s->stride) {
+		/* the stride repeated, confirming a guessed one */
+		s->hits = s->hits ? s->hits + 1 : 2;
+	} else {
+		s->stride = stride;
+		s->hits = 1;
+		s->window = 0;
+	}
+	s->last_offset = offset;
+	s->next_offset = offset + count;
+	s->last_used = state->clock;
+
+	if (s->window == 0) {
+		s->window = params->initial_window;
+		s->ra_next = stride > 0 ? offset + count : offset;
+	} else {
+		s->window = MIN(s->window * 2, params->max_window);
+	}
+
+	if (!stream_contiguous(s, count)) {
+		/* a stride or a backwards read may be chance once,
+		   don't act on it until it repeats */
+		if (s->hits >= 2) {
+			advise_strided(s, offset, count, advice);
+		}
+		return;
+	}
+
+	if (s->stride > 0) {
+		advise_forward(s, offset + count, advice);
+		if (params->drop_behind) {
+			drop_behind(s, params, offset, advice);
+		}
+	} else if (s->hits >= 2) {
+		advise_backward(s, offset, advice);
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ * Sequential read stream detection for readahead.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+/* how many independent read streams are tracked per open file */
+#define PREFETCH_STREAMS 4
+
+/* most ranges one read can ask to have read ahead */
+#define PREFETCH_MAX_RANGES 16
+
+struct prefetch_params {
+	SMB_OFF_T initial_window;	/* readahead size once a stream is found */
+	SMB_OFF_T max_window;		/* the window doubles up to this */
+	BOOL drop_behind;		/* drop pages a forward stream has passed */
+};
+
+struct prefetch_stream {
+	SMB_OFF_T last_offset;		/* start of the last read */
+	SMB_OFF_T next_offset;		/* end of the last read */
+	SMB_OFF_T stride;		/* distance between reads, < 0 backwards */
+	SMB_OFF_T window;		/* bytes to keep read ahead */
+	SMB_OFF_T ra_next;		/* first offset not yet read ahead */
+	SMB_OFF_T dropped;		/* all below was dropped (forward only) */
+	unsigned int hits;		/* consecutive reads that were predicted */
+	unsigned int last_used;		/* 0 for an unused slot */
+};
+
+struct prefetch_state {
+	struct prefetch_stream streams[PREFETCH_STREAMS];
+	unsigned int clock;
+};
+
+struct prefetch_range {
+	SMB_OFF_T offset;
+	SMB_OFF_T len;
+};
+
+struct prefetch_advice {
+	int num_ranges;			/* ranges to read ahead */
+	struct prefetch_range ranges[PREFETCH_MAX_RANGES];
+	struct prefetch_range drop;	/* len 0 if nothing to drop */
+};
+
+void prefetch_observe(struct prefetch_state *state,
+		      const struct prefetch_params *params,
+		      SMB_OFF_T offset, size_t count,
+		      struct prefetch_advice *advice);
+
+#endif /* _PREFETCH_H */
@@ -173,6 +173,22 @@ static ssize_t commit_pwrite(
         return ret;
 }
 
+static ssize_t commit_pwritev(
+        vfs_handle_struct *     handle,
+        files_struct *          fsp,
+        int                     fd,
+        const struct iovec *    iov,
+        int                     iovcnt,
+	SMB_OFF_T	        offset)
+{
+        ssize_t ret;
+
+        ret = SMB_VFS_NEXT_PWRITEV(handle, fsp, fd, iov, iovcnt, offset);
+        commit(handle, fsp, ret);
+
+        return ret;
+}
+
 static ssize_t commit_close(
         vfs_handle_struct * handle,
         files_struct *      fsp,
@@ -192,6 +208,8 @@ static vfs_op_tuple commit_ops [] =
                 SMB_VFS_OP_WRITE, SMB_VFS_LAYER_TRANSPARENT},
         {SMB_VFS_OP(commit_pwrite),
                 SMB_VFS_OP_PWRITE, SMB_VFS_LAYER_TRANSPARENT},
+        {SMB_VFS_OP(commit_pwritev),
+                SMB_VFS_OP_PWRITEV, SMB_VFS_LAYER_TRANSPARENT},
         {SMB_VFS_OP(commit_connect),
                 SMB_VFS_OP_CONNECT,  SMB_VFS_LAYER_TRANSPARENT},
 
@@ -1601,6 +1601,52 @@ static ssize_t darwin_sys_pwrite(vfs_handle_struct *handle,
 	return sio->pwrite(sio, fd, data, count, offset);
 }
 
+/* Streams have no vectored I/O, so do one buffer at a time. */
+
+static ssize_t darwin_sys_preadv(vfs_handle_struct *handle,
+			files_struct *fsp,
+			int fd, const struct iovec *iov,
+			int iovcnt, SMB_OFF_T offset)
+{
+	ssize_t ret, total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		ret = darwin_sys_pread(handle, fsp, fd, iov[i].iov_base,
+				iov[i].iov_len, offset + total);
+		if (ret == -1) {
+			return total ? total : -1;
+		}
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
+static ssize_t darwin_sys_pwritev(vfs_handle_struct *handle,
+			files_struct *fsp,
+			int fd, const struct iovec *iov,
+			int iovcnt, SMB_OFF_T offset)
+{
+	ssize_t ret, total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		ret = darwin_sys_pwrite(handle, fsp, fd, iov[i].iov_base,
+				iov[i].iov_len, offset + total);
+		if (ret == -1) {
+			return total ? total : -1;
+		}
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
 static int darwin_sys_set_create_time(vfs_handle_struct *handle,
 			const char *path,
 			time_t createtime)
@@ -2086,6 +2132,10 @@ static vfs_op_tuple darwin_streams_ops[] = {
 	    SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(darwin_sys_pwrite), SMB_VFS_OP_PWRITE,
 	    SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(darwin_sys_preadv), SMB_VFS_OP_PREADV,
+	    SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(darwin_sys_pwritev), SMB_VFS_OP_PWRITEV,
+	    SMB_VFS_LAYER_OPAQUE},
 
 	{SMB_VFS_OP(darwin_sys_stat), SMB_VFS_OP_STAT,
 	    SMB_VFS_LAYER_OPAQUE},
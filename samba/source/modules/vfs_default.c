@@ -317,6 +317,83 @@ static ssize_t vfswrap_pwrite(vfs_handle_struct *handle, files_struct *fsp, int
 	return result;
 }
 
+/*
+ * Without preadv/pwritev, or on a pipe, do one segment at a time. As
+ * with a single read or write, a short transfer ends the call.
+ */
+
+static ssize_t vfswrap_preadv(vfs_handle_struct *handle, files_struct *fsp, int fd,
+			const struct iovec *iov, int iovcnt, SMB_OFF_T offset)
+{
+	ssize_t result, total = 0;
+	int i;
+
+#if defined(HAVE_PREADV) || defined(HAVE_PREADV64)
+	size_t n = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		n += iov[i].iov_len;
+	}
+
+	START_PROFILE_BYTES(syscall_pread, n);
+	result = sys_preadv(fd, iov, iovcnt, offset);
+	END_PROFILE(syscall_pread);
+
+	if (result != -1 || errno != ESPIPE) {
+		return result;
+	}
+#endif /* HAVE_PREADV */
+
+	for (i = 0; i < iovcnt; i++) {
+		result = SMB_VFS_PREAD(fsp, fd, iov[i].iov_base,
+				       iov[i].iov_len, offset + total);
+		if (result == -1) {
+			return total ? total : -1;
+		}
+		total += result;
+		if ((size_t)result < iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
+static ssize_t vfswrap_pwritev(vfs_handle_struct *handle, files_struct *fsp, int fd,
+			const struct iovec *iov, int iovcnt, SMB_OFF_T offset)
+{
+	ssize_t result, total = 0;
+	int i;
+
+#if defined(HAVE_PWRITEV) || defined(HAVE_PWRITEV64)
+	size_t n = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		n += iov[i].iov_len;
+	}
+
+	START_PROFILE_BYTES(syscall_pwrite, n);
+	result = sys_pwritev(fd, iov, iovcnt, offset);
+	END_PROFILE(syscall_pwrite);
+
+	if (result != -1 || errno != ESPIPE) {
+		return result;
+	}
+#endif /* HAVE_PWRITEV */
+
+	for (i = 0; i < iovcnt; i++) {
+		result = SMB_VFS_PWRITE(fsp, fd, iov[i].iov_base,
+					iov[i].iov_len, offset + total);
+		if (result == -1) {
+			return total ? total : -1;
+		}
+		total += result;
+		if ((size_t)result < iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
 static SMB_OFF_T vfswrap_lseek(vfs_handle_struct *handle, files_struct *fsp, int filedes, SMB_OFF_T offset, int whence)
 {
 	SMB_OFF_T result = 0;
@@ -1276,6 +1353,10 @@ static vfs_op_tuple vfs_default_ops[] = {
 	 SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(vfswrap_pwrite),	SMB_VFS_OP_PWRITE,
 	 SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(vfswrap_preadv),	SMB_VFS_OP_PREADV,
+	 SMB_VFS_LAYER_OPAQUE},
+	{SMB_VFS_OP(vfswrap_pwritev),	SMB_VFS_OP_PWRITEV,
+	 SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(vfswrap_lseek),	SMB_VFS_OP_LSEEK,
 	 SMB_VFS_LAYER_OPAQUE},
 	{SMB_VFS_OP(vfswrap_sendfile),	SMB_VFS_OP_SENDFILE,
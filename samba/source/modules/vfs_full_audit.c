@@ -122,6 +122,12 @@ static ssize_t smb_full_audit_write(vfs_handle_struct *handle, files_struct *fsp
 static ssize_t smb_full_audit_pwrite(vfs_handle_struct *handle, files_struct *fsp,
 			    int fd, const void *data, size_t n,
 			    SMB_OFF_T offset);
+static ssize_t smb_full_audit_preadv(vfs_handle_struct *handle, files_struct *fsp,
+			    int fd, const struct iovec *iov, int iovcnt,
+			    SMB_OFF_T offset);
+static ssize_t smb_full_audit_pwritev(vfs_handle_struct *handle, files_struct *fsp,
+			     int fd, const struct iovec *iov, int iovcnt,
+			     SMB_OFF_T offset);
 static SMB_OFF_T smb_full_audit_lseek(vfs_handle_struct *handle, files_struct *fsp,
 			     int filedes, SMB_OFF_T offset, int whence);
 static ssize_t smb_full_audit_sendfile(vfs_handle_struct *handle, int tofd,
@@ -358,6 +364,10 @@ static vfs_op_tuple audit_op_tuples[] = {
 	 SMB_VFS_LAYER_LOGGER},
 	{SMB_VFS_OP(smb_full_audit_pwrite),	SMB_VFS_OP_PWRITE,
 	 SMB_VFS_LAYER_LOGGER},
+	{SMB_VFS_OP(smb_full_audit_preadv),	SMB_VFS_OP_PREADV,
+	 SMB_VFS_LAYER_LOGGER},
+	{SMB_VFS_OP(smb_full_audit_pwritev),	SMB_VFS_OP_PWRITEV,
+	 SMB_VFS_LAYER_LOGGER},
 	{SMB_VFS_OP(smb_full_audit_lseek),	SMB_VFS_OP_LSEEK,
 	 SMB_VFS_LAYER_LOGGER},
 	{SMB_VFS_OP(smb_full_audit_sendfile),	SMB_VFS_OP_SENDFILE,
@@ -552,6 +562,8 @@ static struct {
 	{ SMB_VFS_OP_PREAD,	"pread" },
 	{ SMB_VFS_OP_WRITE,	"write" },
 	{ SMB_VFS_OP_PWRITE,	"pwrite" },
+	{ SMB_VFS_OP_PREADV,	"preadv" },
+	{ SMB_VFS_OP_PWRITEV,	"pwritev" },
 	{ SMB_VFS_OP_LSEEK,	"lseek" },
 	{ SMB_VFS_OP_SENDFILE,	"sendfile" },
 	{ SMB_VFS_OP_RENAME,	"rename" },
@@ -1112,6 +1124,32 @@ static ssize_t smb_full_audit_pwrite(vfs_handle_struct *handle, files_struct *fs
 	return result;
 }
 
+static ssize_t smb_full_audit_preadv(vfs_handle_struct *handle, files_struct *fsp,
+			    int fd, const struct iovec *iov, int iovcnt,
+			    SMB_OFF_T offset)
+{
+	ssize_t result;
+
+	result = SMB_VFS_NEXT_PREADV(handle, fsp, fd, iov, iovcnt, offset);
+
+	do_log(SMB_VFS_OP_PREADV, (result >= 0), handle, "%s", fsp->fsp_name);
+
+	return result;
+}
+
+static ssize_t smb_full_audit_pwritev(vfs_handle_struct *handle, files_struct *fsp,
+			     int fd, const struct iovec *iov, int iovcnt,
+			     SMB_OFF_T offset)
+{
+	ssize_t result;
+
+	result = SMB_VFS_NEXT_PWRITEV(handle, fsp, fd, iov, iovcnt, offset);
+
+	do_log(SMB_VFS_OP_PWRITEV, (result >= 0), handle, "%s", fsp->fsp_name);
+
+	return result;
+}
+
 static SMB_OFF_T smb_full_audit_lseek(vfs_handle_struct *handle, files_struct *fsp,
 			     int filedes, SMB_OFF_T offset, int whence)
 {
@@ -0,0 +1,201 @@
+/*
+ * Adaptive readahead for sequential, reverse and strided readers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "includes.h"
+#include "modules/prefetch.h"
+
+/*
+ * Unlike vfs_readahead, which fires on reads at fixed offset
+ * boundaries, this module follows the reads made on each open file
+ * (see prefetch.c) and reads ahead only for the streams it finds, with
+ * a window that grows while the stream keeps going. Optionally pages a
+ * forward stream has left behind are dropped, so one client streaming
+ * a large file doesn't push everything else out of the page cache.
+ *
+ *	prefetch:initial window = 128k	readahead once a stream is found
+ *	prefetch:max window = 4M	the window doubles up to this
+ *	prefetch:drop behind = no	drop pages behind forward streams
+ *	prefetch:debug = 10		debug level for the advice issued
+ */
+
+#define MODULE "prefetch"
+
+struct prefetch_data {
+	struct prefetch_params params;
+	int debug;
+	BOOL didmsg;
+};
+
+static void prefetch_advise(struct vfs_handle_struct *handle, int fd,
+			    SMB_OFF_T offset, SMB_OFF_T len, BOOL drop)
+{
+	struct prefetch_data *pd = (struct prefetch_data *)handle->data;
+	int err;
+
+	if (drop) {
+#if defined(HAVE_POSIX_FADVISE)
+		err = posix_fadvise(fd, offset, (off_t)len, POSIX_FADV_DONTNEED);
+#else
+		err = -1;
+#endif
+	} else {
+		/* posix_fadvise() is portable, readahead(2) is Linux
+		   only. On Linux both start the same readahead. */
+#if defined(HAVE_POSIX_FADVISE)
+		err = posix_fadvise(fd, offset, (off_t)len, POSIX_FADV_WILLNEED);
+#elif defined(HAVE_LINUX_READAHEAD)
+		err = readahead(fd, offset, (size_t)len);
+#else
+		if (!pd->didmsg) {
+			DEBUG(0,(MODULE ": no readahead on this platform\n"));
+			pd->didmsg = True;
+		}
+		return;
+#endif
+	}
+
+	DEBUG(pd->debug,(MODULE ": %s on fd %d, offset %llu, len %llu returned %d\n",
+		drop ? "drop" : "readahead", fd,
+		(unsigned long long)offset, (unsigned long long)len, err));
+}
+
+/*******************************************************************
+ Feed one read to the stream tracker and carry out its advice.
+*******************************************************************/
+
+static void prefetch_read(struct vfs_handle_struct *handle,
+			  files_struct *fsp, int fd,
+			  SMB_OFF_T offset, size_t count)
+{
+	struct prefetch_data *pd = (struct prefetch_data *)handle->data;
+	struct prefetch_state *state;
+	struct prefetch_advice advice;
+	int i;
+
+	state = (struct prefetch_state *)VFS_ADD_FSP_EXTENSION(handle, fsp,
+						struct prefetch_state);
+	if (state == NULL) {
+		return;
+	}
+
+	prefetch_observe(state, &pd->params, offset, count, &advice);
+
+	for (i = 0; i < advice.num_ranges; i++) {
+		prefetch_advise(handle, fd, advice.ranges[i].offset,
+				advice.ranges[i].len, False);
+	}
+	if (advice.drop.len > 0) {
+		prefetch_advise(handle, fd, advice.drop.offset,
+				advice.drop.len, True);
+	}
+}
+
+static ssize_t prefetch_sendfile(struct vfs_handle_struct *handle,
+				 int tofd,
+				 files_struct *fsp,
+				 int fromfd,
+				 const DATA_BLOB *header,
+				 SMB_OFF_T offset,
+				 size_t count)
+{
+	prefetch_read(handle, fsp, fromfd, offset, count);
+	return SMB_VFS_NEXT_SENDFILE(handle, tofd, fsp, fromfd, header,
+				     offset, count);
+}
+
+static ssize_t prefetch_pread(vfs_handle_struct *handle,
+			      files_struct *fsp,
+			      int fd,
+			      void *data,
+			      size_t count,
+			      SMB_OFF_T offset)
+{
+	prefetch_read(handle, fsp, fd, offset, count);
+	return SMB_VFS_NEXT_PREAD(handle, fsp, fd, data, count, offset);
+}
+
+#if defined(WITH_AIO)
+static int prefetch_aio_read(struct vfs_handle_struct *handle,
+			     struct files_struct *fsp,
+			     SMB_STRUCT_AIOCB *aiocb)
+{
+	prefetch_read(handle, fsp, fsp->fh->fd, aiocb->aio_offset,
+		      aiocb->aio_nbytes);
+	return SMB_VFS_NEXT_AIO_READ(handle, fsp, aiocb);
+}
+#endif
+
+static void free_prefetch_data(void **pptr)
+{
+	SAFE_FREE(*pptr);
+}
+
+/*******************************************************************
+ Parse the parameters once per connection rather than per read.
+*******************************************************************/
+
+static int prefetch_connect(struct vfs_handle_struct *handle,
+			    const char *service,
+			    const char *user)
+{
+	struct prefetch_data *pd = SMB_MALLOC_P(struct prefetch_data);
+	int snum = SNUM(handle->conn);
+
+	if (!pd) {
+		DEBUG(0,("prefetch_connect: out of memory\n"));
+		return -1;
+	}
+	ZERO_STRUCTP(pd);
+
+	pd->params.initial_window = conv_str_size(
+		lp_parm_const_string(snum, MODULE, "initial window", NULL));
+	if (pd->params.initial_window <= 0) {
+		pd->params.initial_window = 128 * 1024;
+	}
+	pd->params.max_window = conv_str_size(
+		lp_parm_const_string(snum, MODULE, "max window", NULL));
+	if (pd->params.max_window <= 0) {
+		pd->params.max_window = 4 * 1024 * 1024;
+	}
+	if (pd->params.max_window < pd->params.initial_window) {
+		pd->params.max_window = pd->params.initial_window;
+	}
+	pd->params.drop_behind = lp_parm_bool(snum, MODULE, "drop behind", False);
+	pd->debug = lp_parm_int(snum, MODULE, "debug", 10);
+
+	handle->data = (void *)pd;
+	handle->free_data = free_prefetch_data;
+	return SMB_VFS_NEXT_CONNECT(handle, service, user);
+}
+
+static vfs_op_tuple prefetch_ops [] =
+{
+	{SMB_VFS_OP(prefetch_sendfile), SMB_VFS_OP_SENDFILE, SMB_VFS_LAYER_TRANSPARENT},
+	{SMB_VFS_OP(prefetch_pread), SMB_VFS_OP_PREAD, SMB_VFS_LAYER_TRANSPARENT},
+#if defined(WITH_AIO)
+	{SMB_VFS_OP(prefetch_aio_read), SMB_VFS_OP_AIO_READ, SMB_VFS_LAYER_TRANSPARENT},
+#endif
+	{SMB_VFS_OP(prefetch_connect), SMB_VFS_OP_CONNECT, SMB_VFS_LAYER_TRANSPARENT},
+	{SMB_VFS_OP(NULL), SMB_VFS_OP_NOOP, SMB_VFS_LAYER_NOOP}
+};
+
+NTSTATUS vfs_prefetch_init(void);
+NTSTATUS vfs_prefetch_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION, MODULE, prefetch_ops);
+}
@@ -1099,7 +1099,8 @@ done:
 	return ret;
 }
 
-static NTSTATUS idmap_backends_sids_to_unixids(struct id_map **ids)
+static NTSTATUS idmap_backends_sids_to_unixids(struct id_map **ids,
+					       BOOL allocate)
 {
 	struct id_map ***dom_ids;
 	struct idmap_domain *dom;
@@ -1167,7 +1168,7 @@ static NTSTATUS idmap_backends_sids_to_unixids(struct id_map **ids)
 	/* ok all the backends have been contacted at this point */
 	/* let's see if we have any unmapped SID left and act accordingly */
 
-	for (i = 0; ids[i]; i++) {
+	for (i = 0; allocate && ids[i]; i++) {
 		/* NOTE: this will NOT touch ID_EXPIRED entries that the backend
 		 * was not able to confirm/deny (offline mode) */
 		if (ids[i]->status == ID_UNKNOWN ||
@@ -1312,7 +1313,7 @@ done:
 	return ret;
 }
 
-NTSTATUS idmap_sids_to_unixids(struct id_map **ids)
+static NTSTATUS idmap_sids_to_xids(struct id_map **ids, BOOL allocate)
 {
 	TALLOC_CTX *ctx;
 	NTSTATUS ret;
@@ -1390,11 +1391,21 @@ NTSTATUS idmap_sids_to_unixids(struct id_map **ids)
 	 * from the backends */
 	if (bids) {
 
-		ret = idmap_backends_sids_to_unixids(bids);
+		ret = idmap_backends_sids_to_unixids(bids, allocate);
 		IDMAP_CHECK_RET(ret);
 
 		/* update the cache */
 		for (i = 0; bids[i]; i++) {
+			if (!allocate &&
+			    (bids[i]->status != ID_MAPPED ||
+			     (bids[i]->xid.type != ID_TYPE_UID &&
+			      bids[i]->xid.type != ID_TYPE_GID))) {
+				/* we did not try to allocate, so don't
+				 * cache a negative answer; and a backend
+				 * that can't tell the type only guessed */
+				bids[i]->status = ID_UNMAPPED;
+				continue;
+			}
 			if (bids[i]->status == ID_MAPPED) {
 				ret = idmap_cache_set(idmap_cache, bids[i]);
 			} else if (bids[i]->status == ID_EXPIRED) {
@@ -1424,6 +1435,28 @@ done:
 	return ret;
 }
 
+NTSTATUS idmap_sids_to_unixids(struct id_map **ids)
+{
+	return idmap_sids_to_xids(ids, True);
+}
+
+/**************************************************************************
+ Like idmap_sids_to_unixids(), but only report mappings that already
+ exist. The SIDs are not validated, so no new ids are allocated and the
+ ids[]->xid.type given is ignored; the caller has to go through the
+ single SID calls for whatever is left unmapped.
+**************************************************************************/
+
+NTSTATUS idmap_sids_to_known_unixids(struct id_map **ids)
+{
+	int i;
+
+	for (i = 0; ids && ids[i]; i++) {
+		ids[i]->xid.type = ID_TYPE_NOT_SPECIFIED;
+	}
+	return idmap_sids_to_xids(ids, False);
+}
+
 NTSTATUS idmap_set_mapping(const struct id_map *id)
 {
 	TALLOC_CTX *ctx;
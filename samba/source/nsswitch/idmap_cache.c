@@ -1,4 +1,4 @@
-/* 
+/*
    Unix SMB/CIFS implementation.
    ID Mapping Cache
 
@@ -24,9 +24,33 @@
 #include "includes.h"
 #include "winbindd.h"
 
-#define TIMEOUT_LEN 12
-#define IDMAP_CACHE_DATA_FMT	"%12u/%s"
-#define IDMAP_READ_CACHE_DATA_FMT_TEMPLATE "%%12u/%%%us"
+/*
+ * The cache holds two kinds of records, keyed by a tag byte and the
+ * binary SID or id, so that a lookup needs no allocation and no
+ * string conversion:
+ *
+ *	'S' + linearized SID		-> uid or gid
+ *	'U' or 'G' + 32 bit id		-> SID
+ *
+ * A value is a IDMAP_CACHE_HDR_LEN byte header holding the timeout as
+ * 64 bit number and the kind of the value, followed by the id as 32 bit
+ * number or the linearized SID. All numbers are little endian. The tdb
+ * is read through tdb_parse_record(), straight from the mmap.
+ */
+
+#define IDMAP_CACHE_HDR_LEN	12
+#define IDMAP_CACHE_KEY_LEN	(1 + 8 + 4 * MAXSUBAUTHS)
+
+#define IDMAP_CACHE_SID		'S'
+#define IDMAP_CACHE_UID		'U'
+#define IDMAP_CACHE_GID		'G'
+#define IDMAP_CACHE_NEGATIVE	'N'
+
+/* The cache is dropped when it was written in another format */
+#define IDMAP_CACHE_VERSION_KEY	"IDMAP_CACHE_VERSION"
+#define IDMAP_CACHE_VERSION	2
+
+#define IDMAP_CACHE_HASH_SIZE	10007
 
 struct idmap_cache_ctx {
 	TDB_CONTEXT *tdb;
@@ -44,10 +68,69 @@ static int idmap_cache_destructor(struct idmap_cache_ctx *cache)
 	return ret;
 }
 
+/*
+ * tdb can not grow its hash table, so a cache in the old format is
+ * not emptied but replaced by a new file. Whoever holds the lock on the
+ * old file does the work, the others find the new file afterwards.
+ */
+
+static BOOL idmap_cache_replace(TDB_CONTEXT *tdb, const char *fname)
+{
+	SMB_STRUCT_STAT st_path, st_tdb;
+	TDB_CONTEXT *new_tdb;
+	pstring tmp;
+	BOOL ret = False;
+
+	if (tdb_lockall(tdb) != 0) {
+		return False;
+	}
+
+	if ((sys_stat(fname, &st_path) != 0) ||
+	    (sys_fstat(tdb_fd(tdb), &st_tdb) != 0) ||
+	    (st_path.st_dev != st_tdb.st_dev) ||
+	    (st_path.st_ino != st_tdb.st_ino)) {
+		/* somebody else has replaced it already */
+		tdb_unlockall(tdb);
+		return True;
+	}
+
+	DEBUG(3, ("Replacing idmap cache %s in old format\n", fname));
+
+	pstr_sprintf(tmp, "%s.%u", fname, (unsigned int)sys_getpid());
+	unlink(tmp);
+
+	new_tdb = tdb_open_log(tmp, IDMAP_CACHE_HASH_SIZE, TDB_DEFAULT,
+			       O_RDWR|O_CREAT|O_EXCL, 0600);
+	if (new_tdb == NULL) {
+		DEBUG(1, ("Could not create %s\n", tmp));
+		goto done;
+	}
+	if (tdb_store_int32(new_tdb, IDMAP_CACHE_VERSION_KEY,
+			    IDMAP_CACHE_VERSION) != 0) {
+		tdb_close(new_tdb);
+		unlink(tmp);
+		goto done;
+	}
+	tdb_close(new_tdb);
+
+	if (rename(tmp, fname) != 0) {
+		DEBUG(1, ("Could not rename %s to %s: %s\n", tmp, fname,
+			  strerror(errno)));
+		unlink(tmp);
+		goto done;
+	}
+	ret = True;
+
+ done:
+	tdb_unlockall(tdb);
+	return ret;
+}
+
 struct idmap_cache_ctx *idmap_cache_init(TALLOC_CTX *memctx)
 {
 	struct idmap_cache_ctx *cache;
 	char* cache_fname = NULL;
+	int tries;
 
 	cache = talloc(memctx, struct idmap_cache_ctx);
 	if ( ! cache) {
@@ -57,18 +140,44 @@ struct idmap_cache_ctx *idmap_cache_init(TALLOC_CTX *memctx)
 
 	cache_fname = lock_path("idmap_cache.tdb");
 
-	DEBUG(10, ("Opening cache file at %s\n", cache_fname));
+	for (tries = 0; tries < 3; tries++) {
 
-	cache->tdb = tdb_open_log(cache_fname, 0, TDB_DEFAULT, O_RDWR|O_CREAT, 0600);
+		DEBUG(10, ("Opening cache file at %s\n", cache_fname));
 
-	if (!cache->tdb) {
-		DEBUG(5, ("Attempt to open %s has failed.\n", cache_fname));
-		return NULL;
-	}
+		cache->tdb = tdb_open_log(cache_fname, IDMAP_CACHE_HASH_SIZE,
+					  TDB_DEFAULT, O_RDWR|O_CREAT, 0600);
+
+		if (!cache->tdb) {
+			DEBUG(5, ("Attempt to open %s has failed.\n", cache_fname));
+			return NULL;
+		}
+
+		/* A file we have just created is marked as ours, one in
+		   the old format is replaced */
 
-	talloc_set_destructor(cache, idmap_cache_destructor);
+		if ((tdb_fetch_int32(cache->tdb, IDMAP_CACHE_VERSION_KEY) ==
+		     IDMAP_CACHE_VERSION) ||
+		    ((tdb_hash_size(cache->tdb) == IDMAP_CACHE_HASH_SIZE) &&
+		     (tdb_store_int32(cache->tdb, IDMAP_CACHE_VERSION_KEY,
+				      IDMAP_CACHE_VERSION) == 0))) {
+			talloc_set_destructor(cache, idmap_cache_destructor);
+			return cache;
+		}
+
+		if (!idmap_cache_replace(cache->tdb, cache_fname)) {
+			break;
+		}
 
-	return cache;
+		tdb_close(cache->tdb);
+		cache->tdb = NULL;
+	}
+
+	DEBUG(1, ("Could not set up the idmap cache in %s\n", cache_fname));
+	if (cache->tdb) {
+		tdb_close(cache->tdb);
+	}
+	TALLOC_FREE(cache);
+	return NULL;
 }
 
 void idmap_cache_shutdown(struct idmap_cache_ctx *cache)
@@ -76,25 +185,86 @@ void idmap_cache_shutdown(struct idmap_cache_ctx *cache)
 	talloc_free(cache);
 }
 
-NTSTATUS idmap_cache_build_sidkey(TALLOC_CTX *ctx, char **sidkey, const struct id_map *id)
+/* Build the keys in a buffer of IDMAP_CACHE_KEY_LEN bytes */
+
+static TDB_DATA idmap_cache_sidkey(char *buf, const struct id_map *id)
 {
-	*sidkey = talloc_asprintf(ctx, "IDMAP/SID/%s", sid_string_static(id->sid));
-	if ( ! *sidkey) {
-		DEBUG(1, ("failed to build sidkey, OOM?\n"));
-		return NT_STATUS_NO_MEMORY;
-	}
+	TDB_DATA key;
 
-	return NT_STATUS_OK;
+	buf[0] = IDMAP_CACHE_SID;
+	sid_linearize(buf + 1, IDMAP_CACHE_KEY_LEN - 1, id->sid);
+
+	key.dptr = buf;
+	key.dsize = 1 + sid_size(id->sid);
+	return key;
+}
+
+static TDB_DATA idmap_cache_idkey(char *buf, const struct id_map *id)
+{
+	TDB_DATA key;
+
+	buf[0] = (id->xid.type == ID_TYPE_UID) ?
+		IDMAP_CACHE_UID : IDMAP_CACHE_GID;
+	SIVAL(buf, 1, id->xid.id);
+
+	key.dptr = buf;
+	key.dsize = 5;
+	return key;
+}
+
+static const char *idmap_cache_keystr(TDB_DATA key)
+{
+	static fstring keystr;
+	DOM_SID sid;
+
+	if ((key.dptr[0] == IDMAP_CACHE_SID) &&
+	    sid_parse(key.dptr + 1, key.dsize - 1, &sid)) {
+		fstr_sprintf(keystr, "SID/%s", sid_string_static(&sid));
+	} else {
+		fstr_sprintf(keystr, "%s/%u",
+			     (key.dptr[0] == IDMAP_CACHE_UID) ? "UID" : "GID",
+			     (unsigned int)IVAL(key.dptr, 1));
+	}
+	return keystr;
 }
 
-NTSTATUS idmap_cache_build_idkey(TALLOC_CTX *ctx, char **idkey, const struct id_map *id)
+static NTSTATUS idmap_cache_store(struct idmap_cache_ctx *cache, TDB_DATA key,
+				  time_t timeout, char kind,
+				  const struct id_map *id)
 {
-	*idkey = talloc_asprintf(ctx, "IDMAP/%s/%lu",
-				(id->xid.type==ID_TYPE_UID)?"UID":"GID",
-				(unsigned long)id->xid.id);
-	if ( ! *idkey) {
-		DEBUG(1, ("failed to build idkey, OOM?\n"));
-		return NT_STATUS_NO_MEMORY;
+	char buf[IDMAP_CACHE_HDR_LEN + 8 + 4 * MAXSUBAUTHS];
+	SMB_BIG_UINT t = (SMB_BIG_UINT)(SMB_BIG_INT)timeout;
+	TDB_DATA databuf;
+
+	memset(buf, 0, IDMAP_CACHE_HDR_LEN);
+	SIVAL(buf, 0, t & 0xffffffff);
+	SIVAL(buf, 4, t >> 32);
+	SCVAL(buf, 8, kind);
+
+	databuf.dptr = buf;
+	databuf.dsize = IDMAP_CACHE_HDR_LEN;
+
+	switch (kind) {
+	case IDMAP_CACHE_UID:
+	case IDMAP_CACHE_GID:
+		SIVAL(buf, IDMAP_CACHE_HDR_LEN, id->xid.id);
+		databuf.dsize += 4;
+		break;
+	case IDMAP_CACHE_SID:
+		sid_linearize(buf + IDMAP_CACHE_HDR_LEN,
+			      sizeof(buf) - IDMAP_CACHE_HDR_LEN, id->sid);
+		databuf.dsize += sid_size(id->sid);
+		break;
+	}
+
+	DEBUG(10, ("Adding cache entry with key = %s; kind = %c and timeout ="
+	           " %s (%d seconds %s)\n", idmap_cache_keystr(key), kind,
+		   ctime(&timeout), (int)(timeout - time(NULL)),
+		   timeout > time(NULL) ? "ahead" : "in the past"));
+
+	if (tdb_store(cache->tdb, key, databuf, TDB_REPLACE) != 0) {
+		DEBUG(3, ("Failed to store cache entry!\n"));
+		return NT_STATUS_UNSUCCESSFUL;
 	}
 
 	return NT_STATUS_OK;
@@ -104,110 +274,47 @@ NTSTATUS idmap_cache_set(struct idmap_cache_ctx *cache, const struct id_map *id)
 {
 	NTSTATUS ret;
 	time_t timeout = time(NULL) + lp_idmap_cache_time();
-	TDB_DATA keybuf, databuf;
-	char *sidkey;
-	char *idkey;
-	char *valstr;
+	char sidkey[IDMAP_CACHE_KEY_LEN];
+	char idkey[IDMAP_CACHE_KEY_LEN];
 
 	/* Don't cache lookups in the S-1-22-{1,2} domain */
-	if ( (id->xid.type == ID_TYPE_UID) && 
+	if ( (id->xid.type == ID_TYPE_UID) &&
 	     sid_check_is_in_unix_users(id->sid) )
 	{
 		return NT_STATUS_OK;
 	}
-	if ( (id->xid.type == ID_TYPE_GID) && 
+	if ( (id->xid.type == ID_TYPE_GID) &&
 	     sid_check_is_in_unix_groups(id->sid) )
 	{
 		return NT_STATUS_OK;
 	}
-	
-
-	ret = idmap_cache_build_sidkey(cache, &sidkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
-
-	/* use sidkey as the local memory ctx */
-	ret = idmap_cache_build_idkey(sidkey, &idkey, id);
-	if (!NT_STATUS_IS_OK(ret)) {
-		goto done;
-	}
 
 	/* save SID -> ID */
 
-	/* use sidkey as the local memory ctx */
-	valstr = talloc_asprintf(sidkey, IDMAP_CACHE_DATA_FMT, (int)timeout, idkey);
-	if (!valstr) {
-		DEBUG(0, ("Out of memory!\n"));
-		ret = NT_STATUS_NO_MEMORY;
-		goto done;
-	}
-
-	keybuf.dptr = sidkey;
-	keybuf.dsize = strlen(sidkey)+1;
-	databuf.dptr = valstr;
-	databuf.dsize = strlen(valstr)+1;
-	DEBUG(10, ("Adding cache entry with key = %s; value = %s and timeout ="
-	           " %s (%d seconds %s)\n", keybuf.dptr, valstr , ctime(&timeout),
-		   (int)(timeout - time(NULL)), 
-		   timeout > time(NULL) ? "ahead" : "in the past"));
-
-	if (tdb_store(cache->tdb, keybuf, databuf, TDB_REPLACE) != 0) {
-		DEBUG(3, ("Failed to store cache entry!\n"));
-		ret = NT_STATUS_UNSUCCESSFUL;
-		goto done;
+	ret = idmap_cache_store(cache, idmap_cache_sidkey(sidkey, id), timeout,
+				(id->xid.type == ID_TYPE_UID) ?
+				IDMAP_CACHE_UID : IDMAP_CACHE_GID, id);
+	if (!NT_STATUS_IS_OK(ret)) {
+		return ret;
 	}
 
 	/* save ID -> SID */
 
-	/* use sidkey as the local memory ctx */
-	valstr = talloc_asprintf(sidkey, IDMAP_CACHE_DATA_FMT, (int)timeout, sidkey);
-	if (!valstr) {
-		DEBUG(0, ("Out of memory!\n"));
-		ret = NT_STATUS_NO_MEMORY;
-		goto done;
-	}
-
-	keybuf.dptr = idkey;
-	keybuf.dsize = strlen(idkey)+1;
-	databuf.dptr = valstr;
-	databuf.dsize = strlen(valstr)+1;
-	DEBUG(10, ("Adding cache entry with key = %s; value = %s and timeout ="
-	           " %s (%d seconds %s)\n", keybuf.dptr, valstr, ctime(&timeout),
-		   (int)(timeout - time(NULL)), 
-		   timeout > time(NULL) ? "ahead" : "in the past"));
-
-	if (tdb_store(cache->tdb, keybuf, databuf, TDB_REPLACE) != 0) {
-		DEBUG(3, ("Failed to store cache entry!\n"));
-		ret = NT_STATUS_UNSUCCESSFUL;
-		goto done;
-	}
-
-	ret = NT_STATUS_OK;
-
-done:
-	talloc_free(sidkey);
-	return ret;
+	return idmap_cache_store(cache, idmap_cache_idkey(idkey, id), timeout,
+				 IDMAP_CACHE_SID, id);
 }
 
 NTSTATUS idmap_cache_del(struct idmap_cache_ctx *cache, const struct id_map *id)
 {
-	NTSTATUS ret;
+	char sidkey[IDMAP_CACHE_KEY_LEN];
+	char idkey[IDMAP_CACHE_KEY_LEN];
 	TDB_DATA keybuf;
-	char *sidkey = NULL;
-	char *idkey = NULL;
-
-	ret = idmap_cache_build_sidkey(cache, &sidkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
-
-	ret = idmap_cache_build_idkey(cache, &idkey, id);
-	if (!NT_STATUS_IS_OK(ret)) {
-		goto done;
-	}
 
 	/* delete SID */
 
-	keybuf.dptr = sidkey;
-	keybuf.dsize = strlen(sidkey)+1;
-	DEBUG(10, ("Deleting cache entry (key = %s)\n", keybuf.dptr));
+	keybuf = idmap_cache_sidkey(sidkey, id);
+	DEBUG(10, ("Deleting cache entry (key = %s)\n",
+		   idmap_cache_keystr(keybuf)));
 
 	if (tdb_delete(cache->tdb, keybuf) != 0) {
 		DEBUG(3, ("Failed to delete cache entry!\n"));
@@ -215,152 +322,154 @@ NTSTATUS idmap_cache_del(struct idmap_cache_ctx *cache, const struct id_map *id)
 
 	/* delete ID */
 
-	keybuf.dptr = idkey;
-	keybuf.dsize = strlen(idkey)+1;
-	DEBUG(10, ("Deleting cache entry (key = %s)\n", keybuf.dptr));
+	keybuf = idmap_cache_idkey(idkey, id);
+	DEBUG(10, ("Deleting cache entry (key = %s)\n",
+		   idmap_cache_keystr(keybuf)));
 
 	if (tdb_delete(cache->tdb, keybuf) != 0) {
 		DEBUG(3, ("Failed to delete cache entry!\n"));
 	}
 
-done:
-	talloc_free(sidkey);
-	talloc_free(idkey);
-	return ret;
+	return NT_STATUS_OK;
 }
 
 NTSTATUS idmap_cache_set_negative_sid(struct idmap_cache_ctx *cache, const struct id_map *id)
 {
-	NTSTATUS ret;
 	time_t timeout = time(NULL) + lp_idmap_negative_cache_time();
-	TDB_DATA keybuf, databuf;
-	char *sidkey;
-	char *valstr;
+	char sidkey[IDMAP_CACHE_KEY_LEN];
 
-	ret = idmap_cache_build_sidkey(cache, &sidkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
+	return idmap_cache_store(cache, idmap_cache_sidkey(sidkey, id),
+				 timeout, IDMAP_CACHE_NEGATIVE, id);
+}
 
-	/* use sidkey as the local memory ctx */
-	valstr = talloc_asprintf(sidkey, IDMAP_CACHE_DATA_FMT, (int)timeout, "IDMAP/NEGATIVE");
-	if (!valstr) {
-		DEBUG(0, ("Out of memory!\n"));
-		ret = NT_STATUS_NO_MEMORY;
-		goto done;
-	}
+NTSTATUS idmap_cache_set_negative_id(struct idmap_cache_ctx *cache, const struct id_map *id)
+{
+	time_t timeout = time(NULL) + lp_idmap_negative_cache_time();
+	char idkey[IDMAP_CACHE_KEY_LEN];
 
-	keybuf.dptr = sidkey;
-	keybuf.dsize = strlen(sidkey)+1;
-	databuf.dptr = valstr;
-	databuf.dsize = strlen(valstr)+1;
-	DEBUG(10, ("Adding cache entry with key = %s; value = %s and timeout ="
-	           " %s (%d seconds %s)\n", keybuf.dptr, valstr, ctime(&timeout),
-		   (int)(timeout - time(NULL)), 
-		   timeout > time(NULL) ? "ahead" : "in the past"));
+	return idmap_cache_store(cache, idmap_cache_idkey(idkey, id),
+				 timeout, IDMAP_CACHE_NEGATIVE, id);
+}
 
-	if (tdb_store(cache->tdb, keybuf, databuf, TDB_REPLACE) != 0) {
-		DEBUG(3, ("Failed to store cache entry!\n"));
-		ret = NT_STATUS_UNSUCCESSFUL;
-		goto done;
-	}
+/* What tdb_parse_record() hands to idmap_cache_parse() and gets back */
 
-done:
-	talloc_free(sidkey);
-	return ret;
-}
+struct idmap_cache_lookup {
+	struct id_map *id;
+	time_t timeout;
+	char kind;
+	BOOL found;
+	BOOL valid;
+};
 
-NTSTATUS idmap_cache_set_negative_id(struct idmap_cache_ctx *cache, const struct id_map *id)
+static int idmap_cache_parse(TDB_DATA key, TDB_DATA data, void *private_data)
 {
-	NTSTATUS ret;
-	time_t timeout = time(NULL) + lp_idmap_negative_cache_time();
-	TDB_DATA keybuf, databuf;
-	char *idkey;
-	char *valstr;
+	struct idmap_cache_lookup *state =
+		(struct idmap_cache_lookup *)private_data;
+	SMB_BIG_UINT t;
 
-	ret = idmap_cache_build_idkey(cache, &idkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
+	state->found = True;
 
-	/* use idkey as the local memory ctx */
-	valstr = talloc_asprintf(idkey, IDMAP_CACHE_DATA_FMT, (int)timeout, "IDMAP/NEGATIVE");
-	if (!valstr) {
-		DEBUG(0, ("Out of memory!\n"));
-		ret = NT_STATUS_NO_MEMORY;
-		goto done;
+	if (data.dsize < IDMAP_CACHE_HDR_LEN) {
+		return 0;
 	}
 
-	keybuf.dptr = idkey;
-	keybuf.dsize = strlen(idkey)+1;
-	databuf.dptr = valstr;
-	databuf.dsize = strlen(valstr)+1;
-	DEBUG(10, ("Adding cache entry with key = %s; value = %s and timeout ="
-	           " %s (%d seconds %s)\n", keybuf.dptr, valstr, ctime(&timeout),
-		   (int)(timeout - time(NULL)), 
-		   timeout > time(NULL) ? "ahead" : "in the past"));
+	t = ((SMB_BIG_UINT)IVAL(data.dptr, 4) << 32) | IVAL(data.dptr, 0);
+	state->timeout = (time_t)(SMB_BIG_INT)t;
+	state->kind = CVAL(data.dptr, 8);
 
-	if (tdb_store(cache->tdb, keybuf, databuf, TDB_REPLACE) != 0) {
-		DEBUG(3, ("Failed to store cache entry!\n"));
-		ret = NT_STATUS_UNSUCCESSFUL;
-		goto done;
+	data.dptr += IDMAP_CACHE_HDR_LEN;
+	data.dsize -= IDMAP_CACHE_HDR_LEN;
+
+	switch (state->kind) {
+	case IDMAP_CACHE_UID:
+	case IDMAP_CACHE_GID:
+		if ((key.dptr[0] != IDMAP_CACHE_SID) || (data.dsize != 4)) {
+			return 0;
+		}
+		state->id->xid.type = (state->kind == IDMAP_CACHE_UID) ?
+			ID_TYPE_UID : ID_TYPE_GID;
+		state->id->xid.id = IVAL(data.dptr, 0);
+		break;
+	case IDMAP_CACHE_SID:
+		if ((key.dptr[0] == IDMAP_CACHE_SID) ||
+		    !sid_parse(data.dptr, data.dsize, state->id->sid)) {
+			return 0;
+		}
+		break;
+	case IDMAP_CACHE_NEGATIVE:
+		break;
+	default:
+		return 0;
 	}
 
-done:
-	talloc_free(idkey);
-	return ret;
+	state->valid = True;
+	return 0;
 }
 
-NTSTATUS idmap_cache_fill_map(struct id_map *id, const char *value)
+/*
+ * Look up one record, the 4 cases are described at
+ * idmap_cache_map_sid().
+ */
+
+static NTSTATUS idmap_cache_lookup(struct idmap_cache_ctx *cache,
+				   TDB_DATA keybuf, struct id_map *id)
 {
-	char *rem;
+	struct idmap_cache_lookup state;
+	time_t now;
 
-	/* see if it is a sid */
-	if ( ! strncmp("IDMAP/SID/", value, 10)) {
-		
-		if ( ! string_to_sid(id->sid, &value[10])) {
-			goto failed;
-		}
-		
-		id->status = ID_MAPPED;
+	/* make sure it is marked as unknown by default */
+	id->status = ID_UNKNOWN;
 
-		return NT_STATUS_OK;
-	}
+	ZERO_STRUCT(state);
+	state.id = id;
 
-	/* not a SID see if it is an UID or a GID */
-	if ( ! strncmp("IDMAP/UID/", value, 10)) {
-		
-		/* a uid */
-		id->xid.type = ID_TYPE_UID;
-		
-	} else if ( ! strncmp("IDMAP/GID/", value, 10)) {
-		
-		/* a gid */
-		id->xid.type = ID_TYPE_GID;
-		
-	} else {
-		
-		/* a completely bogus value bail out */
-		goto failed;
+	tdb_parse_record(cache->tdb, keybuf, idmap_cache_parse, &state);
+
+	if (!state.found) {
+		DEBUG(10, ("Cache entry with key = %s couldn't be found\n",
+			   idmap_cache_keystr(keybuf)));
+		return NT_STATUS_NONE_MAPPED;
 	}
-	
-	id->xid.id = strtol(&value[10], &rem, 0);
-	if (*rem != '\0') {
-		goto failed;
+
+	if (!state.valid) {
+		DEBUG(2, ("Invalid idmap cache entry with key = %s\n",
+			  idmap_cache_keystr(keybuf)));
+		/* remove the entry */
+		tdb_delete(cache->tdb, keybuf);
+		id->status = ID_UNKNOWN;
+		return NT_STATUS_NONE_MAPPED;
 	}
 
-	id->status = ID_MAPPED;
+	now = time(NULL);
 
-	return NT_STATUS_OK;
+	DEBUG(10, ("Returning %s cache entry: key = %s, kind = %c, "
+		   "timeout = %s", state.timeout > now ? "valid" : "expired",
+		   idmap_cache_keystr(keybuf), state.kind,
+		   ctime(&state.timeout)));
 
-failed:
-	DEBUG(1, ("invalid value: %s\n", value));
-	id->status = ID_UNKNOWN;
-	return NT_STATUS_INTERNAL_DB_CORRUPTION;
-}
+	if (state.kind == IDMAP_CACHE_NEGATIVE) {
+		if (state.timeout <= now) {
+			/* We're expired, delete the NEGATIVE entry and return
+			   not mapped */
+			tdb_delete(cache->tdb, keybuf);
+			return NT_STATUS_NONE_MAPPED;
+		}
+		/* this is not mapped as it was a negative cache hit */
+		id->status = ID_UNMAPPED;
+		return NT_STATUS_OK;
+	}
 
-BOOL idmap_cache_is_negative(const char *val)
-{
-	if ( ! strcmp("IDMAP/NEGATIVE", val)) {
-		return True;
+	if (state.timeout <= now) {
+		/* we have it, but it is expired */
+		id->status = ID_EXPIRED;
+
+		/* We're expired, set an error code
+		   for upper layer */
+		return NT_STATUS_SYNCHRONIZATION_REQUIRED;
 	}
-	return False;
+
+	id->status = ID_MAPPED;
+	return NT_STATUS_OK;
 }
 
 /* search the cahce for the SID an return a mapping if found *
@@ -380,85 +489,9 @@ BOOL idmap_cache_is_negative(const char *val)
 
 NTSTATUS idmap_cache_map_sid(struct idmap_cache_ctx *cache, struct id_map *id)
 {
-	NTSTATUS ret;
-	TDB_DATA keybuf, databuf;
-	time_t t, now;
-	char *sidkey;
-	char *endptr;
-
-	/* make sure it is marked as unknown by default */
-	id->status = ID_UNKNOWN;
-	
-	ret = idmap_cache_build_sidkey(cache, &sidkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
-
-	keybuf.dptr = sidkey;
-	keybuf.dsize = strlen(sidkey)+1;
-
-	databuf = tdb_fetch(cache->tdb, keybuf);
-
-	if (databuf.dptr == NULL) {
-		DEBUG(10, ("Cache entry with key = %s couldn't be found\n", sidkey));
-		ret = NT_STATUS_NONE_MAPPED;
-		goto done;
-	}
-
-	t = strtol(databuf.dptr, &endptr, 10);
+	char sidkey[IDMAP_CACHE_KEY_LEN];
 
-	if ((endptr == NULL) || (*endptr != '/')) {
-		DEBUG(2, ("Invalid gencache data format: %s\n", databuf.dptr));
-		/* remove the entry */
-		tdb_delete(cache->tdb, keybuf);
-		ret = NT_STATUS_NONE_MAPPED;
-		goto done;
-	}
-
-	now = time(NULL);
-
-	/* check it is not negative */
-	if (strcmp("IDMAP/NEGATIVE", endptr+1) != 0) {
-
-		DEBUG(10, ("Returning %s cache entry: key = %s, value = %s, "
-			   "timeout = %s", t > now ? "valid" :
-			   "expired", sidkey, endptr+1, ctime(&t)));
-
-		/* this call if successful will also mark the entry as mapped */
-		ret = idmap_cache_fill_map(id, endptr+1);
-		if ( ! NT_STATUS_IS_OK(ret)) {
-			/* if not valid form delete the entry */
-			tdb_delete(cache->tdb, keybuf);
-			ret = NT_STATUS_NONE_MAPPED;
-			goto done;
-		}
-
-		/* here ret == NT_STATUS_OK and id->status = ID_MAPPED */
-
-		if (t <= now) {
-	
-			/* we have it, but it is expired */
-			id->status = ID_EXPIRED;
-				
-			/* We're expired, set an error code
-			   for upper layer */
-			ret = NT_STATUS_SYNCHRONIZATION_REQUIRED;
-		}
-	} else {
-		if (t <= now) {
-			/* We're expired, delete the NEGATIVE entry and return
-			   not mapped */
-			tdb_delete(cache->tdb, keybuf);
-			ret = NT_STATUS_NONE_MAPPED;
-		} else {
-			/* this is not mapped as it was a negative cache hit */
-			id->status = ID_UNMAPPED;
-			ret = NT_STATUS_OK;
-		}
-	}
-	
-done:
-	SAFE_FREE(databuf.dptr);
-	talloc_free(sidkey);
-	return ret;
+	return idmap_cache_lookup(cache, idmap_cache_sidkey(sidkey, id), id);
 }
 
 /* search the cahce for the ID an return a mapping if found *
@@ -478,83 +511,7 @@ done:
 
 NTSTATUS idmap_cache_map_id(struct idmap_cache_ctx *cache, struct id_map *id)
 {
-	NTSTATUS ret;
-	TDB_DATA keybuf, databuf;
-	time_t t, now;
-	char *idkey;
-	char *endptr;
-
-	/* make sure it is marked as unknown by default */
-	id->status = ID_UNKNOWN;
-	
-	ret = idmap_cache_build_idkey(cache, &idkey, id);
-	if (!NT_STATUS_IS_OK(ret)) return ret;
-
-	keybuf.dptr = idkey;
-	keybuf.dsize = strlen(idkey)+1;
-
-	databuf = tdb_fetch(cache->tdb, keybuf);
+	char idkey[IDMAP_CACHE_KEY_LEN];
 
-	if (databuf.dptr == NULL) {
-		DEBUG(10, ("Cache entry with key = %s couldn't be found\n", idkey));
-		ret = NT_STATUS_NONE_MAPPED;
-		goto done;
-	}
-
-	t = strtol(databuf.dptr, &endptr, 10);
-
-	if ((endptr == NULL) || (*endptr != '/')) {
-		DEBUG(2, ("Invalid gencache data format: %s\n", databuf.dptr));
-		/* remove the entry */
-		tdb_delete(cache->tdb, keybuf);
-		ret = NT_STATUS_NONE_MAPPED;
-		goto done;
-	}
-
-	now = time(NULL);
-
-	/* check it is not negative */
-	if (strcmp("IDMAP/NEGATIVE", endptr+1) != 0) {
-		
-		DEBUG(10, ("Returning %s cache entry: key = %s, value = %s, "
-			   "timeout = %s", t > now ? "valid" :
-			   "expired", idkey, endptr+1, ctime(&t)));
-
-		/* this call if successful will also mark the entry as mapped */
-		ret = idmap_cache_fill_map(id, endptr+1);
-		if ( ! NT_STATUS_IS_OK(ret)) {
-			/* if not valid form delete the entry */
-			tdb_delete(cache->tdb, keybuf);
-			ret = NT_STATUS_NONE_MAPPED;
-			goto done;
-		}
-
-		/* here ret == NT_STATUS_OK and id->mapped = ID_MAPPED */
-
-		if (t <= now) {
-
-			/* we have it, but it is expired */
-			id->status = ID_EXPIRED;
-
-			/* We're expired, set an error code
-			   for upper layer */
-			ret = NT_STATUS_SYNCHRONIZATION_REQUIRED;
-		}
-	} else {
-		if (t <= now) {
-			/* We're expired, delete the NEGATIVE entry and return
-			   not mapped */
-			tdb_delete(cache->tdb, keybuf);
-			ret = NT_STATUS_NONE_MAPPED;
-		} else {
-			/* this is not mapped as it was a negative cache hit */
-			id->status = ID_UNMAPPED;
-			ret = NT_STATUS_OK;
-		}
-	}
-done:
-	SAFE_FREE(databuf.dptr);
-	talloc_free(idkey);
-	return ret;
+	return idmap_cache_lookup(cache, idmap_cache_idkey(idkey, id), id);
 }
-
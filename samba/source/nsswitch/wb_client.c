@@ -362,7 +362,9 @@ BOOL winbind_gid_to_sid(DOM_SID *sid, gid_t gid)
 	return (result == NSS_STATUS_SUCCESS);
 }
 
-/* Call winbindd to convert SID to uid */
+/* Call winbindd to convert a list of SIDs to unix ids. winbindd only
+   reports the mappings it already has, the others are ID_UNMAPPED and
+   need a winbind_sid_to_[ug]id() each. */
 
 BOOL winbind_sids_to_unixids(struct id_map *ids, int num_ids)
 {
@@ -380,6 +382,9 @@ BOOL winbind_sids_to_unixids(struct id_map *ids, int num_ids)
 	request.extra_len = num_ids * sizeof(DOM_SID);
 
 	sids = (DOM_SID *)SMB_MALLOC(request.extra_len);
+	if (sids == NULL) {
+		return False;
+	}
 	for (i = 0; i < num_ids; i++) {
 		sid_copy(&sids[i], ids[i].sid);
 	}
@@ -390,13 +395,20 @@ BOOL winbind_sids_to_unixids(struct id_map *ids, int num_ids)
 
 	result = winbindd_request_response(WINBINDD_SIDS_TO_XIDS, &request, &response);
 
+	if ((result == NSS_STATUS_SUCCESS) &&
+	    (response.length != sizeof(response) +
+	     num_ids * sizeof(struct unixid))) {
+		result = NSS_STATUS_UNAVAIL;
+	}
+
 	/* Copy out result */
 
 	if (result == NSS_STATUS_SUCCESS) {
 		struct unixid *wid = (struct unixid *)response.extra_data.data;
 		
 		for (i = 0; i < num_ids; i++) {
-			if (wid[i].type == -1) {
+			if ((wid[i].type != ID_TYPE_UID) &&
+			    (wid[i].type != ID_TYPE_GID)) {
 				ids[i].status = ID_UNMAPPED;
 			} else {
 				ids[i].status = ID_MAPPED;
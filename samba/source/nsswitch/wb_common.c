@@ -25,6 +25,11 @@
 */
 
 #include "winbind_client.h"
+#include "winbind_nsscache.h"
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 BOOL winbind_env_set( void );
 BOOL winbind_off( void );
@@ -637,6 +642,14 @@ NSS_STATUS winbindd_request_response(int req_type,
 	NSS_STATUS status = NSS_STATUS_UNAVAIL;
 	int count = 0;
 
+	/* Recent answers don't need a trip to winbindd */
+
+	if (!winbind_env_set() &&
+	    winbindd_nsscache_lookup(req_type, request, response)) {
+		return (response->result == WINBINDD_OK) ?
+			NSS_STATUS_SUCCESS : NSS_STATUS_NOTFOUND;
+	}
+
 	while ((status == NSS_STATUS_UNAVAIL) && (count < 10)) {
 		status = winbindd_send_request(req_type, 0, request);
 		if (status != NSS_STATUS_SUCCESS) 
@@ -666,6 +679,237 @@ NSS_STATUS winbindd_priv_request_response(int req_type,
 	return status;
 }
 
+/*
+ * Pipelined requests. A socket opened with winbindd_pipeline_open()
+ * takes any number of requests without waiting for the replies, each
+ * sent with a tag of the caller's choosing. winbindd answers them in
+ * the order they finish, winbindd_pipeline_recv() returns the tag of
+ * the request a reply belongs to. Threads sharing the socket have to
+ * serialise their sends and their receives. winbindd stops reading
+ * from a client with 256 requests outstanding, so a client that does
+ * not read the replies while sending must keep fewer in flight.
+ *
+ * The getent calls keep state in the connection and are refused.
+ */
+
+/* Move the buffers over the non-blocking socket, several at a time.
+   Gives up when nothing moved for 30 seconds, like read_sock(). */
+
+static int pipeline_io(int fd, struct iovec *iov, int iovcnt, BOOL writing)
+{
+	int waited = 0;
+
+	if (fd < 0 || fd >= FD_SETSIZE) {
+		errno = EBADF;
+		return -1;
+	}
+
+	while (iovcnt > 0) {
+		struct timeval tv;
+		fd_set fds;
+		ssize_t ret;
+		int selret;
+
+		if (iov->iov_len == 0) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		if (writing) {
+			ret = writev(fd, iov, iovcnt);
+		} else {
+			ret = readv(fd, iov, iovcnt);
+		}
+
+		if (ret > 0) {
+			while ((iovcnt > 0) && (ret >= (ssize_t)iov->iov_len)) {
+				ret -= iov->iov_len;
+				iov++;
+				iovcnt--;
+			}
+			if (ret > 0) {
+				iov->iov_base = (char *)iov->iov_base + ret;
+				iov->iov_len -= ret;
+			}
+			waited = 0;
+			continue;
+		}
+		if (ret == 0) {
+			return -1;		/* winbindd went away */
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			return -1;
+		}
+
+		if (waited >= 30) {
+			return -1;
+		}
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		ZERO_STRUCT(tv);
+		tv.tv_sec = 5;
+
+		selret = select(fd + 1, writing ? NULL : &fds,
+				writing ? &fds : NULL, NULL, &tv);
+		if (selret == -1 && errno != EINTR) {
+			return -1;
+		}
+		if (selret == 0) {
+			waited += 5;
+		}
+	}
+
+	return 0;
+}
+
+/* Read a response, after the tag if there is one */
+
+static int pipeline_read_response(int fd, uint32 *tag,
+				  struct winbindd_response *response)
+{
+	struct iovec iov[2];
+	size_t extra_len;
+	int n = 0;
+
+	if (tag != NULL) {
+		iov[n].iov_base = (void *)tag;
+		iov[n++].iov_len = sizeof(*tag);
+	}
+	iov[n].iov_base = (void *)response;
+	iov[n++].iov_len = sizeof(*response);
+
+	if (pipeline_io(fd, iov, n, False) == -1) {
+		return -1;
+	}
+
+	response->extra_data.data = NULL;
+
+	if (response->length <= sizeof(*response)) {
+		return 0;
+	}
+
+	extra_len = response->length - sizeof(*response);
+	if ((response->extra_data.data = malloc(extra_len)) == NULL) {
+		return -1;
+	}
+	iov[0].iov_base = response->extra_data.data;
+	iov[0].iov_len = extra_len;
+	if (pipeline_io(fd, iov, 1, False) == -1) {
+		free_response(response);
+		return -1;
+	}
+	return 0;
+}
+
+/* Send a request the old way, for setting the socket up */
+
+static BOOL pipeline_setup_request(int fd, int req_type,
+				   struct winbindd_response *response)
+{
+	struct winbindd_request request;
+	struct iovec iov;
+
+	ZERO_STRUCT(request);
+	ZERO_STRUCTP(response);
+	init_request(&request, req_type);
+
+	iov.iov_base = (void *)&request;
+	iov.iov_len = sizeof(request);
+
+	if ((pipeline_io(fd, &iov, 1, True) == -1) ||
+	    (pipeline_read_response(fd, NULL, response) == -1)) {
+		return False;
+	}
+	free_response(response);
+
+	return (response->result == WINBINDD_OK);
+}
+
+/* Open a new socket to winbindd for pipelined requests. Returns -1 if
+   winbindd is not there or does not pipeline, the caller then has to
+   do with winbindd_request_response(). */
+
+int winbindd_pipeline_open(void)
+{
+	struct winbindd_response response;
+	int fd;
+
+	if (winbind_env_set()) {
+		return -1;
+	}
+
+	if ((fd = winbind_named_pipe_sock(WINBINDD_SOCKET_DIR)) == -1) {
+		return -1;
+	}
+
+	if (!pipeline_setup_request(fd, WINBINDD_INTERFACE_VERSION,
+				    &response) ||
+	    (response.data.interface_version != WINBIND_INTERFACE_VERSION) ||
+	    !pipeline_setup_request(fd, WINBINDD_PIPELINE, &response)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+NSS_STATUS winbindd_pipeline_send(int fd, uint32 tag, int req_type,
+				  struct winbindd_request *request)
+{
+	struct winbindd_request lrequest;
+	struct iovec iov[3];
+
+	if (!request) {
+		ZERO_STRUCT(lrequest);
+		request = &lrequest;
+	}
+
+	init_request(request, req_type);
+
+	iov[0].iov_base = (void *)&tag;
+	iov[0].iov_len = sizeof(tag);
+	iov[1].iov_base = (void *)request;
+	iov[1].iov_len = sizeof(*request);
+	iov[2].iov_base = request->extra_data.data;
+	iov[2].iov_len = request->extra_len;
+
+	if (pipeline_io(fd, iov, 3, True) == -1) {
+		return NSS_STATUS_UNAVAIL;
+	}
+
+	return NSS_STATUS_SUCCESS;
+}
+
+/* Wait for the next reply, *tag says which request it belongs to */
+
+NSS_STATUS winbindd_pipeline_recv(int fd, uint32 *tag,
+				  struct winbindd_response *response)
+{
+	init_response(response);
+
+	if (pipeline_read_response(fd, tag, response) == -1) {
+		return NSS_STATUS_UNAVAIL;
+	}
+
+	if (response->result != WINBINDD_OK) {
+		return NSS_STATUS_NOTFOUND;
+	}
+
+	return NSS_STATUS_SUCCESS;
+}
+
+void winbindd_pipeline_close(int fd)
+{
+	if (fd != -1) {
+		close(fd);
+	}
+}
+
 /*************************************************************************
  A couple of simple functions to disable winbindd lookups and re-
  enable them
@@ -0,0 +1,221 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   winbind client side of the shared NSS answer cache
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA  02111-1307, USA.
+*/
+
+#include "winbind_client.h"
+#include "winbind_nsscache.h"
+#include <sys/mman.h>
+#include <time.h>
+
+/* The key a request is cached under. Only requests whose answer
+   depends on nothing but the key are cached. */
+
+BOOL wb_nsscache_key(int req_type, const struct winbindd_request *request,
+		     fstring key)
+{
+	const char *name;
+
+	switch (req_type) {
+	case WINBINDD_GETPWNAM:
+		name = request->data.username;
+		break;
+	case WINBINDD_GETGRNAM:
+		name = request->data.groupname;
+		break;
+	case WINBINDD_SID_TO_UID:
+	case WINBINDD_SID_TO_GID:
+		name = request->data.sid;
+		break;
+	case WINBINDD_GETPWUID:
+		snprintf(key, sizeof(fstring), "%lu",
+			 (unsigned long)request->data.uid);
+		return True;
+	case WINBINDD_GETGRGID:
+		snprintf(key, sizeof(fstring), "%lu",
+			 (unsigned long)request->data.gid);
+		return True;
+	default:
+		return False;
+	}
+
+	if (name[0] == '\0' || strnlen(name, sizeof(fstring)) == sizeof(fstring)) {
+		return False;
+	}
+	strncpy(key, name, sizeof(fstring));
+	return True;
+}
+
+uint32 wb_nsscache_hash(int req_type, const char *key)
+{
+	uint32 h = 2166136261U ^ (uint32)req_type;	/* FNV-1a */
+
+	for (; *key != '\0'; key++) {
+		h ^= (unsigned char)*key;
+		h *= 16777619;
+	}
+	return h;
+}
+
+#ifdef HAVE_WB_NSSCACHE
+
+/* Map the cache winbindd has published, if any. A cache winbindd has
+   replaced is dropped, and looked for again at most once a second. */
+
+static const struct wb_nsscache_header *wb_nsscache_map(void)
+{
+	static const struct wb_nsscache_header *hdr;
+	static size_t hdr_size;
+	static time_t last_try;
+	const struct wb_nsscache_header *h;
+	struct stat st;
+	time_t now;
+	void *p;
+	int fd;
+
+	if (hdr != NULL) {
+		if (hdr->magic == WB_NSSCACHE_MAGIC) {
+			return hdr;
+		}
+		munmap((void *)hdr, hdr_size);
+		hdr = NULL;
+	}
+
+	now = time(NULL);
+	if (now == last_try) {
+		return NULL;
+	}
+	last_try = now;
+
+	fd = open(WINBINDD_SOCKET_DIR "/" WB_NSSCACHE_NAME, O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	/* Only trust a file nobody but winbindd could have written */
+
+	if ((fstat(fd, &st) == -1) || !S_ISREG(st.st_mode) ||
+	    (st.st_uid != 0 && st.st_uid != geteuid()) ||
+	    (st.st_mode & (S_IWGRP|S_IWOTH)) ||
+	    (st.st_size < sizeof(struct wb_nsscache_header))) {
+		close(fd);
+		return NULL;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+
+	h = (const struct wb_nsscache_header *)p;
+	if ((h->magic != WB_NSSCACHE_MAGIC) ||
+	    (h->version != WB_NSSCACHE_VERSION) ||
+	    (h->slot_size != sizeof(struct wb_nsscache_slot)) ||
+	    (h->num_slots == 0) ||
+	    (sizeof(*h) + (size_t)h->num_slots * h->slot_size > st.st_size)) {
+		munmap(p, st.st_size);
+		return NULL;
+	}
+
+	hdr = h;
+	hdr_size = st.st_size;
+	return hdr;
+}
+
+/* Answer a request from the cache. Returns False if it has to go to
+   winbindd. */
+
+BOOL winbindd_nsscache_lookup(int req_type,
+			      const struct winbindd_request *request,
+			      struct winbindd_response *response)
+{
+	const struct wb_nsscache_header *hdr;
+	const volatile struct wb_nsscache_slot *slots, *slot;
+	struct wb_nsscache_slot copy;
+	fstring key;
+	uint32 hash, seqnum;
+	int i;
+
+	if ((request == NULL) || (response == NULL) ||
+	    !wb_nsscache_key(req_type, request, key)) {
+		return False;
+	}
+
+	if ((hdr = wb_nsscache_map()) == NULL) {
+		return False;
+	}
+
+	hash = wb_nsscache_hash(req_type, key);
+	slots = (const volatile struct wb_nsscache_slot *)(hdr + 1);
+
+	for (i = 0; i < WB_NSSCACHE_PROBES; i++) {
+		slot = &slots[(hash + i) % hdr->num_slots];
+
+		seqnum = slot->seqnum;
+		WB_NSSCACHE_BARRIER();
+		if ((seqnum & 1) || (slot->hash != hash) ||
+		    (slot->cmd != req_type)) {
+			continue;
+		}
+		memcpy(&copy, (const void *)slot, sizeof(copy));
+		WB_NSSCACHE_BARRIER();
+		if (slot->seqnum != seqnum) {
+			/* being replaced right now */
+			return False;
+		}
+
+		if ((copy.generation != hdr->generation) ||
+		    (strncmp(copy.key, key, sizeof(fstring)) != 0)) {
+			continue;
+		}
+		if ((copy.expires <= time(NULL)) ||
+		    (copy.extra_len > WB_NSSCACHE_EXTRA)) {
+			return False;
+		}
+
+		memset(response, 0, sizeof(*response));
+		response->length = sizeof(*response) + copy.extra_len;
+		response->result = (enum winbindd_result)copy.result;
+		memcpy(&response->data, &copy.data, sizeof(copy.data));
+
+		if (copy.extra_len != 0) {
+			response->extra_data.data = malloc(copy.extra_len);
+			if (response->extra_data.data == NULL) {
+				return False;
+			}
+			memcpy(response->extra_data.data, copy.extra,
+			       copy.extra_len);
+		}
+		return True;
+	}
+
+	return False;
+}
+
+#else
+
+BOOL winbindd_nsscache_lookup(int req_type,
+			      const struct winbindd_request *request,
+			      struct winbindd_response *response)
+{
+	return False;
+}
+
+#endif /* HAVE_WB_NSSCACHE */
@@ -1182,6 +1182,102 @@ static BOOL wbinfo_ping(void)
         return result == NSS_STATUS_SUCCESS;
 }
 
+/* show queue depth and latency of the domain children */
+static BOOL wbinfo_child_stats(void)
+{
+	struct winbindd_response response;
+
+	ZERO_STRUCT(response);
+
+	/* Send request */
+
+	if (winbindd_request_response(WINBINDD_CHILD_STATS, NULL, &response) !=
+	    NSS_STATUS_SUCCESS)
+		return False;
+
+	/* Display response */
+
+	if (response.extra_data.data) {
+		d_printf("%s", (char *)response.extra_data.data);
+		SAFE_FREE(response.extra_data.data);
+	}
+
+	return True;
+}
+
+/* Time sid to name lookups done one at a time against lookups kept
+   in flight on a pipelined socket */
+
+#define PIPELINE_BENCH_COUNT 10000
+#define PIPELINE_BENCH_DEPTH 64
+
+static BOOL wbinfo_pipeline_bench(const char *sid)
+{
+	struct winbindd_request request;
+	struct winbindd_response response;
+	struct timeval start;
+	uint32 sent, received, tag;
+	double secs;
+	int fd;
+
+	ZERO_STRUCT(request);
+	fstrcpy(request.data.sid, sid);
+
+	GetTimeOfDay(&start);
+	for (sent = 0; sent < PIPELINE_BENCH_COUNT; sent++) {
+		ZERO_STRUCT(response);
+		if (winbindd_request_response(WINBINDD_LOOKUPSID, &request,
+					      &response) != NSS_STATUS_SUCCESS) {
+			d_fprintf(stderr, "Could not lookup sid %s\n", sid);
+			return False;
+		}
+		free_response(&response);
+	}
+	secs = timeval_elapsed(&start);
+	d_printf("one at a time: %d lookups in %.3f seconds, %.0f/s\n",
+		 PIPELINE_BENCH_COUNT, secs, PIPELINE_BENCH_COUNT / secs);
+
+	if ((fd = winbindd_pipeline_open()) == -1) {
+		d_fprintf(stderr, "winbindd does not pipeline requests\n");
+		return False;
+	}
+
+	GetTimeOfDay(&start);
+	sent = received = 0;
+	while (received < PIPELINE_BENCH_COUNT) {
+		while ((sent < PIPELINE_BENCH_COUNT) &&
+		       (sent - received < PIPELINE_BENCH_DEPTH)) {
+			if (winbindd_pipeline_send(fd, sent, WINBINDD_LOOKUPSID,
+						   &request) != NSS_STATUS_SUCCESS) {
+				goto fail;
+			}
+			sent++;
+		}
+
+		ZERO_STRUCT(response);
+		if ((winbindd_pipeline_recv(fd, &tag, &response) !=
+		     NSS_STATUS_SUCCESS) || (tag >= sent)) {
+			free_response(&response);
+			goto fail;
+		}
+		free_response(&response);
+		received++;
+	}
+	secs = timeval_elapsed(&start);
+	d_printf("%d in flight: %d lookups in %.3f seconds, %.0f/s\n",
+		 PIPELINE_BENCH_DEPTH, PIPELINE_BENCH_COUNT, secs,
+		 PIPELINE_BENCH_COUNT / secs);
+
+	winbindd_pipeline_close(fd);
+	return True;
+
+ fail:
+	d_fprintf(stderr, "Pipelined lookup of sid %s failed after %u "
+		  "replies\n", sid, received);
+	winbindd_pipeline_close(fd);
+	return False;
+}
+
 /* Main program */
 
 enum {
@@ -1198,6 +1294,8 @@ enum {
 	OPT_LIST_ALL_DOMAINS,
 	OPT_LIST_OWN_DOMAIN,
 	OPT_GROUP_INFO,
+	OPT_CHILD_STATS,
+	OPT_PIPELINE_BENCH,
 };
 
 int main(int argc, char **argv, char **envp)
@@ -1236,6 +1334,8 @@ int main(int argc, char **argv, char **envp)
 		{ "all-domains", 0, POPT_ARG_NONE, 0, OPT_LIST_ALL_DOMAINS, "List all domains (trusted and own domain)" },
 		{ "own-domain", 0, POPT_ARG_NONE, 0, OPT_LIST_OWN_DOMAIN, "List own domain" },
 		{ "sequence", 0, POPT_ARG_NONE, 0, OPT_SEQUENCE, "Show sequence numbers of all domains" },
+		{ "child-stats", 0, POPT_ARG_NONE, 0, OPT_CHILD_STATS, "Show queue depth and latency of the domain children" },
+		{ "pipeline-bench", 0, POPT_ARG_STRING, &string_arg, OPT_PIPELINE_BENCH, "Time sid lookups one at a time and pipelined", "SID" },
 		{ "domain-info", 'D', POPT_ARG_STRING, &string_arg, 'D', "Show most of the info we have about the domain" },
 		{ "user-info", 'i', POPT_ARG_STRING, &string_arg, 'i', "Get user info", "USER" },
 		{ "group-info", 0, POPT_ARG_STRING, &string_arg, OPT_GROUP_INFO, "Get group info", "GROUP" },
@@ -1398,6 +1498,17 @@ int main(int argc, char **argv, char **envp)
 				goto done;
 			}
 			break;
+		case OPT_CHILD_STATS:
+			if (!wbinfo_child_stats()) {
+				d_fprintf(stderr, "Could not show child statistics\n");
+				goto done;
+			}
+			break;
+		case OPT_PIPELINE_BENCH:
+			if (!wbinfo_pipeline_bench(string_arg)) {
+				goto done;
+			}
+			break;
 		case 'D':
 			if (!wbinfo_domain_info(string_arg)) {
 				d_fprintf(stderr, "Could not get domain info\n");
@@ -15,4 +15,10 @@ int write_sock(void *buffer, int count, int recursing, int need_priv);
 int read_reply(struct winbindd_response *response);
 void close_sock(void);
 void free_response(struct winbindd_response *response);
+int winbindd_pipeline_open(void);
+NSS_STATUS winbindd_pipeline_send(int fd, uint32 tag, int req_type,
+				  struct winbindd_request *request);
+NSS_STATUS winbindd_pipeline_recv(int fd, uint32 *tag,
+				  struct winbindd_response *response);
+void winbindd_pipeline_close(int fd);
 
@@ -0,0 +1,90 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   Cache of winbindd answers shared with the NSS clients
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA  02111-1307, USA.
+*/
+
+#ifndef _WINBIND_NSSCACHE_H
+#define _WINBIND_NSSCACHE_H
+
+/*
+ * winbindd publishes recent getpw*, getgr* and sid_to_[ug]id answers
+ * in a file next to its socket, which the clients map read-only and
+ * search before they talk to winbindd. There is a single writer, the
+ * main winbindd, and the readers take no locks: a slot's seqnum is
+ * odd while winbindd rewrites it, so a reader keeps a copy only if
+ * the seqnum was even and unchanged across the copy.
+ *
+ * Like the request and response structures the layout must be the
+ * same in 32 and 64 bit builds.
+ */
+
+#define WB_NSSCACHE_NAME	"nsscache"
+#define WB_NSSCACHE_MAGIC	0x574e5343	/* "WNSC" */
+#define WB_NSSCACHE_VERSION	1
+
+/* a key is found in one of this many slots after its hash slot */
+#define WB_NSSCACHE_PROBES	4
+
+/* answers with more extra data (group members) are not cached */
+#define WB_NSSCACHE_EXTRA	1024
+
+/* the readers need a memory barrier, without one there is no cache */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 1)))
+#define HAVE_WB_NSSCACHE 1
+#define WB_NSSCACHE_BARRIER() __sync_synchronize()
+#else
+#define WB_NSSCACHE_BARRIER()
+#endif
+
+struct wb_nsscache_header {
+	uint32 magic;		/* set last when the file is ready, cleared
+				   when winbindd replaces it */
+	uint32 version;
+	uint32 num_slots;
+	uint32 slot_size;
+	uint32 generation;	/* bumped to drop all entries */
+	char padding[44];
+};
+
+struct wb_nsscache_slot {
+	uint32 seqnum;		/* odd while the slot is written */
+	uint32 generation;
+	SMB_TIME_T expires;
+	uint32 cmd;
+	uint32 hash;
+	fstring key;
+	uint32 result;		/* WINBINDD_OK or WINBINDD_ERROR */
+	uint32 extra_len;
+	union {
+		struct winbindd_pw pw;
+		struct winbindd_gr gr;
+		uid_t uid;
+		gid_t gid;
+	} data;
+	char extra[WB_NSSCACHE_EXTRA];
+};
+
+BOOL wb_nsscache_key(int req_type, const struct winbindd_request *request,
+		     fstring key);
+uint32 wb_nsscache_hash(int req_type, const char *key);
+BOOL winbindd_nsscache_lookup(int req_type,
+			      const struct winbindd_request *request,
+			      struct winbindd_response *response);
+
+#endif /* _WINBIND_NSSCACHE_H */
@@ -26,6 +26,7 @@
 
 #include "includes.h"
 #include "winbindd.h"
+#include "winbind_nsscache.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_WINBIND
@@ -113,6 +114,7 @@ static void flush_caches(void)
            hang around until the sequence number changes. */
 
 	wcache_invalidate_cache();
+	winbindd_nsscache_flush();
 }
 
 /* Handle the signal by unlinking socket and exiting */
@@ -121,6 +123,8 @@ static void terminate(void)
 {
 
 	winbindd_release_sockets();
+	winbindd_nsscache_shutdown();
+	wcache_flush_hot_keys(True);
 	idmap_close();
 	
 	trustdom_cache_shutdown();
@@ -243,9 +247,7 @@ static struct winbindd_dispatch_table {
 	{ WINBINDD_SID_TO_GID, winbindd_sid_to_gid, "SID_TO_GID" },
 	{ WINBINDD_UID_TO_SID, winbindd_uid_to_sid, "UID_TO_SID" },
 	{ WINBINDD_GID_TO_SID, winbindd_gid_to_sid, "GID_TO_SID" },
-#if 0   /* DISABLED until we fix the interface in Samba 3.0.26 --jerry */
 	{ WINBINDD_SIDS_TO_XIDS, winbindd_sids_to_unixids, "SIDS_TO_XIDS" },
-#endif  /* end DISABLED */
 	{ WINBINDD_ALLOCATE_UID, winbindd_allocate_uid, "ALLOCATE_UID" },
 	{ WINBINDD_ALLOCATE_GID, winbindd_allocate_gid, "ALLOCATE_GID" },
 	{ WINBINDD_SET_MAPPING, winbindd_set_mapping, "SET_MAPPING" },
@@ -266,6 +268,8 @@ static struct winbindd_dispatch_table {
 	{ WINBINDD_PRIV_PIPE_DIR, winbindd_priv_pipe_dir,
 	  "WINBINDD_PRIV_PIPE_DIR" },
 	{ WINBINDD_GETDCNAME, winbindd_getdcname, "GETDCNAME" },
+	{ WINBINDD_CHILD_STATS, winbindd_child_stats, "CHILD_STATS" },
+	{ WINBINDD_PIPELINE, winbindd_pipeline, "PIPELINE" },
 
 	/* Credential cache access */
 	{ WINBINDD_CCACHE_NTLMAUTH, winbindd_ccache_ntlm_auth, "NTLMAUTH" },
@@ -301,6 +305,13 @@ static void process_request(struct winbindd_cli_state *state)
 	/* Remember who asked us. */
 	state->pid = state->request.pid;
 
+	/* Compute the NSS cache key now, the handlers may modify the
+	   request */
+	if (!wb_nsscache_key(state->request.cmd, &state->request,
+			     state->nsscache_key)) {
+		state->nsscache_key[0] = '\0';
+	}
+
 	/* Process command */
 
 	for (table = dispatch_table; table->fn; table++) {
@@ -444,6 +455,23 @@ static void request_finished(struct winbindd_cli_state *state);
 void request_finished_cont(void *private_data, BOOL success);
 static void response_main_sent(void *private_data, BOOL success);
 static void response_extra_sent(void *private_data, BOOL success);
+static void request_frame_recv(void *private_data, BOOL success);
+static void pipeline_reply(struct winbindd_cli_state *state);
+
+/* Wait for the next request, on a pipelined connection it starts
+   with its tag. The tag and the length are read in one go. */
+
+static void setup_request_read(struct winbindd_cli_state *state)
+{
+	if (state->pipelined) {
+		setup_async_read(&state->fd_event, state->frame,
+				 sizeof(state->frame), request_frame_recv,
+				 state);
+		return;
+	}
+	setup_async_read(&state->fd_event, &state->request, sizeof(uint32),
+			 request_len_recv, state);
+}
 
 static void response_extra_sent(void *private_data, BOOL success)
 {
@@ -463,8 +491,7 @@ static void response_extra_sent(void *private_data, BOOL success)
 	SAFE_FREE(state->request.extra_data.data);
 	SAFE_FREE(state->response.extra_data.data);
 
-	setup_async_read(&state->fd_event, &state->request, sizeof(uint32),
-			 request_len_recv, state);
+	setup_request_read(state);
 }
 
 static void response_main_sent(void *private_data, BOOL success)
@@ -483,8 +510,7 @@ static void response_main_sent(void *private_data, BOOL success)
 			state->mem_ctx = NULL;
 		}
 
-		setup_async_read(&state->fd_event, &state->request,
-				 sizeof(uint32), request_len_recv, state);
+		setup_request_read(state);
 		return;
 	}
 
@@ -495,6 +521,10 @@ static void response_main_sent(void *private_data, BOOL success)
 
 static void request_finished(struct winbindd_cli_state *state)
 {
+	if (state->pipeline != NULL) {
+		pipeline_reply(state);
+		return;
+	}
 	setup_async_write(&state->fd_event, &state->response,
 			  sizeof(state->response), response_main_sent, state);
 }
@@ -503,6 +533,8 @@ void request_error(struct winbindd_cli_state *state)
 {
 	SMB_ASSERT(state->response.result == WINBINDD_PENDING);
 	state->response.result = WINBINDD_ERROR;
+	winbindd_nsscache_store(state->request.cmd, state->nsscache_key,
+				&state->response);
 	request_finished(state);
 }
 
@@ -510,6 +542,8 @@ void request_ok(struct winbindd_cli_state *state)
 {
 	SMB_ASSERT(state->response.result == WINBINDD_PENDING);
 	state->response.result = WINBINDD_OK;
+	winbindd_nsscache_store(state->request.cmd, state->nsscache_key,
+				&state->response);
 	request_finished(state);
 }
 
@@ -524,6 +558,22 @@ void request_finished_cont(void *private_data, BOOL success)
 		request_error(state);
 }
 
+static void request_frame_recv(void *private_data, BOOL success)
+{
+	struct winbindd_cli_state *state =
+		talloc_get_type_abort(private_data, struct winbindd_cli_state);
+
+	if (!success) {
+		state->finished = True;
+		return;
+	}
+
+	state->tag = state->frame[0];
+	*(uint32 *)(&state->request) = state->frame[1];
+
+	request_len_recv(state, True);
+}
+
 static void request_len_recv(void *private_data, BOOL success)
 {
 	struct winbindd_cli_state *state =
@@ -587,6 +637,187 @@ static void request_main_recv(void *private_data, BOOL success)
 			 state->request.extra_len, request_recv, state);
 }
 
+/*
+ * Pipelined connections. After WINBINDD_PIPELINE every request is
+ * preceded by a tag, and is handed to process_request() in a state of
+ * its own, so the connection can go on reading the next one. The
+ * replies are sent in the order the requests finish, each preceded by
+ * the tag of its request.
+ */
+
+static void pipeline_free(struct winbindd_cli_state *state)
+{
+	struct winbindd_cli_state *conn = state->pipeline;
+
+	SAFE_FREE(state->request.extra_data.data);
+	SAFE_FREE(state->response.extra_data.data);
+	if (state->mem_ctx != NULL) {
+		talloc_destroy(state->mem_ctx);
+		state->mem_ctx = NULL;
+	}
+	TALLOC_FREE(state);
+
+	/* We stopped reading when the client had too many requests
+	   outstanding */
+
+	if ((conn->num_pipelined-- == WINBINDD_MAX_PIPELINED) &&
+	    !conn->finished) {
+		setup_request_read(conn);
+	}
+}
+
+static void pipeline_failed(struct winbindd_cli_state *conn)
+{
+	struct winbindd_cli_state *state;
+
+	conn->finished = True;
+	conn->fd_event.flags = 0;	/* stop reading requests */
+
+	while ((state = conn->replies) != NULL) {
+		DLIST_REMOVE(conn->replies, state);
+		pipeline_free(state);
+	}
+}
+
+static void pipeline_send(struct winbindd_cli_state *conn);
+
+static void pipeline_sent(struct winbindd_cli_state *state)
+{
+	struct winbindd_cli_state *conn = state->pipeline;
+
+	conn->last_access = time(NULL);
+	DLIST_REMOVE(conn->replies, state);
+	pipeline_free(state);
+
+	if (conn->replies != NULL) {
+		pipeline_send(conn);
+	}
+}
+
+static void pipeline_reply_sent(void *private_data, BOOL success)
+{
+	struct winbindd_cli_state *state =
+		talloc_get_type_abort(private_data, struct winbindd_cli_state);
+
+	if (!success) {
+		pipeline_failed(state->pipeline);
+		return;
+	}
+
+	pipeline_sent(state);
+}
+
+/* Start sending the oldest reply in the queue. The tag, the response
+   and its extra data go out in one write. */
+
+static void pipeline_send(struct winbindd_cli_state *conn)
+{
+	struct winbindd_cli_state *state = conn->replies;
+	size_t extra_len = state->response.length - sizeof(state->response);
+	char *buf;
+
+	buf = TALLOC_ARRAY(state, char, sizeof(uint32) + state->response.length);
+	if (buf == NULL) {
+		DEBUG(0, ("talloc failed\n"));
+		pipeline_failed(conn);
+		return;
+	}
+
+	memcpy(buf, &state->tag, sizeof(uint32));
+	memcpy(buf + sizeof(uint32), &state->response, sizeof(state->response));
+	if (extra_len != 0) {
+		memcpy(buf + sizeof(uint32) + sizeof(state->response),
+		       state->response.extra_data.data, extra_len);
+	}
+
+	setup_async_write(&conn->write_event, buf,
+			  sizeof(uint32) + state->response.length,
+			  pipeline_reply_sent, state);
+}
+
+static void pipeline_reply(struct winbindd_cli_state *state)
+{
+	struct winbindd_cli_state *conn = state->pipeline;
+
+	if (conn->finished) {
+		/* Nobody left to tell */
+		pipeline_free(state);
+		return;
+	}
+
+	/* The reply at the head of the queue is the one being sent */
+
+	DLIST_ADD_END(conn->replies, state, struct winbindd_cli_state *);
+	if (conn->replies == state) {
+		pipeline_send(conn);
+	}
+}
+
+static void pipeline_dispatch(struct winbindd_cli_state *conn)
+{
+	struct winbindd_cli_state *state;
+
+	state = TALLOC_ZERO_P(conn, struct winbindd_cli_state);
+	if (state == NULL) {
+		DEBUG(0, ("talloc failed\n"));
+		SAFE_FREE(conn->request.extra_data.data);
+		conn->finished = True;
+		return;
+	}
+
+	/* The new state takes over the request and its extra data */
+
+	state->sock = conn->sock;
+	state->privileged = conn->privileged;
+	state->last_access = conn->last_access = time(NULL);
+	state->pipeline = conn;
+	state->tag = conn->tag;
+	state->request = conn->request;
+	conn->request.extra_data.data = NULL;
+
+	if (++conn->num_pipelined < WINBINDD_MAX_PIPELINED) {
+		setup_request_read(conn);
+	}
+
+	switch (state->request.cmd) {
+	case WINBINDD_SETPWENT:
+	case WINBINDD_GETPWENT:
+	case WINBINDD_ENDPWENT:
+	case WINBINDD_SETGRENT:
+	case WINBINDD_GETGRENT:
+	case WINBINDD_ENDGRENT:
+	case WINBINDD_GETGRLST:
+	case WINBINDD_PIPELINE:
+		/* These keep state in the connection */
+		DEBUG(3, ("pipeline_dispatch: request %d refused on "
+			  "pipelined connection\n", (int)state->request.cmd));
+		state->response.result = WINBINDD_PENDING;
+		state->response.length = sizeof(state->response);
+		request_error(state);
+		return;
+	default:
+		break;
+	}
+
+	process_request(state);
+}
+
+void winbindd_pipeline(struct winbindd_cli_state *state)
+{
+	DEBUG(3, ("[%5lu]: pipeline\n", (unsigned long)state->pid));
+
+	/* The OK still goes out unframed, everything after it is
+	   tagged. Replies are written through a second event on the
+	   socket, so reading the next request goes on meanwhile. */
+
+	state->pipelined = True;
+	state->write_event.fd = state->sock;
+	state->write_event.flags = 0;
+	add_fd_event(&state->write_event);
+
+	request_ok(state);
+}
+
 static void request_recv(void *private_data, BOOL success)
 {
 	struct winbindd_cli_state *state =
@@ -597,6 +828,11 @@ static void request_recv(void *private_data, BOOL success)
 		return;
 	}
 
+	if (state->pipelined) {
+		pipeline_dispatch(state);
+		return;
+	}
+
 	process_request(state);
 }
 
@@ -639,8 +875,7 @@ static void new_connection(int listen_sock, BOOL privileged)
 	state->fd_event.flags = 0;
 	add_fd_event(&state->fd_event);
 
-	setup_async_read(&state->fd_event, &state->request, sizeof(uint32),
-			 request_len_recv, state);
+	setup_request_read(state);
 
 	/* Add to connection list */
 	
@@ -677,6 +912,9 @@ static void remove_client(struct winbindd_cli_state *state)
 	}
 
 	remove_fd_event(&state->fd_event);
+	if (state->pipelined) {
+		remove_fd_event(&state->write_event);
+	}
 		
 	/* Remove from list and free */
 		
@@ -694,6 +932,7 @@ static BOOL remove_idle_client(void)
 
 	for (state = winbindd_client_list(); state; state = state->next) {
 		if (state->response.result != WINBINDD_PENDING &&
+		    state->num_pipelined == 0 &&
 		    !state->getpwent_state && !state->getgrent_state) {
 			nidle++;
 			if (!last_access || state->last_access < last_access) {
@@ -773,9 +1012,10 @@ static int process_loop(int listen_sock, int listen_priv_sock)
 		struct winbindd_cli_state *next = state->next;
 
 		/* Dispose of client connection if it is marked as 
-		   finished */ 
+		   finished, and none of its pipelined requests is
+		   still being worked on */ 
 
-		if (state->finished)
+		if (state->finished && state->num_pipelined == 0)
 			remove_client(state);
 
 		state = next;
@@ -823,9 +1063,13 @@ static int process_loop(int listen_sock, int listen_priv_sock)
 	while (ev != NULL) {
 		struct fd_event *next = ev->next;
 		int flags = 0;
-		if (FD_ISSET(ev->fd, &r_fds))
+
+		/* A pipelined connection has a reader and a writer on
+		   the same socket, each only wants its own events */
+
+		if ((ev->flags & EVENT_FD_READ) && FD_ISSET(ev->fd, &r_fds))
 			flags |= EVENT_FD_READ;
-		if (FD_ISSET(ev->fd, &w_fds))
+		if ((ev->flags & EVENT_FD_WRITE) && FD_ISSET(ev->fd, &w_fds))
 			flags |= EVENT_FD_WRITE;
 		if (flags)
 			ev->handler(ev, flags);
@@ -876,6 +1120,8 @@ static int process_loop(int listen_sock, int listen_priv_sock)
 	winbindd_check_cache_size(time(NULL));
 #endif
 
+	wcache_flush_hot_keys(False);
+
 	/* Check signal handling things */
 
 	if (do_sigterm)
@@ -929,6 +1175,8 @@ static void winbindd_process_loop(enum smb_server_mode server_mode)
 		terminate();
 	}
 
+	winbindd_nsscache_init();
+
 	for (;;) {
 		int clients = process_loop(listen_public, listen_priv);
 
@@ -84,27 +84,40 @@ struct winbindd_cli_state {
 						   * initialized? */
 	struct getent_state *getpwent_state;      /* State for getpwent() */
 	struct getent_state *getgrent_state;      /* State for getgrent() */
+	fstring nsscache_key;                     /* Key to publish the answer
+						   * under, see wb_nsscache.c */
+
+	/* Pipelined connections, see WINBINDD_PIPELINE. Every request
+	 * gets its own state, the connection queues the replies. */
+	BOOL pipelined;                           /* Requests come tagged */
+	uint32 frame[2];                          /* Tag and length of the next
+						   * request */
+	uint32 tag;                               /* Tag of this request */
+	struct winbindd_cli_state *pipeline;      /* Connection we came in on */
+	int num_pipelined;                        /* Requests not answered yet */
+	struct winbindd_cli_state *replies;       /* Replies waiting to be sent */
+	struct fd_event write_event;              /* Sending the replies */
+};
+
+/* Position in a cached user or group list, see wcache_enum_users() */
+
+struct getent_cursor {
+	BOOL started;
+	uint32 index;                        /* next entry to return */
+	uint32 total;                        /* entries in the list */
+	uint32 ofs;                          /* where the next entry starts */
+	uint32 seqnum, len;                  /* to notice the list changed */
 };
 
 /* State between get{pw,gr}ent() calls */
 
 struct getent_state {
 	struct getent_state *prev, *next;
-	void *sam_entries;
+	void *sam_entries;                   /* talloc'ed chunk of entries */
 	uint32 sam_entry_index, num_sam_entries;
 	BOOL got_sam_entries;
 	fstring domain_name;
-};
-
-/* Storage for cached getpwent() user entries */
-
-struct getpwent_user {
-	fstring name;                        /* Account name */
-	fstring gecos;                       /* User information */
-	fstring homedir;                     /* User Home Directory */
-	fstring shell;                       /* User Login Shell */
-	DOM_SID user_sid;                    /* NT user and primary group SIDs */
-	DOM_SID group_sid;
+	struct getent_cursor cursor;
 };
 
 /* Server state structure */
@@ -136,6 +149,19 @@ struct winbindd_cm_conn {
 
 struct winbindd_async_request;
 
+/* Queueing statistics of a pool of children, see wbinfo --child-stats */
+
+struct winbindd_child_stats {
+	uint32 forked;			/* children started */
+	uint32 queued;			/* requests waiting for a child now */
+	uint32 max_queued;		/* most requests ever waiting */
+	uint32 served;			/* replies received */
+	uint32 failed;			/* requests that got no reply */
+	SMB_BIG_UINT wait_usec;		/* total time spent waiting */
+	SMB_BIG_UINT reply_usec;	/* total time from queueing to reply */
+	uint32 max_reply_usec;
+};
+
 /* Async child */
 
 struct winbindd_child {
@@ -147,7 +173,18 @@ struct winbindd_child {
 
 	struct fd_event event;
 	struct timed_event *lockout_policy_event;
+	struct timed_event *cache_refresh_event;
+
+	/* A domain can be served by several children. The one set up
+	   by setup_domain_child() owns the queue and the statistics,
+	   the others are started on demand and only do the work. */
+	struct winbindd_child *pool;		/* owner of our queue */
+	struct winbindd_child *pool_next;	/* next child of the pool */
+	int pool_size;				/* most children to start */
+	struct winbindd_async_request *busy;	/* request being worked on */
+
 	struct winbindd_async_request *requests;
+	struct winbindd_child_stats stats;
 };
 
 /* Structures to hold per domain information */
@@ -247,7 +247,7 @@ static void winbindd_sids2xids_recv(TALLOC_CTX *mem_ctx, BOOL success,
 		return;
 	}
 
-	cont(private_data, True, response->extra_data.data, response->length - sizeof(response));
+	cont(private_data, True, response->extra_data.data, response->length - sizeof(*response));
 }
 			 
 void winbindd_sids2xids_async(TALLOC_CTX *mem_ctx, void *sids, int size,
@@ -288,7 +288,7 @@ enum winbindd_result winbindd_dual_sids2xids(struct winbindd_domain *domain,
 		return WINBINDD_ERROR;
 	}
 	for (i = 0; i < num; i++) {
-		ids[i] = TALLOC_P(ids, struct id_map);
+		ids[i] = TALLOC_ZERO_P(ids, struct id_map);
 		if ( ! ids[i]) {
 			DEBUG(0, ("Out of memory!\n"));
 			talloc_free(ids);
@@ -297,7 +297,10 @@ enum winbindd_result winbindd_dual_sids2xids(struct winbindd_domain *domain,
 		ids[i]->sid = &sids[i];
 	}
 
-	result = idmap_sids_to_unixids(ids);
+	/* The SIDs have not been validated like in the single SID
+	   calls, so only report the mappings we already have. */
+
+	result = idmap_sids_to_known_unixids(ids);
 
 	if (NT_STATUS_IS_OK(result)) {
 
@@ -33,6 +33,7 @@
 #define WINBINDD_CACHE_VERSION_KEYSTR "WINBINDD_CACHE_VERSION"
 
 extern struct winbindd_methods reconnect_methods;
+extern struct winbindd_methods cache_methods;
 extern BOOL opt_nocache;
 #ifdef HAVE_ADS
 extern struct winbindd_methods ads_methods;
@@ -579,6 +580,171 @@ static struct cache_entry *wcache_fetch_raw(char *kstr)
 	return centry;
 }
 
+/*
+  Keep the entries clients keep asking for fresh. Every winbindd
+  process counts the lookups per cache key in a small table and now
+  and then adds the counts to winbindd_cache_hot.tdb, which survives
+  the restarts that empty the cache. The child owning a domain's pool
+  refetches the most asked for entries of its domain as soon as the
+  sequence number moves on, before a client has to wait for the DC,
+  and once when it starts, which warms up the emptied cache. The
+  logons of a domain all go to that child too, so it goes to the DC
+  for one entry at a time and looks for requests in between.
+
+	winbind:cache refresh entries = 100	0 turns this off
+*/
+
+#define WCACHE_HOT_SLOTS 256
+#define WCACHE_HOT_FLUSH_INTERVAL 60
+#define WCACHE_HOT_MAX_AGE (7*24*60*60)
+#define WCACHE_REFRESH_BATCH 1
+
+static struct {
+	char *key;			/* "<domain>/<cache key>" */
+	uint32 hits;
+} wcache_hot[WCACHE_HOT_SLOTS];
+
+static int wcache_hot_entries = -1;
+static BOOL wcache_refreshing;		/* don't count our own lookups */
+static TDB_CONTEXT *wcache_hot_tdb;
+static time_t wcache_hot_last_flush;
+
+static BOOL wcache_refreshable_key(const char *kstr)
+{
+	return (strncmp(kstr, "U/", 2) == 0) ||
+		(strncmp(kstr, "UG/", 3) == 0) ||
+		(strncmp(kstr, "GM/", 3) == 0) ||
+		(strncmp(kstr, "SN/", 3) == 0) ||
+		(strncmp(kstr, "NS/", 3) == 0);
+}
+
+static uint32 wcache_hot_hash(uint32 h, const char *s)
+{
+	for (; *s != '\0'; s++) {	/* FNV-1a */
+		h ^= (unsigned char)*s;
+		h *= 16777619;
+	}
+	return h;
+}
+
+/* Count a lookup. A key only takes over a slot once the lookups of
+   other keys have worn down the count of the key in it. */
+
+static void wcache_count_hit(struct winbindd_domain *domain, const char *kstr)
+{
+	size_t len = strlen(domain->name);
+	unsigned int slot;
+	char *key;
+
+	if (wcache_hot_entries < 0) {
+		wcache_hot_entries = lp_parm_int(-1, "winbind",
+						 "cache refresh entries", 100);
+	}
+	if (wcache_refreshing || (wcache_hot_entries <= 0) ||
+	    domain->internal || !wcache_refreshable_key(kstr)) {
+		return;
+	}
+
+	slot = wcache_hot_hash(wcache_hot_hash(2166136261U, domain->name),
+			       kstr) % WCACHE_HOT_SLOTS;
+	key = wcache_hot[slot].key;
+
+	if ((key != NULL) && (strncmp(key, domain->name, len) == 0) &&
+	    (key[len] == '/') && (strcmp(key + len + 1, kstr) == 0)) {
+		wcache_hot[slot].hits += 1;
+		return;
+	}
+
+	if ((key != NULL) && (wcache_hot[slot].hits > 1)) {
+		wcache_hot[slot].hits -= 1;
+		return;
+	}
+
+	SAFE_FREE(wcache_hot[slot].key);
+	if (asprintf(&wcache_hot[slot].key, "%s/%s", domain->name, kstr) == -1) {
+		wcache_hot[slot].key = NULL;
+		wcache_hot[slot].hits = 0;
+		return;
+	}
+	wcache_hot[slot].hits = 1;
+}
+
+static BOOL wcache_hot_open(void)
+{
+	if (wcache_hot_tdb == NULL) {
+		wcache_hot_tdb = tdb_open_log(lock_path("winbindd_cache_hot.tdb"),
+					      0, TDB_DEFAULT, O_RDWR|O_CREAT,
+					      0600);
+	}
+	return (wcache_hot_tdb != NULL);
+}
+
+/* The record of a key holds its hits and when it was last asked for */
+
+static void wcache_hot_add(const char *key, uint32 hits, time_t now)
+{
+	TDB_DATA kbuf, data;
+	char buf[8];
+
+	kbuf = string_tdb_data(key);
+
+	if (tdb_chainlock(wcache_hot_tdb, kbuf) != 0) {
+		return;
+	}
+	data = tdb_fetch(wcache_hot_tdb, kbuf);
+	if ((data.dptr != NULL) && (data.dsize == sizeof(buf))) {
+		hits += MIN(IVAL(data.dptr, 0), 0xffffffff - hits);
+	}
+	SAFE_FREE(data.dptr);
+
+	SIVAL(buf, 0, hits);
+	SIVAL(buf, 4, (uint32)now);
+	tdb_store(wcache_hot_tdb, kbuf, make_tdb_data(buf, sizeof(buf)),
+		  TDB_REPLACE);
+
+	tdb_chainunlock(wcache_hot_tdb, kbuf);
+}
+
+/* Called in a freshly forked child, the counts of the parent are not
+   ours to hand in */
+
+void wcache_hot_keys_forked(void)
+{
+	int i;
+
+	for (i = 0; i < WCACHE_HOT_SLOTS; i++) {
+		wcache_hot[i].hits = 0;
+	}
+	wcache_hot_last_flush = time(NULL);
+}
+
+/* Add the lookups counted since the last time to the shared counts */
+
+void wcache_flush_hot_keys(BOOL force)
+{
+	time_t now = time(NULL);
+	int i;
+
+	if (!force && (now - wcache_hot_last_flush < WCACHE_HOT_FLUSH_INTERVAL)) {
+		return;
+	}
+	wcache_hot_last_flush = now;
+	wcache_hot_entries = lp_parm_int(-1, "winbind", "cache refresh entries",
+					 100);
+
+	if ((wcache_hot_entries <= 0) || !wcache_hot_open()) {
+		return;
+	}
+
+	for (i = 0; i < WCACHE_HOT_SLOTS; i++) {
+		if (wcache_hot[i].hits == 0) {
+			continue;
+		}
+		wcache_hot_add(wcache_hot[i].key, wcache_hot[i].hits, now);
+		wcache_hot[i].hits = 0;
+	}
+}
+
 /*
   fetch an entry from the cache, with a varargs key. auto-fetch the sequence
   number and return status
@@ -604,6 +770,8 @@ static struct cache_entry *wcache_fetch(struct winbind_cache *cache,
 	smb_xvasprintf(&kstr, format, ap);
 	va_end(ap);
 
+	wcache_count_hit(domain, kstr);
+
 	centry = wcache_fetch_raw(kstr);
 	if (centry == NULL) {
 		free(kstr);
@@ -1337,6 +1505,576 @@ skip_save:
 	return status;
 }
 
+/*
+  getent walks the user and group lists a chunk at a time. The lists are
+  read from their cache entries in place, only the entries handed out
+  are copied, so enumerating a large domain does not keep the whole
+  list in memory. The cursor remembers where the next chunk starts.
+*/
+
+static int wcache_list_header(TDB_DATA kbuf, TDB_DATA dbuf, void *private_data)
+{
+	struct cache_entry *centry = (struct cache_entry *)private_data;
+
+	if (dbuf.dsize >= 8) {
+		centry->status = NT_STATUS(IVAL(dbuf.dptr, 0));
+		centry->sequence_number = IVAL(dbuf.dptr, 4);
+		centry->len = dbuf.dsize;
+	}
+	return 0;
+}
+
+/* is there an entry under kstr that wcache_fetch() would return? */
+static BOOL wcache_entry_current(struct winbindd_domain *domain, const char *kstr)
+{
+	struct cache_entry centry;
+
+	if (opt_nocache || !get_cache(domain)->tdb) {
+		return False;
+	}
+
+	refresh_sequence_number(domain, False);
+
+	ZERO_STRUCT(centry);
+	tdb_parse_record(wcache->tdb, string_tdb_data(kstr),
+			 wcache_list_header, &centry);
+
+	return (centry.len != 0) && !centry_expired(domain, kstr, &centry);
+}
+
+/* step over a string without copying it */
+static BOOL centry_skip_string(struct cache_entry *centry)
+{
+	uint32 len;
+
+	if (centry->len - centry->ofs < 1) {
+		return False;
+	}
+	len = CVAL(centry->data, centry->ofs);
+	centry->ofs += 1;
+
+	if (len == 0xFF) {
+		return True;
+	}
+	if (centry->len - centry->ofs < len) {
+		return False;
+	}
+	centry->ofs += len;
+	return True;
+}
+
+/* a user is 4 strings and 2 sids, a group 2 strings and a rid */
+static BOOL centry_skip_list_entry(struct cache_entry *centry, BOOL users)
+{
+	int i;
+
+	for (i = 0; i < (users ? 6 : 2); i++) {
+		if (!centry_skip_string(centry)) {
+			return False;
+		}
+	}
+	if (!users) {
+		if (centry->len - centry->ofs < 4) {
+			return False;
+		}
+		centry->ofs += 4;
+	}
+	return True;
+}
+
+struct wcache_list_state {
+	const char *kstr;
+	struct getent_cursor *cursor;
+	BOOL users;
+	TALLOC_CTX *mem_ctx;
+	uint32 max_entries;
+	uint32 num_entries;
+	void *info;
+	NTSTATUS status;
+	BOOL found;
+};
+
+static int wcache_list_parse(TDB_DATA kbuf, TDB_DATA dbuf, void *private_data)
+{
+	struct wcache_list_state *state =
+		(struct wcache_list_state *)private_data;
+	struct getent_cursor *cursor = state->cursor;
+	struct cache_entry centry;
+	uint32 seqnum, total, i, n;
+
+	if (dbuf.dsize < 12) {
+		return 0;
+	}
+	state->found = True;
+
+	centry.data = (uint8 *)dbuf.dptr;
+	centry.len = dbuf.dsize;
+	centry.ofs = 0;
+
+	state->status = NT_STATUS(centry_uint32(&centry));
+	seqnum = centry_uint32(&centry);
+	total = centry_uint32(&centry);
+
+	if (!NT_STATUS_IS_OK(state->status)) {
+		return 0;
+	}
+
+	if ((cursor->index == 0) || (cursor->seqnum != seqnum) ||
+	    (cursor->len != dbuf.dsize) || (cursor->total != total)) {
+
+		/* the first chunk, or the list has been replaced since
+		   the last one: find our place again */
+
+		cursor->seqnum = seqnum;
+		cursor->len = dbuf.dsize;
+		cursor->total = total;
+		cursor->index = MIN(cursor->index, total);
+
+		for (i = 0; i < cursor->index; i++) {
+			if (!centry_skip_list_entry(&centry, state->users)) {
+				break;
+			}
+		}
+		if (i < cursor->index) {
+			DEBUG(0,("wcache_list_parse: corrupt list %s\n",
+				 state->kstr));
+			cursor->total = cursor->index;
+			return 0;
+		}
+		cursor->ofs = centry.ofs;
+	}
+
+	centry.ofs = cursor->ofs;
+	n = MIN(state->max_entries, total - cursor->index);
+
+	/* make sure all of the chunk is there before copying it */
+
+	for (i = 0; i < n; i++) {
+		if (!centry_skip_list_entry(&centry, state->users)) {
+			DEBUG(0,("wcache_list_parse: corrupt list %s\n",
+				 state->kstr));
+			cursor->total = cursor->index + i;
+			n = i;
+			break;
+		}
+	}
+	if (n == 0) {
+		return 0;
+	}
+	centry.ofs = cursor->ofs;
+
+	if (state->users) {
+		WINBIND_USERINFO *info;
+
+		info = TALLOC_ARRAY(state->mem_ctx, WINBIND_USERINFO, n);
+		if (info == NULL) {
+			smb_panic("wcache_list_parse out of memory");
+		}
+		for (i = 0; i < n; i++) {
+			ZERO_STRUCT(info[i]);
+			info[i].acct_name = centry_string(&centry, info);
+			info[i].full_name = centry_string(&centry, info);
+			info[i].homedir = centry_string(&centry, info);
+			info[i].shell = centry_string(&centry, info);
+			centry_sid(&centry, info, &info[i].user_sid);
+			centry_sid(&centry, info, &info[i].group_sid);
+		}
+		state->info = info;
+	} else {
+		struct acct_info *info;
+		char *s;
+
+		info = TALLOC_ARRAY(state->mem_ctx, struct acct_info, n);
+		if (info == NULL) {
+			smb_panic("wcache_list_parse out of memory");
+		}
+		for (i = 0; i < n; i++) {
+			s = centry_string(&centry, info);
+			fstrcpy(info[i].acct_name, s ? s : "");
+			TALLOC_FREE(s);
+			s = centry_string(&centry, info);
+			fstrcpy(info[i].acct_desc, s ? s : "");
+			TALLOC_FREE(s);
+			info[i].rid = centry_uint32(&centry);
+		}
+		state->info = info;
+	}
+
+	cursor->ofs = centry.ofs;
+	cursor->index += n;
+	state->num_entries = n;
+	return 0;
+}
+
+static NTSTATUS wcache_enum_list(struct winbindd_domain *domain,
+				 TALLOC_CTX *mem_ctx,
+				 struct getent_cursor *cursor,
+				 BOOL users, BOOL local,
+				 uint32 max_entries,
+				 uint32 *num_entries, void **info)
+{
+	struct wcache_list_state state;
+	NTSTATUS status = NT_STATUS_OK;
+	TALLOC_CTX *tmp_ctx = NULL;
+	uint32 num = 0;
+	void *list = NULL;
+	BOOL cached, fill;
+	fstring kstr;
+	int tries;
+
+	*num_entries = 0;
+	*info = NULL;
+
+	if (cursor->started && (cursor->index >= cursor->total)) {
+		return NT_STATUS_OK;
+	}
+
+	if (users) {
+		fstr_sprintf(kstr, "UL/%s", domain->name);
+	} else {
+		fstr_sprintf(kstr, "GL/%s/%s", domain->name,
+			     local ? "local" : "domain");
+	}
+
+	/* domains not going through the cache are asked directly */
+	cached = (domain->methods == &cache_methods);
+
+	fill = !cursor->started &&
+		!(cached && wcache_entry_current(domain, kstr));
+	cursor->started = True;
+
+	for (tries = 0; tries < 2; tries++) {
+
+		if (fill) {
+			/* ask the DC, this puts the list into the cache */
+
+			TALLOC_FREE(tmp_ctx);
+			tmp_ctx = talloc_new(mem_ctx);
+			if (tmp_ctx == NULL) {
+				return NT_STATUS_NO_MEMORY;
+			}
+
+			if (users) {
+				status = domain->methods->query_user_list(
+					domain, tmp_ctx, &num,
+					(WINBIND_USERINFO **)&list);
+			} else if (local) {
+				status = domain->methods->enum_local_groups(
+					domain, tmp_ctx, &num,
+					(struct acct_info **)&list);
+			} else {
+				status = domain->methods->enum_dom_groups(
+					domain, tmp_ctx, &num,
+					(struct acct_info **)&list);
+			}
+
+			if (!NT_STATUS_IS_OK(status)) {
+				TALLOC_FREE(tmp_ctx);
+				cursor->total = cursor->index;
+				return status;
+			}
+		}
+
+		ZERO_STRUCT(state);
+		state.kstr = kstr;
+		state.cursor = cursor;
+		state.users = users;
+		state.mem_ctx = mem_ctx;
+		state.max_entries = max_entries;
+
+		if (cached && !opt_nocache && (wcache->tdb != NULL)) {
+			tdb_parse_record(wcache->tdb, string_tdb_data(kstr),
+					 wcache_list_parse, &state);
+		}
+
+		if (state.found) {
+			TALLOC_FREE(tmp_ctx);
+			if (!NT_STATUS_IS_OK(state.status)) {
+				cursor->total = cursor->index;
+				return state.status;
+			}
+			*num_entries = state.num_entries;
+			*info = state.info;
+			return NT_STATUS_OK;
+		}
+
+		if (fill) {
+			break;
+		}
+
+		/* the cache has been flushed since the last chunk */
+		fill = True;
+	}
+
+	/* The list did not make it into the cache, the domain is not
+	   cached or the cache is off. Hand out all of it at once. The
+	   backends put the names on tmp_ctx next to the array, so it has
+	   to go away with the array and not before. */
+
+	if ((cursor->index == 0) && (list != NULL)) {
+		*num_entries = num;
+		*info = talloc_steal(mem_ctx, list);
+		talloc_steal(list, tmp_ctx);
+		tmp_ctx = NULL;
+	}
+	cursor->index = cursor->total = num;
+
+	TALLOC_FREE(tmp_ctx);
+	return status;
+}
+
+NTSTATUS wcache_enum_users(struct winbindd_domain *domain,
+			   TALLOC_CTX *mem_ctx,
+			   struct getent_cursor *cursor,
+			   uint32 max_entries,
+			   uint32 *num_entries,
+			   WINBIND_USERINFO **info)
+{
+	return wcache_enum_list(domain, mem_ctx, cursor, True, False,
+				max_entries, num_entries, (void **)info);
+}
+
+NTSTATUS wcache_enum_groups(struct winbindd_domain *domain,
+			    TALLOC_CTX *mem_ctx,
+			    struct getent_cursor *cursor,
+			    BOOL local,
+			    uint32 max_entries,
+			    uint32 *num_entries,
+			    struct acct_info **info)
+{
+	return wcache_enum_list(domain, mem_ctx, cursor, False, local,
+				max_entries, num_entries, (void **)info);
+}
+
+/* the hot keys of a domain, most asked for first */
+
+struct wcache_hot_key {
+	char *kstr;
+	uint32 hits;
+};
+
+struct wcache_hot_state {
+	const char *prefix;
+	size_t prefix_len;
+	time_t now;
+	TALLOC_CTX *mem_ctx;
+	struct wcache_hot_key *keys;
+	int num_keys;
+};
+
+/* Collect the keys of a domain. The counts are halved every time, so
+   a key has to keep being asked for to stay hot. */
+
+static int wcache_hot_collect(TDB_CONTEXT *the_tdb, TDB_DATA kbuf,
+			      TDB_DATA dbuf, void *private_data)
+{
+	struct wcache_hot_state *state =
+		(struct wcache_hot_state *)private_data;
+	struct wcache_hot_key key;
+	uint32 hits, last;
+	char buf[8];
+
+	if ((kbuf.dsize <= state->prefix_len) ||
+	    (memcmp(kbuf.dptr, state->prefix, state->prefix_len) != 0)) {
+		return 0;
+	}
+
+	if (dbuf.dsize != sizeof(buf)) {
+		tdb_delete(the_tdb, kbuf);
+		return 0;
+	}
+	hits = IVAL(dbuf.dptr, 0);
+	last = IVAL(dbuf.dptr, 4);
+
+	if ((hits < 2) || (last + WCACHE_HOT_MAX_AGE < state->now)) {
+		tdb_delete(the_tdb, kbuf);
+	} else {
+		SIVAL(buf, 0, hits / 2);
+		SIVAL(buf, 4, last);
+		tdb_store(the_tdb, kbuf, make_tdb_data(buf, sizeof(buf)),
+			  TDB_REPLACE);
+	}
+
+	key.kstr = talloc_strndup(state->mem_ctx,
+				  (const char *)kbuf.dptr + state->prefix_len,
+				  kbuf.dsize - state->prefix_len);
+	key.hits = hits;
+	if (key.kstr != NULL) {
+		ADD_TO_ARRAY(state->mem_ctx, struct wcache_hot_key, key,
+			     &state->keys, &state->num_keys);
+	}
+	return 0;
+}
+
+static int wcache_hot_cmp(const struct wcache_hot_key *a,
+			  const struct wcache_hot_key *b)
+{
+	if (a->hits == b->hits) {
+		return 0;
+	}
+	return (a->hits > b->hits) ? -1 : 1;
+}
+
+/* Refetch an entry unless it is current. Returns True if it went to
+   the DC for it. */
+
+static BOOL wcache_refresh_key(struct winbindd_domain *domain,
+			       const char *kstr)
+{
+	TALLOC_CTX *mem_ctx;
+	NTSTATUS status = NT_STATUS_INVALID_PARAMETER;
+	DOM_SID sid;
+	const char *p;
+
+	if (wcache_entry_current(domain, kstr)) {
+		return False;
+	}
+
+	if ((mem_ctx = talloc_init("wcache_refresh_key")) == NULL) {
+		return False;
+	}
+
+	if ((strncmp(kstr, "U/", 2) == 0) && string_to_sid(&sid, kstr + 2)) {
+		WINBIND_USERINFO info;
+
+		status = domain->methods->query_user(domain, mem_ctx, &sid,
+						     &info);
+	} else if ((strncmp(kstr, "UG/", 3) == 0) &&
+		   string_to_sid(&sid, kstr + 3)) {
+		uint32 num_groups;
+		DOM_SID *groups;
+
+		status = domain->methods->lookup_usergroups(domain, mem_ctx,
+							    &sid, &num_groups,
+							    &groups);
+	} else if ((strncmp(kstr, "GM/", 3) == 0) &&
+		   string_to_sid(&sid, kstr + 3)) {
+		uint32 num_names, *types;
+		DOM_SID *sids;
+		char **names;
+
+		status = domain->methods->lookup_groupmem(domain, mem_ctx,
+							  &sid, &num_names,
+							  &sids, &names,
+							  &types);
+	} else if ((strncmp(kstr, "SN/", 3) == 0) &&
+		   string_to_sid(&sid, kstr + 3)) {
+		char *domain_name, *name;
+		enum lsa_SidType type;
+
+		status = domain->methods->sid_to_name(domain, mem_ctx, &sid,
+						      &domain_name, &name,
+						      &type);
+	} else if ((strncmp(kstr, "NS/", 3) == 0) &&
+		   ((p = strchr(kstr + 3, '/')) != NULL)) {
+		char *domain_name;
+		enum lsa_SidType type;
+
+		domain_name = talloc_strndup(mem_ctx, kstr + 3,
+					     p - (kstr + 3));
+		if (domain_name != NULL) {
+			status = domain->methods->name_to_sid(domain, mem_ctx,
+							      domain_name,
+							      p + 1, &sid,
+							      &type);
+		}
+	}
+
+	DEBUG(10, ("wcache_refresh_key: refreshed %s for domain %s: %s\n",
+		   kstr, domain->name, nt_errstr(status)));
+
+	talloc_destroy(mem_ctx);
+	return True;
+}
+
+/*
+  Called by the children of a domain from a timed event. Returns the
+  seconds until it wants to be called again, or -1 if refreshing is
+  turned off. Only the owner of the domain's pool (refresh is True)
+  refetches entries, the others just hand in their counts.
+*/
+
+int wcache_refresh_ahead(struct winbindd_domain *domain, BOOL refresh)
+{
+	static TALLOC_CTX *keys_ctx;
+	static struct wcache_hot_key *keys;
+	static int num_keys, next_key;
+	struct wcache_hot_state state;
+	int cache_time = lp_winbind_cache_time();
+	int i, next;
+
+	wcache_flush_hot_keys(next_key >= num_keys);
+
+	if (wcache_hot_entries <= 0) {
+		return -1;
+	}
+	if (!refresh) {
+		return WCACHE_HOT_FLUSH_INTERVAL;
+	}
+
+	if (next_key >= num_keys) {
+
+		/* start a new round */
+
+		TALLOC_FREE(keys_ctx);
+		keys = NULL;
+		num_keys = next_key = 0;
+
+		if (opt_nocache || !domain->online || !get_cache(domain)->tdb ||
+		    !wcache_hot_open()) {
+			return MAX(cache_time, WCACHE_HOT_FLUSH_INTERVAL);
+		}
+
+		refresh_sequence_number(domain, False);
+
+		if ((keys_ctx = talloc_init("wcache_refresh_ahead")) == NULL) {
+			return cache_time;
+		}
+
+		ZERO_STRUCT(state);
+		state.prefix = talloc_asprintf(keys_ctx, "%s/", domain->name);
+		state.prefix_len = strlen(domain->name) + 1;
+		state.now = time(NULL);
+		state.mem_ctx = keys_ctx;
+
+		if (state.prefix != NULL) {
+			tdb_traverse(wcache_hot_tdb, wcache_hot_collect, &state);
+		}
+
+		keys = state.keys;
+		num_keys = MIN(state.num_keys, wcache_hot_entries);
+		if (num_keys > 1) {
+			qsort(keys, state.num_keys, sizeof(*keys),
+			      QSORT_CAST wcache_hot_cmp);
+		}
+
+		DEBUG(10, ("wcache_refresh_ahead: %d hot keys for domain %s\n",
+			   num_keys, domain->name));
+	}
+
+	/* Go to the DC for WCACHE_REFRESH_BATCH entries at a time and let
+	   the requests coming in meanwhile, logons among them, get their
+	   turn */
+
+	wcache_refreshing = True;
+	for (i = 0; (i < WCACHE_REFRESH_BATCH) && (next_key < num_keys);
+	     next_key++) {
+		if (wcache_refresh_key(domain, keys[next_key].kstr)) {
+			i++;
+		}
+	}
+	wcache_refreshing = False;
+
+	if (next_key < num_keys) {
+		return 0;
+	}
+
+	/* Next round when the sequence number is due to be checked */
+
+	next = domain->last_seq_check + cache_time - time(NULL) + 1;
+	return MAX(MIN(next, cache_time), 1);
+}
+
 /* convert a single name to a sid in a domain */
 static NTSTATUS name_to_sid(struct winbindd_domain *domain,
 			    TALLOC_CTX *mem_ctx,
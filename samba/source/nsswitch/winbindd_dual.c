@@ -88,18 +88,27 @@ static void child_read_request(struct winbindd_cli_state *state)
  * winbindd_request, select a child to query, and issue a async_request
  * call. When the request is completed, the callback function you specified is
  * called back with the private pointer you gave to async_request.
+ *
+ * A domain may be served by a pool of up to "winbind:domain children"
+ * processes, so that one slow call to the DC no longer holds up every
+ * other lookup for the domain. The child set up by setup_domain_child()
+ * owns the queue, further children are forked when requests are waiting
+ * and all children that are running are busy.
  */
 
 struct winbindd_async_request {
 	struct winbindd_async_request *next, *prev;
 	TALLOC_CTX *mem_ctx;
-	struct winbindd_child *child;
+	struct winbindd_child *child;	/* owner of the queue */
+	struct winbindd_child *worker;	/* child the request was sent to */
 	struct winbindd_request *request;
 	struct winbindd_response *response;
 	void (*continuation)(void *private_data, BOOL success);
 	struct timed_event *reply_timeout_event;
 	pid_t child_pid; /* pid of the child we're waiting on. Used to detect
-			    a restart of the child (child->pid != child_pid). */
+			    a restart of the child (worker->pid != child_pid). */
+	struct timeval queued;
+	int retries;	/* times given to another child after a crash */
 	void *private_data;
 };
 
@@ -108,6 +117,67 @@ static void async_request_sent(void *private_data, BOOL success);
 static void async_reply_recv(void *private_data, BOOL success);
 static void schedule_async_request(struct winbindd_child *child);
 
+/****************************************************************
+ Requests that walk a whole domain rather than look up one name.
+ They queue behind the lookups and never take the last idle child
+ of a pool.
+****************************************************************/
+
+static BOOL request_is_bulk(const struct winbindd_request *request)
+{
+	switch (request->cmd) {
+	case WINBINDD_LIST_TRUSTDOM:
+	case WINBINDD_SHOW_SEQUENCE:
+	case WINBINDD_CHECK_MACHACC:
+	case WINBINDD_DUAL_DUMP_MAPS:
+		return True;
+	default:
+		return False;
+	}
+}
+
+/****************************************************************
+ Requests using the credentials a child caches for logged on users.
+ These must all end up in the same child, the first one of a pool.
+****************************************************************/
+
+static BOOL request_is_pinned(const struct winbindd_request *request)
+{
+	switch (request->cmd) {
+	case WINBINDD_PAM_AUTH:
+	case WINBINDD_PAM_LOGOFF:
+	case WINBINDD_PAM_CHAUTHTOK:
+	case WINBINDD_CCACHE_NTLMAUTH:
+		return True;
+	default:
+		return False;
+	}
+}
+
+static void queue_async_request(struct winbindd_child *child,
+				struct winbindd_async_request *state)
+{
+	struct winbindd_async_request *r, *last = NULL;
+
+	if (request_is_bulk(state->request)) {
+		DLIST_ADD_END(child->requests, state,
+			      struct winbindd_async_request *);
+	} else {
+		for (r = child->requests; r != NULL; r = r->next) {
+			if (request_is_bulk(r->request)) {
+				break;
+			}
+			last = r;
+		}
+		DLIST_ADD_AFTER(child->requests, state, last);
+	}
+
+	child->stats.queued += 1;
+	if (child->stats.queued > child->stats.max_queued) {
+		child->stats.max_queued = child->stats.queued;
+	}
+}
+
 void async_request(TALLOC_CTX *mem_ctx, struct winbindd_child *child,
 		   struct winbindd_request *request,
 		   struct winbindd_response *response,
@@ -118,7 +188,7 @@ void async_request(TALLOC_CTX *mem_ctx, struct winbindd_child *child,
 
 	SMB_ASSERT(continuation != NULL);
 
-	state = TALLOC_P(mem_ctx, struct winbindd_async_request);
+	state = TALLOC_ZERO_P(mem_ctx, struct winbindd_async_request);
 
 	if (state == NULL) {
 		DEBUG(0, ("talloc failed\n"));
@@ -132,25 +202,57 @@ void async_request(TALLOC_CTX *mem_ctx, struct winbindd_child *child,
 	state->response = response;
 	state->continuation = continuation;
 	state->private_data = private_data;
+	GetTimeOfDay(&state->queued);
 
-	DLIST_ADD_END(child->requests, state, struct winbindd_async_request *);
+	queue_async_request(child, state);
 
 	schedule_async_request(child);
 
 	return;
 }
 
+/**************************************************************
+ Common function called on both async send and recv fail.
+ Cleans up the child and schedules the next request.
+**************************************************************/
+
+static void async_request_fail(struct winbindd_async_request *state)
+{
+	struct winbindd_child *worker = state->worker;
+
+	TALLOC_FREE(state->reply_timeout_event);
+
+	SMB_ASSERT(state->child_pid != (pid_t)0);
+
+	if (worker->busy == state) {
+		worker->busy = NULL;
+	}
+	state->child->stats.failed += 1;
+
+	/* If not already reaped, send kill signal to child. */
+	if (worker->pid == state->child_pid) {
+		kill(state->child_pid, SIGTERM);
+
+		/* 
+		 * Close the socket to the child.
+		 */
+		winbind_child_died(state->child_pid);
+	}
+
+	state->response->length = sizeof(struct winbindd_response);
+	state->response->result = WINBINDD_ERROR;
+	state->continuation(state->private_data, False);
+}
+
 static void async_main_request_sent(void *private_data, BOOL success)
 {
 	struct winbindd_async_request *state =
 		talloc_get_type_abort(private_data, struct winbindd_async_request);
 
 	if (!success) {
-		DEBUG(5, ("Could not send async request\n"));
-
-		state->response->length = sizeof(struct winbindd_response);
-		state->response->result = WINBINDD_ERROR;
-		state->continuation(state->private_data, False);
+		DEBUG(5, ("Could not send async request to child pid %u\n",
+			(unsigned int)state->child_pid ));
+		async_request_fail(state);
 		return;
 	}
 
@@ -159,7 +261,7 @@ static void async_main_request_sent(void *private_data, BOOL success)
 		return;
 	}
 
-	setup_async_write(&state->child->event, state->request->extra_data.data,
+	setup_async_write(&state->worker->event, state->request->extra_data.data,
 			  state->request->extra_len,
 			  async_request_sent, state);
 }
@@ -185,34 +287,6 @@ static void async_request_timeout_handler(struct event_context *ctx,
 	async_reply_recv(private_data, False);
 }
 
-/**************************************************************
- Common function called on both async send and recv fail.
- Cleans up the child and schedules the next request.
-**************************************************************/
-
-static void async_request_fail(struct winbindd_async_request *state)
-{
-	DLIST_REMOVE(state->child->requests, state);
-
-	TALLOC_FREE(state->reply_timeout_event);
-
-	SMB_ASSERT(state->child_pid != (pid_t)0);
-
-	/* If not already reaped, send kill signal to child. */
-	if (state->child->pid == state->child_pid) {
-		kill(state->child_pid, SIGTERM);
-
-		/* 
-		 * Close the socket to the child.
-		 */
-		winbind_child_died(state->child_pid);
-	}
-
-	state->response->length = sizeof(struct winbindd_response);
-	state->response->result = WINBINDD_ERROR;
-	state->continuation(state->private_data, False);
-}
-
 static void async_request_sent(void *private_data_data, BOOL success)
 {
 	struct winbindd_async_request *state =
@@ -227,7 +301,7 @@ static void async_request_sent(void *private_data_data, BOOL success)
 
 	/* Request successfully sent to the child, setup the wait for reply */
 
-	setup_async_read(&state->child->event,
+	setup_async_read(&state->worker->event,
 			 &state->response->result,
 			 sizeof(state->response->result),
 			 async_reply_recv, state);
@@ -254,6 +328,8 @@ static void async_reply_recv(void *private_data, BOOL success)
 	struct winbindd_async_request *state =
 		talloc_get_type_abort(private_data, struct winbindd_async_request);
 	struct winbindd_child *child = state->child;
+	struct timeval now;
+	SMB_BIG_UINT usec;
 
 	TALLOC_FREE(state->reply_timeout_event);
 
@@ -272,8 +348,16 @@ static void async_reply_recv(void *private_data, BOOL success)
 					   state->response));
 
 	cache_cleanup_response(state->child_pid);
-	
-	DLIST_REMOVE(child->requests, state);
+
+	state->worker->busy = NULL;
+
+	GetTimeOfDay(&now);
+	usec = usec_time_diff(&now, &state->queued);
+	child->stats.served += 1;
+	child->stats.reply_usec += usec;
+	if (usec > child->stats.max_reply_usec) {
+		child->stats.max_reply_usec = (uint32)MIN(usec, 0xffffffff);
+	}
 
 	schedule_async_request(child);
 
@@ -282,36 +366,137 @@ static void async_reply_recv(void *private_data, BOOL success)
 
 static BOOL fork_domain_child(struct winbindd_child *child);
 
-static void schedule_async_request(struct winbindd_child *child)
+/****************************************************************
+ Start another child for a pool, it is forked by the caller.
+****************************************************************/
+
+static struct winbindd_child *add_pool_child(struct winbindd_child *child)
 {
-	struct winbindd_async_request *request = child->requests;
+	struct winbindd_child *worker, *last;
 
-	if (request == NULL) {
-		return;
+	worker = SMB_MALLOC_P(struct winbindd_child);
+	if (worker == NULL) {
+		DEBUG(0, ("malloc failed\n"));
+		return NULL;
 	}
+	ZERO_STRUCTP(worker);
+
+	worker->domain = child->domain;
+	pstrcpy(worker->logfilename, child->logfilename);
+	worker->pool = child;
 
-	if (child->event.flags != 0) {
-		return;		/* Busy */
+	for (last = child; last->pool_next != NULL; last = last->pool_next)
+		;
+	last->pool_next = worker;
+
+	return worker;
+}
+
+/****************************************************************
+ Pick the child of a pool to send a request to. Returns NULL if the
+ request has to wait. The child returned may still need forking.
+****************************************************************/
+
+static struct winbindd_child *find_worker(struct winbindd_child *child,
+					  struct winbindd_async_request *request)
+{
+	struct winbindd_child *worker, *idle = NULL, *unborn = NULL;
+	int num_children = 0, num_busy = 0;
+
+	if (request_is_pinned(request->request)) {
+		return (child->busy == NULL) ? child : NULL;
+	}
+
+	for (worker = child; worker != NULL; worker = worker->pool_next) {
+		num_children += 1;
+		if (worker->busy != NULL) {
+			num_busy += 1;
+		} else if (worker->pid == 0) {
+			if (unborn == NULL) {
+				unborn = worker;
+			}
+		} else if ((idle == NULL) || (idle == child)) {
+			/* Rather leave the first one to the pinned
+			   requests */
+			idle = worker;
+		}
 	}
 
-	if ((child->pid == 0) && (!fork_domain_child(child))) {
-		/* Cancel all outstanding requests */
+	if (request_is_bulk(request->request) && (child->pool_size > 1) &&
+	    (num_busy + 1 >= child->pool_size)) {
+		return NULL;
+	}
 
-		while (request != NULL) {
-			/* request might be free'd in the continuation */
-			struct winbindd_async_request *next = request->next;
-			request->continuation(request->private_data, False);
-			request = next;
+	if (idle != NULL) {
+		return idle;
+	}
+	if (unborn != NULL) {
+		return unborn;
+	}
+	if (num_children < child->pool_size) {
+		return add_pool_child(child);
+	}
+	return NULL;
+}
+
+static BOOL pool_running(struct winbindd_child *child)
+{
+	for (; child != NULL; child = child->pool_next) {
+		if (child->pid != 0) {
+			return True;
 		}
-		return;
 	}
+	return False;
+}
+
+static void schedule_async_request(struct winbindd_child *child)
+{
+	struct winbindd_async_request *request, *next;
+	struct winbindd_child *worker;
+	struct timeval now;
+
+	for (request = child->requests; request != NULL; request = next) {
+		next = request->next;
+
+		worker = find_worker(child, request);
+		if (worker == NULL) {
+			continue;	/* Busy */
+		}
+
+		if ((worker->pid == 0) && (!fork_domain_child(worker))) {
+			if (pool_running(child)) {
+				/* Leave it to the ones we have */
+				return;
+			}
 
-	/* Now we know who we're sending to - remember the pid. */
-	request->child_pid = child->pid;
+			/* Cancel all outstanding requests */
 
-	setup_async_write(&child->event, request->request,
-			  sizeof(*request->request),
-			  async_main_request_sent, request);
+			while ((request = child->requests) != NULL) {
+				DLIST_REMOVE(child->requests, request);
+				child->stats.queued -= 1;
+				child->stats.failed += 1;
+				/* request might be free'd in the continuation */
+				request->continuation(request->private_data,
+						      False);
+			}
+			return;
+		}
+
+		DLIST_REMOVE(child->requests, request);
+		child->stats.queued -= 1;
+
+		GetTimeOfDay(&now);
+		child->stats.wait_usec += usec_time_diff(&now, &request->queued);
+
+		/* Now we know who we're sending to - remember the pid. */
+		request->worker = worker;
+		request->child_pid = worker->pid;
+		worker->busy = request;
+
+		setup_async_write(&worker->event, request->request,
+				  sizeof(*request->request),
+				  async_main_request_sent, request);
+	}
 
 	return;
 }
@@ -434,9 +619,7 @@ static struct winbindd_child_dispatch_table child_dispatch_table[] = {
 	{ WINBINDD_CHECK_MACHACC,        winbindd_dual_check_machine_acct,    "CHECK_MACHACC" },
 	{ WINBINDD_DUAL_SID2UID,         winbindd_dual_sid2uid,               "DUAL_SID2UID" },
 	{ WINBINDD_DUAL_SID2GID,         winbindd_dual_sid2gid,               "DUAL_SID2GID" },
-#if 0   /* DISABLED until we fix the interface in Samba 3.0.26 --jerry */
 	{ WINBINDD_DUAL_SIDS2XIDS,       winbindd_dual_sids2xids,             "DUAL_SIDS2XIDS" },
-#endif  /* end DISABLED */
 	{ WINBINDD_DUAL_UID2SID,         winbindd_dual_uid2sid,               "DUAL_UID2SID" },
 	{ WINBINDD_DUAL_GID2SID,         winbindd_dual_gid2sid,               "DUAL_GID2SID" },
 	{ WINBINDD_DUAL_UID2NAME,        winbindd_dual_uid2name,              "DUAL_UID2NAME" },
@@ -508,6 +691,16 @@ void setup_domain_child(struct winbindd_domain *domain,
 	}
 
 	child->domain = domain;
+	child->pool = child;
+
+	/* The idmap child and the internal domains keep a single
+	   child, they don't wait for a DC. */
+	if ((domain == NULL) || domain->internal) {
+		child->pool_size = 1;
+	} else {
+		child->pool_size = lp_parm_int(-1, "winbind", "domain children", 4);
+		child->pool_size = MAX(child->pool_size, 1);
+	}
 }
 
 struct winbindd_child *children = NULL;
@@ -527,13 +720,41 @@ void winbind_child_died(pid_t pid)
 		return;
 	}
 
+	DLIST_REMOVE(children, child);
+
 	remove_fd_event(&child->event);
 	close(child->event.fd);
 	child->event.fd = 0;
 	child->event.flags = 0;
 	child->pid = 0;
 
-	schedule_async_request(child);
+	if (child->busy != NULL) {
+		struct winbindd_async_request *request = child->busy;
+		child->busy = NULL;
+		TALLOC_FREE(request->reply_timeout_event);
+		request->worker = NULL;
+
+		if (request->retries >= WINBINDD_CHILD_RETRIES) {
+			/* It has killed a child before, don't let it take
+			   down the whole pool */
+			DEBUG(1, ("winbind_child_died: giving up on request "
+				  "%d after %d child crashes\n",
+				  (int)request->request->cmd,
+				  request->retries + 1));
+			request->child->stats.failed += 1;
+			request->response->length =
+				sizeof(struct winbindd_response);
+			request->response->result = WINBINDD_ERROR;
+			request->continuation(request->private_data, False);
+		} else {
+			/* Give the request to another child */
+			request->retries += 1;
+			DLIST_ADD(child->pool->requests, request);
+			child->pool->stats.queued += 1;
+		}
+	}
+
+	schedule_async_request(child->pool);
 }
 
 /* Ensure any negative cache entries with the netbios or realm names are removed. */
@@ -634,6 +855,7 @@ void winbind_msg_online(int msg_type, struct process_id src,
 
 	smb_nscd_flush_user_cache();
 	smb_nscd_flush_group_cache();
+	winbindd_nsscache_flush();
 
 	/* Set all our domains as online. */
 	for (domain = domain_list(); domain; domain = domain->next) {
@@ -744,6 +966,31 @@ static void account_lockout_policy_handler(struct event_context *ctx,
 						      child);
 }
 
+/* Keep the most asked for cache entries fresh, see wcache_refresh_ahead() */
+
+static void cache_refresh_handler(struct event_context *ctx,
+				  struct timed_event *te,
+				  const struct timeval *now,
+				  void *private_data)
+{
+	struct winbindd_child *child =
+		(struct winbindd_child *)private_data;
+	int next;
+
+	TALLOC_FREE(child->cache_refresh_event);
+
+	next = wcache_refresh_ahead(child->domain, (child->pool == child));
+	if (next < 0) {
+		return;
+	}
+
+	child->cache_refresh_event = event_add_timed(winbind_event_context(), NULL,
+						     timeval_current_ofs(next, 0),
+						     "cache_refresh_handler",
+						     cache_refresh_handler,
+						     child);
+}
+
 /* Deal with a request to go offline. */
 
 static void child_msg_offline(int msg_type, struct process_id src,
@@ -921,8 +1168,8 @@ static BOOL fork_domain_child(struct winbindd_child *child)
 		DLIST_ADD(children, child);
 		child->event.fd = fdpair[1];
 		child->event.flags = 0;
-		child->requests = NULL;
 		add_fd_event(&child->event);
+		child->pool->stats.forked += 1;
 		/* We're ok with online/offline messages now. */
 		message_unblock();
 		return True;
@@ -940,6 +1187,7 @@ static BOOL fork_domain_child(struct winbindd_child *child)
 	}
 
 	close_conns_after_fork();
+	wcache_hot_keys_forked();
 
 	if (!override_logfile) {
 		lp_set_logfile(child->logfilename);
@@ -987,6 +1235,11 @@ static BOOL fork_domain_child(struct winbindd_child *child)
 	    lp_winbind_offline_logon()) {
 
 		set_domain_online_request(child->domain);
+	}
+
+	/* One child of a pool is enough to keep the policy cached */
+	if (child->domain && !(child->domain->internal) &&
+	    lp_winbind_offline_logon() && (child->pool == child)) {
 
 		child->lockout_policy_event = event_add_timed(
 			winbind_event_context(), NULL, timeval_zero(),
@@ -1005,6 +1258,18 @@ static BOOL fork_domain_child(struct winbindd_child *child)
 		child->domain->online = False;
 	}
 
+	/* The first round warms up the cache, give the request we were
+	   started for a head start */
+
+	if (child->domain && !(child->domain->internal)) {
+		child->cache_refresh_event = event_add_timed(
+			winbind_event_context(), NULL,
+			timeval_current_ofs(5, 0),
+			"cache_refresh_handler",
+			cache_refresh_handler,
+			child);
+	}
+
 	while (1) {
 
 		int ret;
@@ -781,79 +781,63 @@ void winbindd_endgrent(struct winbindd_cli_state *state)
 	request_ok(state);
 }
 
-/* Get the list of domain groups and domain aliases for a domain.  We fill in
-   the sam_entries and num_sam_entries fields with domain group information.  
-   The dispinfo_ndx field is incremented to the index of the next group to 
-   fetch. Return True if some groups were returned, False otherwise. */
+/* Get the next chunk of domain groups and domain aliases for a domain.
+   We fill in the sam_entries and num_sam_entries fields with domain group
+   information.  The domain groups come first, got_sam_entries is set when
+   they are done.  Return True if some groups were returned, False
+   otherwise. */
+
+#define MAX_GETGRENT_GROUPS 500
 
 static BOOL get_sam_group_entries(struct getent_state *ent)
 {
 	NTSTATUS status;
-	uint32 num_entries;
-	struct acct_info *name_list = NULL;
-	TALLOC_CTX *mem_ctx;
-	BOOL result = False;
+	uint32 num_entries = 0;
 	struct acct_info *sam_grp_entries = NULL;
 	struct winbindd_domain *domain;
         
-	if (ent->got_sam_entries)
-		return False;
-
-	if (!(mem_ctx = talloc_init("get_sam_group_entries(%s)",
-					  ent->domain_name))) {
-		DEBUG(1, ("get_sam_group_entries: could not create talloc context!\n")); 
-		return False;
-	}
-		
 	/* Free any existing group info */
 
-	SAFE_FREE(ent->sam_entries);
+	TALLOC_FREE(ent->sam_entries);
 	ent->num_sam_entries = 0;
-	ent->got_sam_entries = True;
-
-	/* Enumerate domain groups */
-
-	num_entries = 0;
+	ent->sam_entry_index = 0;
 
 	if (!(domain = find_domain_from_name(ent->domain_name))) {
 		DEBUG(3, ("no such domain %s in get_sam_group_entries\n", ent->domain_name));
-		goto done;
+		return False;
 	}
 
 	/* always get the domain global groups */
 
-	status = domain->methods->enum_dom_groups(domain, mem_ctx, &num_entries, &sam_grp_entries);
-	
-	if (!NT_STATUS_IS_OK(status)) {
-		DEBUG(3, ("get_sam_group_entries: could not enumerate domain groups! Error: %s\n", nt_errstr(status)));
-		result = False;
-		goto done;
-	}
+	if (!ent->got_sam_entries) {
+		status = wcache_enum_groups(domain, NULL, &ent->cursor, False,
+					    MAX_GETGRENT_GROUPS, &num_entries,
+					    &sam_grp_entries);
 
-	/* Copy entries into return buffer */
+		if (!NT_STATUS_IS_OK(status)) {
+			DEBUG(3, ("get_sam_group_entries: could not enumerate domain groups! Error: %s\n", nt_errstr(status)));
+			return False;
+		}
 
-	if (num_entries) {
-		if ( !(name_list = SMB_MALLOC_ARRAY(struct acct_info, num_entries)) ) {
-			DEBUG(0,("get_sam_group_entries: Failed to malloc memory for %d domain groups!\n", 
-				num_entries));
-			result = False;
-			goto done;
+		if (num_entries == 0) {
+			ent->got_sam_entries = True;
+			ZERO_STRUCT(ent->cursor);
 		}
-		memcpy( name_list, sam_grp_entries, num_entries * sizeof(struct acct_info) );
 	}
 	
-	ent->num_sam_entries = num_entries;
-	
 	/* get the domain local groups if we are a member of a native win2k domain
 	   and are not using LDAP to get the groups */
 	   
-	if ( ( lp_security() != SEC_ADS && domain->native_mode 
-		&& domain->primary) || domain->internal )
+	if ( (num_entries == 0) &&
+	     (( lp_security() != SEC_ADS && domain->native_mode 
+		&& domain->primary) || domain->internal) )
 	{
 		DEBUG(4,("get_sam_group_entries: %s domain; enumerating local groups as well\n", 
 			domain->native_mode ? "Native Mode 2k":"BUILTIN or local"));
 		
-		status = domain->methods->enum_local_groups(domain, mem_ctx, &num_entries, &sam_grp_entries);
+		status = wcache_enum_groups(domain, NULL, &ent->cursor, True,
+					    MAX_GETGRENT_GROUPS, &num_entries,
+					    &sam_grp_entries);
 		
 		if ( !NT_STATUS_IS_OK(status) ) { 
 			DEBUG(3,("get_sam_group_entries: Failed to enumerate domain local groups!\n"));
@@ -861,43 +845,18 @@ static BOOL get_sam_group_entries(struct getent_state *ent)
 		}
 		else
 			DEBUG(4,("get_sam_group_entries: Returned %d local groups\n", num_entries));
-		
-		/* Copy entries into return buffer */
-
-		if ( num_entries ) {
-			if ( !(name_list = SMB_REALLOC_ARRAY( name_list, struct acct_info, ent->num_sam_entries+num_entries)) )
-			{
-				DEBUG(0,("get_sam_group_entries: Failed to realloc more memory for %d local groups!\n", 
-					num_entries));
-				result = False;
-				goto done;
-			}
-			
-			memcpy( &name_list[ent->num_sam_entries], sam_grp_entries, 
-				num_entries * sizeof(struct acct_info) );
-		}
-	
-		ent->num_sam_entries += num_entries;
 	}
 	
-		
 	/* Fill in remaining fields */
 
-	ent->sam_entries = name_list;
-	ent->sam_entry_index = 0;
-
-	result = (ent->num_sam_entries > 0);
-
- done:
-	talloc_destroy(mem_ctx);
+	ent->sam_entries = sam_grp_entries;
+	ent->num_sam_entries = num_entries;
 
-	return result;
+	return (ent->num_sam_entries > 0);
 }
 
 /* Fetch next group entry from ntdom database */
 
-#define MAX_GETGRENT_GROUPS 500
-
 void winbindd_getgrent(struct winbindd_cli_state *state)
 {
 	struct getent_state *ent;
@@ -969,7 +928,7 @@ void winbindd_getgrent(struct winbindd_cli_state *state)
 
 				/* Free state information for this domain */
 
-				SAFE_FREE(ent->sam_entries);
+				TALLOC_FREE(ent->sam_entries);
 
 				next_ent = ent->next;
 				DLIST_REMOVE(state->getgrent_state, ent);
@@ -1179,47 +1138,44 @@ void winbindd_list_groups(struct winbindd_cli_state *state)
 			
 		ZERO_STRUCT(groups);
 
-		/* Get list of sam groups */
+		/* Get list of sam groups, a chunk at a time */
 		
 		fstrcpy(groups.domain_name, domain->name);
 
-		get_sam_group_entries(&groups);
-			
-		if (groups.num_sam_entries == 0) {
-			/* this domain is empty or in an error state */
-			continue;
-		}
+		while (get_sam_group_entries(&groups)) {
 
-		/* keep track the of the total number of groups seen so 
-		   far over all domains */
-		total_entries += groups.num_sam_entries;
+			/* keep track the of the total number of groups seen so 
+			   far over all domains */
+			total_entries += groups.num_sam_entries;
 		
-		/* Allocate some memory for extra data.  Note that we limit
-		   account names to sizeof(fstring) = 128 characters.  */		
-		extra_data = (char *)SMB_REALLOC(
-			extra_data, sizeof(fstring) * total_entries);
+			/* Allocate some memory for extra data.  Note that we limit
+			   account names to sizeof(fstring) = 128 characters.  */		
+			extra_data = (char *)SMB_REALLOC(
+				extra_data, sizeof(fstring) * total_entries);
  
-		if (!extra_data) {
-			DEBUG(0,("failed to enlarge buffer!\n"));
-			request_error(state);
-			return;
-		}
-
-		/* Pack group list into extra data fields */
-		for (i = 0; i < groups.num_sam_entries; i++) {
-			char *group_name = ((struct acct_info *)
-					    groups.sam_entries)[i].acct_name; 
-			fstring name;
+			if (!extra_data) {
+				DEBUG(0,("failed to enlarge buffer!\n"));
+				TALLOC_FREE(groups.sam_entries);
+				request_error(state);
+				return;
+			}
 
-			fill_domain_username(name, domain->name, group_name, True);
-			/* Append to extra data */			
-			memcpy(&extra_data[extra_data_len], name, 
-                               strlen(name));
-			extra_data_len += strlen(name);
-			extra_data[extra_data_len++] = ',';
+			/* Pack group list into extra data fields */
+			for (i = 0; i < groups.num_sam_entries; i++) {
+				char *group_name = ((struct acct_info *)
+						    groups.sam_entries)[i].acct_name; 
+				fstring name;
+
+				fill_domain_username(name, domain->name, group_name, True);
+				/* Append to extra data */			
+				memcpy(&extra_data[extra_data_len], name, 
+				       strlen(name));
+				extra_data_len += strlen(name);
+				extra_data[extra_data_len++] = ',';
+			}
 		}
 
-		SAFE_FREE(groups.sam_entries);
+		TALLOC_FREE(groups.sam_entries);
 	}
 
 	/* Assign extra_data fields in response structure */
@@ -471,6 +471,68 @@ void winbindd_ping(struct winbindd_cli_state *state)
 	request_ok(state);
 }
 
+/* Show how busy the children of each domain are */
+
+static char *child_stats_line(TALLOC_CTX *mem_ctx, char *buf,
+			      const char *name, struct winbindd_child *child)
+{
+	struct winbindd_child *worker;
+	const struct winbindd_child_stats *stats = &child->stats;
+	int running = 0, busy = 0;
+	uint32 started = stats->served + stats->failed;
+
+	for (worker = child; worker != NULL; worker = worker->pool_next) {
+		if (worker->pid != 0) {
+			running += 1;
+		}
+		if (worker->busy != NULL) {
+			busy += 1;
+		}
+	}
+
+	return talloc_asprintf(mem_ctx, "%s%s : children %d/%d (forked %u), "
+			       "busy %d, queued %u (max %u), "
+			       "served %u, failed %u, "
+			       "wait avg %.1fms, reply avg %.1fms max %.1fms\n",
+			       buf, name, running, child->pool_size,
+			       stats->forked, busy, stats->queued,
+			       stats->max_queued, stats->served, stats->failed,
+			       started ? (double)stats->wait_usec / started / 1000 : 0.0,
+			       stats->served ? (double)stats->reply_usec / stats->served / 1000 : 0.0,
+			       (double)stats->max_reply_usec / 1000);
+}
+
+void winbindd_child_stats(struct winbindd_cli_state *state)
+{
+	struct winbindd_domain *domain;
+	char *buf;
+
+	DEBUG(3, ("[%5lu]: request child statistics\n",
+		  (unsigned long)state->pid));
+
+	buf = child_stats_line(state->mem_ctx, talloc_strdup(state->mem_ctx, ""),
+			       "idmap", idmap_child());
+
+	for (domain = domain_list(); domain && buf; domain = domain->next) {
+		buf = child_stats_line(state->mem_ctx, buf, domain->name,
+				       &domain->child);
+	}
+
+	if (buf == NULL) {
+		DEBUG(0, ("talloc failed\n"));
+		request_error(state);
+		return;
+	}
+
+	state->response.extra_data.data = SMB_STRDUP(buf);
+	if (state->response.extra_data.data == NULL) {
+		request_error(state);
+		return;
+	}
+	state->response.length += strlen(buf) + 1;
+	request_ok(state);
+}
+
 /* List various tidbits of information */
 
 void winbindd_info(struct winbindd_cli_state *state)
@@ -172,6 +172,13 @@ enum winbindd_cmd {
 	   protocol using cached password. */
 	WINBINDD_CCACHE_NTLMAUTH,
 
+	/* Queue depth and latency of the domain children */
+	WINBINDD_CHILD_STATS,
+
+	/* Switch the socket to pipelined requests, see
+	   winbindd_pipeline_open() */
+	WINBINDD_PIPELINE,
+
 	WINBINDD_NUM_CMDS
 };
 
@@ -0,0 +1,254 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   Winbind daemon - publish answers in the cache shared with NSS clients
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "includes.h"
+#include "winbindd.h"
+#include "winbind_nsscache.h"
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_WINBIND
+
+/*
+ * See winbind_nsscache.h for the layout. Only the main winbindd
+ * writes the cache, its children never answer clients directly.
+ *
+ *	winbind:nss cache ttl = 60		0 turns the cache off
+ *	winbind:nss cache negative ttl = 10	for unknown names and ids
+ *	winbind:nss cache size = 4096		slots of 2.5k each
+ */
+
+static struct wb_nsscache_header *nsscache;
+static size_t nsscache_size;
+static int nsscache_ttl;
+static int nsscache_negative_ttl;
+
+static void nsscache_path(pstring path)
+{
+	pstr_sprintf(path, "%s/%s", WINBINDD_SOCKET_DIR, WB_NSSCACHE_NAME);
+}
+
+/****************************************************************
+ Tell the clients still mapping a cache from an earlier winbindd
+ to let go of it.
+****************************************************************/
+
+static void nsscache_retire(const char *path)
+{
+	struct wb_nsscache_header *old;
+	int fd;
+
+	fd = sys_open(path, O_RDWR, 0);
+	if (fd == -1) {
+		return;
+	}
+	old = (struct wb_nsscache_header *)mmap(NULL, sizeof(*old),
+			PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (old == (struct wb_nsscache_header *)MAP_FAILED) {
+		return;
+	}
+	old->magic = 0;
+	munmap((void *)old, sizeof(*old));
+}
+
+void winbindd_nsscache_init(void)
+{
+	pstring path, tmp;
+	int fd, num_slots;
+	void *p;
+
+	nsscache_path(path);
+	nsscache_retire(path);
+
+#ifdef HAVE_WB_NSSCACHE
+	nsscache_ttl = lp_parm_int(-1, "winbind", "nss cache ttl", 60);
+	nsscache_negative_ttl = lp_parm_int(-1, "winbind",
+					    "nss cache negative ttl", 10);
+#endif
+	if (nsscache_ttl <= 0) {
+		unlink(path);
+		return;
+	}
+
+	num_slots = lp_parm_int(-1, "winbind", "nss cache size", 4096);
+	num_slots = MAX(num_slots, WB_NSSCACHE_PROBES);
+	nsscache_size = sizeof(struct wb_nsscache_header) +
+		(size_t)num_slots * sizeof(struct wb_nsscache_slot);
+
+	/* Build it under a private name and rename it into place, so a
+	   client never sees a half set up file. */
+
+	pstr_sprintf(tmp, "%s.%u", path, (unsigned int)sys_getpid());
+	unlink(tmp);
+	fd = sys_open(tmp, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd == -1) {
+		DEBUG(0, ("winbindd_nsscache_init: could not create %s: %s\n",
+			  tmp, strerror(errno)));
+		return;
+	}
+	if (sys_ftruncate(fd, nsscache_size) == -1) {
+		DEBUG(0, ("winbindd_nsscache_init: could not size %s: %s\n",
+			  tmp, strerror(errno)));
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	p = mmap(NULL, nsscache_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		DEBUG(0, ("winbindd_nsscache_init: could not map %s: %s\n",
+			  tmp, strerror(errno)));
+		unlink(tmp);
+		return;
+	}
+
+	nsscache = (struct wb_nsscache_header *)p;
+	nsscache->version = WB_NSSCACHE_VERSION;
+	nsscache->num_slots = num_slots;
+	nsscache->slot_size = sizeof(struct wb_nsscache_slot);
+	nsscache->generation = 1;
+	WB_NSSCACHE_BARRIER();
+	nsscache->magic = WB_NSSCACHE_MAGIC;
+
+	if (rename(tmp, path) == -1) {
+		DEBUG(0, ("winbindd_nsscache_init: could not rename %s: %s\n",
+			  tmp, strerror(errno)));
+		munmap(p, nsscache_size);
+		nsscache = NULL;
+		unlink(tmp);
+		return;
+	}
+
+	DEBUG(3, ("winbindd_nsscache_init: %d slots in %s\n", num_slots, path));
+}
+
+void winbindd_nsscache_shutdown(void)
+{
+	pstring path;
+
+	if (nsscache == NULL) {
+		return;
+	}
+	nsscache->magic = 0;
+	munmap((void *)nsscache, nsscache_size);
+	nsscache = NULL;
+
+	nsscache_path(path);
+	unlink(path);
+}
+
+/****************************************************************
+ Drop everything, for example when the domains come back online.
+****************************************************************/
+
+void winbindd_nsscache_flush(void)
+{
+	if (nsscache == NULL) {
+		return;
+	}
+	nsscache->generation += 1;
+	WB_NSSCACHE_BARRIER();
+}
+
+/****************************************************************
+ Publish the answer to a request. key is what wb_nsscache_key()
+ returned when the request came in, the handlers are free to change
+ the request.
+****************************************************************/
+
+void winbindd_nsscache_store(int cmd, const char *key,
+			     const struct winbindd_response *response)
+{
+	struct wb_nsscache_slot *slots, *slot, *victim = NULL;
+	uint32 hash, generation;
+	size_t extra_len;
+	time_t now;
+	int i, ttl;
+
+	if ((nsscache == NULL) || (key[0] == '\0')) {
+		return;
+	}
+
+	if (response->result == WINBINDD_OK) {
+		ttl = nsscache_ttl;
+	} else if (response->result == WINBINDD_ERROR) {
+		ttl = nsscache_negative_ttl;
+	} else {
+		return;
+	}
+	if (ttl <= 0) {
+		return;
+	}
+
+	extra_len = response->length - sizeof(*response);
+	if ((response->length < sizeof(*response)) ||
+	    (extra_len > WB_NSSCACHE_EXTRA) ||
+	    ((extra_len != 0) && (response->extra_data.data == NULL))) {
+		return;
+	}
+
+	now = time(NULL);
+	generation = nsscache->generation;
+	hash = wb_nsscache_hash(cmd, key);
+	slots = (struct wb_nsscache_slot *)(nsscache + 1);
+
+	/* Reuse the slot holding the key, else a free one, else the one
+	   expiring first */
+
+	for (i = 0; i < WB_NSSCACHE_PROBES; i++) {
+		slot = &slots[(hash + i) % nsscache->num_slots];
+
+		if ((slot->hash == hash) && (slot->cmd == cmd) &&
+		    (strncmp(slot->key, key, sizeof(fstring)) == 0)) {
+			victim = slot;
+			break;
+		}
+		if ((slot->generation != generation) || (slot->expires <= now)) {
+			if ((victim == NULL) || (victim->generation == generation &&
+						 victim->expires > now)) {
+				victim = slot;
+			}
+			continue;
+		}
+		if ((victim == NULL) || (slot->expires < victim->expires)) {
+			victim = slot;
+		}
+	}
+
+	slot = victim;
+
+	slot->seqnum += 1;
+	WB_NSSCACHE_BARRIER();
+
+	slot->generation = generation;
+	slot->expires = now + ttl;
+	slot->cmd = cmd;
+	slot->hash = hash;
+	fstrcpy(slot->key, key);
+	slot->result = response->result;
+	slot->extra_len = extra_len;
+	memcpy(&slot->data, &response->data, sizeof(slot->data));
+	if (extra_len != 0) {
+		memcpy(slot->extra, response->extra_data.data, extra_len);
+	}
+
+	WB_NSSCACHE_BARRIER();
+	slot->seqnum += 1;
+}
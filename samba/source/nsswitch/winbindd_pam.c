@@ -814,8 +814,15 @@ NTSTATUS winbindd_dual_pam_auth_cached(struct winbindd_domain *domain,
 				name_user,
 				&sid,
 				&type)) {
-		DEBUG(10,("winbindd_dual_pam_auth_cached: no such user in the cache\n"));
-		return NT_STATUS_NO_SUCH_USER;
+
+		/* The name to sid mapping may have expired or never
+		   been made while the user has a cached logon */
+
+		if (!netsamlogon_cache_sid_byname(name_domain, name_user, &sid)) {
+			DEBUG(10,("winbindd_dual_pam_auth_cached: no such user in the cache\n"));
+			return NT_STATUS_NO_SUCH_USER;
+		}
+		type = SID_NAME_USER;
 	}
 
 	if (type != SID_NAME_USER) {
@@ -339,8 +339,28 @@ static void sids2xids_recv(void *private_data, BOOL success, void *data, int len
 
 void winbindd_sids_to_unixids(struct winbindd_cli_state *state)
 {
+	DOM_SID *sids = (DOM_SID *)state->request.extra_data.data;
+	size_t i, num;
+
 	DEBUG(3, ("[%5lu]: sids to xids\n", (unsigned long)state->pid));
 
+	num = state->request.extra_len / sizeof(DOM_SID);
+	if ((num == 0) ||
+	    (state->request.extra_len != num * sizeof(DOM_SID))) {
+		DEBUG(5, ("Invalid buffer size %u\n",
+			  (unsigned int)state->request.extra_len));
+		request_error(state);
+		return;
+	}
+	for (i = 0; i < num; i++) {
+		if (sids[i].num_auths > MAXSUBAUTHS) {
+			DEBUG(5, ("Invalid sid at position %u\n",
+				  (unsigned int)i));
+			request_error(state);
+			return;
+		}
+	}
+
 	winbindd_sids2xids_async(state->mem_ctx,
 			state->request.extra_data.data,
 			state->request.extra_len,
@@ -526,23 +526,24 @@ void winbindd_endpwent(struct winbindd_cli_state *state)
 	request_ok(state);
 }
 
-/* Get partial list of domain users for a domain.  We fill in the sam_entries,
-   and num_sam_entries fields with domain user information.  The dispinfo_ndx
-   field is incremented to the index of the next user to fetch.  Return True if
-   some users were returned, False otherwise. */
+/* Get the next chunk of domain users for a domain.  We fill in the
+   sam_entries and num_sam_entries fields with domain user information.
+   Return True if some users were returned, False otherwise. */
 
-static BOOL get_sam_user_entries(struct getent_state *ent, TALLOC_CTX *mem_ctx)
+#define MAX_GETPWENT_USERS 500
+
+static BOOL get_sam_user_entries(struct getent_state *ent)
 {
 	NTSTATUS status;
 	uint32 num_entries;
 	WINBIND_USERINFO *info;
-	struct getpwent_user *name_list = NULL;
 	struct winbindd_domain *domain;
-	struct winbindd_methods *methods;
-	unsigned int i;
 
-	if (ent->num_sam_entries)
-		return False;
+	/* Free any existing user info */
+
+	TALLOC_FREE(ent->sam_entries);
+	ent->num_sam_entries = 0;
+	ent->sam_entry_index = 0;
 
 	if (!(domain = find_domain_from_name(ent->domain_name))) {
 		DEBUG(3, ("no such domain %s in get_sam_user_entries\n",
@@ -550,83 +551,26 @@ static BOOL get_sam_user_entries(struct getent_state *ent, TALLOC_CTX *mem_ctx)
 		return False;
 	}
 
-	methods = domain->methods;
+	/* Read the next chunk of the user list, only the list itself
+	   stays in the cache */
 
-	/* Free any existing user info */
+	status = wcache_enum_users(domain, NULL, &ent->cursor,
+				   MAX_GETPWENT_USERS, &num_entries, &info);
 
-	SAFE_FREE(ent->sam_entries);
-	ent->num_sam_entries = 0;
-	
-	/* Call query_user_list to get a list of usernames and user rids */
-
-	num_entries = 0;
-
-	status = methods->query_user_list(domain, mem_ctx, &num_entries, 
-					  &info);
-		
 	if (!NT_STATUS_IS_OK(status)) {
 		DEBUG(10,("get_sam_user_entries: query_user_list failed with %s\n",
 			nt_errstr(status) ));
 		return False;
 	}
 
-	if (num_entries) {
-		name_list = SMB_REALLOC_ARRAY(name_list, struct getpwent_user, ent->num_sam_entries + num_entries);
-		
-		if (!name_list) {
-			DEBUG(0,("get_sam_user_entries realloc failed.\n"));
-			return False;
-		}
-	}
+	ent->sam_entries = info;
+	ent->num_sam_entries = num_entries;
 
-	for (i = 0; i < num_entries; i++) {
-		/* Store account name and gecos */
-		if (!info[i].acct_name) {
-			fstrcpy(name_list[ent->num_sam_entries + i].name, "");
-		} else {
-			fstrcpy(name_list[ent->num_sam_entries + i].name, 
-				info[i].acct_name); 
-		}
-		if (!info[i].full_name) {
-			fstrcpy(name_list[ent->num_sam_entries + i].gecos, "");
-		} else {
-			fstrcpy(name_list[ent->num_sam_entries + i].gecos, 
-				info[i].full_name); 
-		}
-		if (!info[i].homedir) {
-			fstrcpy(name_list[ent->num_sam_entries + i].homedir, "");
-		} else {
-			fstrcpy(name_list[ent->num_sam_entries + i].homedir, 
-				info[i].homedir); 
-		}
-		if (!info[i].shell) {
-			fstrcpy(name_list[ent->num_sam_entries + i].shell, "");
-		} else {
-			fstrcpy(name_list[ent->num_sam_entries + i].shell, 
-				info[i].shell); 
-		}
-	
-	
-		/* User and group ids */
-		sid_copy(&name_list[ent->num_sam_entries+i].user_sid,
-			 &info[i].user_sid);
-		sid_copy(&name_list[ent->num_sam_entries+i].group_sid,
-			 &info[i].group_sid);
-	}
-		
-	ent->num_sam_entries += num_entries;
-	
-	/* Fill in remaining fields */
-	
-	ent->sam_entries = name_list;
-	ent->sam_entry_index = 0;
 	return ent->num_sam_entries > 0;
 }
 
 /* Fetch next passwd entry from ntdom database */
 
-#define MAX_GETPWENT_USERS 500
-
 void winbindd_getpwent(struct winbindd_cli_state *state)
 {
 	struct getent_state *ent;
@@ -672,20 +616,19 @@ void winbindd_getpwent(struct winbindd_cli_state *state)
 	/* Start sending back users */
 
 	for (user_list_ndx = 0; user_list_ndx < num_users; ) {
-		struct getpwent_user *name_list = NULL;
+		WINBIND_USERINFO *info;
 		uint32 result;
 
 		/* Do we need to fetch another chunk of users? */
 
 		if (ent->num_sam_entries == ent->sam_entry_index) {
 
-			while(ent &&
-			      !get_sam_user_entries(ent, state->mem_ctx)) {
+			while(ent && !get_sam_user_entries(ent)) {
 				struct getent_state *next_ent;
 
 				/* Free state information for this domain */
 
-				SAFE_FREE(ent->sam_entries);
+				TALLOC_FREE(ent->sam_entries);
 
 				next_ent = ent->next;
 				DLIST_REMOVE(state->getpwent_state, ent);
@@ -700,19 +643,21 @@ void winbindd_getpwent(struct winbindd_cli_state *state)
 				break;
 		}
 
-		name_list = (struct getpwent_user *)ent->sam_entries;
+		info = &((WINBIND_USERINFO *)ent->sam_entries)
+			[ent->sam_entry_index];
 
 		/* Lookup user info */
 		
-		result = winbindd_fill_pwent(
-			ent->domain_name, 
-			name_list[ent->sam_entry_index].name,
-			&name_list[ent->sam_entry_index].user_sid,
-			&name_list[ent->sam_entry_index].group_sid,
-			name_list[ent->sam_entry_index].gecos,
-			name_list[ent->sam_entry_index].homedir,
-			name_list[ent->sam_entry_index].shell,
-			&user_list[user_list_ndx]);
+		result = (info->acct_name != NULL) &&
+			winbindd_fill_pwent(
+				ent->domain_name, 
+				info->acct_name,
+				&info->user_sid,
+				&info->group_sid,
+				info->full_name,
+				info->homedir,
+				info->shell,
+				&user_list[user_list_ndx]);
 		
 		/* Add user to return list */
 		
@@ -725,7 +670,7 @@ void winbindd_getpwent(struct winbindd_cli_state *state)
 
 		} else
 			DEBUG(1, ("could not lookup domain user %s\n",
-				  name_list[ent->sam_entry_index].name));
+				  info->acct_name ? info->acct_name : ""));
 
 		ent->sam_entry_index++;
 		
@@ -780,7 +780,7 @@ void free_getent_state(struct getent_state *state)
 
 		/* Free sam entries then list entry */
 
-		SAFE_FREE(state->sam_entries);
+		TALLOC_FREE(state->sam_entries);
 		DLIST_REMOVE(state, state);
 		next = temp->next;
 
@@ -967,60 +967,79 @@ int winbindd_num_clients(void)
 	return _num_clients;
 }
 
+/* Build the group list straight from the cached info3 record */
+
+struct usergroups_cached_state {
+	TALLOC_CTX *mem_ctx;
+	NTSTATUS status;
+	DOM_SID *sids;
+	uint32 num_sids;
+};
+
+static BOOL usergroups_cached_fn(const struct netsamlogon_cache_entry *entry,
+				 void *private_data)
+{
+	struct usergroups_cached_state *state =
+		(struct usergroups_cached_state *)private_data;
+	const uint8 *p;
+	uint32 i;
+
+	if (entry->num_groups == 0) {
+		state->status = NT_STATUS_UNSUCCESSFUL;
+		return True;
+	}
+
+	state->sids = TALLOC_ARRAY(state->mem_ctx, DOM_SID,
+				   entry->num_groups + 1);
+	if (state->sids == NULL) {
+		state->status = NT_STATUS_NO_MEMORY;
+		return True;
+	}
+
+	/* always add the primary group to the sid array */
+	sid_compose(&state->sids[0], &entry->domain_sid, entry->user_rid);
+
+	for (i = 0, p = entry->groups; i < entry->num_groups; i++, p += 8) {
+		sid_compose(&state->sids[i + 1], &entry->domain_sid,
+			    IVAL(p, 0));
+	}
+
+	state->num_sids = entry->num_groups + 1;
+	state->status = NT_STATUS_OK;
+	return True;
+}
+
 NTSTATUS lookup_usergroups_cached(struct winbindd_domain *domain,
 				  TALLOC_CTX *mem_ctx,
 				  const DOM_SID *user_sid,
 				  uint32 *p_num_groups, DOM_SID **user_sids)
 {
-	NET_USER_INFO_3 *info3 = NULL;
-	NTSTATUS status = NT_STATUS_NO_MEMORY;
-	int i;
-	size_t num_groups = 0;
-	DOM_SID group_sid, primary_group;
-	
+	struct usergroups_cached_state state;
+
 	DEBUG(3,(": lookup_usergroups_cached\n"));
 	
 	*user_sids = NULL;
-	num_groups = 0;
 	*p_num_groups = 0;
 
-	info3 = netsamlogon_cache_get(mem_ctx, user_sid);
+	state.mem_ctx = mem_ctx;
+	state.status = NT_STATUS_NO_MEMORY;
+	state.sids = NULL;
+	state.num_sids = 0;
 
-	if (info3 == NULL) {
+	if (!netsamlogon_cache_parse(user_sid, usergroups_cached_fn, &state)) {
 		return NT_STATUS_OBJECT_NAME_NOT_FOUND;
 	}
 
-	if (info3->num_groups == 0) {
-		TALLOC_FREE(info3);
-		return NT_STATUS_UNSUCCESSFUL;
-	}
-	
-	/* always add the primary group to the sid array */
-	sid_compose(&primary_group, &info3->dom_sid.sid, info3->user_rid);
-	
-	if (!add_sid_to_array(mem_ctx, &primary_group, user_sids, &num_groups)) {
-		TALLOC_FREE(info3);
-		return NT_STATUS_NO_MEMORY;
-	}
-
-	for (i=0; i<info3->num_groups; i++) {
-		sid_copy(&group_sid, &info3->dom_sid.sid);
-		sid_append_rid(&group_sid, info3->gids[i].g_rid);
-
-		if (!add_sid_to_array(mem_ctx, &group_sid, user_sids,
-				 &num_groups)) {
-			TALLOC_FREE(info3);
-			return NT_STATUS_NO_MEMORY;
-		}
+	if (!NT_STATUS_IS_OK(state.status)) {
+		return state.status;
 	}
 
-	TALLOC_FREE(info3);
-	*p_num_groups = num_groups;
-	status = (user_sids != NULL) ? NT_STATUS_OK : NT_STATUS_NO_MEMORY;
+	*user_sids = state.sids;
+	*p_num_groups = state.num_sids;
 	
 	DEBUG(3,(": lookup_usergroups_cached succeeded\n"));
 
-	return status;
+	return NT_STATUS_OK;
 }
 
 /*********************************************************************
@@ -332,6 +332,8 @@ typedef struct {
 	BOOL autoloaded;
 	int usershare;
 	time_t usershare_last_mod;
+	BOOL conf_nodigest;
+	unsigned char conf_digest[16];
 	char *szService;
 	char *szPath;
 	char *szUsername;
@@ -476,6 +478,8 @@ static service sDefault = {
 	False,			/* not autoloaded */
 	0,			/* not a usershare */
 	(time_t)0,              /* No last mod time */
+	False,			/* conf_nodigest */
+	{0},			/* conf_digest */
 	NULL,			/* szService */
 	NULL,			/* szPath */
 	NULL,			/* szUsername */
@@ -622,6 +626,9 @@ static service **ServicePtrs = NULL;
 static int iNumServices = 0;
 static int iServiceIndex = 0;
 static TDB_CONTEXT *ServiceHash;
+static int ServiceHashSize = 0;
+static int *subst_services = NULL;
+static int num_subst_services = 0;
 static int *invalid_services = NULL;
 static int num_invalid_services = 0;
 static BOOL bInGlobalSection = True;
@@ -1784,25 +1791,28 @@ static char *lp_string(const char *s)
 #define FN_GLOBAL_INTEGER(fn_name,ptr) \
  int fn_name(void) {return(*(int *)(ptr));}
 
+/* Number of per-share parameter lookups, for the smbd profile. */
+static unsigned int param_lookups;
+
 #define FN_LOCAL_STRING(fn_name,val) \
- char *fn_name(int i) {return(lp_string((LP_SNUM_OK(i) && ServicePtrs[(i)]->val) ? ServicePtrs[(i)]->val : sDefault.val));}
+ char *fn_name(int i) {param_lookups++; return(lp_string((LP_SNUM_OK(i) && ServicePtrs[(i)]->val) ? ServicePtrs[(i)]->val : sDefault.val));}
 #define FN_LOCAL_CONST_STRING(fn_name,val) \
- const char *fn_name(int i) {return (const char *)((LP_SNUM_OK(i) && ServicePtrs[(i)]->val) ? ServicePtrs[(i)]->val : sDefault.val);}
+ const char *fn_name(int i) {param_lookups++; return (const char *)((LP_SNUM_OK(i) && ServicePtrs[(i)]->val) ? ServicePtrs[(i)]->val : sDefault.val);}
 #define FN_LOCAL_LIST(fn_name,val) \
- const char **fn_name(int i) {return(const char **)(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
+ const char **fn_name(int i) {param_lookups++; return(const char **)(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
 #define FN_LOCAL_BOOL(fn_name,val) \
- BOOL fn_name(int i) {return(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
+ BOOL fn_name(int i) {param_lookups++; return(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
 #define FN_LOCAL_INTEGER(fn_name,val) \
- int fn_name(int i) {return(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
+ int fn_name(int i) {param_lookups++; return(LP_SNUM_OK(i)? ServicePtrs[(i)]->val : sDefault.val);}
 
 #define FN_LOCAL_PARM_BOOL(fn_name,val) \
- BOOL fn_name(const struct share_params *p) {return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
+ BOOL fn_name(const struct share_params *p) {param_lookups++; return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
 #define FN_LOCAL_PARM_INTEGER(fn_name,val) \
- int fn_name(const struct share_params *p) {return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
+ int fn_name(const struct share_params *p) {param_lookups++; return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
 #define FN_LOCAL_PARM_STRING(fn_name,val) \
- char *fn_name(const struct share_params *p) {return(lp_string((LP_SNUM_OK(p->service) && ServicePtrs[(p->service)]->val) ? ServicePtrs[(p->service)]->val : sDefault.val));}
+ char *fn_name(const struct share_params *p) {param_lookups++; return(lp_string((LP_SNUM_OK(p->service) && ServicePtrs[(p->service)]->val) ? ServicePtrs[(p->service)]->val : sDefault.val));}
 #define FN_LOCAL_CHAR(fn_name,val) \
- char fn_name(const struct share_params *p) {return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
+ char fn_name(const struct share_params *p) {param_lookups++; return(LP_SNUM_OK(p->service)? ServicePtrs[(p->service)]->val : sDefault.val);}
 
 FN_GLOBAL_STRING(lp_smb_ports, &Globals.smb_ports)
 FN_GLOBAL_STRING(lp_dos_charset, &Globals.dos_charset)
@@ -2519,8 +2529,17 @@ static void free_service_byindex(int idx)
 
 	if (ServicePtrs[idx]->szService) {
 		char *canon_name = canonicalize_servicename( ServicePtrs[idx]->szService );
+		int i;
 		
 		tdb_delete_bystring(ServiceHash, canon_name );
+
+		for (i = 0; i < num_subst_services; i++) {
+			if (subst_services[i] == idx) {
+				subst_services[i] =
+					subst_services[--num_subst_services];
+				break;
+			}
+		}
 	}
 
 	free_service(ServicePtrs[idx]);
@@ -2637,18 +2656,55 @@ static char *canonicalize_servicename(const char *src)
   Add a name/index pair for the services array to the hash table.
 ***************************************************************************/
 
+#define SERVICE_HASH_MIN_SIZE 1031
+
+/***************************************************************************
+  (Re)create the service hash with the given number of buckets and fill
+  it with the services we already have, so that lookups stay O(1) when
+  thousands of shares are defined.
+***************************************************************************/
+
+static BOOL create_service_hash(int hash_size)
+{
+	TDB_CONTEXT *tdb;
+	int i;
+
+	DEBUG(10,("create_service_hash: creating tdb servicehash with %d "
+		  "buckets\n", hash_size));
+
+	tdb = tdb_open("servicehash", hash_size, TDB_INTERNAL,
+		       (O_RDWR|O_CREAT), 0600);
+	if ( !tdb ) {
+		DEBUG(0,("create_service_hash: open tdb servicehash failed!\n"));
+		return False;
+	}
+
+	for (i = 0; i < iNumServices; i++) {
+		char *canon_name;
+
+		if (!VALID(i) || !ServicePtrs[i]->szService)
+			continue;
+		if ( !(canon_name = canonicalize_servicename( ServicePtrs[i]->szService )) )
+			continue;
+		tdb_store_int32(tdb, canon_name, i);
+	}
+
+	if (ServiceHash)
+		tdb_close(ServiceHash);
+	ServiceHash = tdb;
+	ServiceHashSize = hash_size;
+
+	return True;
+}
+
 static BOOL hash_a_service(const char *name, int idx)
 {
 	char *canon_name;
 
-	if ( !ServiceHash ) {
-		DEBUG(10,("hash_a_service: creating tdb servicehash\n"));
-		ServiceHash = tdb_open("servicehash", 1031, TDB_INTERNAL, 
-                                        (O_RDWR|O_CREAT), 0600);
-		if ( !ServiceHash ) {
-			DEBUG(0,("hash_a_service: open tdb servicehash failed!\n"));
+	if ( !ServiceHash || iNumServices > 2 * ServiceHashSize ) {
+		if (!create_service_hash(MAX(SERVICE_HASH_MIN_SIZE,
+					     4 * iNumServices + 1)))
 			return False;
-		}
 	}
 
 	DEBUG(10,("hash_a_service: hashing index %d for service name %s\n",
@@ -2659,6 +2715,19 @@ static BOOL hash_a_service(const char *name, int idx)
 
         tdb_store_int32(ServiceHash, canon_name, idx);
 
+	/* names like "%U" only match after substitution, remember them
+	   so that lp_servicenumber() need not look at every service */
+	if (strchr_m(name, '%')) {
+		int *tmp = SMB_REALLOC_ARRAY(subst_services, int,
+					     num_subst_services + 1);
+		if (tmp == NULL) {
+			DEBUG(0,("hash_a_service: out of memory!\n"));
+			return False;
+		}
+		subst_services = tmp;
+		subst_services[num_subst_services++] = idx;
+	}
+
 	return True;
 }
 
@@ -3155,6 +3224,432 @@ BOOL lp_file_list_changed(void)
 	return (False);
 }
 
+/***************************************************************************
+ Shared snapshot of the parsed configuration.
+
+ A forking smbd parent records the stream of sections and parameters it
+ sees while parsing smb.conf (includes flattened into it) and publishes
+ it in smbconf_cache.tdb under a generation number. Its children compare
+ that generation instead of stat'ing every config file, and when it has
+ moved they replay the stream rather than re-parsing the files. Each
+ service carries a digest of its definition so that services which did
+ not change are kept as they are.
+
+ The snapshot is only published if no config file name depends on
+ substitutions (e.g. "include = %U"), as those may differ per child.
+***************************************************************************/
+
+#define SNAPSHOT_TDB "smbconf_cache.tdb"
+#define SNAPSHOT_GENERATION_KEY "GENERATION"
+#define SNAPSHOT_DATA_KEY "SNAPSHOT"
+
+/* generation(4) + global digest(16) */
+#define SNAPSHOT_HDR_LEN 20
+
+#define SNAPSHOT_SECTION 'S'
+#define SNAPSHOT_PARAMETER 'P'
+#define SNAPSHOT_DIGEST 'D'
+
+static TDB_CONTEXT *snapshot_tdb;
+static BOOL bSnapshotPublisher = False;
+static BOOL bRecordSnapshot = False;
+static uint32 snapshot_generation = 0;
+static BOOL bConfDigestValid = False;
+static unsigned char global_conf_digest[16];
+static char *snapshot_buf;
+static size_t snapshot_len, snapshot_alloc;
+static BOOL *snapshot_keep;
+static int snapshot_num_keep;
+static BOOL bSnapshotSkip = False;
+
+/*******************************************************************
+ Chain a parameter into a definition digest.
+********************************************************************/
+
+static void snapshot_digest(unsigned char digest[16],
+			    const char *pszParmName, const char *pszParmValue)
+{
+	struct MD5Context ctx;
+
+	MD5Init(&ctx);
+	MD5Update(&ctx, digest, 16);
+	MD5Update(&ctx, (const unsigned char *)pszParmName,
+		  strlen(pszParmName) + 1);
+	MD5Update(&ctx, (const unsigned char *)pszParmValue,
+		  strlen(pszParmValue) + 1);
+	MD5Final(digest, &ctx);
+}
+
+/*******************************************************************
+ Append a record to the snapshot being built.
+********************************************************************/
+
+static BOOL snapshot_append(char type, const char *s1, const void *p2,
+			    size_t len2)
+{
+	size_t len1 = strlen(s1) + 1;
+	size_t needed = snapshot_len + 1 + len1 + len2;
+
+	if (needed > snapshot_alloc) {
+		size_t new_alloc = MAX(needed, snapshot_alloc * 2);
+		char *tmp = SMB_REALLOC(snapshot_buf, new_alloc);
+
+		if (tmp == NULL) {
+			DEBUG(0, ("snapshot_append: out of memory\n"));
+			bRecordSnapshot = False;
+			return False;
+		}
+		snapshot_buf = tmp;
+		snapshot_alloc = new_alloc;
+	}
+
+	snapshot_buf[snapshot_len++] = type;
+	memcpy(snapshot_buf + snapshot_len, s1, len1);
+	snapshot_len += len1;
+	if (len2) {
+		memcpy(snapshot_buf + snapshot_len, p2, len2);
+		snapshot_len += len2;
+	}
+	return True;
+}
+
+/*******************************************************************
+ Walk the records of a snapshot. Returns the offset of the next record
+ or 0 at the end (or on a malformed record).
+********************************************************************/
+
+static size_t snapshot_next(const char *buf, size_t len, size_t ofs,
+			    char *type, const char **s1, const char **p2)
+{
+	const char *end;
+
+	if (ofs >= len)
+		return 0;
+
+	*type = buf[ofs++];
+	*s1 = buf + ofs;
+	if ((end = memchr(*s1, '\0', len - ofs)) == NULL)
+		return 0;
+	ofs += (end - *s1) + 1;
+	*p2 = buf + ofs;
+
+	switch (*type) {
+	case SNAPSHOT_SECTION:
+		return ofs;
+	case SNAPSHOT_PARAMETER:
+		if (ofs >= len ||
+		    (end = memchr(*p2, '\0', len - ofs)) == NULL)
+			return 0;
+		return ofs + (end - *p2) + 1;
+	case SNAPSHOT_DIGEST:
+		if (ofs + 16 > len)
+			return 0;
+		return ofs + 16;
+	}
+	return 0;
+}
+
+static BOOL is_global_section(const char *pszSectionName)
+{
+	return ((strwicmp(pszSectionName, GLOBAL_NAME) == 0) ||
+		(strwicmp(pszSectionName, GLOBAL_NAME2) == 0));
+}
+
+/*******************************************************************
+ Open the snapshot tdb.
+********************************************************************/
+
+static BOOL snapshot_open(void)
+{
+	if (snapshot_tdb)
+		return True;
+
+	snapshot_tdb = tdb_open_log(lock_path(SNAPSHOT_TDB), 0, TDB_DEFAULT,
+				    bSnapshotPublisher ? (O_RDWR|O_CREAT) :
+				    O_RDONLY, 0644);
+	if (!snapshot_tdb) {
+		DEBUG(bSnapshotPublisher ? 0 : 10,
+		      ("snapshot_open: failed to open %s\n",
+		       lock_path(SNAPSHOT_TDB)));
+		return False;
+	}
+	return True;
+}
+
+/*******************************************************************
+ Make this process the one that publishes its parsed configuration.
+ The next lp_load() publishes or removes any stale snapshot.
+********************************************************************/
+
+void lp_set_snapshot_publisher(BOOL publish)
+{
+	if (publish && !bSnapshotPublisher && snapshot_tdb) {
+		/* reopen read-write */
+		tdb_close(snapshot_tdb);
+		snapshot_tdb = NULL;
+	}
+	bSnapshotPublisher = publish;
+}
+
+/*******************************************************************
+ Start recording the sections and parameters of a full parse.
+********************************************************************/
+
+static void snapshot_begin(void)
+{
+	int i;
+
+	if (!bSnapshotPublisher || bGlobalOnly) {
+		/* our digests no longer describe the snapshot */
+		bConfDigestValid = False;
+		return;
+	}
+
+	snapshot_len = SNAPSHOT_HDR_LEN;
+	if (snapshot_alloc < snapshot_len) {
+		SAFE_FREE(snapshot_buf);
+		snapshot_alloc = 0;
+		if ((snapshot_buf = SMB_MALLOC(8192)) == NULL)
+			return;
+		snapshot_alloc = 8192;
+	}
+
+	memset(global_conf_digest, '\0', sizeof(global_conf_digest));
+	for (i = 0; i < iNumServices; i++) {
+		if (VALID(i)) {
+			ServicePtrs[i]->conf_nodigest = False;
+			memset(ServicePtrs[i]->conf_digest, '\0', 16);
+		}
+	}
+	bRecordSnapshot = True;
+}
+
+static void snapshot_record_section(const char *pszSectionName)
+{
+	snapshot_append(SNAPSHOT_SECTION, pszSectionName, NULL, 0);
+}
+
+static void snapshot_record_parameter(const char *pszParmName,
+				      const char *pszParmValue)
+{
+	int parmnum = map_parameter(pszParmName);
+
+	/* included files are recorded inline by the nested parse */
+	if (parmnum >= 0 && parm_table[parmnum].special == handle_include)
+		return;
+
+	if (!snapshot_append(SNAPSHOT_PARAMETER, pszParmName, pszParmValue,
+			     strlen(pszParmValue) + 1))
+		return;
+
+	if (bInGlobalSection) {
+		snapshot_digest(global_conf_digest, pszParmName, pszParmValue);
+	} else if (iServiceIndex >= 0) {
+		service *ps = ServicePtrs[iServiceIndex];
+
+		/* a copied service depends on another definition */
+		if (parmnum >= 0 && parm_table[parmnum].special == handle_copy)
+			ps->conf_nodigest = True;
+		snapshot_digest(ps->conf_digest, pszParmName, pszParmValue);
+	}
+}
+
+/*******************************************************************
+ Publish the recorded parse, or remove the snapshot if the children
+ can't use it.
+********************************************************************/
+
+static void snapshot_publish(void)
+{
+	struct file_lists *f;
+	BOOL shareable = lp_parm_bool(-1, "smbd", "config snapshot", True);
+	size_t ofs, len;
+	int32 gen;
+	TDB_DATA data;
+
+	if (!bRecordSnapshot)
+		return;
+	bRecordSnapshot = False;
+
+	if (!snapshot_open())
+		return;
+
+	for (f = file_lists; f && shareable; f = f->next) {
+		if (strchr_m(f->name, '%') != NULL) {
+			DEBUG(3, ("snapshot_publish: %s depends on "
+				  "substitutions, not publishing\n", f->name));
+			shareable = False;
+		}
+	}
+
+	if (!shareable) {
+		tdb_delete_bystring(snapshot_tdb, SNAPSHOT_GENERATION_KEY);
+		tdb_delete_bystring(snapshot_tdb, SNAPSHOT_DATA_KEY);
+		bConfDigestValid = False;
+		return;
+	}
+
+	/* append the definition digest of every service we parsed */
+	len = snapshot_len;
+	ofs = SNAPSHOT_HDR_LEN;
+	while (ofs) {
+		char type;
+		const char *s1, *p2;
+		fstring name;
+		int i;
+
+		ofs = snapshot_next(snapshot_buf, len, ofs, &type, &s1, &p2);
+		if (!ofs || type != SNAPSHOT_SECTION || is_global_section(s1))
+			continue;
+		i = getservicebyname(s1, NULL);
+		if (i < 0 || ServicePtrs[i]->conf_nodigest)
+			continue;
+		/* s1 moves if the append below grows the buffer */
+		fstrcpy(name, s1);
+		if (!snapshot_append(SNAPSHOT_DIGEST, name,
+				     ServicePtrs[i]->conf_digest, 16))
+			return;
+	}
+
+	gen = tdb_fetch_int32(snapshot_tdb, SNAPSHOT_GENERATION_KEY);
+	if (gen == -1)
+		gen = (int32)time(NULL);
+	gen++;
+
+	SIVAL(snapshot_buf, 0, (uint32)gen);
+	memcpy(snapshot_buf + 4, global_conf_digest, 16);
+
+	data.dptr = snapshot_buf;
+	data.dsize = snapshot_len;
+
+	if (tdb_store_bystring(snapshot_tdb, SNAPSHOT_DATA_KEY, data,
+			       TDB_REPLACE) != 0 ||
+	    tdb_store_int32(snapshot_tdb, SNAPSHOT_GENERATION_KEY, gen) != 0) {
+		DEBUG(0, ("snapshot_publish: failed to store snapshot: %s\n",
+			  tdb_errorstr(snapshot_tdb)));
+		tdb_delete_bystring(snapshot_tdb, SNAPSHOT_GENERATION_KEY);
+		bConfDigestValid = False;
+		return;
+	}
+
+	DEBUG(5, ("snapshot_publish: published generation %u (%u bytes)\n",
+		  (unsigned int)gen, (unsigned int)snapshot_len));
+
+	snapshot_generation = (uint32)gen;
+	bConfDigestValid = True;
+}
+
+/*******************************************************************
+ Work out which of our services the snapshot leaves unchanged, and
+ drop the unused ones that did change.
+********************************************************************/
+
+static void snapshot_select_kept(const TDB_DATA *snap,
+				 BOOL (*snumused) (int))
+{
+	size_t ofs = SNAPSHOT_HDR_LEN;
+	int i;
+
+	snapshot_num_keep = 0;
+	snapshot_keep = NULL;
+
+	if (iNumServices > 0 &&
+	    (snapshot_keep = SMB_CALLOC_ARRAY(BOOL, iNumServices)) != NULL)
+		snapshot_num_keep = iNumServices;
+
+	if (snapshot_keep && bConfDigestValid &&
+	    memcmp(snap->dptr + 4, global_conf_digest, 16) == 0) {
+		while (ofs) {
+			char type;
+			const char *s1, *p2;
+
+			ofs = snapshot_next(snap->dptr, snap->dsize, ofs,
+					    &type, &s1, &p2);
+			if (!ofs || type != SNAPSHOT_DIGEST)
+				continue;
+			i = getservicebyname(s1, NULL);
+			if (i < 0 || ServicePtrs[i]->conf_nodigest ||
+			    ServicePtrs[i]->autoloaded ||
+			    ServicePtrs[i]->usershare == USERSHARE_VALID)
+				continue;
+			if (memcmp(ServicePtrs[i]->conf_digest, p2, 16) == 0)
+				snapshot_keep[i] = True;
+		}
+	}
+
+	for (i = 0; i < iNumServices; i++) {
+		if (!VALID(i) || ServicePtrs[i]->autoloaded ||
+		    ServicePtrs[i]->usershare == USERSHARE_VALID)
+			continue;
+		if (i < snapshot_num_keep && snapshot_keep[i])
+			continue;
+		if (!snumused || !snumused(i))
+			free_service_byindex(i);
+	}
+}
+
+/*******************************************************************
+ Return the index of a kept service, or -1 if the section has to be
+ parsed.
+********************************************************************/
+
+static int snapshot_kept_service(const char *pszSectionName)
+{
+	int i;
+
+	if (snapshot_keep == NULL)
+		return -1;
+	i = getservicebyname(pszSectionName, NULL);
+	if (i < 0 || i >= snapshot_num_keep || !snapshot_keep[i])
+		return -1;
+	return i;
+}
+
+/*******************************************************************
+ Feed a snapshot through the section and parameter handlers.
+********************************************************************/
+
+static BOOL snapshot_replay(const TDB_DATA *snap)
+{
+	size_t ofs = SNAPSHOT_HDR_LEN;
+	BOOL bRetval = True;
+	int i;
+
+	while (ofs && bRetval) {
+		char type;
+		const char *s1, *p2;
+
+		ofs = snapshot_next(snap->dptr, snap->dsize, ofs,
+				    &type, &s1, &p2);
+		if (!ofs)
+			break;
+		switch (type) {
+		case SNAPSHOT_SECTION:
+			bRetval = do_section(s1);
+			break;
+		case SNAPSHOT_PARAMETER:
+			bRetval = do_parameter(s1, p2);
+			break;
+		case SNAPSHOT_DIGEST:
+			i = getservicebyname(s1, NULL);
+			if (i >= 0) {
+				ServicePtrs[i]->conf_nodigest = False;
+				memcpy(ServicePtrs[i]->conf_digest, p2, 16);
+			}
+			break;
+		}
+	}
+
+	bSnapshotSkip = False;
+	SAFE_FREE(snapshot_keep);
+	snapshot_num_keep = 0;
+
+	memcpy(global_conf_digest, snap->dptr + 4, 16);
+	bConfDigestValid = True;
+
+	return bRetval;
+}
+
 /***************************************************************************
  Run standard_sub_basic on netbios name... needed because global_myname
  is not accessed through any lp_ macro.
@@ -3669,8 +4164,15 @@ static BOOL do_parameter(const char *pszParmName, const char *pszParmValue)
 	if (!bInGlobalSection && bGlobalOnly)
 		return (True);
 
+	/* kept unchanged from the previous snapshot */
+	if (!bInGlobalSection && bSnapshotSkip)
+		return (True);
+
 	DEBUGADD(4, ("doing parameter %s = %s\n", pszParmName, pszParmValue));
 
+	if (bRecordSnapshot)
+		snapshot_record_parameter(pszParmName, pszParmValue);
+
 	return (lp_do_parameter(bInGlobalSection ? -2 : iServiceIndex,
 				pszParmName, pszParmValue));
 }
@@ -3812,10 +4314,12 @@ void init_locals(void)
 static BOOL do_section(const char *pszSectionName)
 {
 	BOOL bRetval;
-	BOOL isglobal = ((strwicmp(pszSectionName, GLOBAL_NAME) == 0) ||
-			 (strwicmp(pszSectionName, GLOBAL_NAME2) == 0));
+	BOOL isglobal = is_global_section(pszSectionName);
 	bRetval = False;
 
+	if (bRecordSnapshot)
+		snapshot_record_section(pszSectionName);
+
 	/* if we were in a global section then do the local inits */
 	if (bInGlobalSection && !isglobal)
 		init_locals();
@@ -3844,6 +4348,14 @@ static BOOL do_section(const char *pszSectionName)
 		/* issued by the post-processing of a previous section. */
 		DEBUG(2, ("Processing section \"[%s]\"\n", pszSectionName));
 
+		bSnapshotSkip = False;
+		if ((iServiceIndex = snapshot_kept_service(pszSectionName)) >= 0) {
+			DEBUG(4, ("keeping unchanged service %s\n",
+				  pszSectionName));
+			bSnapshotSkip = True;
+			return (True);
+		}
+
 		if ((iServiceIndex = add_a_service(&sDefault, pszSectionName))
 		    < 0) {
 			DEBUG(0, ("Failed to add a new service\n"));
@@ -5079,22 +5591,26 @@ void gfree_loadparm(void)
  False on failure.
 ***************************************************************************/
 
-BOOL lp_load(const char *pszFname,
-             BOOL global_only,
-             BOOL save_defaults,
-	     BOOL add_ipc,
-             BOOL initialize_globals)
+static BOOL lp_load_internal(const char *pszFname,
+			     BOOL global_only,
+			     BOOL save_defaults,
+			     BOOL add_ipc,
+			     BOOL initialize_globals,
+			     const TDB_DATA *snapshot)
 {
 	pstring n2;
 	BOOL bRetval;
 	param_opt_struct *data, *pdata;
 
-	pstrcpy(n2, pszFname);
-	
-	standard_sub_basic( get_current_username(), current_user_info.domain,
-			    n2,sizeof(n2) );
+	if (!snapshot) {
+		pstrcpy(n2, pszFname);
 
-	add_to_file_list(pszFname, n2);
+		standard_sub_basic( get_current_username(),
+				    current_user_info.domain,
+				    n2,sizeof(n2) );
+
+		add_to_file_list(pszFname, n2);
+	}
 
 	bRetval = False;
 
@@ -5126,7 +5642,12 @@ BOOL lp_load(const char *pszFname,
 	
 	/* We get sections first, so have to start 'behind' to make up */
 	iServiceIndex = -1;
-	bRetval = pm_process(n2, do_section, do_parameter);
+	if (snapshot) {
+		bRetval = snapshot_replay(snapshot);
+	} else {
+		snapshot_begin();
+		bRetval = pm_process(n2, do_section, do_parameter);
+	}
 
 	/* finish up the last section */
 	DEBUG(4, ("pm_process() returned %s\n", BOOLSTR(bRetval)));
@@ -5158,9 +5679,71 @@ BOOL lp_load(const char *pszFname,
 
 	init_iconv();
 
+	if (!snapshot)
+		snapshot_publish();
+
 	return (bRetval);
 }
 
+BOOL lp_load(const char *pszFname,
+             BOOL global_only,
+             BOOL save_defaults,
+	     BOOL add_ipc,
+             BOOL initialize_globals)
+{
+	return lp_load_internal(pszFname, global_only, save_defaults,
+				add_ipc, initialize_globals, NULL);
+}
+
+/***************************************************************************
+ Reload the services array from the snapshot published by the parent,
+ if there is a usable one. Returns False if the caller has to check the
+ config files itself. Otherwise *reloaded says whether the generation
+ had moved on and the services were rebuilt; unchanged services are kept
+ and changed ones are dropped unless snumused() says they are in use.
+***************************************************************************/
+
+BOOL lp_load_snapshot(BOOL (*snumused) (int), BOOL *reloaded)
+{
+	TDB_DATA data;
+	int32 gen;
+
+	*reloaded = False;
+
+	if (bSnapshotPublisher || !snapshot_open())
+		return False;
+
+	gen = tdb_fetch_int32(snapshot_tdb, SNAPSHOT_GENERATION_KEY);
+	if (gen == -1)
+		return False;
+
+	if ((uint32)gen == snapshot_generation)
+		return True;
+
+	data = tdb_fetch_bystring(snapshot_tdb, SNAPSHOT_DATA_KEY);
+	if (data.dptr == NULL || data.dsize < SNAPSHOT_HDR_LEN) {
+		SAFE_FREE(data.dptr);
+		return False;
+	}
+
+	if (IVAL(data.dptr, 0) != (uint32)gen) {
+		/* caught the publisher in the middle of an update */
+		SAFE_FREE(data.dptr);
+		return True;
+	}
+
+	DEBUG(3, ("lp_load_snapshot: loading generation %u\n",
+		  (unsigned int)gen));
+
+	snapshot_select_kept(&data, snumused);
+	lp_load_internal(dyn_CONFIGFILE, False, False, True, True, &data);
+	SAFE_FREE(data.dptr);
+
+	snapshot_generation = (uint32)gen;
+	*reloaded = True;
+	return True;
+}
+
 /***************************************************************************
  Reset the max number of services.
 ***************************************************************************/
@@ -5223,25 +5806,38 @@ does not copy the found service.
 int lp_servicenumber(const char *pszServiceName)
 {
 	int iService;
+	int i;
         fstring serviceName;
         
         if (!pszServiceName) {
         	return GLOBAL_SECTION_SNUM;
 	}
-        
-	for (iService = iNumServices - 1; iService >= 0; iService--) {
-		if (VALID(iService) && ServicePtrs[iService]->szService) {
-			/*
-			 * The substitution here is used to support %U is
-			 * service names
-			 */
-			fstrcpy(serviceName, ServicePtrs[iService]->szService);
-			standard_sub_basic(get_current_username(),
-					   current_user_info.domain,
-					   serviceName,sizeof(serviceName));
-			if (strequal(serviceName, pszServiceName)) {
-				break;
-			}
+
+	/* Plain names are found through the hash. */
+	iService = getservicebyname(pszServiceName, NULL);
+	if (iService >= 0 && strchr_m(ServicePtrs[iService]->szService, '%')) {
+		iService = -1;
+	}
+
+	/* The highest numbered match wins, as it always has. */
+	for (i = 0; i < num_subst_services; i++) {
+		int snum = subst_services[i];
+
+		if (snum <= iService || !VALID(snum) ||
+		    !ServicePtrs[snum]->szService) {
+			continue;
+		}
+
+		/*
+		 * The substitution here is used to support %U is
+		 * service names
+		 */
+		fstrcpy(serviceName, ServicePtrs[snum]->szService);
+		standard_sub_basic(get_current_username(),
+				   current_user_info.domain,
+				   serviceName,sizeof(serviceName));
+		if (strequal(serviceName, pszServiceName)) {
+			iService = snum;
 		}
 	}
 
@@ -5587,6 +6183,15 @@ void lp_set_logfile(const char *name)
 	pstrcpy(debugf, name);
 }
 
+/*******************************************************************
+ Return the number of per-share parameter lookups done so far.
+********************************************************************/
+
+unsigned int lp_param_lookups(void)
+{
+	return param_lookups;
+}
+
 /*******************************************************************
  Return the max print jobs per queue.
 ********************************************************************/
@@ -5656,7 +6261,19 @@ BOOL lp_use_sendfile(int snum)
 	if (Protocol < PROTOCOL_NT1) {
 		return False;
 	}
-	return (_lp_use_sendfile(snum) && (get_remote_arch() != RA_WIN95) && !srv_is_signing_active());
+	if (!_lp_use_sendfile(snum) || (get_remote_arch() == RA_WIN95)) {
+		return False;
+	}
+	/*
+	 * A signed reply needs its MAC in the header before the data is
+	 * sent. send_file_readX() can compute it from the file first,
+	 * but a local writer changing the range before it goes out on
+	 * the wire would break the signature, so this is optional.
+	 */
+	if (srv_is_signing_active()) {
+		return lp_parm_bool(-1, "smbd", "signed sendfile", False);
+	}
+	return True;
 }
 
 /*******************************************************************
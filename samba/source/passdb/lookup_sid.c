@@ -979,8 +979,8 @@ BOOL lookup_sid(TALLOC_CTX *mem_ctx, const DOM_SID *sid,
 
 #define MAX_UID_SID_CACHE_SIZE 100
 #define TURNOVER_UID_SID_CACHE_SIZE 10
-#define MAX_GID_SID_CACHE_SIZE 100
-#define TURNOVER_GID_SID_CACHE_SIZE 10
+#define MAX_GID_SID_CACHE_SIZE 1000	/* users can be in a lot of groups */
+#define TURNOVER_GID_SID_CACHE_SIZE 100
 
 static size_t n_uid_sid_cache = 0;
 static size_t n_gid_sid_cache = 0;
@@ -1477,3 +1477,85 @@ BOOL sid_to_gid(const DOM_SID *psid, gid_t *pgid)
 	return True;
 }
 
+/*****************************************************************
+ Convert a list of SIDs to gids like sid_to_gid() would, adding the
+ gids to *gids. Whatever the cache can't answer goes to winbindd in a
+ single request, only the SIDs winbindd has no mapping for yet are
+ then looked up one by one. SIDs that are no groups are ignored.
+*****************************************************************/  
+
+BOOL sids_to_gids(TALLOC_CTX *mem_ctx, const DOM_SID *sids, size_t num_sids,
+		  gid_t **gids, size_t *num_gids)
+{
+	struct id_map *ids;
+	size_t i, num_ids = 0;
+	BOOL batched = False;
+	uint32 rid;
+	uid_t uid;
+	gid_t gid;
+
+	if (num_sids == 0) {
+		return True;
+	}
+
+	ids = TALLOC_ZERO_ARRAY(mem_ctx, struct id_map, num_sids);
+	if (ids == NULL) {
+		return False;
+	}
+
+	for (i=0; i<num_sids; i++) {
+		if (fetch_gid_from_cache(&gid, &sids[i])) {
+			if (!add_gid_to_array_unique(mem_ctx, gid,
+						     gids, num_gids)) {
+				TALLOC_FREE(ids);
+				return False;
+			}
+			continue;
+		}
+		if (fetch_uid_from_cache(&uid, &sids[i])) {
+			continue;
+		}
+		if (sid_peek_check_rid(&global_sid_Unix_Groups, &sids[i],
+				       &rid)) {
+			if (!add_gid_to_array_unique(mem_ctx, (gid_t)rid,
+						     gids, num_gids)) {
+				TALLOC_FREE(ids);
+				return False;
+			}
+			continue;
+		}
+		ids[num_ids++].sid = CONST_DISCARD(DOM_SID *, &sids[i]);
+	}
+
+	if (num_ids > 1) {
+		batched = winbind_sids_to_unixids(ids, num_ids);
+	}
+
+	for (i=0; i<num_ids; i++) {
+		if (batched && (ids[i].status == ID_MAPPED)) {
+			if (ids[i].xid.type == ID_TYPE_UID) {
+				/* sid_to_gid() would say no */
+				store_uid_sid_cache(ids[i].sid, ids[i].xid.id);
+				continue;
+			}
+			gid = ids[i].xid.id;
+			DEBUG(10,("sid %s -> gid %u\n",
+				  sid_string_static(ids[i].sid),
+				  (unsigned int)gid));
+			store_gid_sid_cache(ids[i].sid, gid);
+		} else if (!sid_to_gid(ids[i].sid, &gid)) {
+			DEBUG(10, ("Could not convert SID %s to gid, "
+				   "ignoring it\n",
+				   sid_string_static(ids[i].sid)));
+			continue;
+		}
+		if (!add_gid_to_array_unique(mem_ctx, gid, gids, num_gids)) {
+			TALLOC_FREE(ids);
+			return False;
+		}
+	}
+
+	TALLOC_FREE(ids);
+	return True;
+}
+
@@ -2140,14 +2140,16 @@ pause, or resume print job. User name: %s. Printer name: %s.",
 }
 
 /****************************************************************************
- Write to a print file.
+ Write several buffers to a print file, one after the other from pos.
 ****************************************************************************/
 
-ssize_t print_job_write(int snum, uint32 jobid, const char *buf, SMB_OFF_T pos, size_t size)
+ssize_t print_job_writev(int snum, uint32 jobid, const struct iovec *iov, int iovcnt, SMB_OFF_T pos)
 {
 	const char* sharename = lp_const_servicename(snum);
-	int return_code;
+	ssize_t return_code;
 	struct printjob *pjob;
+	size_t size = 0;
+	int i;
 
 	pjob = print_job_find(sharename, jobid);
 
@@ -2157,7 +2159,13 @@ ssize_t print_job_write(int snum, uint32 jobid, const char *buf, SMB_OFF_T pos,
 	if (pjob->pid != sys_getpid())
 		return -1;
 
-	return_code = write_data_at_offset(pjob->fd, buf, size, pos);
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
+	if (iovcnt == 1)
+		return_code = write_data_at_offset(pjob->fd, (const char *)iov[0].iov_base, size, pos);
+	else
+		return_code = writev_data_at_offset(pjob->fd, iov, iovcnt, pos);
 
 	if (return_code>0) {
 		pjob->size += size;
@@ -2166,6 +2174,19 @@ ssize_t print_job_write(int snum, uint32 jobid, const char *buf, SMB_OFF_T pos,
 	return return_code;
 }
 
+/****************************************************************************
+ Write to a print file.
+****************************************************************************/
+
+ssize_t print_job_write(int snum, uint32 jobid, const char *buf, SMB_OFF_T pos, size_t size)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = size;
+	return print_job_writev(snum, jobid, &iov, 1, pos);
+}
+
 /****************************************************************************
  Get the queue status - do not update if db is out of date.
 ****************************************************************************/
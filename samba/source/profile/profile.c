@@ -29,6 +29,7 @@
 #ifdef WITH_PROFILE
 static int shm_id;
 static BOOL read_only;
+static void profile_clear(void);
 #if defined(HAVE_CLOCK_GETTIME)
 clockid_t __profile_clock;
 BOOL have_profiling_clock = False;
@@ -86,7 +87,7 @@ void set_profile_level(int level, struct process_id src)
 			 (int)procid_to_pid(&src)));
 		break;
 	case 3:		/* reset profile values */
-		memset((char *)profile_p, 0, sizeof(*profile_p));
+		profile_clear();
 		DEBUG(1,("INFO: Profiling values cleared from pid %d\n",
 			 (int)procid_to_pid(&src)));
 		break;
@@ -189,9 +190,184 @@ static void init_clock_gettime(void)
 }
 #endif
 
+/* round up to the slab alignment */
+#define PROF_ALIGNED(x) (((x) + PROF_SLAB_ALIGN - 1) & ~(size_t)(PROF_SLAB_ALIGN - 1))
+
+/* the slab this process counts into, -1 if it only reads */
+static int my_slab = -1;
+
+static size_t profile_shm_size(int slabs)
+{
+	return PROF_ALIGNED(sizeof(struct profile_header)) +
+		slabs * PROF_ALIGNED(sizeof(struct profile_slab));
+}
+
+struct profile_slab *profile_slab(int i)
+{
+	SMB_ASSERT(i >= 0 && i < profile_h->prof_shm_slabs);
+	return (struct profile_slab *)((char *)profile_h +
+		PROF_ALIGNED(sizeof(struct profile_header)) +
+		i * PROF_ALIGNED(sizeof(struct profile_slab)));
+}
+
+/****************************************************************************
+ Add up the counters of all slabs, or only of the one used by pid.
+ Returns False if pid has no slab of its own.
+****************************************************************************/
+
+BOOL profile_sum(struct profile_stats *total, pid_t pid)
+{
+	unsigned *dst = (unsigned *)total;
+	const size_t n = sizeof(*total) / sizeof(unsigned);
+	BOOL found = False;
+	int i;
+	size_t j;
+
+	memset(total, 0, sizeof(*total));
+
+	for (i = 0; i < profile_h->prof_shm_slabs; i++) {
+		struct profile_slab *slab = profile_slab(i);
+		const unsigned *src = (const unsigned *)&slab->stats;
+
+		if (pid != 0 && slab->pid != pid) {
+			continue;
+		}
+		for (j = 0; j < n; j++) {
+			dst[j] += src[j];
+		}
+		found = True;
+	}
+
+	return pid == 0 || found;
+}
+
+/****************************************************************************
+ Move the counts of a process that has gone to the retired slab, and free
+ its slab. Only the main smbd does this, so the retired slab has a single
+ writer.
+****************************************************************************/
+
+static void retire_slab(struct profile_slab *slab)
+{
+	unsigned *dst = (unsigned *)&profile_slab(PROF_SLAB_RETIRED)->stats;
+	const unsigned *src = (const unsigned *)&slab->stats;
+	size_t j;
+
+	for (j = 0; j < sizeof(slab->stats) / sizeof(unsigned); j++) {
+		dst[j] += src[j];
+	}
+	memset(&slab->stats, 0, sizeof(slab->stats));
+	slab->pid = 0;
+}
+
+/****************************************************************************
+ Find a free slab for a process about to be forked. Slabs of processes we
+ have not seen go, eg. ones started by an earlier smbd, are only looked
+ at once there is nothing free. Returns PROF_SLAB_SHARED if all are used.
+****************************************************************************/
+
+int profile_slab_alloc(void)
+{
+	int i;
+
+	if (my_slab != PROF_SLAB_SHARED) {
+		/* only the main smbd hands out slabs */
+		return PROF_SLAB_SHARED;
+	}
+
+	for (i = PROF_SLAB_FIRST; i < profile_h->prof_shm_slabs; i++) {
+		if (profile_slab(i)->pid == 0) {
+			return i;
+		}
+	}
+
+	for (i = PROF_SLAB_FIRST; i < profile_h->prof_shm_slabs; i++) {
+		struct profile_slab *slab = profile_slab(i);
+
+		if (!process_exists_by_pid(slab->pid)) {
+			retire_slab(slab);
+			return i;
+		}
+	}
+
+	return PROF_SLAB_SHARED;
+}
+
+/****************************************************************************
+ Record which process a slab was handed to. Called by the parent with the
+ pid fork() returned, so the slab is not handed out twice before the
+ child has run.
+****************************************************************************/
+
+void profile_slab_owner(int i, pid_t pid)
+{
+	if (i >= PROF_SLAB_FIRST) {
+		profile_slab(i)->pid = pid;
+	}
+}
+
+/****************************************************************************
+ Start counting into a slab. Called by the child after fork().
+****************************************************************************/
+
+void profile_slab_attach(int i)
+{
+	struct profile_slab *slab = profile_slab(i);
+
+	if (i >= PROF_SLAB_FIRST) {
+		slab->pid = sys_getpid();
+	}
+	profile_p = &slab->stats;
+	my_slab = i;
+}
+
+/****************************************************************************
+ A child has exited, keep its counts and free its slab.
+****************************************************************************/
+
+void profile_slab_release(pid_t pid)
+{
+	int i;
+
+	if (my_slab != PROF_SLAB_SHARED) {
+		return;
+	}
+
+	for (i = PROF_SLAB_FIRST; i < profile_h->prof_shm_slabs; i++) {
+		struct profile_slab *slab = profile_slab(i);
+
+		if (slab->pid == pid) {
+			retire_slab(slab);
+			return;
+		}
+	}
+}
+
+/****************************************************************************
+ Clear the counters. A process with a slab of its own clears just that,
+ the main smbd clears the lot.
+****************************************************************************/
+
+static void profile_clear(void)
+{
+	int i;
+
+	if (my_slab != PROF_SLAB_SHARED) {
+		memset((char *)profile_p, 0, sizeof(*profile_p));
+		return;
+	}
+
+	for (i = 0; i < profile_h->prof_shm_slabs; i++) {
+		memset(&profile_slab(i)->stats, 0, sizeof(struct profile_stats));
+	}
+	memset(profile_h->share_latency, 0, sizeof(profile_h->share_latency));
+}
+
 BOOL profile_setup(BOOL rdonly)
 {
 	struct shmid_ds shm_ds;
+	int slabs = 0;
+	size_t size = 0;
 
 	read_only = rdonly;
 
@@ -199,6 +375,12 @@ BOOL profile_setup(BOOL rdonly)
 	init_clock_gettime();
 #endif
 
+	if (!read_only) {
+		slabs = PROF_SLAB_FIRST +
+			MAX(lp_parm_int(-1, "smbd", "profile slabs", 256), 0);
+		size = profile_shm_size(slabs);
+	}
+
  again:
 	/* try to use an existing key */
 	shm_id = shmget(PROF_SHMEM_KEY, 0, 0);
@@ -207,7 +389,7 @@ BOOL profile_setup(BOOL rdonly)
 	   if we are running from inetd. Bad luck. */
 	if (shm_id == -1) {
 		if (read_only) return False;
-		shm_id = shmget(PROF_SHMEM_KEY, sizeof(*profile_h), 
+		shm_id = shmget(PROF_SHMEM_KEY, size,
 				IPC_CREAT | IPC_EXCL | IPC_PERMS);
 	}
 	
@@ -220,9 +402,10 @@ BOOL profile_setup(BOOL rdonly)
 	
 	profile_h = (struct profile_header *)shmat(shm_id, 0, 
 						   read_only?SHM_RDONLY:0);
-	if ((long)profile_p == -1) {
+	if ((long)profile_h == -1) {
 		DEBUG(0,("Can't attach to IPC area. Error was %s\n", 
 			 strerror(errno)));
+		profile_h = NULL;
 		return False;
 	}
 
@@ -242,24 +425,46 @@ BOOL profile_setup(BOOL rdonly)
 		return False;
 	}
 
-	if (shm_ds.shm_segsz != sizeof(*profile_h)) {
+	if (read_only) {
+		/* the number of slabs is whatever smbd chose */
+		if (shm_ds.shm_segsz < sizeof(*profile_h) ||
+		    profile_h->prof_shm_magic != PROF_SHM_MAGIC ||
+		    profile_h->prof_shm_version != PROF_SHM_VERSION ||
+		    shm_ds.shm_segsz != profile_shm_size(profile_h->prof_shm_slabs)) {
+			DEBUG(0,("ERROR: profile area is from a different "
+				 "version of smbd\n"));
+			return False;
+		}
+
+		/* readers see the totals */
+		profile_p = SMB_MALLOC_P(struct profile_stats);
+		if (profile_p == NULL) {
+			return False;
+		}
+		profile_sum(profile_p, 0);
+		return True;
+	}
+
+	if (shm_ds.shm_segsz != size) {
 		DEBUG(0,("WARNING: profile size is %d (expected %lu). Deleting\n",
-			 (int)shm_ds.shm_segsz, sizeof(*profile_h)));
+			 (int)shm_ds.shm_segsz, (unsigned long)size));
 		if (shmctl(shm_id, IPC_RMID, &shm_ds) == 0) {
+			shmdt((void *)profile_h);
 			goto again;
 		} else {
 			return False;
 		}
 	}
 
-	if (!read_only && (shm_ds.shm_nattch == 1)) {
-		memset((char *)profile_h, 0, sizeof(*profile_h));
+	if (shm_ds.shm_nattch == 1) {
+		memset((char *)profile_h, 0, size);
 		profile_h->prof_shm_magic = PROF_SHM_MAGIC;
 		profile_h->prof_shm_version = PROF_SHM_VERSION;
+		profile_h->prof_shm_slabs = slabs;
 		DEBUG(3,("Initialised profile area\n"));
 	}
 
-	profile_p = &profile_h->stats;
+	profile_slab_attach(PROF_SLAB_SHARED);
 	message_register(MSG_PROFILE, profile_message, NULL);
 	message_register(MSG_REQ_PROFILELEVEL, reqprofile_message, NULL);
 	return True;
@@ -296,6 +501,7 @@ BOOL profile_setup(BOOL rdonly)
 	    "syscall_fchmod",		/* PR_VALUE_SYSCALL_FCHMOD */
 	    "syscall_chown",		/* PR_VALUE_SYSCALL_CHOWN */
 	    "syscall_fchown",		/* PR_VALUE_SYSCALL_FCHOWN */
+	    "syscall_lchown",		/* PR_VALUE_SYSCALL_LCHOWN */
 	    "syscall_chdir",		/* PR_VALUE_SYSCALL_CHDIR */
 	    "syscall_getwd",		/* PR_VALUE_SYSCALL_GETWD */
 	    "syscall_ntimes",		/* PR_VALUE_SYSCALL_NTIMES */
@@ -444,6 +650,136 @@ BOOL profile_setup(BOOL rdonly)
 	return valnames[val];
 }
 
+/****************************************************************************
+ Latency histograms. These are updated on every SMB while times are being
+ profiled, so everything here has to stay cheap.
+****************************************************************************/
+
+/* subcommand of the trans2 or nttrans being handled, -1 if none */
+static int profile_subcommand = -1;
+
+static int latency_bucket(SMB_BIG_UINT usecs)
+{
+	int b = 0;
+
+	if (usecs >= ((SMB_BIG_UINT)1 << (PR_HIST_BUCKETS - 1))) {
+		return PR_HIST_BUCKETS - 1;
+	}
+	if (usecs >> 16) { b += 16; usecs >>= 16; }
+	if (usecs >> 8) { b += 8; usecs >>= 8; }
+	if (usecs >> 4) { b += 4; usecs >>= 4; }
+	if (usecs >> 2) { b += 2; usecs >>= 2; }
+	if (usecs >> 1) { b += 1; usecs >>= 1; }
+	return b + (int)usecs;
+}
+
+/****************************************************************************
+ Find the histogram slot for a share, claiming a free one the first time
+ the share is seen. Slots are shared by all smbds without locking: two
+ claiming the same slot at once may charge a few SMBs to the wrong share,
+ which is fine for statistics.
+****************************************************************************/
+
+static int latency_share_slot(connection_struct *conn)
+{
+	const char *name = lp_const_servicename(SNUM(conn));
+	struct profile_share_latency *s;
+	int i;
+
+	/* the slot used last time is nearly always still right, unless
+	   the profile was cleared since */
+	i = conn->profile_share;
+	if (i >= 0 && i < PR_HIST_SHARES &&
+	    strcmp(profile_h->share_latency[i].name, name) == 0) {
+		return i;
+	}
+
+	for (i = 0; i < PR_HIST_SHARES; i++) {
+		s = &profile_h->share_latency[i];
+		if (s->name[0] == '\0') {
+			fstrcpy(s->name, name);
+		}
+		if (strcmp(s->name, name) == 0) {
+			conn->profile_share = i;
+			return i;
+		}
+	}
+
+	profile_p->latency_untracked_shares++;
+	return -1;
+}
+
+SMB_BIG_UINT profile_latency_start(connection_struct *conn, int *pshare)
+{
+	profile_subcommand = -1;
+	*pshare = conn ? latency_share_slot(conn) : -1;
+	return profile_timestamp();
+}
+
+/****************************************************************************
+ Map an SMB to its profile value by name, looking each one up only once.
+****************************************************************************/
+
+static int smb_latency_value(int type, const char *name)
+{
+	static int values[256]; /* value + 1, or -1 if there is none */
+	int i;
+
+	type &= 0xff;
+	if (values[type] == 0) {
+		values[type] = -1;
+		for (i = PR_HIST_FIRST; i <= PR_HIST_LAST; i++) {
+			if (strcmp(profile_value_name(i), name) == 0) {
+				values[type] = i + 1;
+				break;
+			}
+		}
+	}
+	return values[type] - 1;
+}
+
+static void latency_add(int share, int value, int bucket)
+{
+	value -= PR_HIST_FIRST;
+	profile_p->latency.buckets[value][bucket]++;
+	if (share != -1) {
+		profile_h->share_latency[share].latency.buckets[value][bucket]++;
+	}
+}
+
+void profile_latency_end(SMB_BIG_UINT start, int type, const char *name, int share)
+{
+	int value = smb_latency_value(type, name);
+	int bucket = latency_bucket(profile_timestamp() - start);
+
+	if (value != -1) {
+		latency_add(share, value, bucket);
+	}
+	if (profile_subcommand != -1) {
+		latency_add(share, profile_subcommand, bucket);
+		profile_subcommand = -1;
+	}
+}
+
+void profile_trans2_subcommand(int call)
+{
+	if (call >= TRANSACT2_OPEN && call <= TRANSACT2_SESSION_SETUP) {
+		profile_subcommand = PR_VALUE_TRANS2_OPEN + call - TRANSACT2_OPEN;
+	} else if (call >= TRANSACT2_GET_DFS_REFERRAL &&
+		   call <= TRANSACT2_REPORT_DFS_INCONSISTANCY) {
+		profile_subcommand = PR_VALUE_TRANS2_GET_DFS_REFERRAL +
+			call - TRANSACT2_GET_DFS_REFERRAL;
+	}
+}
+
+void profile_nttrans_subcommand(int call)
+{
+	if (call >= NT_TRANSACT_CREATE && call <= NT_TRANSACT_SET_USER_QUOTA) {
+		profile_subcommand = PR_VALUE_NT_TRANSACT_CREATE +
+			call - NT_TRANSACT_CREATE;
+	}
+}
+
 #endif /* WITH_PROFILE */
 
 #ifdef WITH_DARWIN_STATS
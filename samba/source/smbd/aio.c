@@ -202,7 +202,7 @@ BOOL schedule_aio_read_and_X(connection_struct *conn,
 	struct aio_extra *aio_ex;
 	SMB_STRUCT_AIOCB *a;
 	size_t bufsize;
-	size_t min_aio_read_size = lp_aio_read_size(SNUM(conn));
+	size_t min_aio_read_size = conn->share_cache.aio_read_size;
 
 	if (!min_aio_read_size || (smb_maxcnt < min_aio_read_size)) {
 		/* Too small a read for aio request. */
@@ -213,10 +213,8 @@ BOOL schedule_aio_read_and_X(connection_struct *conn,
 		return False;
 	}
 
-	/* Only do this on non-chained and non-chaining reads not using the
-	 * write cache. */
-        if (chain_size !=0 || (CVAL(inbuf,smb_vwv0) != 0xFF)
-	    || (lp_write_cache_size(SNUM(conn)) != 0) ) {
+	/* Only do this on non-chained and non-chaining reads. */
+        if (chain_size !=0 || (CVAL(inbuf,smb_vwv0) != 0xFF)) {
 		return False;
 	}
 
@@ -237,6 +235,13 @@ BOOL schedule_aio_read_and_X(connection_struct *conn,
 		return False;
 	}
 
+	/* Anything still in the write cache for the range must reach
+	   the file before the kernel reads it. */
+	if (flush_write_cache_range(fsp, startpos, smb_maxcnt, READ_FLUSH) == -1) {
+		delete_aio_ex(aio_ex);
+		return False;
+	}
+
 	/* Copy the SMB header already setup in outbuf. */
 	memcpy(aio_ex->outbuf, outbuf, smb_buf(outbuf) - outbuf);
 	SCVAL(aio_ex->outbuf,smb_vwv0,0xFF); /* Never a chained reply. */
@@ -285,7 +290,7 @@ BOOL schedule_aio_write_and_X(connection_struct *conn,
 	SMB_STRUCT_AIOCB *a;
 	size_t inbufsize, outbufsize;
 	BOOL write_through = BITSETW(inbuf+smb_vwv7,0);
-	size_t min_aio_write_size = lp_aio_write_size(SNUM(conn));
+	size_t min_aio_write_size = conn->share_cache.aio_write_size;
 
 	if (!min_aio_write_size || (numtowrite < min_aio_write_size)) {
 		/* Too small a write for aio request. */
@@ -296,10 +301,8 @@ BOOL schedule_aio_write_and_X(connection_struct *conn,
 		return False;
 	}
 
-	/* Only do this on non-chained and non-chaining reads not using the
-	 * write cache. */
-        if (chain_size !=0 || (CVAL(inbuf,smb_vwv0) != 0xFF)
-	    || (lp_write_cache_size(SNUM(conn)) != 0) ) {
+	/* Only do this on non-chained and non-chaining writes. */
+        if (chain_size !=0 || (CVAL(inbuf,smb_vwv0) != 0xFF)) {
 		return False;
 	}
 
@@ -324,6 +327,13 @@ BOOL schedule_aio_write_and_X(connection_struct *conn,
 		return False;
 	}
 
+	/* Older data for the range still in the write cache must not be
+	   written over this later. */
+	if (flush_write_cache_range(fsp, startpos, numtowrite, WRITE_FLUSH) == -1) {
+		delete_aio_ex(aio_ex);
+		return False;
+	}
+
 	/* Copy the SMB header already setup in outbuf. */
 	memcpy(aio_ex->inbuf, inbuf, inbufsize);
 
@@ -350,7 +360,12 @@ BOOL schedule_aio_write_and_X(connection_struct *conn,
 		return False;
 	}
 
-	if (!write_through && !lp_syncalways(SNUM(fsp->conn))
+	if (fsp->wcp && startpos + numtowrite > fsp->wcp->file_size) {
+		/* Don't let the cache truncate the file back. */
+		fsp->wcp->file_size = startpos + numtowrite;
+	}
+
+	if (!write_through && !fsp->conn->share_cache.sync_always
 	    && fsp->aio_write_behind) {
 		/* Lie to the client and immediately claim we finished the
 		 * write. */
@@ -224,6 +224,56 @@ BOOL conn_idle_all(time_t t, int deadtime)
 	return allidle;
 }
 
+/****************************************************************************
+ Copy the share parameters used on the fast paths into the connection.
+****************************************************************************/
+
+void conn_set_share_cache(connection_struct *conn)
+{
+	struct share_cache *c = &conn->share_cache;
+	int snum = SNUM(conn);
+
+	ZERO_STRUCTP(c);
+
+	c->store_dos_attributes = lp_store_dos_attributes(snum);
+	c->hide_dot_files = lp_hide_dot_files(snum);
+	c->dos_filemode = lp_dos_filemode(snum);
+	c->dos_filetimes = lp_dos_filetimes(snum);
+	c->map_archive = lp_map_archive(snum);
+	c->map_hidden = lp_map_hidden(snum);
+	c->map_system = lp_map_system(snum);
+	c->inherit_perms = lp_inherit_perms(snum);
+	c->dmapi_support = lp_dmapi_support(snum);
+	c->widelinks = lp_widelinks(snum);
+	c->symlinks = lp_symlinks(snum);
+	c->hide_unreadable = lp_hideunreadable(snum);
+	c->hide_unwriteable = lp_hideunwriteable_files(snum);
+	c->hide_special = lp_hide_special_files(snum);
+	c->msdfs_root = lp_msdfs_root(snum);
+	c->ea_support = lp_ea_support(snum);
+	c->strict_allocate = lp_strict_allocate(snum);
+	c->strict_sync = lp_strict_sync(snum);
+	c->sync_always = lp_syncalways(snum);
+	c->map_readonly = lp_map_readonly(snum);
+	c->default_case = lp_defaultcase(snum);
+	c->write_cache_size = lp_write_cache_size(snum);
+	c->aio_read_size = lp_aio_read_size(snum);
+	c->aio_write_size = lp_aio_write_size(snum);
+}
+
+/****************************************************************************
+ Pick up changed share parameters after a reload.
+****************************************************************************/
+
+void conn_refresh_share_caches(void)
+{
+	connection_struct *conn;
+
+	for (conn=Connections;conn;conn=conn->next) {
+		conn_set_share_cache(conn);
+	}
+}
+
 /****************************************************************************
  Clear a vuid out of the validity cache, and as the 'owner' of a connection.
 ****************************************************************************/
@@ -231,20 +281,18 @@ BOOL conn_idle_all(time_t t, int deadtime)
 void conn_clear_vuid_cache(uint16 vuid)
 {
 	connection_struct *conn;
-	unsigned int i;
+	struct vuid_cache_entry *ent;
 
 	for (conn=Connections;conn;conn=conn->next) {
 		if (conn->vuid == vuid) {
 			conn->vuid = UID_FIELD_INVALID;
 		}
 
-		for (i=0;i<conn->vuid_cache.entries && i< VUID_CACHE_SIZE;i++) {
-			if (conn->vuid_cache.array[i].vuid == vuid) {
-				struct vuid_cache_entry *ent = &conn->vuid_cache.array[i];
-				ent->vuid = UID_FIELD_INVALID;
-				ent->read_only = False;
-				ent->admin_user = False;
-			}
+		ent = &conn->vuid_cache.array[vuid % VUID_CACHE_SIZE];
+		if (ent->vuid == vuid) {
+			ent->vuid = UID_FIELD_INVALID;
+			ent->read_only = False;
+			ent->admin_user = False;
 		}
 	}
 }
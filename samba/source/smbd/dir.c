@@ -61,6 +61,7 @@ struct dptr_struct {
 	char *path;
 	BOOL has_wild; /* Set to true if the wcard entry has MS wildcard characters in it. */
 	BOOL did_stat; /* Optimisation for non-wcard searches. */
+	struct ms_wildcard *wcard_match; /* Compiled wcard, see dptr_mask_match(). */
 };
 
 static struct bitmap *dptr_bmap;
@@ -255,6 +256,7 @@ static void dptr_close_internal(struct dptr_struct *dptr)
 
 	/* Lanman 2 specific code */
 	SAFE_FREE(dptr->wcard);
+	TALLOC_FREE(dptr->wcard_match);
 	string_set(&dptr->path,"");
 	SAFE_FREE(dptr);
 }
@@ -797,10 +799,35 @@ BOOL dir_check_ftype(connection_struct *conn, uint32 mode, uint32 dirtype)
 	return True;
 }
 
+/****************************************************************************
+ mask_match() for the names returned by a directory search. The mask is
+ compiled once per search instead of being converted again for every
+ directory entry.
+****************************************************************************/
+
+BOOL dptr_mask_match(struct dptr_struct *dptr, const char *string, const char *mask,
+		     BOOL translate_pattern, BOOL is_case_sensitive)
+{
+	if (strcmp(mask,".") == 0)
+		return False;
+
+	if (dptr != NULL && (dptr->wcard_match == NULL ||
+	    !ms_wildcard_same(dptr->wcard_match, mask, translate_pattern, is_case_sensitive))) {
+		TALLOC_FREE(dptr->wcard_match);
+		dptr->wcard_match = ms_wildcard_compile(NULL, mask, translate_pattern,
+							is_case_sensitive);
+	}
+
+	if (dptr == NULL || dptr->wcard_match == NULL)
+		return ms_fnmatch(mask, string, translate_pattern, is_case_sensitive) == 0;
+
+	return ms_wildcard_match(dptr->wcard_match, string) == 0;
+}
+
 static BOOL mangle_mask_match(connection_struct *conn, fstring filename, char *mask)
 {
 	mangle_map(filename,True,False,conn->params);
-	return mask_match_search(filename,mask,False);
+	return dptr_mask_match(conn->dirptr,filename,mask,True,False);
 }
 
 /****************************************************************************
@@ -842,7 +869,7 @@ BOOL get_dir_entry(connection_struct *conn,char *mask,uint32 dirtype, pstring fn
 			see masktest for a demo
 		*/
 		if ((strcmp(mask,"*.*") == 0) ||
-		    mask_match_search(filename,mask,False) ||
+		    dptr_mask_match(conn->dirptr,filename,mask,True,False) ||
 		    mangle_mask_match(conn,filename,mask)) {
 
 			if (!mangle_is_8_3(filename, False, conn->params))
@@ -1029,9 +1056,9 @@ static BOOL file_is_special(connection_struct *conn, char *name, SMB_STRUCT_STAT
 
 BOOL is_visible_file(connection_struct *conn, const char *dir_path, const char *name, SMB_STRUCT_STAT *pst, BOOL use_veto)
 {
-	BOOL hide_unreadable = lp_hideunreadable(SNUM(conn));
-	BOOL hide_unwriteable = lp_hideunwriteable_files(SNUM(conn));
-	BOOL hide_special = lp_hide_special_files(SNUM(conn));
+	BOOL hide_unreadable = conn->share_cache.hide_unreadable;
+	BOOL hide_unwriteable = conn->share_cache.hide_unwriteable;
+	BOOL hide_special = conn->share_cache.hide_special;
 
 	SET_STAT_INVALID(*pst);
 
@@ -1055,7 +1082,7 @@ BOOL is_visible_file(connection_struct *conn, const char *dir_path, const char *
 
 		/* If it's a dfs symlink, ignore _hide xxxx_ options */
 		if (lp_host_msdfs() &&
-				lp_msdfs_root(SNUM(conn)) &&
+				conn->share_cache.msdfs_root &&
 				is_msdfs_link(conn, entry, link_target, NULL)) {
 			SAFE_FREE(entry);
 			return True;
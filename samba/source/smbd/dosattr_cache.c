@@ -0,0 +1,245 @@
+/*
+   Unix SMB/CIFS implementation.
+   cache of DOS attributes and EA sizes read from extended attributes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/*
+ * With "store dos attributes" every dos_mode() costs a getxattr, and
+ * with "ea support" every directory entry at the EA info levels costs
+ * a listxattr plus a getxattr per EA. On network filesystems these
+ * round trips dominate directory listings, so remember the results per
+ * process, keyed by device and inode.
+ *
+ * Any change to a file's extended attributes updates its ctime, so an
+ * entry is only used while the ctime in the caller's stat buffer still
+ * matches. A file whose ctime is in the current second is not cached,
+ * as a second change within the same timestamp tick would go unseen.
+ * Changes made through this smbd also invalidate the entry directly.
+ *
+ * Whether an EA can be read depends on who asks, so an entry only
+ * answers for the unix user that filled it in.
+ */
+
+#include "includes.h"
+
+extern struct current_user current_user;
+
+/* by default have a max of 4096 entries in the cache. */
+#ifndef DOSATTR_CACHE_SIZE
+#define DOSATTR_CACHE_SIZE 4096
+#endif
+
+#define DOSATTR_CACHE_ATTR	0x1	/* dosattr/have_attr are valid */
+#define DOSATTR_CACHE_EA_SIZE	0x2	/* ea_size is valid */
+
+struct dosattr_cache_entry {
+	SMB_DEV_T dev;
+	SMB_INO_T inode;
+	struct timespec ctime;
+	uid_t uid;
+	uint32 valid;
+	BOOL have_attr;		/* False if the file has no DOSATTRIB EA */
+	uint32 dosattr;
+	size_t ea_size;
+};
+
+static struct dosattr_cache_entry *dosattr_cache;
+static BOOL dosattr_cache_disabled;
+
+/****************************************************************************
+ Allocate the cache on first use.
+****************************************************************************/
+
+static BOOL dosattr_cache_init(void)
+{
+	if (dosattr_cache) {
+		return True;
+	}
+	if (dosattr_cache_disabled) {
+		return False;
+	}
+	if (!lp_parm_bool(-1, "smbd", "dosattr cache", True)) {
+		dosattr_cache_disabled = True;
+		return False;
+	}
+	dosattr_cache = SMB_CALLOC_ARRAY(struct dosattr_cache_entry,
+					 DOSATTR_CACHE_SIZE);
+	if (!dosattr_cache) {
+		DEBUG(0,("dosattr_cache_init: out of memory\n"));
+		dosattr_cache_disabled = True;
+		return False;
+	}
+	return True;
+}
+
+/****************************************************************************
+ Find the slot for a file. Each file maps to exactly one slot, a later
+ file hashing to the same slot just replaces it.
+****************************************************************************/
+
+static struct dosattr_cache_entry *dosattr_cache_slot(const SMB_STRUCT_STAT *sbuf)
+{
+	uint64 h = ((uint64)sbuf->st_ino * 0x9E3779B97F4A7C15ULL) ^ (uint64)sbuf->st_dev;
+
+	return &dosattr_cache[(h >> 32) % DOSATTR_CACHE_SIZE];
+}
+
+/****************************************************************************
+ Return the entry for a file if it is still current, else NULL.
+****************************************************************************/
+
+static struct dosattr_cache_entry *dosattr_cache_find(const SMB_STRUCT_STAT *sbuf, uint32 want)
+{
+	struct dosattr_cache_entry *e;
+	struct timespec ctime;
+
+	if (sbuf == NULL || !VALID_STAT(*sbuf) || !dosattr_cache_init()) {
+		return NULL;
+	}
+
+	e = dosattr_cache_slot(sbuf);
+	ctime = get_ctimespec(sbuf);
+
+	if (!(e->valid & want) || e->dev != sbuf->st_dev ||
+	    e->inode != sbuf->st_ino || e->uid != current_user.ut.uid ||
+	    timespec_compare(&e->ctime, &ctime) != 0) {
+		DO_PROFILE_INC(dosattr_cache_misses);
+		return NULL;
+	}
+
+	DO_PROFILE_INC(dosattr_cache_hits);
+	return e;
+}
+
+/****************************************************************************
+ Get the slot to store a result for a file in, resetting it if it held
+ another file or an older version of this one. Returns NULL if the
+ result should not be cached.
+****************************************************************************/
+
+static struct dosattr_cache_entry *dosattr_cache_store(const SMB_STRUCT_STAT *sbuf)
+{
+	struct dosattr_cache_entry *e;
+	struct timespec ctime;
+
+	if (sbuf == NULL || !VALID_STAT(*sbuf) || !dosattr_cache_init()) {
+		return NULL;
+	}
+
+	ctime = get_ctimespec(sbuf);
+	if (ctime.tv_sec >= time(NULL) - 1) {
+		/* too recent to trust the ctime to change on the next
+		   update */
+		return NULL;
+	}
+
+	e = dosattr_cache_slot(sbuf);
+	if (e->dev != sbuf->st_dev || e->inode != sbuf->st_ino ||
+	    e->uid != current_user.ut.uid ||
+	    timespec_compare(&e->ctime, &ctime) != 0) {
+		e->dev = sbuf->st_dev;
+		e->inode = sbuf->st_ino;
+		e->uid = current_user.ut.uid;
+		e->ctime = ctime;
+		e->valid = 0;
+	}
+	return e;
+}
+
+/****************************************************************************
+ Look up the DOS attributes stored in a file's EA. Returns True on a
+ hit, with *have_attr False if the file is known to have no such EA.
+****************************************************************************/
+
+BOOL dosattr_cache_get_attr(const SMB_STRUCT_STAT *sbuf, BOOL *have_attr, uint32 *pattr)
+{
+	struct dosattr_cache_entry *e = dosattr_cache_find(sbuf, DOSATTR_CACHE_ATTR);
+
+	if (e == NULL) {
+		return False;
+	}
+	*have_attr = e->have_attr;
+	*pattr = e->dosattr;
+	return True;
+}
+
+/****************************************************************************
+ Remember the DOS attributes read from a file's EA, or that it has none.
+****************************************************************************/
+
+void dosattr_cache_set_attr(const SMB_STRUCT_STAT *sbuf, BOOL have_attr, uint32 dosattr)
+{
+	struct dosattr_cache_entry *e = dosattr_cache_store(sbuf);
+
+	if (e == NULL) {
+		return;
+	}
+	e->have_attr = have_attr;
+	e->dosattr = dosattr;
+	e->valid |= DOSATTR_CACHE_ATTR;
+}
+
+/****************************************************************************
+ Look up the total size of a file's EA list.
+****************************************************************************/
+
+BOOL dosattr_cache_get_ea_size(const SMB_STRUCT_STAT *sbuf, size_t *pea_size)
+{
+	struct dosattr_cache_entry *e = dosattr_cache_find(sbuf, DOSATTR_CACHE_EA_SIZE);
+
+	if (e == NULL) {
+		return False;
+	}
+	*pea_size = e->ea_size;
+	return True;
+}
+
+/****************************************************************************
+ Remember the total size of a file's EA list.
+****************************************************************************/
+
+void dosattr_cache_set_ea_size(const SMB_STRUCT_STAT *sbuf, size_t ea_size)
+{
+	struct dosattr_cache_entry *e = dosattr_cache_store(sbuf);
+
+	if (e == NULL) {
+		return;
+	}
+	e->ea_size = ea_size;
+	e->valid |= DOSATTR_CACHE_EA_SIZE;
+}
+
+/****************************************************************************
+ Forget anything cached for a file whose EAs we are changing.
+****************************************************************************/
+
+void dosattr_cache_delete(SMB_DEV_T dev, SMB_INO_T inode)
+{
+	SMB_STRUCT_STAT sbuf;
+	struct dosattr_cache_entry *e;
+
+	if (dosattr_cache == NULL) {
+		return;
+	}
+
+	sbuf.st_dev = dev;
+	sbuf.st_ino = inode;
+	e = dosattr_cache_slot(&sbuf);
+	if (e->dev == dev && e->inode == inode) {
+		e->valid = 0;
+	}
+}
@@ -41,7 +41,7 @@ static uint32 set_offline_flag(connection_struct *conn, const char *const path)
 		return 0;
 	}
 
-	if (!lp_dmapi_support(SNUM(conn)) || !dmapi_have_session()) {
+	if (!conn->share_cache.dmapi_support || !dmapi_have_session()) {
 		return 0;
 	}
 
@@ -78,12 +78,12 @@ mode_t unix_mode(connection_struct *conn, int dosmode, const char *fname,
 	mode_t dir_mode = 0; /* Mode of the inherit_from directory if
 			      * inheriting. */
 
-	if (!lp_store_dos_attributes(SNUM(conn)) && IS_DOS_READONLY(dosmode)) {
+	if (!conn->share_cache.store_dos_attributes && IS_DOS_READONLY(dosmode)) {
 		result &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
 	}
 
 	if (fname && (inherit_from_dir != NULL)
-	    && lp_inherit_perms(SNUM(conn))) {
+	    && conn->share_cache.inherit_perms) {
 		SMB_STRUCT_STAT sbuf;
 
 		DEBUG(2, ("unix_mode(%s) inheriting from %s\n", fname,
@@ -119,13 +119,13 @@ mode_t unix_mode(connection_struct *conn, int dosmode, const char *fname,
 			result |= lp_force_dir_mode(SNUM(conn));
 		}
 	} else { 
-		if (lp_map_archive(SNUM(conn)) && IS_DOS_ARCHIVE(dosmode))
+		if (conn->share_cache.map_archive && IS_DOS_ARCHIVE(dosmode))
 			result |= S_IXUSR;
 
-		if (lp_map_system(SNUM(conn)) && IS_DOS_SYSTEM(dosmode))
+		if (conn->share_cache.map_system && IS_DOS_SYSTEM(dosmode))
 			result |= S_IXGRP;
  
-		if (lp_map_hidden(SNUM(conn)) && IS_DOS_HIDDEN(dosmode))
+		if (conn->share_cache.map_hidden && IS_DOS_HIDDEN(dosmode))
 			result |= S_IXOTH;  
 
 		if (dir_mode) {
@@ -150,7 +150,7 @@ mode_t unix_mode(connection_struct *conn, int dosmode, const char *fname,
 static uint32 dos_mode_from_sbuf(connection_struct *conn, const char *path, SMB_STRUCT_STAT *sbuf)
 {
 	int result = 0;
-	enum mapreadonly_options ro_opts = (enum mapreadonly_options)lp_map_readonly(SNUM(conn));
+	enum mapreadonly_options ro_opts = (enum mapreadonly_options)conn->share_cache.map_readonly;
 
 #if defined(HAVE_STAT_ST_FLAGS) && defined(UF_IMMUTABLE) && defined(SF_IMMUTABLE)
 	/* We should check the immutable bit irrespective of which MAP_READONLY
@@ -256,14 +256,23 @@ static BOOL get_ea_dos_attribute(connection_struct *conn, const char *path,SMB_S
 	ssize_t sizeret;
 	fstring attrstr;
 	unsigned int dosattr;
+	BOOL have_attr;
+	uint32 cached;
 
-	if (!lp_store_dos_attributes(SNUM(conn))) {
+	if (!conn->share_cache.store_dos_attributes) {
 		return False;
 	}
 
 	/* Don't reset pattr to zero as we may already have filename-based attributes we
 	   need to preserve. */
 
+	if (dosattr_cache_get_attr(sbuf, &have_attr, &cached)) {
+		if (have_attr) {
+			*pattr = cached;
+		}
+		return have_attr;
+	}
+
 	sizeret = SMB_VFS_GETXATTR(conn, path, SAMBA_XATTR_DOS_ATTRIB, attrstr, sizeof(attrstr));
 	if (sizeret == -1) {
 #if defined(ENOTSUP) && defined(ENOATTR)
@@ -272,6 +281,13 @@ static BOOL get_ea_dos_attribute(connection_struct *conn, const char *path,SMB_S
 				path, strerror(errno) ));
 			set_store_dos_attributes(SNUM(conn), False);
 		}
+#endif
+#if defined(ENOATTR)
+		/* Only remember a definite answer, not one that
+		   depends on who is asking. */
+		if (errno == ENOATTR) {
+			dosattr_cache_set_attr(sbuf, False, 0);
+		}
 #endif
 		return False;
 	}
@@ -282,6 +298,7 @@ static BOOL get_ea_dos_attribute(connection_struct *conn, const char *path,SMB_S
 	if (sizeret < 2 || attrstr[0] != '0' || attrstr[1] != 'x' ||
 			sscanf(attrstr, "%x", &dosattr) != 1) {
 		DEBUG(1,("get_ea_dos_attributes: Badly formed DOSATTRIB on file %s - %s\n", path, attrstr));
+		dosattr_cache_set_attr(sbuf, False, 0);
                 return False;
         }
 
@@ -289,6 +306,7 @@ static BOOL get_ea_dos_attribute(connection_struct *conn, const char *path,SMB_S
 		dosattr |= aDIR;
 	}
 	*pattr = (uint32)(dosattr & SAMBA_ATTRIBUTES_MASK);
+	dosattr_cache_set_attr(sbuf, True, *pattr);
 
 	DEBUG(8,("get_ea_dos_attribute returning (0x%x)", dosattr));
 
@@ -313,10 +331,12 @@ static BOOL set_ea_dos_attribute(connection_struct *conn, const char *path, SMB_
 	files_struct *fsp = NULL;
 	BOOL ret = False;
 
-	if (!lp_store_dos_attributes(SNUM(conn))) {
+	if (!conn->share_cache.store_dos_attributes) {
 		return False;
 	}
 
+	dosattr_cache_delete(sbuf->st_dev, sbuf->st_ino);
+
 	snprintf(attrstr, sizeof(attrstr)-1, "0x%x", dosmode & SAMBA_ATTRIBUTES_MASK);
 	if (SMB_VFS_SETXATTR(conn, path, SAMBA_XATTR_DOS_ATTRIB, attrstr, strlen(attrstr), 0) == -1) {
 		if((errno != EPERM) && (errno != EACCES)) {
@@ -336,7 +356,7 @@ static BOOL set_ea_dos_attribute(connection_struct *conn, const char *path, SMB_
 		*/
 
 		/* Check if we have write access. */
-		if(!CAN_WRITE(conn) || !lp_dos_filemode(SNUM(conn)))
+		if(!CAN_WRITE(conn) || !conn->share_cache.dos_filemode)
 			return False;
 
 		/*
@@ -375,7 +395,7 @@ uint32 dos_mode_msdfs(connection_struct *conn, const char *path,SMB_STRUCT_STAT
 
 	/* First do any modifications that depend on the path name. */
 	/* hide files with a name starting with a . */
-	if (lp_hide_dot_files(SNUM(conn))) {
+	if (conn->share_cache.hide_dot_files) {
 		const char *p = strrchr_m(path,'/');
 		if (p) {
 			p++;
@@ -426,7 +446,7 @@ uint32 dos_mode(connection_struct *conn, const char *path,SMB_STRUCT_STAT *sbuf)
 
 	/* First do any modifications that depend on the path name. */
 	/* hide files with a name starting with a . */
-	if (lp_hide_dot_files(SNUM(conn))) {
+	if (conn->share_cache.hide_dot_files) {
 		const char *p = strrchr_m(path,'/');
 		if (p) {
 			p++;
@@ -606,7 +626,7 @@ int file_set_dosmode(connection_struct *conn, const char *fname,
 	if((errno != EPERM) && (errno != EACCES))
 		return -1;
 
-	if(!lp_dos_filemode(SNUM(conn)))
+	if(!conn->share_cache.dos_filemode)
 		return -1;
 
 	/* We want DOS semantics, ie allow non owner with write permission to change the
@@ -672,7 +692,7 @@ int file_ntimes(connection_struct *conn, const char *fname, const struct timespe
 		return -1;
 	}
 
-	if(!lp_dos_filetimes(SNUM(conn))) {
+	if(!conn->share_cache.dos_filetimes) {
 		return -1;
 	}
 
@@ -22,8 +22,47 @@
 
 #include "includes.h"
 
+extern struct current_user current_user;
+
 static BOOL setup_write_cache(files_struct *, SMB_OFF_T);
 
+/*
+ * The write cache.
+ *
+ * While a client holds an exclusive oplock no other client can see the
+ * file, so small writes can be held back and written out later in
+ * fewer, larger writes. Each file with a cache keeps the data written
+ * as a list of extents sorted by offset; a write replaces whatever the
+ * extents held for its range, appends to an extent it abuts, or starts
+ * a new one. Writes arriving out of order therefore still end up as one
+ * run of abutting extents, and each run is written with a single call
+ * when the cache is flushed.
+ *
+ * A file holds at most "write cache size" bytes. All caches in the
+ * process together hold at most "smbd:write cache budget" bytes
+ * (MAX_WRITE_CACHES times the write cache size by default); when the
+ * budget is used up the cache written to longest ago is flushed.
+ * Cached data is also flushed "smbd:write behind delay" milliseconds
+ * (1000 by default) after it was first written, from the main loop and
+ * so after the reply to the write has been sent. An error from such a
+ * flush is returned by the next write, flush or close on the file.
+ */
+
+/* most extents a file may have before it is flushed */
+#define WRITE_CACHE_MAX_EXTENTS 64
+
+/* how many write caches have been allocated */
+static unsigned int allocated_write_caches;
+
+/* caches holding data, the most recently written to first */
+static write_cache *dirty_write_caches;
+
+/* buffer space held by all the caches, and the most they may hold */
+static size_t write_cache_bytes;
+static size_t write_cache_budget;
+
+static int write_behind_msec;
+
 /****************************************************************************
  Read from write cache if we can.
 ****************************************************************************/
@@ -31,16 +70,31 @@ static BOOL setup_write_cache(files_struct *, SMB_OFF_T);
 static BOOL read_from_write_cache(files_struct *fsp,char *data,SMB_OFF_T pos,size_t n)
 {
 	write_cache *wcp = fsp->wcp;
+	struct write_cache_extent *e, *f;
+	SMB_OFF_T end = pos + n, off;
 
-	if(!wcp) {
+	if(!wcp || n == 0) {
 		return False;
 	}
 
-	if( n > wcp->data_size || pos < wcp->offset || pos + n > wcp->offset + wcp->data_size) {
-		return False;
+	for (e = wcp->extents; e && e->offset + e->size <= pos; e = e->next) {
+		;
+	}
+
+	/* The extents from e on must cover the range without a gap. */
+	for (f = e, off = pos; off < end; f = f->next) {
+		if (f == NULL || f->offset > off) {
+			return False;
+		}
+		off = f->offset + f->size;
 	}
 
-	memcpy(data, wcp->data + (pos - wcp->offset), n);
+	for (f = e, off = pos; off < end; f = f->next) {
+		size_t len = MIN(end, f->offset + (SMB_OFF_T)f->size) - off;
+
+		memcpy(data + (off - pos), f->data + (off - f->offset), len);
+		off += len;
+	}
 
 	DO_PROFILE_INC(writecache_read_hits);
 
@@ -70,7 +124,7 @@ ssize_t read_file(files_struct *fsp,char *data,SMB_OFF_T pos,size_t n)
 		return n;
 	}
 
-	flush_write_cache(fsp, READ_FLUSH);
+	flush_write_cache_range(fsp, pos, n, READ_FLUSH);
 
 	fsp->fh->pos = pos;
 
@@ -110,31 +164,53 @@ tryagain:
 	return(ret);
 }
 
-/* how many write cache buffers have been allocated */
-static unsigned int allocated_write_caches;
-
 /****************************************************************************
- *Really* write to a file.
+ *Really* write to a file, several buffers at once.
 ****************************************************************************/
 
-static ssize_t real_write_file(files_struct *fsp,const char *data, SMB_OFF_T pos, size_t n)
+static ssize_t real_write_filev(files_struct *fsp, const struct iovec *iov,
+				int iovcnt, SMB_OFF_T pos)
 {
 	ssize_t ret;
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		n += iov[i].iov_len;
+	}
 
         if (pos == -1) {
-                ret = vfs_write_data(fsp, data, n);
+		ssize_t w;
+
+		for (i = 0, ret = 0; i < iovcnt; i++) {
+			w = vfs_write_data(fsp, (const char *)iov[i].iov_base,
+					   iov[i].iov_len);
+			if (w == -1) {
+				ret = ret ? ret : -1;
+				break;
+			}
+			ret += w;
+			if ((size_t)w < iov[i].iov_len) {
+				break;
+			}
+		}
         } else {
 		fsp->fh->pos = pos;
-		if (pos && lp_strict_allocate(SNUM(fsp->conn))) {
+		if (pos && fsp->conn->share_cache.strict_allocate) {
 			if (vfs_fill_sparse(fsp, pos) == -1) {
 				return -1;
 			}
 		}
-                ret = vfs_pwrite_data(fsp, data, n, pos);
+		if (iovcnt == 1) {
+			ret = vfs_pwrite_data(fsp, (const char *)iov[0].iov_base,
+					      n, pos);
+		} else {
+			ret = vfs_pwritev_data(fsp, iov, iovcnt, pos);
+		}
 	}
 
-	DEBUG(10,("real_write_file (%s): pos = %.0f, size = %lu, returned %ld\n",
-		fsp->fsp_name, (double)pos, (unsigned long)n, (long)ret ));
+	DEBUG(10,("real_write_file (%s): pos = %.0f, size = %lu in %d buffers, returned %ld\n",
+		fsp->fsp_name, (double)pos, (unsigned long)n, iovcnt, (long)ret ));
 
 	if (ret != -1) {
 		fsp->fh->pos += ret;
@@ -169,17 +245,26 @@ static ssize_t real_write_file(files_struct *fsp,const char *data, SMB_OFF_T pos
 	return ret;
 }
 
+static ssize_t real_write_file(files_struct *fsp,const char *data, SMB_OFF_T pos, size_t n)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = n;
+	return real_write_filev(fsp, &iov, 1, pos);
+}
+
 /****************************************************************************
  File size cache change.
  Updates size on disk but doesn't flush the cache.
 ****************************************************************************/
 
-static int wcp_file_size_change(files_struct *fsp)
+static int wcp_file_size_change(files_struct *fsp, SMB_OFF_T file_size)
 {
 	int ret;
 	write_cache *wcp = fsp->wcp;
 
-	wcp->file_size = wcp->offset + wcp->data_size;
+	wcp->file_size = file_size;
 	ret = SMB_VFS_FTRUNCATE(fsp, fsp->fh->fd, wcp->file_size);
 	if (ret == -1) {
 		DEBUG(0,("wcp_file_size_change (%s): ftruncate of size %.0f error %s\n",
@@ -189,524 +274,582 @@ static int wcp_file_size_change(files_struct *fsp)
 }
 
 /****************************************************************************
- Write to a file.
+ Allocate an extent holding a copy of some data. The caller links it in.
 ****************************************************************************/
 
-ssize_t write_file(files_struct *fsp, const char *data, SMB_OFF_T pos, size_t n)
+static struct write_cache_extent *new_extent(write_cache *wcp, const char *data,
+					     SMB_OFF_T pos, size_t n)
 {
-	write_cache *wcp = fsp->wcp;
-	ssize_t total_written = 0;
-	int write_path = -1; 
-
-	if (fsp->print_file) {
-		fstring sharename;
-		uint32 jobid;
-
-		if (!rap_to_pjobid(fsp->rap_print_jobid, sharename, &jobid)) {
-			DEBUG(3,("write_file: Unable to map RAP jobid %u to jobid.\n",
-						(unsigned int)fsp->rap_print_jobid ));
-			errno = EBADF;
-			return -1;
-		}
+	struct write_cache_extent *e;
 
-		return print_job_write(SNUM(fsp->conn), jobid, data, pos, n);
+	if ((e = SMB_MALLOC_P(struct write_cache_extent)) == NULL) {
+		return NULL;
 	}
-
-	if (!fsp->can_write) {
-		errno = EPERM;
-		return -1;
+	if ((e->buf = (char *)SMB_MALLOC(n)) == NULL) {
+		SAFE_FREE(e);
+		return NULL;
 	}
+	memcpy(e->buf, data, n);
+	e->next = e->prev = NULL;
+	e->offset = pos;
+	e->size = n;
+	e->data = e->buf;
+	e->alloc = n;
+
+	wcp->num_extents++;
+	wcp->data_size += n;
+	write_cache_bytes += n;
+	return e;
+}
 
-	if (!fsp->modified) {
-		SMB_STRUCT_STAT st;
-		fsp->modified = True;
-
-		if (SMB_VFS_FSTAT(fsp,fsp->fh->fd,&st) == 0) {
-			int dosmode = dos_mode(fsp->conn,fsp->fsp_name,&st);
-			if ((lp_store_dos_attributes(SNUM(fsp->conn)) || MAP_ARCHIVE(fsp->conn)) && !IS_DOS_ARCHIVE(dosmode)) {
-				file_set_dosmode(fsp->conn,fsp->fsp_name,dosmode | aARCH,&st, False);
-			}
+static void free_extent(write_cache *wcp, struct write_cache_extent *e)
+{
+	DLIST_REMOVE(wcp->extents, e);
+	wcp->num_extents--;
+	wcp->data_size -= e->size;
+	write_cache_bytes -= e->alloc;
+	SAFE_FREE(e->buf);
+	SAFE_FREE(e);
+}
 
-			/*
-			 * If this is the first write and we have an exclusive oplock then setup
-			 * the write cache.
-			 */
+/****************************************************************************
+ Forget what the cache holds for a range that is being overwritten. Only
+ fails, changing nothing, if an extent has to be split and there is no
+ memory for its tail.
+****************************************************************************/
 
-			if (EXCLUSIVE_OPLOCK_TYPE(fsp->oplock_type) && !wcp) {
-				setup_write_cache(fsp, st.st_size);
-				wcp = fsp->wcp;
-			} 
-		}  
-	}
+static BOOL discard_cached_range(write_cache *wcp, SMB_OFF_T pos, size_t n)
+{
+	struct write_cache_extent *e, *next;
+	SMB_OFF_T end = pos + n;
 
-#ifdef WITH_PROFILE
-	DO_PROFILE_INC(writecache_total_writes);
-	if (!fsp->oplock_type) {
-		DO_PROFILE_INC(writecache_non_oplock_writes);
-	}
-#endif
+	for (e = wcp->extents; e && e->offset < end; e = next) {
+		SMB_OFF_T e_end = e->offset + e->size;
 
-	/*
-	 * If this file is level II oplocked then we need
-	 * to grab the shared memory lock and inform all
-	 * other files with a level II lock that they need
-	 * to flush their read caches. We keep the lock over
-	 * the shared memory area whilst doing this.
-	 */
+		next = e->next;
 
-	release_level_2_oplocks_on_change(fsp);
+		if (e_end <= pos) {
+			continue;
+		}
 
-#ifdef WITH_PROFILE
-	if (profile_p && profile_p->writecache_total_writes % 500 == 0) {
-		DEBUG(3,("WRITECACHE: initwrites=%u abutted=%u total=%u \
-nonop=%u allocated=%u active=%u direct=%u perfect=%u readhits=%u\n",
-			profile_p->writecache_init_writes,
-			profile_p->writecache_abutted_writes,
-			profile_p->writecache_total_writes,
-			profile_p->writecache_non_oplock_writes,
-			profile_p->writecache_allocated_write_caches,
-			profile_p->writecache_num_write_caches,
-			profile_p->writecache_direct_writes,
-			profile_p->writecache_num_perfect_writes,
-			profile_p->writecache_read_hits ));
+		if (e->offset < pos && e_end > end) {
+			/* The range is inside this extent, so it is the
+			   only one touched. Keep the head, copy the tail. */
+			struct write_cache_extent *tail;
 
-		DEBUG(3,("WRITECACHE: Flushes SEEK=%d, READ=%d, WRITE=%d, READRAW=%d, OPLOCK=%d, CLOSE=%d, SYNC=%d\n",
-			profile_p->writecache_flushed_writes[SEEK_FLUSH],
-			profile_p->writecache_flushed_writes[READ_FLUSH],
-			profile_p->writecache_flushed_writes[WRITE_FLUSH],
-			profile_p->writecache_flushed_writes[READRAW_FLUSH],
-			profile_p->writecache_flushed_writes[OPLOCK_RELEASE_FLUSH],
-			profile_p->writecache_flushed_writes[CLOSE_FLUSH],
-			profile_p->writecache_flushed_writes[SYNC_FLUSH] ));
-	}
-#endif
+			tail = new_extent(wcp, e->data + (end - e->offset),
+					  end, e_end - end);
+			if (tail == NULL) {
+				return False;
+			}
+			DLIST_ADD_AFTER(wcp->extents, tail, e);
+			wcp->data_size -= e_end - pos;
+			e->size = pos - e->offset;
+			return True;
+		}
 
-	if(!wcp) {
-		DO_PROFILE_INC(writecache_direct_writes);
-		total_written = real_write_file(fsp, data, pos, n);
-		return total_written;
+		if (e->offset >= pos && e_end <= end) {
+			free_extent(wcp, e);
+		} else if (e->offset < pos) {
+			/* cut off the tail */
+			wcp->data_size -= e_end - pos;
+			e->size = pos - e->offset;
+		} else {
+			/* cut off the head */
+			wcp->data_size -= end - e->offset;
+			e->data += end - e->offset;
+			e->size -= end - e->offset;
+			e->offset = end;
+		}
 	}
+	return True;
+}
 
-	DEBUG(9,("write_file (%s)(fd=%d pos=%.0f size=%u) wcp->offset=%.0f wcp->data_size=%u\n",
-		fsp->fsp_name, fsp->fh->fd, (double)pos, (unsigned int)n, (double)wcp->offset, (unsigned int)wcp->data_size));
-
-	fsp->fh->pos = pos + n;
-
-	/* 
-	 * If we have active cache and it isn't contiguous then we flush.
-	 * NOTE: There is a small problem with running out of disk ....
-	 */
-
-	if (wcp->data_size) {
-		BOOL cache_flush_needed = False;
-
-		if ((pos >= wcp->offset) && (pos <= wcp->offset + wcp->data_size)) {
-      
-			/* ASCII art.... JRA.
-
-      +--------------+-----
-      | Cached data  | Rest of allocated cache buffer....
-      +--------------+-----
-
-            +-------------------+
-            | Data to write     |
-            +-------------------+
-
-	    		*/
-
-			/*
-			 * Start of write overlaps or abutts the existing data.
-			 */
-
-			size_t data_used = MIN((wcp->alloc_size - (pos - wcp->offset)), n);
-
-			memcpy(wcp->data + (pos - wcp->offset), data, data_used);
+/****************************************************************************
+ Put a write into the cache. Returns False if out of memory, leaving the
+ cache as it was.
+****************************************************************************/
 
-			/*
-			 * Update the current buffer size with the new data.
-			 */
+static BOOL cache_write(write_cache *wcp, const char *data, SMB_OFF_T pos, size_t n)
+{
+	struct write_cache_extent *e, *prev = NULL;
 
-			if(pos + data_used > wcp->offset + wcp->data_size) {
-				wcp->data_size = pos + data_used - wcp->offset;
-			}
+	if (!discard_cached_range(wcp, pos, n)) {
+		return False;
+	}
 
-			/*
-			 * Update the file size if changed.
-			 */
+	for (e = wcp->extents; e && e->offset < pos; e = e->next) {
+		prev = e;
+	}
 
-			if (wcp->offset + wcp->data_size > wcp->file_size) {
-				if (wcp_file_size_change(fsp) == -1) {
-					return -1;
-				}
-			}
+	if (prev && prev->offset + prev->size == pos) {
+		/* Extend the extent this write abuts, growing its
+		   buffer geometrically so sequential writes stay cheap. */
+		size_t used = PTR_DIFF(prev->data, prev->buf) + prev->size;
 
-			/*
-			 * If we used all the data then
-			 * return here.
-			 */
+		if (used + n > prev->alloc) {
+			size_t alloc = MAX(MIN(2 * prev->alloc, wcp->alloc_size), used + n);
+			char *buf = (char *)SMB_REALLOC_KEEP_OLD_ON_ERROR(prev->buf, alloc);
 
-			if(n == data_used) {
-				return n;
-			} else {
-				cache_flush_needed = True;
+			if (buf == NULL) {
+				return False;
 			}
-			/*
-			 * Move the start of data forward by the amount used,
-			 * cut down the amount left by the same amount.
-			 */
+			prev->data = buf + PTR_DIFF(prev->data, prev->buf);
+			prev->buf = buf;
+			write_cache_bytes += alloc - prev->alloc;
+			prev->alloc = alloc;
+		}
+		memcpy(prev->data + prev->size, data, n);
+		prev->size += n;
+		wcp->data_size += n;
+		DO_PROFILE_INC(writecache_abutted_writes);
+		return True;
+	}
 
-			data += data_used;
-			pos += data_used;
-			n -= data_used;
+	if ((e = new_extent(wcp, data, pos, n)) == NULL) {
+		return False;
+	}
+	if (prev) {
+		DLIST_ADD_AFTER(wcp->extents, e, prev);
+	} else {
+		DLIST_ADD(wcp->extents, e);
+	}
+	return True;
+}
 
-			DO_PROFILE_INC(writecache_abutted_writes);
-			total_written = data_used;
+/****************************************************************************
+ Write out a run of abutting extents, first to last, in one call.
+****************************************************************************/
 
-			write_path = 1;
+static ssize_t write_extent_run(files_struct *fsp,
+				struct write_cache_extent *first,
+				struct write_cache_extent *last)
+{
+	struct iovec iov[WRITE_CACHE_MAX_EXTENTS];
+	struct write_cache_extent *e;
+	int n = 0;
+
+	for (e = first; ; e = e->next) {
+		iov[n].iov_base = e->data;
+		iov[n].iov_len = e->size;
+		n++;
+		if (e == last) {
+			break;
+		}
+	}
 
-		} else if ((pos < wcp->offset) && (pos + n > wcp->offset) && 
-					(pos + n <= wcp->offset + wcp->alloc_size)) {
+	if (n > 1) {
+		DO_PROFILE_INC(writecache_gathered_writes);
+	}
+	return real_write_filev(fsp, iov, n, first->offset);
+}
 
-			/* ASCII art.... JRA.
+/*******************************************************************
+ Is this cache on the list of caches holding data ?
+********************************************************************/
 
-                        +---------------+
-                        | Cache buffer  |
-                        +---------------+
+static BOOL cache_is_dirty(write_cache *wcp)
+{
+	return wcp->prev != NULL || dirty_write_caches == wcp;
+}
 
-            +-------------------+
-            | Data to write     |
-            +-------------------+
+/*******************************************************************
+ Once a cache holds no data it needs no flushing.
+********************************************************************/
 
-	    		*/
+static void check_cache_empty(write_cache *wcp)
+{
+	if (wcp->data_size != 0) {
+		return;
+	}
+	if (cache_is_dirty(wcp)) {
+		DO_PROFILE_DEC(writecache_num_write_caches);
+		DLIST_REMOVE(dirty_write_caches, wcp);
+	}
+	TALLOC_FREE(wcp->flush_event);
+}
 
-			/*
-			 * End of write overlaps the existing data.
-			 */
+/*******************************************************************
+ Flush the runs of cached data that touch [start, end), or all of them.
+ The data is dropped from the cache even if writing it fails, as the
+ old single buffer cache did.
+********************************************************************/
 
-			size_t data_used = pos + n - wcp->offset;
+static ssize_t flush_extents(files_struct *fsp, BOOL all, SMB_OFF_T start,
+			     SMB_OFF_T end, enum flush_reason_enum reason)
+{
+	write_cache *wcp = fsp->wcp;
+	struct write_cache_extent *e, *first, *last, *next;
+	ssize_t ret, total = 0;
+	int saved_errno = 0;
+	BOOL flushed = False;
+
+	for (e = wcp->extents; e; e = next) {
+		size_t len = e->size;
+
+		first = last = e;
+		while (last->next && last->next->offset == last->offset + last->size) {
+			last = last->next;
+			len += last->size;
+		}
+		next = last->next;
 
-			memcpy(wcp->data, data + n - data_used, data_used);
+		if (!all && (last->offset + (SMB_OFF_T)last->size <= start ||
+			     first->offset >= end)) {
+			continue;
+		}
 
-			/*
-			 * Update the current buffer size with the new data.
-			 */
+		DEBUG(9,("flushing write cache: fd = %d, off=%.0f, size=%u\n",
+			fsp->fh->fd, (double)first->offset, (unsigned int)len));
 
-			if(pos + n > wcp->offset + wcp->data_size) {
-				wcp->data_size = pos + n - wcp->offset;
-			}
+#ifdef WITH_PROFILE
+		if (len == wcp->alloc_size) {
+			DO_PROFILE_INC(writecache_num_perfect_writes);
+		}
+#endif
 
+		ret = write_extent_run(fsp, first, last);
+		if (ret == -1) {
+			saved_errno = errno;
+		} else {
+			total += ret;
 			/*
-			 * Update the file size if changed.
+			 * Ensure file size if kept up to date if write extends file.
 			 */
-
-			if (wcp->offset + wcp->data_size > wcp->file_size) {
-				if (wcp_file_size_change(fsp) == -1) {
-					return -1;
-				}
+			if (first->offset + ret > wcp->file_size) {
+				wcp->file_size = first->offset + ret;
 			}
+		}
 
-			/*
-			 * We don't need to move the start of data, but we
-			 * cut down the amount left by the amount used.
-			 */
+		while (first != next) {
+			e = first;
+			first = first->next;
+			free_extent(wcp, e);
+		}
+		flushed = True;
+	}
 
-			n -= data_used;
+	if (flushed) {
+		DO_PROFILE_INC(writecache_flushed_writes[reason]);
+		check_cache_empty(wcp);
+	}
 
-			/*
-			 * We cannot have used all the data here.
-			 */
+	if (saved_errno) {
+		errno = saved_errno;
+		return -1;
+	}
+	return total;
+}
 
-			cache_flush_needed = True;
+/*******************************************************************
+ Flush a file's cache some time after it was written to, by when the
+ client has had its reply.
+********************************************************************/
 
-			DO_PROFILE_INC(writecache_abutted_writes);
-			total_written = data_used;
+static void write_cache_idle_flush(struct event_context *ctx,
+				   struct timed_event *te,
+				   const struct timeval *now,
+				   void *private_data)
+{
+	files_struct *fsp = (files_struct *)private_data;
+	write_cache *wcp = fsp->wcp;
 
-			write_path = 2;
+	TALLOC_FREE(wcp->flush_event);
 
-		} else if ( (pos >= wcp->file_size) && 
-					(wcp->offset + wcp->data_size == wcp->file_size) &&
-					(pos > wcp->offset + wcp->data_size) && 
-					(pos < wcp->offset + wcp->alloc_size) ) {
+	/* We run from the main loop as whoever the last request was. */
+	if (!change_to_user(fsp->conn, fsp->vuid)) {
+		DEBUG(1,("write_cache_idle_flush: can't become the user of %s, "
+			"flushing as root\n", fsp->fsp_name ));
+		change_to_root_user();
+	}
 
-			/* ASCII art.... JRA.
+	if (flush_extents(fsp, True, 0, 0, IDLE_FLUSH) == -1) {
+		DEBUG(1,("write_cache_idle_flush: flushing %s failed: %s\n",
+			fsp->fsp_name, strerror(errno) ));
+		wcp->flush_errno = errno;
+	}
 
-                       End of file ---->|
+	change_to_root_user();
+}
 
-                        +---------------+---------------+
-                        | Cached data   | Cache buffer  |
-                        +---------------+---------------+
+/*******************************************************************
+ Flush the caches written to longest ago until n more bytes fit in the
+ process budget.
+********************************************************************/
 
-                                              +-------------------+
-                                              | Data to write     |
-                                              +-------------------+
+static void make_room_in_budget(size_t n)
+{
+	write_cache *wcp;
+	BOOL other_user;
+	ssize_t ret;
+	int saved_errno;
 
-	    		*/
+	while (write_cache_bytes + n > write_cache_budget && dirty_write_caches) {
+		for (wcp = dirty_write_caches; wcp->next; wcp = wcp->next) {
+			;
+		}
 
-			/*
-			 * Non-contiguous write part of which fits within
-			 * the cache buffer and is extending the file
-			 * and the cache contents reflect the current
-			 * data up to the current end of the file.
-			 */
+		/* Don't write another user's file as the current user;
+		   do it as root, as an oplock break would. */
+		other_user = (wcp->fsp->conn != current_user.conn ||
+			      wcp->fsp->vuid != current_user.vuid);
+		if (other_user) {
+			become_root();
+		}
+		ret = flush_extents(wcp->fsp, True, 0, 0, BUDGET_FLUSH);
+		saved_errno = errno;
+		if (other_user) {
+			unbecome_root();
+		}
+		if (ret == -1) {
+			DEBUG(1,("make_room_in_budget: flushing %s failed: %s\n",
+				wcp->fsp->fsp_name, strerror(saved_errno) ));
+			wcp->flush_errno = saved_errno;
+		}
+	}
+}
 
-			size_t data_used;
+/****************************************************************************
+ Write past the cache, making sure older cached data for the range can't
+ later overwrite it.
+****************************************************************************/
 
-			if(pos + n <= wcp->offset + wcp->alloc_size) {
-				data_used = n;
-			} else {
-				data_used = wcp->offset + wcp->alloc_size - pos;
-			}
+static ssize_t write_around_cache(files_struct *fsp, const char *data, SMB_OFF_T pos, size_t n)
+{
+	write_cache *wcp = fsp->wcp;
+	ssize_t ret;
 
-			/*
-			 * Fill in the non-continuous area with zeros.
-			 */
+	if (pos == -1) {
+		ret = flush_extents(fsp, True, 0, 0, WRITE_FLUSH);
+	} else {
+		ret = flush_extents(fsp, False, pos, pos + n, WRITE_FLUSH);
+	}
+	if (ret == -1) {
+		return -1;
+	}
 
-			memset(wcp->data + wcp->data_size, '\0',
-				pos - (wcp->offset + wcp->data_size) );
+	DO_PROFILE_INC(writecache_direct_writes);
+	ret = real_write_file(fsp, data, pos, n);
+	if (ret == -1) {
+		return -1;
+	}
 
-			memcpy(wcp->data + (pos - wcp->offset), data, data_used);
+	if (pos != -1 && pos + ret > wcp->file_size) {
+		wcp->file_size = pos + ret;
+	}
+	return ret;
+}
 
-			/*
-			 * Update the current buffer size with the new data.
-			 */
+/****************************************************************************
+ Write to a file through its write cache.
+****************************************************************************/
 
-			if(pos + data_used > wcp->offset + wcp->data_size) {
-				wcp->data_size = pos + data_used - wcp->offset;
-			}
+static ssize_t write_to_cache(files_struct *fsp, const char *data, SMB_OFF_T pos, size_t n)
+{
+	write_cache *wcp = fsp->wcp;
 
-			/*
-			 * Update the file size if changed.
-			 */
+	DEBUG(9,("write_file (%s)(fd=%d pos=%.0f size=%u) cached=%u in %u extents\n",
+		fsp->fsp_name, fsp->fh->fd, (double)pos, (unsigned int)n,
+		(unsigned int)wcp->data_size, wcp->num_extents));
 
-			if (wcp->offset + wcp->data_size > wcp->file_size) {
-				if (wcp_file_size_change(fsp) == -1) {
-					return -1;
-				}
-			}
+	if (n == 0) {
+		/* nothing to cache, and no empty extent to leave behind */
+		return 0;
+	}
 
-			/*
-			 * If we used all the data then
-			 * return here.
-			 */
+	if (wcp->flush_errno) {
+		/* A flush nobody was waiting for failed, report it now. */
+		errno = wcp->flush_errno;
+		wcp->flush_errno = 0;
+		return -1;
+	}
 
-			if(n == data_used) {
-				return n;
-			} else {
-				cache_flush_needed = True;
-			}
+	if (pos == -1 || n > wcp->alloc_size) {
+		return write_around_cache(fsp, data, pos, n);
+	}
 
-			/*
-			 * Move the start of data forward by the amount used,
-			 * cut down the amount left by the same amount.
-			 */
+	/*
+	 * Make room for the write, first within this file's share of
+	 * the cache and then within the process budget.
+	 */
 
-			data += data_used;
-			pos += data_used;
-			n -= data_used;
+	if (wcp->data_size + n > wcp->alloc_size ||
+	    wcp->num_extents >= WRITE_CACHE_MAX_EXTENTS) {
+		DEBUG(9,("write_file: cache for %s full, flushing %u bytes in %u extents\n",
+			fsp->fsp_name, (unsigned int)wcp->data_size, wcp->num_extents));
+		if (flush_extents(fsp, True, 0, 0, WRITE_FLUSH) == -1) {
+			return -1;
+		}
+	}
+	make_room_in_budget(n);
+
+	if (!cache_write(wcp, data, pos, n)) {
+		DEBUG(0,("write_file: out of memory caching write to %s\n",
+			fsp->fsp_name ));
+		/* making room for it may have emptied the cache */
+		check_cache_empty(wcp);
+		return write_around_cache(fsp, data, pos, n);
+	}
 
-			DO_PROFILE_INC(writecache_abutted_writes);
-			total_written = data_used;
+	fsp->fh->pos = pos + n;
 
-			write_path = 3;
+	if (!cache_is_dirty(wcp)) {
+		DO_PROFILE_INC(writecache_init_writes);
+		DO_PROFILE_INC(writecache_num_write_caches);
+		DLIST_ADD(dirty_write_caches, wcp);
+	} else {
+		DLIST_PROMOTE(dirty_write_caches, wcp);
+	}
 
-                } else if ( (pos >= wcp->file_size) &&
-			    (n == 1) &&
-			    (wcp->file_size == wcp->offset + wcp->data_size) &&
-			    (pos < wcp->file_size + wcp->alloc_size)) {
+	if (wcp->flush_event == NULL && write_behind_msec > 0) {
+		wcp->flush_event = event_add_timed(smbd_event_context(), NULL,
+				timeval_current_ofs(write_behind_msec / 1000,
+						    (write_behind_msec % 1000) * 1000),
+				"write_cache_idle_flush",
+				write_cache_idle_flush, fsp);
+	}
 
-                        /*
+	/*
+	 * Update the file size if changed.
+	 */
 
-                End of file ---->|
+	if (pos + n > wcp->file_size) {
+		if (wcp_file_size_change(fsp, pos + n) == -1) {
+			return -1;
+		}
+	}
 
-                 +---------------+---------------+
-                 | Cached data   | Cache buffer  |
-                 +---------------+---------------+
+	return n;
+}
 
-                                 |<------- allocated size ---------------->|
+/****************************************************************************
+ Write several buffers to a file, one after the other from pos.
+****************************************************************************/
 
-                                                         +--------+
-                                                         | 1 Byte |
-                                                         +--------+
+ssize_t write_filev(files_struct *fsp, const struct iovec *iov, int iovcnt, SMB_OFF_T pos)
+{
+	write_cache *wcp = fsp->wcp;
+	ssize_t ret, total = 0;
+	int i;
 
-			MS-Office seems to do this a lot to determine if there's enough
-			space on the filesystem to write a new file.
+	if (fsp->print_file) {
+		fstring sharename;
+		uint32 jobid;
 
-			Change to :
+		if (!rap_to_pjobid(fsp->rap_print_jobid, sharename, &jobid)) {
+			DEBUG(3,("write_file: Unable to map RAP jobid %u to jobid.\n",
+						(unsigned int)fsp->rap_print_jobid ));
+			errno = EBADF;
+			return -1;
+		}
 
-                End of file ---->|
-                                 +-----------------------+--------+
-                                 | Zeroed Cached data    | 1 Byte |
-                                 +-----------------------+--------+
-                        */
+		return print_job_writev(SNUM(fsp->conn), jobid, iov, iovcnt, pos);
+	}
 
-			flush_write_cache(fsp, WRITE_FLUSH);
-			wcp->offset = wcp->file_size;
-			wcp->data_size = pos - wcp->file_size + 1;
-			memset(wcp->data, '\0', wcp->data_size);
-			memcpy(wcp->data + wcp->data_size-1, data, 1);
+	if (!fsp->can_write) {
+		errno = EPERM;
+		return -1;
+	}
 
-			/*
-			 * Update the file size if changed.
-			 */
+	if (!fsp->modified) {
+		SMB_STRUCT_STAT st;
+		fsp->modified = True;
 
-			if (wcp->offset + wcp->data_size > wcp->file_size) {
-				if (wcp_file_size_change(fsp) == -1) {
-					return -1;
-				}
+		if (SMB_VFS_FSTAT(fsp,fsp->fh->fd,&st) == 0) {
+			int dosmode = dos_mode(fsp->conn,fsp->fsp_name,&st);
+			if ((fsp->conn->share_cache.store_dos_attributes || MAP_ARCHIVE(fsp->conn)) && !IS_DOS_ARCHIVE(dosmode)) {
+				file_set_dosmode(fsp->conn,fsp->fsp_name,dosmode | aARCH,&st, False);
 			}
 
-			return n;
-
-		} else {
-
-			/* ASCII art..... JRA.
-
-   Case 1).
-
-                        +---------------+---------------+
-                        | Cached data   | Cache buffer  |
-                        +---------------+---------------+
-
-                                                              +-------------------+
-                                                              | Data to write     |
-                                                              +-------------------+
-
-   Case 2).
-
-                           +---------------+---------------+
-                           | Cached data   | Cache buffer  |
-                           +---------------+---------------+
-
-   +-------------------+
-   | Data to write     |
-   +-------------------+
-
-    Case 3).
-
-                           +---------------+---------------+
-                           | Cached data   | Cache buffer  |
-                           +---------------+---------------+
-
-                  +-----------------------------------------------------+
-                  | Data to write                                       |
-                  +-----------------------------------------------------+
-
-		  */
-
- 			/*
-			 * Write is bigger than buffer, or there is no overlap on the
-			 * low or high ends.
-			 */
-
-			DEBUG(9,("write_file: non cacheable write : fd = %d, pos = %.0f, len = %u, current cache pos = %.0f \
-len = %u\n",fsp->fh->fd, (double)pos, (unsigned int)n, (double)wcp->offset, (unsigned int)wcp->data_size ));
-
 			/*
-			 * If write would fit in the cache, and is larger than
-			 * the data already in the cache, flush the cache and
-			 * preferentially copy the data new data into it. Otherwise
-			 * just write the data directly.
+			 * If this is the first write and we have an exclusive oplock then setup
+			 * the write cache.
 			 */
 
-			if ( n <= wcp->alloc_size && n > wcp->data_size) {
-				cache_flush_needed = True;
-			} else {
-				ssize_t ret = real_write_file(fsp, data, pos, n);
-
-				/*
-				 * If the write overlaps the entire cache, then
-				 * discard the current contents of the cache.
-				 * Fix from Rasmus Borup Hansen rbh@math.ku.dk.
-				 */
-
-				if ((pos <= wcp->offset) &&
-						(pos + n >= wcp->offset + wcp->data_size) ) {
-					DEBUG(9,("write_file: discarding overwritten write \
-cache: fd = %d, off=%.0f, size=%u\n", fsp->fh->fd, (double)wcp->offset, (unsigned int)wcp->data_size ));
-					wcp->data_size = 0;
-				}
-
-				DO_PROFILE_INC(writecache_direct_writes);
-				if (ret == -1) {
-					return ret;
-				}
-
-				if (pos + ret > wcp->file_size) {
-					wcp->file_size = pos + ret;
-				}
-
-				return ret;
-			}
-
-			write_path = 4;
-
-		}
-
-		if (cache_flush_needed) {
-			DEBUG(3,("WRITE_FLUSH:%d: due to noncontinuous write: fd = %d, size = %.0f, pos = %.0f, \
-n = %u, wcp->offset=%.0f, wcp->data_size=%u\n",
-				write_path, fsp->fh->fd, (double)wcp->file_size, (double)pos, (unsigned int)n,
-				(double)wcp->offset, (unsigned int)wcp->data_size ));
+			if (EXCLUSIVE_OPLOCK_TYPE(fsp->oplock_type) && !wcp) {
+				setup_write_cache(fsp, st.st_size);
+				wcp = fsp->wcp;
+			} 
+		}  
+	}
 
-			flush_write_cache(fsp, WRITE_FLUSH);
-		}
+#ifdef WITH_PROFILE
+	DO_PROFILE_INC(writecache_total_writes);
+	if (!fsp->oplock_type) {
+		DO_PROFILE_INC(writecache_non_oplock_writes);
 	}
+#endif
 
 	/*
-	 * If the write request is bigger than the cache
-	 * size, write it all out.
+	 * If this file is level II oplocked then we need
+	 * to grab the shared memory lock and inform all
+	 * other files with a level II lock that they need
+	 * to flush their read caches. We keep the lock over
+	 * the shared memory area whilst doing this.
 	 */
 
-	if (n > wcp->alloc_size ) {
-		ssize_t ret = real_write_file(fsp, data, pos, n);
-		if (ret == -1) {
-			return -1;
-		}
+	release_level_2_oplocks_on_change(fsp);
 
-		if (pos + ret > wcp->file_size) {
-			wcp->file_size = pos + n;
-		}
+#ifdef WITH_PROFILE
+	if (profile_p && profile_p->writecache_total_writes % 500 == 0) {
+		DEBUG(3,("WRITECACHE: initwrites=%u abutted=%u total=%u \
+nonop=%u allocated=%u active=%u direct=%u perfect=%u gathered=%u readhits=%u\n",
+			profile_p->writecache_init_writes,
+			profile_p->writecache_abutted_writes,
+			profile_p->writecache_total_writes,
+			profile_p->writecache_non_oplock_writes,
+			profile_p->writecache_allocated_write_caches,
+			profile_p->writecache_num_write_caches,
+			profile_p->writecache_direct_writes,
+			profile_p->writecache_num_perfect_writes,
+			profile_p->writecache_gathered_writes,
+			profile_p->writecache_read_hits ));
 
-		DO_PROFILE_INC(writecache_direct_writes);
-		return total_written + n;
+		DEBUG(3,("WRITECACHE: Flushes SEEK=%d, READ=%d, WRITE=%d, READRAW=%d, OPLOCK=%d, CLOSE=%d, SYNC=%d, IDLE=%d, BUDGET=%d\n",
+			profile_p->writecache_flushed_writes[SEEK_FLUSH],
+			profile_p->writecache_flushed_writes[READ_FLUSH],
+			profile_p->writecache_flushed_writes[WRITE_FLUSH],
+			profile_p->writecache_flushed_writes[READRAW_FLUSH],
+			profile_p->writecache_flushed_writes[OPLOCK_RELEASE_FLUSH],
+			profile_p->writecache_flushed_writes[CLOSE_FLUSH],
+			profile_p->writecache_flushed_writes[SYNC_FLUSH],
+			profile_p->writecache_flushed_writes[IDLE_FLUSH],
+			profile_p->writecache_flushed_writes[BUDGET_FLUSH] ));
 	}
+#endif
 
-	/*
-	 * If there's any data left, cache it.
-	 */
+	if(!wcp) {
+		DO_PROFILE_INC(writecache_direct_writes);
+		return real_write_filev(fsp, iov, iovcnt, pos);
+	}
 
-	if (n) {
-#ifdef WITH_PROFILE
-		if (wcp->data_size) {
-			DO_PROFILE_INC(writecache_abutted_writes);
-		} else {
-			DO_PROFILE_INC(writecache_init_writes);
+	/* the cache gathers the buffers again when it is flushed */
+	for (i = 0; i < iovcnt; i++) {
+		ret = write_to_cache(fsp, (const char *)iov[i].iov_base,
+				     pos == -1 ? -1 : pos + total,
+				     iov[i].iov_len);
+		if (ret == -1) {
+			return total ? total : -1;
 		}
-#endif
-		memcpy(wcp->data+wcp->data_size, data, n);
-		if (wcp->data_size == 0) {
-			wcp->offset = pos;
-			DO_PROFILE_INC(writecache_num_write_caches);
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len) {
+			break;
 		}
-		wcp->data_size += n;
+	}
+	return total;
+}
 
-		/*
-		 * Update the file size if changed.
-		 */
+/****************************************************************************
+ Write to a file.
+****************************************************************************/
 
-		if (wcp->offset + wcp->data_size > wcp->file_size) {
-			if (wcp_file_size_change(fsp) == -1) {
-				return -1;
-			}
-		}
-		DEBUG(9,("wcp->offset = %.0f wcp->data_size = %u cache return %u\n",
-			(double)wcp->offset, (unsigned int)wcp->data_size, (unsigned int)n));
+ssize_t write_file(files_struct *fsp, const char *data, SMB_OFF_T pos, size_t n)
+{
+	struct iovec iov;
 
-		total_written += n;
-		return total_written; /* .... that's a write :) */
-	}
-  
-	return total_written;
+	iov.iov_base = (void *)data;
+	iov.iov_len = n;
+	return write_filev(fsp, &iov, 1, pos);
 }
 
 /****************************************************************************
@@ -730,7 +873,7 @@ void delete_write_cache(files_struct *fsp)
 
 	SMB_ASSERT(wcp->data_size == 0);
 
-	SAFE_FREE(wcp->data);
+	TALLOC_FREE(wcp->flush_event);
 	SAFE_FREE(fsp->wcp);
 
 	DEBUG(10,("delete_write_cache: File %s deleted write cache\n", fsp->fsp_name ));
@@ -742,13 +885,10 @@ void delete_write_cache(files_struct *fsp)
 
 static BOOL setup_write_cache(files_struct *fsp, SMB_OFF_T file_size)
 {
-	ssize_t alloc_size = lp_write_cache_size(SNUM(fsp->conn));
+	ssize_t alloc_size = fsp->conn->share_cache.write_cache_size;
+	size_t budget;
 	write_cache *wcp;
 
-	if (allocated_write_caches >= MAX_WRITE_CACHES) {
-		return False;
-	}
-
 	if(alloc_size == 0 || fsp->wcp) {
 		return False;
 	}
@@ -758,18 +898,18 @@ static BOOL setup_write_cache(files_struct *fsp, SMB_OFF_T file_size)
 		return False;
 	}
 
+	ZERO_STRUCTP(wcp);
+	wcp->fsp = fsp;
 	wcp->file_size = file_size;
-	wcp->offset = 0;
 	wcp->alloc_size = alloc_size;
-	wcp->data_size = 0;
-	if((wcp->data = (char *)SMB_MALLOC(wcp->alloc_size)) == NULL) {
-		DEBUG(0,("setup_write_cache: malloc fail for buffer size %u.\n",
-			(unsigned int)wcp->alloc_size ));
-		SAFE_FREE(wcp);
-		return False;
-	}
 
-	memset(wcp->data, '\0', wcp->alloc_size );
+	budget = (size_t)conv_str_size(lp_parm_const_string(-1, "smbd",
+						"write cache budget", NULL));
+	if (budget == 0) {
+		budget = MAX_WRITE_CACHES * alloc_size;
+	}
+	write_cache_budget = MAX(write_cache_budget, budget);
+	write_behind_msec = lp_parm_int(-1, "smbd", "write behind delay", 1000);
 
 	fsp->wcp = wcp;
 	DO_PROFILE_INC(writecache_allocated_write_caches);
@@ -806,38 +946,41 @@ on file %s with write cache size = %lu\n", fsp->fsp_name, (unsigned long)fsp->wc
 ssize_t flush_write_cache(files_struct *fsp, enum flush_reason_enum reason)
 {
 	write_cache *wcp = fsp->wcp;
-	size_t data_size;
-	ssize_t ret;
+	ssize_t ret = 0;
 
-	if(!wcp || !wcp->data_size) {
+	if(!wcp) {
 		return 0;
 	}
 
-	data_size = wcp->data_size;
-	wcp->data_size = 0;
-
-	DO_PROFILE_DEC_INC(writecache_num_write_caches,writecache_flushed_writes[reason]);
-
-	DEBUG(9,("flushing write cache: fd = %d, off=%.0f, size=%u\n",
-		fsp->fh->fd, (double)wcp->offset, (unsigned int)data_size));
+	if (wcp->data_size) {
+		ret = flush_extents(fsp, True, 0, 0, reason);
+	}
 
-#ifdef WITH_PROFILE
-	if(data_size == wcp->alloc_size) {
-		DO_PROFILE_INC(writecache_num_perfect_writes);
+	if (ret != -1 && wcp->flush_errno) {
+		/* An earlier flush in the background failed. */
+		errno = wcp->flush_errno;
+		wcp->flush_errno = 0;
+		ret = -1;
 	}
-#endif
 
-	ret = real_write_file(fsp, wcp->data, wcp->offset, data_size);
+	return ret;
+}
 
-	/*
-	 * Ensure file size if kept up to date if write extends file.
-	 */
+/*******************************************************************
+ Flush just the cached data overlapping a range, before it is read or
+ written other than through the cache.
+********************************************************************/
 
-	if ((ret != -1) && (wcp->offset + ret > wcp->file_size)) {
-		wcp->file_size = wcp->offset + ret;
+ssize_t flush_write_cache_range(files_struct *fsp, SMB_OFF_T pos, size_t n,
+				enum flush_reason_enum reason)
+{
+	write_cache *wcp = fsp->wcp;
+
+	if(!wcp || !wcp->data_size) {
+		return 0;
 	}
 
-	return ret;
+	return flush_extents(fsp, False, pos, pos + n, reason);
 }
 
 /*******************************************************************
@@ -849,8 +992,8 @@ NTSTATUS sync_file(connection_struct *conn, files_struct *fsp, BOOL write_throug
        	if (fsp->fh->fd == -1)
 		return NT_STATUS_INVALID_HANDLE;
 
-	if (lp_strict_sync(SNUM(conn)) &&
-	    (lp_syncalways(SNUM(conn)) || write_through)) {
+	if (conn->share_cache.strict_sync &&
+	    (conn->share_cache.sync_always || write_through)) {
 		int ret = flush_write_cache(fsp, SYNC_FLUSH);
 		if (ret == -1) {
 			return map_nt_error_from_unix(errno);
@@ -209,7 +209,7 @@ NTSTATUS unix_convert(connection_struct *conn,
 	 */
 
 	if (conn->case_sensitive && !conn->case_preserve && !conn->short_case_preserve) {
-		strnorm(name, lp_defaultcase(SNUM(conn)));
+		strnorm(name, conn->share_cache.default_case);
 	}
 	
 	start = name;
@@ -445,7 +445,7 @@ NTSTATUS unix_convert(connection_struct *conn,
 				if (!conn->case_preserve ||
 				    (mangle_is_8_3(start, False, conn->params) &&
 						 !conn->short_case_preserve)) {
-					strnorm(start, lp_defaultcase(SNUM(conn)));
+					strnorm(start, conn->share_cache.default_case);
 				}
 
 				/*
@@ -553,7 +553,7 @@ NTSTATUS check_name(connection_struct *conn, const pstring name)
 		}
 	}
 
-	if (!lp_widelinks(SNUM(conn)) || !lp_symlinks(SNUM(conn))) {
+	if (!conn->share_cache.widelinks || !conn->share_cache.symlinks) {
 		NTSTATUS status = reduce_name(conn,name);
 		if (!NT_STATUS_IS_OK(status)) {
 			DEBUG(5,("check_name: name %s failed with %s\n",name, nt_errstr(status)));
@@ -78,6 +78,14 @@
 #define MANGLE_CACHE_SIZE 4096
 #endif
 
+/* the shared cache is emptied when it grows past this many entries */
+#ifndef MANGLE_SHARED_CACHE_MAX
+#define MANGLE_SHARED_CACHE_MAX 100000
+#endif
+
+/* the number of entries in the shared cache is kept under this key */
+#define MANGLE_SHARED_COUNT_KEY "ENTRIES"
+
 #define FNV1_PRIME 0x01000193
 /*the following number is a fnv1 of the string: idra@samba.org 2002 */
 #define FNV1_INIT  0xa6b93095
@@ -94,14 +102,37 @@ static unsigned char char_flags[256];
 */
 static unsigned mangle_prefix;
 
-/* we will use a very simple direct mapped prefix cache. The big
-   advantage of this cache structure is speed and low memory usage 
+/* the prefix cache maps the hash in a mangled name back to the long
+   name prefix it came from. It is set associative with
+   MANGLE_CACHE_WAYS entries per set, replaced least recently used
+   first, and all entries live in one array allocated at startup.
 
    The cache is indexed by the low-order bits of the hash, and confirmed by
-   hashing the resulting cache entry to match the known hash
+   comparing the hash stored in the entry
 */
-static char **prefix_cache;
-static unsigned int *prefix_cache_hashes;
+#define MANGLE_CACHE_WAYS 4
+
+/* prefixes up to this long are stored in the entry itself, longer
+   ones (rare) are allocated */
+#define MANGLE_CACHE_INLINE 112
+
+struct prefix_cache_entry {
+	unsigned int hash;
+	unsigned int last_used;		/* 0 for an empty entry */
+	char *long_prefix;
+	char prefix[MANGLE_CACHE_INLINE];
+};
+
+static struct prefix_cache_entry *prefix_cache;
+static unsigned int prefix_cache_sets;
+static unsigned int prefix_cache_clock;
+
+/* with "smbd:mangle cache shared = yes" misses are looked up in a tdb
+   that all smbd processes add to, so a name mangled by one client's
+   smbd can be resolved by another. Entries are keyed by share and
+   hash, the same hash in another share is most likely another name */
+static TDB_CONTEXT *tdb_mangle_cache;
+static BOOL tdb_mangle_cache_tried;
 
 /* these are the characters we use in the 8.3 hash. Must be 36 chars long */
 static const char *basechars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -153,51 +184,247 @@ static unsigned int mangle_hash(const char *key, unsigned int length)
  */
 static BOOL cache_init(void)
 {
+	int size;
+
 	if (prefix_cache) {
 		return True;
 	}
 
-	prefix_cache = SMB_CALLOC_ARRAY(char *,MANGLE_CACHE_SIZE);
+	/* round the number of sets down to a power of two, at least one */
+	size = lp_parm_int(-1, "smbd", "mangle cache size", MANGLE_CACHE_SIZE);
+	for (prefix_cache_sets = 1;
+	     prefix_cache_sets * 2 * MANGLE_CACHE_WAYS <= (unsigned int)MAX(size, 0);
+	     prefix_cache_sets *= 2) {
+		;
+	}
+
+	prefix_cache = SMB_CALLOC_ARRAY(struct prefix_cache_entry,
+					prefix_cache_sets * MANGLE_CACHE_WAYS);
 	if (!prefix_cache) {
 		return False;
 	}
 
-	prefix_cache_hashes = SMB_CALLOC_ARRAY(unsigned int, MANGLE_CACHE_SIZE);
-	if (!prefix_cache_hashes) {
-		return False;
+	return True;
+}
+
+/*
+  open the shared cache if it has been asked for. Failure just means
+  running with the per-process cache only.
+*/
+static void shared_cache_init(void)
+{
+	if (tdb_mangle_cache || tdb_mangle_cache_tried) {
+		return;
+	}
+	if (!lp_parm_bool(-1, "smbd", "mangle cache shared", False)) {
+		return;
+	}
+	if (!directory_exist(lp_lockdir(), NULL)) {
+		/* too early in startup, try again on first use */
+		return;
 	}
 
+	tdb_mangle_cache_tried = True;
+	tdb_mangle_cache = tdb_open_log(lock_path("mangle_cache.tdb"), 10007,
+					TDB_CLEAR_IF_FIRST|TDB_DEFAULT,
+					O_RDWR|O_CREAT, 0644);
+	if (!tdb_mangle_cache) {
+		DEBUG(1,("shared_cache_init: failed to open %s, using a "
+			 "per-process mangle cache only\n",
+			 lock_path("mangle_cache.tdb")));
+	}
+}
+
+/*
+  find the set a hash belongs to. Names in one directory often differ
+  only near the end, which FNV leaves mostly in the low bits, so mix
+  the hash before picking the set
+*/
+static struct prefix_cache_entry *cache_set(unsigned int hash)
+{
+	unsigned int i = ((hash * 0x9E3779B1U) >> 12) & (prefix_cache_sets - 1);
+
+	return &prefix_cache[i * MANGLE_CACHE_WAYS];
+}
+
+/*
+  store a prefix in the per-process cache, returning the entry used
+*/
+static struct prefix_cache_entry *local_cache_insert(const char *prefix, int length, unsigned int hash)
+{
+	struct prefix_cache_entry *set, *e;
+	int i;
+
+	set = cache_set(hash);
+
+	/* reuse the entry for this hash if there is one, else evict the
+	   least recently used */
+	e = set;
+	for (i = 0; i < MANGLE_CACHE_WAYS; i++) {
+		if (set[i].last_used && set[i].hash == hash) {
+			e = &set[i];
+			break;
+		}
+		if (set[i].last_used < e->last_used) {
+			e = &set[i];
+		}
+	}
+
+	SAFE_FREE(e->long_prefix);
+	if (length < MANGLE_CACHE_INLINE) {
+		memcpy(e->prefix, prefix, length);
+		e->prefix[length] = 0;
+	} else {
+		e->long_prefix = SMB_STRNDUP(prefix, length);
+		if (!e->long_prefix) {
+			e->last_used = 0;
+			return NULL;
+		}
+	}
+	e->hash = hash;
+	e->last_used = ++prefix_cache_clock;
+	return e;
+}
+
+static const char *entry_prefix(const struct prefix_cache_entry *e)
+{
+	return e->long_prefix ? e->long_prefix : e->prefix;
+}
+
+static TDB_DATA shared_cache_key(unsigned int hash, const struct share_params *p,
+				 fstring keystr)
+{
+	const char *share = p ? lp_servicename(p->service) : NULL;
+
+	fstr_sprintf(keystr, "MANGLE/%s/%08X", share ? share : "", hash);
+	return string_tdb_data(keystr);
+}
+
+/*
+  add a prefix to the shared cache. Emptying it when it is full is
+  rare enough that it does not matter that it locks the whole tdb
+*/
+static void shared_cache_store(const char *prefix, int length, unsigned int hash,
+			       const struct share_params *p)
+{
+	TDB_DATA key, data;
+	fstring keystr;
+	int32 num = 0;
+
+	key = shared_cache_key(hash, p, keystr);
+	data.dptr = CONST_DISCARD(char *, prefix);
+	data.dsize = length;
+
+	if (tdb_store(tdb_mangle_cache, key, data, TDB_INSERT) == -1) {
+		if (tdb_error(tdb_mangle_cache) == TDB_ERR_EXISTS) {
+			tdb_store(tdb_mangle_cache, key, data, TDB_REPLACE);
+		}
+		return;
+	}
+
+	if (tdb_change_int32_atomic(tdb_mangle_cache, MANGLE_SHARED_COUNT_KEY,
+				    &num, 1) == -1) {
+		return;
+	}
+	if (num + 1 > MANGLE_SHARED_CACHE_MAX) {
+		DEBUG(3,("shared_cache_store: %d entries, emptying the shared "
+			 "mangle cache\n", num + 1));
+		tdb_traverse(tdb_mangle_cache, tdb_traverse_delete_fn, NULL);
+		tdb_store(tdb_mangle_cache, key, data, TDB_REPLACE);
+		tdb_store_int32(tdb_mangle_cache, MANGLE_SHARED_COUNT_KEY, 1);
+	}
+}
+
+/*
+  check that the leading characters of a mangled name are the ones the
+  prefix would have given it
+*/
+static BOOL lead_chars_match(const char *name, const char *prefix, int length)
+{
+	unsigned int i;
+	char c;
+
+	for (i = 0; i < mangle_prefix; i++) {
+		c = (i < length && prefix[i]) ? prefix[i] : '_';
+		if (!FLAG_CHECK(c, FLAG_ASCII)) {
+			c = '_';
+		}
+		if (toupper_ascii(c) != toupper_ascii(name[i])) {
+			return False;
+		}
+	}
 	return True;
 }
 
 /*
   insert an entry into the prefix cache. The string might not be null
   terminated */
-static void cache_insert(const char *prefix, int length, unsigned int hash)
+static void cache_insert(const char *prefix, int length, unsigned int hash,
+			 const struct share_params *p)
 {
-	int i = hash % MANGLE_CACHE_SIZE;
+	struct prefix_cache_entry *set;
+	int i;
 
-	if (prefix_cache[i]) {
-		free(prefix_cache[i]);
+	/* listing a directory again maps the same names again, don't
+	   copy them over themselves or rewrite the shared cache */
+	set = cache_set(hash);
+	for (i = 0; i < MANGLE_CACHE_WAYS; i++) {
+		const char *cached = entry_prefix(&set[i]);
+		if (set[i].last_used && set[i].hash == hash &&
+		    strncmp(cached, prefix, length) == 0 && cached[length] == 0) {
+			set[i].last_used = ++prefix_cache_clock;
+			return;
+		}
 	}
 
-	prefix_cache[i] = SMB_STRNDUP(prefix, length);
-	prefix_cache_hashes[i] = hash;
+	local_cache_insert(prefix, length, hash);
+
+	shared_cache_init();
+	if (tdb_mangle_cache) {
+		shared_cache_store(prefix, length, hash, p);
+	}
 }
 
 /*
   lookup an entry in the prefix cache. Return NULL if not found.
 */
-static const char *cache_lookup(unsigned int hash)
+static const char *cache_lookup(const char *name, unsigned int hash,
+				const struct share_params *p)
 {
-	int i = hash % MANGLE_CACHE_SIZE;
+	struct prefix_cache_entry *set, *e;
+	TDB_DATA key, data;
+	fstring keystr;
+	int i;
 
-	if (!prefix_cache[i] || hash != prefix_cache_hashes[i]) {
-		return NULL;
+	set = cache_set(hash);
+	for (i = 0; i < MANGLE_CACHE_WAYS; i++) {
+		if (set[i].last_used && set[i].hash == hash) {
+			/* yep, it matched */
+			set[i].last_used = ++prefix_cache_clock;
+			DO_PROFILE_INC(mangle_cache_hits);
+			return entry_prefix(&set[i]);
+		}
+	}
+
+	shared_cache_init();
+	if (tdb_mangle_cache) {
+		key = shared_cache_key(hash, p, keystr);
+		data = tdb_fetch(tdb_mangle_cache, key);
+		if (data.dptr && !lead_chars_match(name, data.dptr, data.dsize)) {
+			SAFE_FREE(data.dptr);
+		}
+		if (data.dptr) {
+			e = local_cache_insert(data.dptr, data.dsize, hash);
+			SAFE_FREE(data.dptr);
+			if (e) {
+				DO_PROFILE_INC(mangle_cache_shared_hits);
+				return entry_prefix(e);
+			}
+		}
 	}
 
-	/* yep, it matched */
-	return prefix_cache[i];
+	DO_PROFILE_INC(mangle_cache_misses);
+	return NULL;
 }
 
 
@@ -362,7 +589,9 @@ static BOOL is_8_3(const char *name, BOOL check_case, BOOL allow_wildcards, cons
 */
 static void mangle_reset(void)
 {
-	/* noop */
+	/* the shared cache may now be wanted, or startup may have got
+	   far enough to create it */
+	shared_cache_init();
 }
 
 
@@ -392,7 +621,7 @@ static BOOL check_cache(char *name, size_t maxlen, const struct share_params *p)
 	}
 
 	/* now look in the prefix cache for that hash */
-	prefix = cache_lookup(hash);
+	prefix = cache_lookup(name, hash, p);
 	if (!prefix) {
 		M_DEBUG(10,("check_cache: %s -> %08X -> not found\n", name, hash));
 		return False;
@@ -610,7 +839,7 @@ static void name_map(fstring name, BOOL need83, BOOL cache83, int default_case,
 
 	if (cache83) {
 		/* put it in the cache */
-		cache_insert(name, prefix_len, hash);
+		cache_insert(name, prefix_len, hash, p);
 	}
 
 	M_DEBUG(10,("name_map: %s -> %08X -> %s (cache=%d)\n", 
@@ -192,6 +192,7 @@ static NTSTATUS create_conn_struct(connection_struct *conn, int snum, const char
 	}
 
 	conn->params->service = snum;
+	conn_set_share_cache(conn);
 
 	set_conn_connectpath(conn, connpath);
 
@@ -2948,6 +2948,8 @@ static int handle_nttrans(connection_struct *conn,
 		SSVAL(outbuf,smb_flg2,SVAL(outbuf,smb_flg2) | 0x40); /* IS_LONG_NAME */
 	}
 
+	PROFILE_NTTRANS_SUBCOMMAND(state->call);
+
 	/* Now we must call the relevant NT_TRANS function */
 	switch(state->call) {
 		case NT_TRANSACT_CREATE:
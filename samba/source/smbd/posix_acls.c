@@ -4508,6 +4508,7 @@ SEC_DESC* get_nt_acl_no_snum( TALLOC_CTX *ctx, const char *fname)
 	}
 
 	conn.params->service = -1;
+	conn_set_share_cache(&conn);
 	
 	pstrcpy( path, "/" );
 	set_conn_connectpath(&conn, path);
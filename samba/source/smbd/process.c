@@ -928,6 +928,7 @@ static int switch_message(int type,char *inbuf,char *outbuf,int size,int bufsize
 		/* In share mode security we must ignore the vuid. */
 		uint16 session_tag = (lp_security() == SEC_SHARE) ? UID_FIELD_INVALID : SVAL(inbuf,smb_uid);
 		connection_struct *conn = conn_find(SVAL(inbuf,smb_tid));
+		START_PROFILE_LATENCY(conn);
 
 		DEBUG(3,("switch message %s (pid %d) conn 0x%lx\n",smb_fn_name(type),(int)pid,(unsigned long)conn));
 
@@ -1015,6 +1016,8 @@ static int switch_message(int type,char *inbuf,char *outbuf,int size,int bufsize
 		if (conn && conn->params) {
 		    INC_BYTE_COUNT(SNUM(conn), outsize);
 		}
+
+		END_PROFILE_LATENCY(type, smb_messages[type].name);
 	}
 
 	smb_dump(smb_fn_name(type), 0, outbuf, outsize);
@@ -1037,6 +1040,7 @@ static int construct_reply(char *inbuf,char *outbuf,int size,int bufsize)
 	chain_size = 0;
 	file_chain_reset();
 	reset_chain_p();
+	reset_chained_writes();
 
 	if (msg_type != 0)
 		return(reply_special(inbuf,outbuf));  
@@ -1069,6 +1073,9 @@ static void process_smb(char *inbuf, char *outbuf)
 	int msg_type = CVAL(inbuf,0);
 	int32 len = smb_len(inbuf);
 	int nread = len + 4;
+#ifdef WITH_PROFILE
+	unsigned int param_lookups = lp_param_lookups();
+#endif
 
 	DO_PROFILE_INC(smb_count);
 
@@ -1096,6 +1103,8 @@ static void process_smb(char *inbuf, char *outbuf)
 		return; /* Keepalive packet. */
 
 	nread = construct_reply(inbuf,outbuf,nread,max_send);
+
+	DO_PROFILE_ADD(param_lookups, lp_param_lookups() - param_lookups);
       
 	if(nread > 0) {
 		if (CVAL(outbuf,0) == 0)
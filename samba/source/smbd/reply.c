@@ -2242,8 +2242,8 @@ void send_file_readbraw(connection_struct *conn, files_struct *fsp, SMB_OFF_T st
 	 * reply_readbraw has already checked the length.
 	 */
 
-	if ( (chain_size == 0) && (nread > 0) &&
-	    (fsp->wcp == NULL) && (fsp->is_sendfile_capable) ) {
+	if ( (chain_size == 0) && (nread > 0) && (fsp->is_sendfile_capable) &&
+	    (flush_write_cache_range(fsp, startpos, nread, READRAW_FLUSH) != -1) ) {
 		DATA_BLOB header;
 
 		_smb_setlen(outbuf,nread);
@@ -2567,6 +2567,53 @@ Returning short read of maximum allowed for compatibility with Windows 2000.\n",
 	return(outsize);
 }
 
+/* Granularity at which a signed read feeds data into the MAC. */
+#define SIGNED_READ_CHUNK (32*1024)
+
+#if defined(WITH_SENDFILE)
+/****************************************************************************
+ Put the MAC of a readX reply to be sent with sendfile into its header.
+ The file range is read in chunks, which also brings it into the page
+ cache for the sendfile that follows. Returns False if the range could
+ not be read in full, in which case the caller must do a normal read.
+****************************************************************************/
+
+static BOOL sign_sendfile_readX(files_struct *fsp, char *outbuf, size_t hdr_len,
+				SMB_OFF_T startpos, size_t smb_maxcnt)
+{
+	static char *chunk_buf;
+	size_t done = 0;
+
+	if (chunk_buf == NULL) {
+		chunk_buf = SMB_MALLOC(SIGNED_READ_CHUNK);
+		if (chunk_buf == NULL) {
+			return False;
+		}
+	}
+
+	if (!srv_sign_reply_begin(outbuf, hdr_len)) {
+		return False;
+	}
+
+	while (done < smb_maxcnt) {
+		size_t chunk = MIN(smb_maxcnt - done, SIGNED_READ_CHUNK);
+		ssize_t nread = read_file(fsp, chunk_buf, startpos+done, chunk);
+
+		if (nread != (ssize_t)chunk) {
+			DEBUG(3,("sign_sendfile_readX: short read on %s at %.0f\n",
+				fsp->fsp_name, (double)(startpos+done) ));
+			srv_sign_reply_cancel();
+			return False;
+		}
+		srv_sign_reply_data(chunk_buf, chunk);
+		done += chunk;
+	}
+
+	srv_sign_reply_finish(outbuf, False);
+	return True;
+}
+#endif
+
 /****************************************************************************
  Reply to a read and X - possibly using sendfile.
 ****************************************************************************/
@@ -2586,7 +2633,8 @@ int send_file_readX(connection_struct *conn, char *inbuf,char *outbuf,int length
 	 */
 
 	if ((chain_size == 0) && (CVAL(inbuf,smb_vwv0) == 0xFF) &&
-	    (fsp->is_sendfile_capable) && (fsp->wcp == NULL) ) {
+	    (fsp->is_sendfile_capable) &&
+	    (flush_write_cache_range(fsp, startpos, smb_maxcnt, READ_FLUSH) != -1) ) {
 		SMB_STRUCT_STAT sbuf;
 		DATA_BLOB header;
 
@@ -2619,9 +2667,19 @@ int send_file_readX(connection_struct *conn, char *inbuf,char *outbuf,int length
 		header.length = data - outbuf;
 		header.free = NULL;
 
+		if (srv_is_signing_active() &&
+		    !sign_sendfile_readX(fsp, outbuf, header.length, startpos, smb_maxcnt)) {
+			goto normal_read;
+		}
+
 		if ((nread = SMB_VFS_SENDFILE( smbd_server_fd(), fsp, fsp->fh->fd, &header, startpos, smb_maxcnt)) == -1) {
 			/* Returning ENOSYS means no data at all was sent. Do this as a normal read. */
 			if (errno == ENOSYS) {
+				/* The MAC in outbuf was never sent; give
+				   back its sequence number. */
+				if (srv_is_signing_active()) {
+					srv_sign_reply_rewind(outbuf);
+				}
 				goto normal_read;
 			}
 
@@ -2663,12 +2721,78 @@ int send_file_readX(connection_struct *conn, char *inbuf,char *outbuf,int length
 
 #endif
 
+	/*
+	 * With signing on, compute the MAC while the data is read
+	 * rather than walking the whole reply again in send_smb().
+	 * Only for a non-chained packet, and only if we get exactly
+	 * the amount of data the header was built for.
+	 */
+
+	if ((chain_size == 0) && (CVAL(inbuf,smb_vwv0) == 0xFF) &&
+	    srv_is_signing_active() && (smb_maxcnt > 0)) {
+		SMB_STRUCT_STAT sbuf;
+		size_t expected;
+		size_t done = 0;
+
+		if(SMB_VFS_FSTAT(fsp,fsp->fh->fd, &sbuf) == -1)
+			return(UNIXERROR(ERRDOS,ERRnoaccess));
+
+		if (startpos >= sbuf.st_size)
+			goto unsigned_read;
+
+		expected = smb_maxcnt;
+		if (expected > (sbuf.st_size - startpos))
+			expected = (sbuf.st_size - startpos);
+
+		outsize = set_message(outbuf,12,expected,False);
+		SSVAL(outbuf,smb_vwv2,0xFFFF); /* Remaining - must be -1. */
+		SSVAL(outbuf,smb_vwv5,expected);
+		SSVAL(outbuf,smb_vwv6,smb_offset(data,outbuf));
+		SSVAL(outbuf,smb_vwv7,((expected >> 16) & 1));
+		SSVAL(smb_buf(outbuf),-2,expected);
+		SCVAL(outbuf,smb_vwv0,0xFF);
+
+		if (!srv_sign_reply_begin(outbuf, data - outbuf))
+			goto unsigned_read;
+
+		while (done < expected) {
+			size_t chunk = MIN(expected - done, SIGNED_READ_CHUNK);
+
+			nread = read_file(fsp,data+done,startpos+done,chunk);
+			if (nread <= 0)
+				break;
+			srv_sign_reply_data(data+done, nread);
+			done += nread;
+		}
+
+		if (nread < 0) {
+			srv_sign_reply_cancel();
+			return(UNIXERROR(ERRDOS,ERRnoaccess));
+		}
+
+		if (done == expected) {
+			srv_sign_reply_finish(outbuf, True);
+			DEBUG( 3, ( "send_file_readX fnum=%d max=%d nread=%d (signed)\n",
+				fsp->fnum, (int)smb_maxcnt, (int)done ) );
+			return outsize;
+		}
+
+		/* Short read - the header was wrong, sign in send_smb(). */
+		srv_sign_reply_cancel();
+		nread = done;
+		goto set_reply;
+	}
+
+  unsigned_read:
+
 	nread = read_file(fsp,data,startpos,smb_maxcnt);
   
 	if (nread < 0) {
 		return(UNIXERROR(ERRDOS,ERRnoaccess));
 	}
 
+  set_reply:
+
 	outsize = set_message(outbuf,12,nread,False);
 	SSVAL(outbuf,smb_vwv2,0xFFFF); /* Remaining - must be -1. */
 	SSVAL(outbuf,smb_vwv5,nread);
@@ -3086,6 +3210,147 @@ int reply_write(connection_struct *conn, char *inbuf,char *outbuf,int size,int d
 	return(outsize);
 }
 
+/****************************************************************************
+ A client may chain several WriteX calls into one packet. The first of
+ them writes the data of those that carry on where it ends together
+ with its own, in one call, and leaves the results here for the others
+ to reply with.
+****************************************************************************/
+
+#define MAX_CHAINED_WRITES 16
+
+static struct chained_write {
+	SMB_OFF_T startpos;
+	size_t numtowrite;
+	ssize_t nwritten;
+} chained_writes[MAX_CHAINED_WRITES];
+static int num_chained_writes;
+static int next_chained_write;
+
+void reset_chained_writes(void)
+{
+	num_chained_writes = next_chained_write = 0;
+}
+
+/****************************************************************************
+ If a chained WriteX was already written by the first in the chain,
+ return its result.
+****************************************************************************/
+
+static BOOL take_chained_write(SMB_OFF_T startpos, size_t numtowrite, ssize_t *nwritten)
+{
+	struct chained_write *cw;
+
+	if (chain_size == 0 || next_chained_write == num_chained_writes) {
+		return False;
+	}
+
+	cw = &chained_writes[next_chained_write];
+	if (cw->startpos != startpos || cw->numtowrite != numtowrite) {
+		/* not the write we looked at, don't trust the rest */
+		reset_chained_writes();
+		return False;
+	}
+	next_chained_write++;
+	*nwritten = cw->nwritten;
+	return True;
+}
+
+/****************************************************************************
+ Write the data of a WriteX along with that of the WriteX calls chained
+ to it that continue at the offset it ends at. Only done for the first
+ command in a packet, where the chained commands can still be found at
+ the offsets the client gave.
+****************************************************************************/
+
+static ssize_t write_chained_writes(char *inbuf, files_struct *fsp, char *data,
+				    SMB_OFF_T startpos, size_t numtowrite)
+{
+	struct iovec iov[MAX_CHAINED_WRITES];
+	unsigned int smblen = smb_len(inbuf);
+	SMB_OFF_T endpos = startpos + numtowrite;
+	char *p = inbuf;
+	ssize_t nwritten;
+	size_t left;
+	int i, n = 1;
+
+	reset_chained_writes();
+
+	iov[0].iov_base = data;
+	iov[0].iov_len = numtowrite;
+
+	while (chain_size == 0 && n < MAX_CHAINED_WRITES &&
+	       CVAL(p,smb_vwv0) == SMBwriteX) {
+		unsigned int off = SVAL(p,smb_vwv1);
+		unsigned int smb_doff;
+		char *next = inbuf + 4 + off - smb_wct;
+		SMB_OFF_T pos;
+		size_t len;
+		int wct;
+
+		if (next <= p || off + 1 > smblen) {
+			break;
+		}
+		wct = CVAL(next,smb_wct);
+		if ((wct != 12 && wct != 14) || off + 1 + 2*wct > smblen ||
+		    file_fsp(next,smb_vwv2) != fsp) {
+			break;
+		}
+
+		pos = IVAL_TO_SMB_OFF_T(next,smb_vwv3);
+		if (wct == 14) {
+#ifdef LARGE_SMB_OFF_T
+			pos |= (((SMB_OFF_T)IVAL(next,smb_vwv12)) << 32);
+#else
+			if (IVAL(next,smb_vwv12) != 0) {
+				break;
+			}
+#endif
+		}
+		len = SVAL(next,smb_vwv10);
+		if (wct == 14 && smblen > 0xFFFF) {
+			len |= ((((size_t)SVAL(next,smb_vwv9)) & 1 )<<16);
+		}
+		smb_doff = SVAL(next,smb_vwv11);
+
+		if (pos != endpos || len == 0 ||
+		    smb_doff > smblen || smb_doff + len > smblen ||
+		    is_locked(fsp,(uint32)SVAL(inbuf,smb_pid),(SMB_BIG_UINT)len,(SMB_BIG_UINT)pos, WRITE_LOCK)) {
+			break;
+		}
+
+		iov[n].iov_base = smb_base(inbuf) + smb_doff;
+		iov[n].iov_len = len;
+		chained_writes[n - 1].startpos = pos;
+		chained_writes[n - 1].numtowrite = len;
+		endpos += len;
+		n++;
+		p = next;
+	}
+
+	if (n == 1) {
+		return write_file(fsp, data, startpos, numtowrite);
+	}
+
+	DEBUG(3,("writeX fnum=%d gathering %d chained writes, %.0f bytes\n",
+		 fsp->fnum, n, (double)(endpos - startpos)));
+
+	nwritten = write_filev(fsp, iov, n, startpos);
+	if (nwritten == -1) {
+		return -1;
+	}
+
+	/* share out what was written in order */
+	left = nwritten - MIN((size_t)nwritten, numtowrite);
+	for (i = 0; i < n - 1; i++) {
+		chained_writes[i].nwritten = MIN(left, chained_writes[i].numtowrite);
+		left -= chained_writes[i].nwritten;
+	}
+	num_chained_writes = n - 1;
+
+	return MIN((size_t)nwritten, numtowrite);
+}
+
 /****************************************************************************
  Reply to a write and X.
 ****************************************************************************/
@@ -3164,6 +3429,9 @@ int reply_write_and_X(connection_struct *conn, char *inbuf,char *outbuf,int leng
 
 	if(numtowrite == 0) {
 		nwritten = 0;
+	} else if (take_chained_write(startpos, numtowrite, &nwritten)) {
+		DEBUG(10,("writeX fnum=%d written with the first in the chain\n",
+			fsp->fnum));
 	} else {
 
 		if (schedule_aio_write_and_X(conn, inbuf, outbuf, length, bufsize,
@@ -3172,7 +3440,7 @@ int reply_write_and_X(connection_struct *conn, char *inbuf,char *outbuf,int leng
 			return -1;
 		}
 
-		nwritten = write_file(fsp,data,startpos,numtowrite);
+		nwritten = write_chained_writes(inbuf,fsp,data,startpos,numtowrite);
 	}
   
 	if(((nwritten == 0) && (numtowrite != 0))||(nwritten < 0)) {
@@ -132,7 +132,84 @@ static void gain_root(void)
 	}
 }
 
+/****************************************************************************
+ Remember the supplementary groups we last gave the kernel. Switching
+ between contexts with the same groups, for example between two shares
+ of one user, then does not have to set them again. setgroups() is by
+ far the most expensive part of a switch.
+****************************************************************************/
+
+static struct {
+	BOOL valid;
+	uid_t uid;
+	uint32 hash;
+	int ngroups;
+	gid_t *groups;
+} kernel_groups;
+
+static uint32 groups_hash(int ngroups, const gid_t *groups)
+{
+	const unsigned char *p = (const unsigned char *)groups;
+	size_t i, len = ngroups * sizeof(gid_t);
+	uint32 h = 2166136261U;		/* FNV-1a */
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static void set_unix_groups(uid_t uid, int ngroups, gid_t *groups)
+{
+	uint32 hash = groups_hash(ngroups, groups);
+
+	if (kernel_groups.valid && (kernel_groups.hash == hash) &&
+	    (kernel_groups.ngroups == ngroups) &&
+#if defined(HAVE_DARWIN_INITGROUPS)
+	    /* the dynamic group resolution is done for this uid */
+	    (kernel_groups.uid == uid) &&
+#endif
+	    ((ngroups == 0) ||
+	     (memcmp(kernel_groups.groups, groups,
+		     ngroups * sizeof(gid_t)) == 0))) {
+		DO_PROFILE_INC(setgroups_skipped);
+		return;
+	}
+
+	kernel_groups.valid = False;
+	SAFE_FREE(kernel_groups.groups);
+
+	DO_PROFILE_INC(setgroups_calls);
+	if (sys_setgroups(uid, ngroups, groups) != 0) {
+		return;
+	}
+
+	if (ngroups != 0) {
+		kernel_groups.groups = (gid_t *)memdup(groups,
+						       ngroups * sizeof(gid_t));
+		if (kernel_groups.groups == NULL) {
+			return;
+		}
+	}
+	kernel_groups.uid = uid;
+	kernel_groups.hash = hash;
+	kernel_groups.ngroups = ngroups;
+	kernel_groups.valid = True;
+}
+
+#endif /* !defined (HAVE_PTHREAD_SETUGID_NP) */
+
+/****************************************************************************
+ Somebody else changed the groups of the process, see set_unix_groups().
+****************************************************************************/
+
+void invalidate_sec_ctx_groups(void)
+{
+#if !defined (HAVE_PTHREAD_SETUGID_NP)
+	kernel_groups.valid = False;
 #endif /* !defined (HAVE_PTHREAD_SETUGID_NP) */
+}
 
 /****************************************************************************
  Get the list of current groups.
@@ -280,11 +357,13 @@ void set_sec_ctx(uid_t uid, gid_t gid, int ngroups, gid_t *groups, NT_USER_TOKEN
 	debug_nt_user_token(DBGC_CLASS, 5, token);
 	debug_unix_user_token(DBGC_CLASS, 5, uid, gid, ngroups, groups);
 
+	DO_PROFILE_INC(sec_ctx_switches);
+
 #if !defined(HAVE_PTHREAD_SETUGID_NP)
 	gain_root();
 
 	become_gid(gid);
-	sys_setgroups(uid, ngroups, groups);
+	set_unix_groups(uid, ngroups, groups);
 #endif /* !defined(HAVE_PTHREAD_SETUGID_NP) */
 
 	ctx_p->ut.ngroups = ngroups;
@@ -399,6 +478,8 @@ BOOL pop_sec_ctx(void)
 
 	sec_ctx_stack_ndx--;
 
+	DO_PROFILE_INC(sec_ctx_switches);
+
 #if !defined (HAVE_PTHREAD_SETUGID_NP)
 	gain_root();
 #endif /* !defined (HAVE_PTHREAD_SETUGID_NP) */
@@ -407,7 +488,7 @@ BOOL pop_sec_ctx(void)
 
 #if !defined (HAVE_PTHREAD_SETUGID_NP)
 	become_gid(prev_ctx_p->ut.gid);
-	sys_setgroups(prev_ctx_p->ut.uid,
+	set_unix_groups(prev_ctx_p->ut.uid,
 		prev_ctx_p->ut.ngroups, prev_ctx_p->ut.groups);
 
 	become_uid(prev_ctx_p->ut.uid);
@@ -366,6 +366,7 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 	int maxfd = 0;
 	int i;
 	struct timeval idle_timeout = {0, 0};
+	struct timeval reload_timeout;
 
 	if (server_mode == SERVER_MODE_INETD) {
 		return open_sockets_inetd();
@@ -432,6 +433,9 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 
 			while ((pid = sys_waitpid(-1, NULL, WNOHANG)) > 0) {
 				remove_child_pid(pid);
+#ifdef WITH_PROFILE
+				profile_slab_release(pid);
+#endif
 			}
 		}
 
@@ -443,8 +447,14 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 		 */
 		smbd_vproc_end();
 
+		/* The children go by the config snapshot we publish and
+		 * leave checking the config files to us, so wake up for
+		 * that even when no client comes along. */
+		reload_timeout.tv_sec = SMBD_RELOAD_CHECK;
+		reload_timeout.tv_usec = 0;
+
 		num = sys_select(maxfd+1,&lfds,NULL,NULL,
-			idle_timeout.tv_sec ? &idle_timeout : NULL);
+			idle_timeout.tv_sec ? &idle_timeout : &reload_timeout);
 
 		{
 		    int errsav = errno;
@@ -472,7 +482,8 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 		 * users, exit gracefully. We should be running under a process
 		 * controller that will restart us if necessry.
 		 */
-		if (num == 0 && count_all_current_connections() == 0) {
+		if (num == 0 && idle_timeout.tv_sec &&
+		    count_all_current_connections() == 0) {
 			exit_server_cleanly("idle timeout");
 		}
 
@@ -486,6 +497,9 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 			socklen_t in_addrlen = sizeof(addr);
 			pid_t child = 0;
 			int fd;
+#ifdef WITH_PROFILE
+			int slab;
+#endif
 
 			s = -1;
 			for(i = 0; i < num_sockets; i++) {
@@ -524,6 +538,11 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 			if (server_mode == SERVER_MODE_INTERACTIVE) {
 				return True;
 			}
+
+#ifdef WITH_PROFILE
+			/* give the child its own profile counters */
+			slab = profile_slab_alloc();
+#endif
 			
 			if (allowable_number_of_smbd_processes() &&
 			    smbd_server_fd() != -1 &&
@@ -542,6 +561,10 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 				   descriptors */
 				close_low_fds(False);
 				am_parent = 0;
+				lp_set_snapshot_publisher(False);
+#ifdef WITH_PROFILE
+				profile_slab_attach(slab);
+#endif
 				
 				set_socket_options(smbd_server_fd(),"SO_KEEPALIVE");
 				set_socket_options(smbd_server_fd(),user_socket_options);
@@ -582,6 +605,11 @@ static BOOL open_sockets_smbd(enum smb_server_mode server_mode, const char *smb_
 			if (child != 0) {
 				add_child_pid(child);
 			}
+#ifdef WITH_PROFILE
+			if (child > 0) {
+				profile_slab_owner(slab, child);
+			}
+#endif
 
 			/* Force parent to check log size after
 			 * spawning child.  Fix from
@@ -645,6 +673,7 @@ void reload_printers(void)
 BOOL reload_services(BOOL test)
 {
 	BOOL ret;
+	BOOL reloaded;
 	
 	if (lp_loaded()) {
 		pstring fname;
@@ -658,12 +687,19 @@ BOOL reload_services(BOOL test)
 
 	reopen_logs();
 
-	if (test && !lp_file_list_changed())
-		return(True);
+	if (test && lp_load_snapshot(conn_snum_used, &reloaded)) {
+		/* the parent has already checked the config files for us */
+		if (!reloaded)
+			return(True);
+		ret = True;
+	} else {
+		if (test && !lp_file_list_changed())
+			return(True);
 
-	lp_killunused(conn_snum_used);
+		lp_killunused(conn_snum_used);
 
-	ret = lp_load(dyn_CONFIGFILE, False, False, True, True);
+		ret = lp_load(dyn_CONFIGFILE, False, False, True, True);
+	}
 
 	reload_printers();
 
@@ -682,6 +718,7 @@ BOOL reload_services(BOOL test)
 
 	mangle_reset_cache();
 	reset_stat_cache();
+	conn_refresh_share_caches();
 
 	/* this forces service parameters to be flushed */
 	set_current_service(NULL,0,True);
@@ -948,6 +985,16 @@ extern void build_options(BOOL screen);
 		exit(1);
 	}
 
+	/*
+	 * A forking daemon parses smb.conf on behalf of its children
+	 * and publishes the result for them.
+	 */
+
+	if ((server_mode == SERVER_MODE_DAEMON ||
+	     server_mode == SERVER_MODE_FOREGROUND) && !is_a_socket(0)) {
+		lp_set_snapshot_publisher(True);
+	}
+
 	/*
 	 * Do this before reload_services.
 	 */
@@ -179,7 +179,7 @@ static struct ea_list *get_ea_list_from_file(TALLOC_CTX *mem_ctx, connection_str
 
 	*pea_total_len = 0;
 
-	if (!lp_ea_support(SNUM(conn))) {
+	if (!conn->share_cache.ea_support) {
 		return NULL;
 	}
 
@@ -256,7 +256,7 @@ static unsigned int fill_ea_buffer(TALLOC_CTX *mem_ctx, char *pdata, unsigned in
 
 	SMB_ASSERT(total_data_size >= 4);
 
-	if (!lp_ea_support(SNUM(conn))) {
+	if (!conn->share_cache.ea_support) {
 		SIVAL(pdata,4,0);
 		return 4;
 	}
@@ -293,17 +293,27 @@ static unsigned int fill_ea_buffer(TALLOC_CTX *mem_ctx, char *pdata, unsigned in
 	return ret_data_size;
 }
 
-static unsigned int estimate_ea_size(connection_struct *conn, files_struct *fsp, const char *fname)
+/****************************************************************************
+ Return the total size of a file's EA list. psbuf, if not NULL, must be a
+ current stat of the file and lets the answer come from the dosattr cache.
+****************************************************************************/
+
+static unsigned int estimate_ea_size(connection_struct *conn, files_struct *fsp, const char *fname,
+				     const SMB_STRUCT_STAT *psbuf)
 {
 	size_t total_ea_len = 0;
 	TALLOC_CTX *mem_ctx = NULL;
 
-	if (!lp_ea_support(SNUM(conn))) {
+	if (!conn->share_cache.ea_support) {
 		return 0;
 	}
+	if (dosattr_cache_get_ea_size(psbuf, &total_ea_len)) {
+		return total_ea_len;
+	}
 	mem_ctx = talloc_init("estimate_ea_size");
 	(void)get_ea_list_from_file(mem_ctx, conn, fsp, fname, &total_ea_len);
 	talloc_destroy(mem_ctx);
+	dosattr_cache_set_ea_size(psbuf, total_ea_len);
 	return total_ea_len;
 }
 
@@ -334,10 +344,19 @@ static void canonicalize_ea_name(connection_struct *conn, files_struct *fsp, con
 
 NTSTATUS set_ea(connection_struct *conn, files_struct *fsp, const char *fname, struct ea_list *ea_list)
 {
-	if (!lp_ea_support(SNUM(conn))) {
+	if (!conn->share_cache.ea_support) {
 		return NT_STATUS_EAS_NOT_SUPPORTED;
 	}
 
+	if (fsp) {
+		dosattr_cache_delete(fsp->dev, fsp->inode);
+	} else {
+		SMB_STRUCT_STAT sbuf;
+		if (SMB_VFS_STAT(conn, fname, &sbuf) == 0) {
+			dosattr_cache_delete(sbuf.st_dev, sbuf.st_ino);
+		}
+	}
+
 	for (;ea_list; ea_list = ea_list->next) {
 		int ret;
 		fstring unix_ea_name;
@@ -836,7 +855,7 @@ static int call_trans2open(connection_struct *conn, char *inbuf, char *outbuf, i
 	}
 
 	/* Any data in this call is an EA list. */
-	if (total_data && (total_data != 4) && !lp_ea_support(SNUM(conn))) {
+	if (total_data && (total_data != 4) && !conn->share_cache.ea_support) {
 		return ERROR_NT(NT_STATUS_EAS_NOT_SUPPORTED);
 	}
 
@@ -945,7 +964,7 @@ static int call_trans2open(connection_struct *conn, char *inbuf, char *outbuf, i
 	SIVAL(params,20,inode);
 	SSVAL(params,24,0); /* Padding. */
 	if (flags & 8) {
-		uint32 ea_size = estimate_ea_size(conn, fsp, fname);
+		uint32 ea_size = estimate_ea_size(conn, fsp, fname, NULL);
 		SIVAL(params, 26, ea_size);
 	} else {
 		SIVAL(params, 26, 0);
@@ -1168,7 +1187,9 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 		pstrcpy(fname,dname);      
 
 		if(!(got_match = *got_exact_match = exact_match(conn, fname, mask)))
-			got_match = mask_match(fname, mask, conn->case_sensitive);
+			got_match = dptr_mask_match(conn->dirptr, fname, mask,
+						    Protocol <= PROTOCOL_LANMAN2,
+						    conn->case_sensitive);
 
 		if(!got_match && check_mangled_names &&
 		   !mangle_is_8_3(fname, False, conn->params)) {
@@ -1184,7 +1205,9 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			pstrcpy( newname, fname);
 			mangle_map( newname, True, False, conn->params);
 			if(!(got_match = *got_exact_match = exact_match(conn, newname, mask)))
-				got_match = mask_match(newname, mask, conn->case_sensitive);
+				got_match = dptr_mask_match(conn->dirptr, newname, mask,
+							    Protocol <= PROTOCOL_LANMAN2,
+							    conn->case_sensitive);
 		}
 
 		if(got_match) {
@@ -1316,7 +1339,7 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			SIVAL(p,16,(uint32)allocation_size);
 			SSVAL(p,20,mode);
 			{
-				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal);
+				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal, &sbuf);
 				SIVAL(p,22,ea_size); /* Extended attributes */
 			}
 			p += 27;
@@ -1413,7 +1436,7 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			SIVAL(p,0,nt_extmode); p += 4;
 			q = p; p += 4; /* q is placeholder for name length. */
 			{
-				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal);
+				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal, &sbuf);
 				SIVAL(p,0,ea_size); /* Extended attributes */
 				p += 4;
 			}
@@ -1483,7 +1506,7 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			SIVAL(p,0,nt_extmode); p += 4;
 			q = p; p += 4; /* q is placeholder for name length. */
 			{
-				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal);
+				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal, &sbuf);
 				SIVAL(p,0,ea_size); /* Extended attributes */
 				p +=4;
 			}
@@ -1530,7 +1553,7 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			SIVAL(p,0,nt_extmode); p += 4;
 			q = p; p += 4; /* q is placeholder for name length. */
 			{
-				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal);
+				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal, &sbuf);
 				SIVAL(p,0,ea_size); /* Extended attributes */
 				p +=4;
 			}
@@ -1562,7 +1585,7 @@ static BOOL get_lanman2_dir_entry(connection_struct *conn,
 			SIVAL(p,0,nt_extmode); p += 4;
 			q = p; p += 4; /* q is placeholder for name length */
 			{
-				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal);
+				unsigned int ea_size = estimate_ea_size(conn, NULL, pathreal, &sbuf);
 				SIVAL(p,0,ea_size); /* Extended attributes */
 				p +=4;
 			}
@@ -1797,7 +1820,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 			return ERROR_NT(NT_STATUS_INVALID_PARAMETER);
 		}
 
-		if (!lp_ea_support(SNUM(conn))) {
+		if (!conn->share_cache.ea_support) {
 			return ERROR_DOS(ERRDOS,ERReasnotsupported);
 		}
                                                                                                                                                         
@@ -2072,7 +2095,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 			return ERROR_NT(NT_STATUS_INVALID_PARAMETER);
 		}
                                                                                                                                                      
-		if (!lp_ea_support(SNUM(conn))) {
+		if (!conn->share_cache.ea_support) {
 			return ERROR_DOS(ERRDOS,ERReasnotsupported);
 		}
                                                                                                                                                      
@@ -3524,7 +3547,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 				return ERROR_NT(NT_STATUS_INVALID_PARAMETER);
 			}
 
-			if (!lp_ea_support(SNUM(conn))) {
+			if (!conn->share_cache.ea_support) {
 				return ERROR_DOS(ERRDOS,ERReasnotsupported);
 			}
 
@@ -3638,7 +3661,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 
 		case SMB_INFO_QUERY_EA_SIZE:
 		{
-			unsigned int ea_size = estimate_ea_size(conn, fsp, fname);
+			unsigned int ea_size = estimate_ea_size(conn, fsp, fname, &sbuf);
 			DEBUG(10,("call_trans2qfilepathinfo: SMB_INFO_QUERY_EA_SIZE\n"));
 			data_size = 26;
 			srv_put_dos_date2(pdata,0,create_time);
@@ -3749,7 +3772,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 		case SMB_FILE_EA_INFORMATION:
 		case SMB_QUERY_FILE_EA_INFO:
 		{
-			unsigned int ea_size = estimate_ea_size(conn, fsp, fname);
+			unsigned int ea_size = estimate_ea_size(conn, fsp, fname, &sbuf);
 			DEBUG(10,("call_trans2qfilepathinfo: SMB_FILE_EA_INFORMATION\n"));
 			data_size = 4;
 			SIVAL(pdata,0,ea_size);
@@ -3803,7 +3826,7 @@ total_data=%u (should be %u)\n", (unsigned int)total_data, (unsigned int)IVAL(pd
 		case SMB_QUERY_FILE_ALL_INFO:
 		case SMB_FILE_ALL_INFORMATION:
 		{
-			unsigned int ea_size = estimate_ea_size(conn, fsp, fname);
+			unsigned int ea_size = estimate_ea_size(conn, fsp, fname, &sbuf);
 			DEBUG(10,("call_trans2qfilepathinfo: SMB_FILE_ALL_INFORMATION\n"));
 			put_long_date_timespec(pdata,create_time_ts);
 			put_long_date_timespec(pdata+8,atime_ts);
@@ -6302,7 +6325,7 @@ static int call_trans2mkdir(connection_struct *conn, char *inbuf, char *outbuf,
 	}
 
 	/* Any data in this call is an EA list. */
-	if (total_data && (total_data != 4) && !lp_ea_support(SNUM(conn))) {
+	if (total_data && (total_data != 4) && !conn->share_cache.ea_support) {
 		return ERROR_NT(NT_STATUS_EAS_NOT_SUPPORTED);
 	}
 
@@ -6573,6 +6596,8 @@ int handle_trans2(connection_struct *conn,
 		SSVAL(outbuf,smb_flg2,SVAL(outbuf,smb_flg2) | 0x40); /* IS_LONG_NAME */
 	}
 
+	PROFILE_TRANS2_SUBCOMMAND(state->call);
+
 	/* Now we must call the relevant TRANS2 function */
 	switch(state->call)  {
 	case TRANSACT2_OPEN:
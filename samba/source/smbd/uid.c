@@ -65,6 +65,7 @@ BOOL change_to_guest(void)
 	/* MWW: From AIX FAQ patch to WU-ftpd: call initgroups before 
 	   setting IDs */
 	initgroups(pass->pw_name, pass->pw_gid);
+	invalidate_sec_ctx_groups();
 #endif
 	
 	set_sec_ctx(pass->pw_uid, pass->pw_gid, 0, NULL, NULL);
@@ -84,18 +85,17 @@ BOOL change_to_guest(void)
 
 static BOOL check_user_ok(connection_struct *conn, user_struct *vuser,int snum)
 {
-	unsigned int i;
-	struct vuid_cache_entry *ent = NULL;
+	struct vuid_cache_entry *ent;
 	BOOL readonly_share;
 	NT_USER_TOKEN *token;
 
-	for (i=0;i<conn->vuid_cache.entries && i< VUID_CACHE_SIZE;i++) {
-		if (conn->vuid_cache.array[i].vuid == vuser->vuid) {
-			ent = &conn->vuid_cache.array[i];
-			conn->read_only = ent->read_only;
-			conn->admin_user = ent->admin_user;
-			return(True);
-		}
+	/* vuids never are 0, so an unused slot does not match */
+
+	ent = &conn->vuid_cache.array[vuser->vuid % VUID_CACHE_SIZE];
+	if (ent->vuid == vuser->vuid) {
+		conn->read_only = ent->read_only;
+		conn->admin_user = ent->admin_user;
+		return(True);
 	}
 
 	if (!user_ok_token(vuser->user.unix_name, vuser->nt_user_token, snum))
@@ -124,11 +124,6 @@ static BOOL check_user_ok(connection_struct *conn, user_struct *vuser,int snum)
 		return False;
 	}
 
-	i = conn->vuid_cache.entries % VUID_CACHE_SIZE;
-	if (conn->vuid_cache.entries < VUID_CACHE_SIZE)
-		conn->vuid_cache.entries++;
-
-	ent = &conn->vuid_cache.array[i];
 	ent->vuid = vuser->vuid;
 	ent->read_only = readonly_share;
 
@@ -450,6 +450,42 @@ ssize_t vfs_pwrite_data(files_struct *fsp,const char *buffer,
 	}
 	return (ssize_t)total;
 }
+
+/****************************************************************************
+ Write several buffers to a fd on the vfs at a given offset, with one
+ call when the vfs can.
+****************************************************************************/
+
+ssize_t vfs_pwritev_data(files_struct *fsp, const struct iovec *iov,
+			 int iovcnt, SMB_OFF_T offset)
+{
+	size_t total, skip;
+	ssize_t ret;
+	int i;
+
+	ret = SMB_VFS_PWRITEV(fsp, fsp->fh->fd, iov, iovcnt, offset);
+	if (ret == -1)
+		return -1;
+
+	/* Finish a short write a buffer at a time. */
+	total = skip = ret;
+	for (i = 0; i < iovcnt; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip -= iov[i].iov_len;
+			continue;
+		}
+		ret = vfs_pwrite_data(fsp, (const char *)iov[i].iov_base + skip,
+				      iov[i].iov_len - skip, offset + total);
+		if (ret == -1)
+			return -1;
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len - skip)
+			break;
+		skip = 0;
+	}
+	return (ssize_t)total;
+}
+
 /****************************************************************************
  An allocate file space call using the vfs interface.
  Allocates space for a file from a filedescriptor.
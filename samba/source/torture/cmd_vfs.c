@@ -422,6 +422,96 @@ static NTSTATUS cmd_write(struct vfs_state *vfs, TALLOC_CTX *mem_ctx, int argc,
 }
 
 
+/* the data buffer is split into one iovec per <size> argument */
+#define VFSTEST_MAX_IOV 16
+
+static NTSTATUS cmd_preadv(struct vfs_state *vfs, TALLOC_CTX *mem_ctx, int argc, const char **argv)
+{
+	struct iovec iov[VFSTEST_MAX_IOV];
+	int fd, i, iovcnt;
+	size_t size = 0;
+	ssize_t rsize;
+	SMB_OFF_T offset;
+
+	if (argc < 4 || argc - 3 > VFSTEST_MAX_IOV) {
+		printf("Usage: preadv <fd> <offset> <size> [<size> ...]\n");
+		return NT_STATUS_OK;
+	}
+
+	fd = atoi(argv[1]);
+	offset = atoi(argv[2]);
+	iovcnt = argc - 3;
+	for (i = 0; i < iovcnt; i++) {
+		size += atoi(argv[i + 3]);
+	}
+
+	vfs->data = TALLOC_ARRAY(mem_ctx, char, size);
+	if (vfs->data == NULL) {
+		printf("preadv: error=-1 (not enough memory)");
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+	vfs->data_size = size;
+
+	for (i = 0, size = 0; i < iovcnt; i++) {
+		iov[i].iov_base = (char *)vfs->data + size;
+		iov[i].iov_len = atoi(argv[i + 3]);
+		size += iov[i].iov_len;
+	}
+
+	rsize = SMB_VFS_PREADV(vfs->files[fd], fd, iov, iovcnt, offset);
+	if (rsize == -1) {
+		printf("preadv: error=%d (%s)\n", errno, strerror(errno));
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+
+	printf("preadv: ok (%ld bytes)\n", (long)rsize);
+	return NT_STATUS_OK;
+}
+
+
+static NTSTATUS cmd_pwritev(struct vfs_state *vfs, TALLOC_CTX *mem_ctx, int argc, const char **argv)
+{
+	struct iovec iov[VFSTEST_MAX_IOV];
+	int fd, i, iovcnt;
+	size_t size = 0;
+	ssize_t wsize;
+	SMB_OFF_T offset;
+
+	if (argc < 4 || argc - 3 > VFSTEST_MAX_IOV) {
+		printf("Usage: pwritev <fd> <offset> <size> [<size> ...]\n");
+		return NT_STATUS_OK;
+	}
+
+	fd = atoi(argv[1]);
+	offset = atoi(argv[2]);
+	iovcnt = argc - 3;
+	if (vfs->data == NULL) {
+		printf("pwritev: error=-1 (buffer empty, please populate it before writing)");
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		iov[i].iov_base = (char *)vfs->data + size;
+		iov[i].iov_len = atoi(argv[i + 3]);
+		size += iov[i].iov_len;
+	}
+
+	if (vfs->data_size < size) {
+		printf("pwritev: error=-1 (buffer too small, please put some more data in)");
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+
+	wsize = SMB_VFS_PWRITEV(vfs->files[fd], fd, iov, iovcnt, offset);
+	if (wsize == -1) {
+		printf("pwritev: error=%d (%s)\n", errno, strerror(errno));
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+
+	printf("pwritev: ok (%ld bytes)\n", (long)wsize);
+	return NT_STATUS_OK;
+}
+
+
 static NTSTATUS cmd_lseek(struct vfs_state *vfs, TALLOC_CTX *mem_ctx, int argc, const char **argv)
 {
 	int fd, offset, whence;
@@ -1035,6 +1125,8 @@ struct cmd_set vfs_commands[] = {
 	{ "close",   cmd_close,   "VFS close()",    "close <fd>" },
 	{ "read",   cmd_read,   "VFS read()",    "read <fd> <size>" },
 	{ "write",   cmd_write,   "VFS write()",    "write <fd> <size>" },
+	{ "preadv",   cmd_preadv,   "VFS preadv()",    "preadv <fd> <offset> <size> [<size> ...]" },
+	{ "pwritev",   cmd_pwritev,   "VFS pwritev()",    "pwritev <fd> <offset> <size> [<size> ...]" },
 	{ "lseek",   cmd_lseek,   "VFS lseek()",    "lseek <fd> <offset> <whence>" },
 	{ "rename",   cmd_rename,   "VFS rename()",    "rename <old> <new>" },
 	{ "fsync",   cmd_fsync,   "VFS fsync()",    "fsync <fd>" },
@@ -472,11 +472,55 @@ static void nss_test_errors(void)
 	}
 }
 
+/* see how many getpwuid() calls for one user we manage per second */
+static void nss_bench_getpwuid(int secs)
+{
+	struct passwd *pwd;
+	struct timeval start;
+	unsigned long count = 0;
+	double elapsed;
+	uid_t uid;
+	int i;
+
+	nss_setpwent();
+	pwd = nss_getpwent();
+	nss_endpwent();
+	if (!pwd) {
+		total_errors++;
+		printf("ERROR: no user to look up\n");
+		return;
+	}
+	uid = pwd->pw_uid;
+
+	GetTimeOfDay(&start);
+	do {
+		for (i=0; i<1000; i++) {
+			if (!nss_getpwuid(uid)) {
+				total_errors++;
+				printf("ERROR: can't getpwuid\n");
+				return;
+			}
+		}
+		count += 1000;
+		elapsed = timeval_elapsed(&start);
+	} while (elapsed < secs);
+
+	printf("getpwuid: %lu calls in %.2f seconds, %.0f calls/sec\n",
+	       count, elapsed, count / elapsed);
+}
+
  int main(int argc, char *argv[])
 {	
 	if (argc > 1) so_path = argv[1];
 	if (argc > 2) nss_name = argv[2];
 
+	if (argc > 3) {
+		/* nsstest <library> <name> <seconds> is a benchmark */
+		nss_bench_getpwuid(atoi(argv[3]));
+		printf("total_errors=%d\n", total_errors);
+		return total_errors;
+	}
+
 	nss_test_users();
 	nss_test_groups();
 	nss_test_errors();
@@ -221,6 +221,71 @@ static BOOL samu_correct(struct samu *s1, struct samu *s2)
 	return ret;	
 }
 
+/* Time turning a token of num group SIDs into gids, one SID at a time
+   as smbd used to, and with sids_to_gids() on a cold and a warm cache.
+   The SIDs are the ones winbindd has mapped the idmap gid range to. */
+
+static BOOL token_bench(TALLOC_CTX *ctx, int num)
+{
+	DOM_SID *sids;
+	gid_t low, high, gid, *gids = NULL;
+	size_t i, num_sids = 0, num_gids = 0, found = 0;
+	struct timeval start;
+	double single, batched, cached;
+
+	if (!lp_idmap_gid(&low, &high)) {
+		fprintf(stderr, "No idmap gid range configured\n");
+		return False;
+	}
+
+	if ((num <= 0) || !(sids = TALLOC_ARRAY(ctx, DOM_SID, num))) {
+		return False;
+	}
+
+	for (gid = low; (gid <= high) && (num_sids < num); gid++) {
+		if (winbind_gid_to_sid(&sids[num_sids], gid)) {
+			num_sids++;
+		} else if (gid - low >= 4 * num) {
+			break;
+		}
+	}
+	if (num_sids == 0) {
+		fprintf(stderr, "winbindd has no gids mapped\n");
+		return False;
+	}
+
+	GetTimeOfDay(&start);
+	for (i = 0; i < num_sids; i++) {
+		if (winbind_sid_to_gid(&gid, &sids[i])) {
+			found++;
+		}
+	}
+	single = timeval_elapsed(&start);
+
+	GetTimeOfDay(&start);
+	if (!sids_to_gids(ctx, sids, num_sids, &gids, &num_gids)) {
+		return False;
+	}
+	batched = timeval_elapsed(&start);
+
+	num_gids = 0;
+	GetTimeOfDay(&start);
+	if (!sids_to_gids(ctx, sids, num_sids, &gids, &num_gids)) {
+		return False;
+	}
+	cached = timeval_elapsed(&start);
+
+	printf("%u group SIDs: one at a time %.6fs, batched %.6fs, "
+	       "cached %.6fs\n", (unsigned int)num_sids, single, batched,
+	       cached);
+
+	if (num_gids != found) {
+		printf("Batched lookup found %u gids, one at a time %u\n",
+		       (unsigned int)num_gids, (unsigned int)found);
+		return False;
+	}
+	return True;
+}
 
 int main(int argc, char **argv)
 {
@@ -238,9 +303,11 @@ int main(int argc, char **argv)
 	poptContext pc;
 	static const char *backend = NULL;
 	static const char *unix_user = "nobody";
+	static int token_groups = 0;
 	struct poptOption long_options[] = {
 		{"username", 'u', POPT_ARG_STRING, &unix_user, 0, "Unix user to use for testing", "USERNAME" },
 		{"backend", 'b', POPT_ARG_STRING, &backend, 0, "Backend to use if not default", "BACKEND[:SETTINGS]" },
+		{"token-groups", 't', POPT_ARG_INT, &token_groups, 0, "Only time mapping a token with this many groups", "NUM" },
 		POPT_AUTOHELP
 		POPT_COMMON_SAMBA
 		POPT_TABLEEND
@@ -261,6 +328,13 @@ int main(int argc, char **argv)
 	lp_load(dyn_CONFIGFILE, False, False, True, True);
 	setup_logging("pdbtest", True);
 
+	if (token_groups != 0) {
+		ctx = talloc_init("PDBTEST");
+		error = !token_bench(ctx, token_groups);
+		TALLOC_FREE(ctx);
+		return error ? 1 : 0;
+	}
+
 	if (backend == NULL) {
 		backend = lp_passdb_backend();
 	}
@@ -6,27 +6,93 @@
 
 #include "includes.h"
 
+/* report a rate on stderr, so stdout stays just the comparison result */
+static void report(const char *name, int iters, struct timeval *start)
+{
+	struct timeval end;
+	double t;
+
+	GetTimeOfDay(&end);
+	t = (end.tv_sec - start->tv_sec) + 1.0e-6 * (end.tv_usec - start->tv_usec);
+	fprintf(stderr, "%-16s %12.0f ops/sec\n", name, t > 0 ? iters / t : 0.0);
+	GetTimeOfDay(start);
+}
+
 int main(int argc, char *argv[])
 {
 	int i, ret;
 	int iters = 1;
-	
+	smb_ucs2_t *w1 = NULL, *w2 = NULL, *tmp = NULL;
+	size_t len;
+	struct timeval start;
+
 	/* Needed to initialize character set */
+	load_case_tables();
 	lp_load("/dev/null", True, False, False, True);
 
 	if (argc < 3) {
 		fprintf(stderr, "usage: %s STRING1 STRING2 [ITERS]\n"
-			"Compares two strings, prints the results of StrCaseCmp\n",
+			"Compares two strings, prints the results of StrCaseCmp\n"
+			"With ITERS, also times the case insensitive string kernels\n",
 			argv[0]);
 		return 2;
 	}
 	if (argc >= 4)
 		iters = atoi(argv[3]);
 
+	GetTimeOfDay(&start);
 	for (i = 0; i < iters; i++)
 		ret = StrCaseCmp(argv[1], argv[2]);
 
 	printf("%d\n", ret);
-	
+
+	if (iters <= 1)
+		return 0;
+
+	report("StrCaseCmp", iters, &start);
+
+	for (i = 0; i < iters; i++)
+		ret = strequal(argv[1], argv[2]);
+	report("strequal", iters, &start);
+
+	for (i = 0; i < iters; i++)
+		ret = str_hash_upper(argv[1]);
+	report("str_hash_upper", iters, &start);
+
+	if (push_ucs2_allocate(&w1, argv[1]) == (size_t)-1 ||
+	    push_ucs2_allocate(&w2, argv[2]) == (size_t)-1) {
+		fprintf(stderr, "could not convert arguments to UCS2\n");
+		return 1;
+	}
+	len = (strlen_w(w1) + 1) * sizeof(smb_ucs2_t);
+	tmp = (smb_ucs2_t *)SMB_MALLOC(len);
+	if (tmp == NULL) {
+		return 1;
+	}
+
+	GetTimeOfDay(&start);
+	for (i = 0; i < iters; i++)
+		ret = strcasecmp_w(w1, w2);
+	report("strcasecmp_w", iters, &start);
+
+	for (i = 0; i < iters; i++)
+		ret = strequal_w(w1, w2);
+	report("strequal_w", iters, &start);
+
+	for (i = 0; i < iters; i++)
+		ret = strhash_upper_w(w1, 0);
+	report("strhash_upper_w", iters, &start);
+
+	/* includes copying the string back each time */
+	for (i = 0; i < iters; i++) {
+		memcpy(tmp, w1, len);
+		ret = strupper_w(tmp);
+	}
+	report("strupper_w", iters, &start);
+
+	SAFE_FREE(w1);
+	SAFE_FREE(w2);
+	SAFE_FREE(tmp);
+
 	return 0;
 }
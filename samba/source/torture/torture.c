@@ -19,6 +19,7 @@
 */
 
 #include "includes.h"
+#include "modules/prefetch.h"
 
 extern char *optarg;
 extern int optind;
@@ -41,6 +42,136 @@ static BOOL use_multishare_conn = False;
 
 BOOL torture_showall = False;
 
+/*
+ * Send an SMBwriteclose of no data. The server writes nothing and,
+ * like W2K, leaves the file open.
+ */
+
+static BOOL zero_writeclose(struct cli_state *cli, int fnum, off_t offset)
+{
+	char *p;
+
+	memset(cli->outbuf,'\0',smb_size);
+	memset(cli->inbuf,'\0',smb_size);
+
+	set_message(cli->outbuf,6,0,True);
+
+	SCVAL(cli->outbuf,smb_com,SMBwriteclose);
+	SSVAL(cli->outbuf,smb_tid,cli->cnum);
+	cli_setup_packet(cli);
+
+	SSVAL(cli->outbuf,smb_vwv0,fnum);
+	SSVAL(cli->outbuf,smb_vwv1,0);
+	SIVAL(cli->outbuf,smb_vwv2,offset);
+	SIVAL(cli->outbuf,smb_vwv4,0);
+
+	p = smb_buf(cli->outbuf);
+	*p++ = 0;
+	cli_setup_bcc(cli, p);
+
+	if (!cli_send_smb(cli) || !cli_receive_smb(cli)) {
+		return False;
+	}
+	return !cli_is_error(cli) && SVAL(cli->inbuf,smb_vwv0) == 0;
+}
+
+/*
+ * Zero length writes to a file the server is caching writes for
+ * must leave its write cache alone. Run it with "write cache size"
+ * set on the share and a small "smbd:write cache budget".
+ */
+
+static BOOL run_zerowrite(int dummy)
+{
+	static struct cli_state *cli1;
+	const char *fname = "\\zerowrite.dat";
+	char buf[4096], rbuf[4096];
+	int fnum1, fnum2, i;
+	BOOL correct = True;
+
+	if (!torture_open_connection(&cli1, 0)) {
+		return False;
+	}
+
+	for (i = 0; i < (int)sizeof(buf); i++) {
+		buf[i] = i;
+	}
+
+	cli_unlink(cli1, fname);
+
+	cli1->use_oplocks = True;
+	fnum1 = cli_open(cli1, fname, O_RDWR | O_CREAT | O_EXCL, DENY_NONE);
+	cli1->use_oplocks = use_oplocks;
+	if (fnum1 == -1) {
+		printf("open of %s failed (%s)\n", fname, cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+
+	/* the write sets up the cache, the read empties it again */
+	if (cli_write(cli1, fnum1, 0, buf, 0, 1) != 1 ||
+	    cli_read(cli1, fnum1, rbuf, 0, 1) != 1) {
+		printf("write and read back failed (%s)\n", cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (!zero_writeclose(cli1, fnum1, 10)) {
+			printf("zero length write %d failed (%s)\n", i,
+			       cli_errstr(cli1));
+			correct = False;
+			goto fail;
+		}
+	}
+
+	for (i = 0; i < 64; i++) {
+		if (cli_write(cli1, fnum1, 0, buf, i * sizeof(buf),
+			      sizeof(buf)) != sizeof(buf)) {
+			printf("write %d failed (%s)\n", i, cli_errstr(cli1));
+			correct = False;
+			goto fail;
+		}
+	}
+
+	if (!cli_close(cli1, fnum1)) {
+		printf("close failed (%s)\n", cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+
+	/* another cache must not trip over what is left of the first */
+	cli1->use_oplocks = True;
+	fnum2 = cli_open(cli1, fname, O_RDWR, DENY_NONE);
+	cli1->use_oplocks = use_oplocks;
+	if (fnum2 == -1) {
+		printf("reopen of %s failed (%s)\n", fname, cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+	for (i = 0; i < 64; i++) {
+		if (cli_write(cli1, fnum2, 0, buf, i * sizeof(buf),
+			      sizeof(buf)) != sizeof(buf) ||
+		    cli_read(cli1, fnum2, rbuf, i * sizeof(buf),
+			     sizeof(rbuf)) != sizeof(rbuf) ||
+		    memcmp(buf, rbuf, sizeof(buf)) != 0) {
+			printf("file contents differ from what was written (%s)\n",
+			       cli_errstr(cli1));
+			correct = False;
+			break;
+		}
+	}
+	cli_close(cli1, fnum2);
+
+ fail:
+	cli_unlink(cli1, fname);
+
+	if (!torture_close_connection(cli1)) {
+		correct = False;
+	}
+	return correct;
+}
+
 static double create_procs(BOOL (*fn)(int), BOOL *result);
 
 
@@ -801,6 +932,103 @@ static BOOL run_readwritelarge(int dummy)
 	return correct;
 }
 
+#define SIGNEDREAD_FILE_SIZE (16*1024*1024)
+#define SIGNEDREAD_PASSES 8
+
+/*
+  measure the throughput of large reads on a signed connection. Run it
+  against a server with and without "smbd:signed sendfile" to compare
+  the sendfile and read-and-copy paths.
+*/
+static BOOL run_signedread(int dummy)
+{
+	struct cli_state *cli;
+	const char *fname = "\\signedread.dat";
+	BOOL retry;
+	NTSTATUS status;
+	char *buf, *rbuf;
+	int fnum, i;
+	size_t j;
+	double t;
+	BOOL correct = False;
+
+	printf("starting signedread test\n");
+
+	status = cli_full_connection(&cli, myname, host, NULL, port_to_use,
+				     share, "?????", username, workgroup,
+				     password, use_kerberos ?
+				     CLI_FULL_CONNECTION_USE_KERBEROS : 0,
+				     Required, &retry);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("signed connection failed: %s\n", nt_errstr(status));
+		return False;
+	}
+	cli_sockopt(cli, sockops);
+	cli->timeout = 120000;
+
+	if (!cli->sign_info.doing_signing) {
+		printf("server did not turn on signing\n");
+		torture_close_connection(cli);
+		return False;
+	}
+
+	buf = SMB_MALLOC_ARRAY(char, SIGNEDREAD_FILE_SIZE);
+	rbuf = SMB_MALLOC_ARRAY(char, SIGNEDREAD_FILE_SIZE);
+	if (!buf || !rbuf) {
+		printf("malloc failed\n");
+		goto done;
+	}
+	for (j = 0; j < SIGNEDREAD_FILE_SIZE; j++) {
+		buf[j] = (char)random();
+	}
+
+	cli_unlink(cli, fname);
+	fnum = cli_open(cli, fname, O_RDWR|O_CREAT|O_TRUNC, DENY_NONE);
+	if (fnum == -1) {
+		printf("open of %s failed (%s)\n", fname, cli_errstr(cli));
+		goto done;
+	}
+
+	if (cli_write(cli, fnum, 0, buf, 0, SIGNEDREAD_FILE_SIZE) !=
+	    SIGNEDREAD_FILE_SIZE) {
+		printf("write failed (%s)\n", cli_errstr(cli));
+		cli_close(cli, fnum);
+		goto done;
+	}
+
+	start_timer();
+	for (i = 0; i < SIGNEDREAD_PASSES; i++) {
+		memset(rbuf, 0, SIGNEDREAD_FILE_SIZE);
+		if (cli_read(cli, fnum, rbuf, 0, SIGNEDREAD_FILE_SIZE) !=
+		    SIGNEDREAD_FILE_SIZE) {
+			printf("read failed (%s)\n", cli_errstr(cli));
+			cli_close(cli, fnum);
+			goto done;
+		}
+	}
+	t = end_timer();
+
+	if (memcmp(buf, rbuf, SIGNEDREAD_FILE_SIZE) != 0) {
+		printf("read data does not match written data\n");
+		cli_close(cli, fnum);
+		goto done;
+	}
+
+	printf("signed read: %g MB/sec\n",
+	       (double)SIGNEDREAD_PASSES * SIGNEDREAD_FILE_SIZE / t / 1.0e6);
+
+	correct = cli_close(cli, fnum);
+	cli_unlink(cli, fname);
+
+ done:
+	SAFE_FREE(buf);
+	SAFE_FREE(rbuf);
+	if (!torture_close_connection(cli)) {
+		correct = False;
+	}
+	return correct;
+}
+
 int line_count = 0;
 int nbio_id;
 
@@ -4862,6 +5090,8 @@ static BOOL run_local_gencache(int dummy)
 {
 	char *val;
 	time_t tm;
+	pid_t child;
+	int i;
 
 	if (!gencache_init()) {
 		d_printf("%s: gencache_init() failed\n", __location__);
@@ -4887,6 +5117,54 @@ static BOOL run_local_gencache(int dummy)
 
 	SAFE_FREE(val);
 
+	/* A change made by another process must be seen at once, even
+	   though we remember what we looked up */
+
+	child = sys_fork();
+	if (child == 0) {
+		gencache_shutdown();
+		gencache_set("foo", "baz", time(NULL) + 1000);
+		_exit(0);
+	}
+	if ((child == -1) || (sys_waitpid(child, NULL, 0) != child)) {
+		d_printf("%s: could not run the child\n", __location__);
+		return False;
+	}
+
+	if (!gencache_get("foo", &val, &tm)) {
+		d_printf("%s: gencache_get() failed\n", __location__);
+		return False;
+	}
+	if (strcmp(val, "baz") != 0) {
+		d_printf("%s: gencache_get() returned %s, expected %s\n",
+			 __location__, val, "baz");
+		SAFE_FREE(val);
+		return False;
+	}
+	SAFE_FREE(val);
+
+	start_timer();
+	for (i=0; i<torture_numops * 1000; i++) {
+		if (!gencache_get("foo", NULL, NULL)) {
+			d_printf("%s: gencache_get() failed\n", __location__);
+			return False;
+		}
+	}
+	printf("%d gencache_get() calls took %.6f seconds\n",
+	       torture_numops * 1000, end_timer());
+
+	if (!gencache_set("expired", "bar", time(NULL) - 1)) {
+		d_printf("%s: gencache_set() failed\n", __location__);
+		return False;
+	}
+	if (gencache_get("expired", &val, &tm)) {
+		d_printf("%s: gencache_get() on expired entry "
+			 "succeeded\n", __location__);
+		SAFE_FREE(val);
+		return False;
+	}
+	gencache_del("expired");
+
 	if (!gencache_del("foo")) {
 		d_printf("%s: gencache_del() failed\n", __location__);
 		return False;
@@ -4917,6 +5195,1510 @@ static BOOL run_local_gencache(int dummy)
 	return True;
 }
 
+/* Fill the idmap cache with mappings of a made up domain, time the
+   lookups both ways and remove them again */
+
+#define IDMAPCACHE_BASE_ID 3000000
+
+static BOOL idmapcache_sid(DOM_SID *sid, uint32 rid)
+{
+	return string_to_sid(sid, "S-1-5-21-1-2-3") &&
+		sid_append_rid(sid, rid);
+}
+
+static BOOL run_local_idmapcache(int dummy)
+{
+	struct idmap_cache_ctx *cache;
+	struct id_map map;
+	DOM_SID sid, sid2;
+	int i, num = torture_numops * 10;
+	BOOL ret = False;
+	NTSTATUS status;
+	double t;
+
+	if ((cache = idmap_cache_init(NULL)) == NULL) {
+		d_printf("%s: idmap_cache_init() failed\n", __location__);
+		return False;
+	}
+
+	ZERO_STRUCT(map);
+	map.sid = &sid;
+
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		map.xid.type = (i & 1) ? ID_TYPE_GID : ID_TYPE_UID;
+		map.xid.id = IDMAPCACHE_BASE_ID + i;
+		status = idmap_cache_set(cache, &map);
+		if (!NT_STATUS_IS_OK(status)) {
+			d_printf("%s: idmap_cache_set() failed: %s\n",
+				 __location__, nt_errstr(status));
+			goto done;
+		}
+	}
+
+	start_timer();
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		map.xid.type = ID_TYPE_NOT_SPECIFIED;
+		map.xid.id = 0;
+		status = idmap_cache_map_sid(cache, &map);
+		if (!NT_STATUS_IS_OK(status) || (map.status != ID_MAPPED) ||
+		    (map.xid.type != ((i & 1) ? ID_TYPE_GID : ID_TYPE_UID)) ||
+		    (map.xid.id != IDMAPCACHE_BASE_ID + i)) {
+			d_printf("%s: idmap_cache_map_sid(%s) returned %s, "
+				 "%u\n", __location__, sid_string_static(&sid),
+				 nt_errstr(status), (unsigned int)map.xid.id);
+			goto done;
+		}
+	}
+	t = end_timer();
+	printf("%d idmap_cache_map_sid() calls took %.6f seconds\n", num, t);
+
+	map.sid = &sid2;
+	start_timer();
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		map.xid.type = (i & 1) ? ID_TYPE_GID : ID_TYPE_UID;
+		map.xid.id = IDMAPCACHE_BASE_ID + i;
+		ZERO_STRUCT(sid2);
+		status = idmap_cache_map_id(cache, &map);
+		if (!NT_STATUS_IS_OK(status) || (map.status != ID_MAPPED) ||
+		    !sid_equal(&sid, &sid2)) {
+			d_printf("%s: idmap_cache_map_id(%u) returned %s\n",
+				 __location__, (unsigned int)map.xid.id,
+				 nt_errstr(status));
+			goto done;
+		}
+	}
+	t = end_timer();
+	printf("%d idmap_cache_map_id() calls took %.6f seconds\n", num, t);
+
+	/* a gid is not the uid with the same number */
+
+	map.xid.type = ID_TYPE_UID;
+	map.xid.id = IDMAPCACHE_BASE_ID + 1;
+	status = idmap_cache_map_id(cache, &map);
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_NONE_MAPPED) ||
+	    (map.status != ID_UNKNOWN)) {
+		d_printf("%s: idmap_cache_map_id() found uid %u: %s\n",
+			 __location__, (unsigned int)map.xid.id,
+			 nt_errstr(status));
+		goto done;
+	}
+
+	/* negative entries */
+
+	map.sid = &sid;
+	idmapcache_sid(&sid, 1000 + num);
+	status = idmap_cache_set_negative_sid(cache, &map);
+	if (NT_STATUS_IS_OK(status)) {
+		status = idmap_cache_map_sid(cache, &map);
+	}
+	if (!NT_STATUS_IS_OK(status) || (map.status != ID_UNMAPPED)) {
+		d_printf("%s: negative entry for %s not found: %s\n",
+			 __location__, sid_string_static(&sid),
+			 nt_errstr(status));
+		goto done;
+	}
+
+	map.xid.type = ID_TYPE_UID;
+	map.xid.id = IDMAPCACHE_BASE_ID + num;
+	status = idmap_cache_set_negative_id(cache, &map);
+	if (NT_STATUS_IS_OK(status)) {
+		status = idmap_cache_map_id(cache, &map);
+	}
+	if (!NT_STATUS_IS_OK(status) || (map.status != ID_UNMAPPED)) {
+		d_printf("%s: negative entry for uid %u not found: %s\n",
+			 __location__, (unsigned int)map.xid.id,
+			 nt_errstr(status));
+		goto done;
+	}
+
+	ret = True;
+
+ done:
+	map.sid = &sid;
+	for (i = 0; i <= num; i++) {
+		/* num is even, its negative entries are for a uid */
+		idmapcache_sid(&sid, 1000 + i);
+		map.xid.type = (i & 1) ? ID_TYPE_GID : ID_TYPE_UID;
+		map.xid.id = IDMAPCACHE_BASE_ID + i;
+		idmap_cache_del(cache, &map);
+	}
+	idmap_cache_shutdown(cache);
+	return ret;
+}
+
+/* Store info3s of a made up domain in the samlogon cache, time getting
+   them back and remove them again */
+
+#define SAMLOGONCACHE_NUM_GROUPS 20
+
+static void samlogoncache_info3(TALLOC_CTX *mem_ctx, NET_USER_INFO_3 *info3,
+				uint32 rid)
+{
+	DOM_SID sid;
+	uint32 i;
+
+	ZERO_STRUCTP(info3);
+
+	info3->ptr_user_info = 1;
+	info3->buffer_dom_id = 1;
+	string_to_sid(&sid, "S-1-5-21-1-2-3");
+	init_dom_sid2(&info3->dom_sid, &sid);
+	info3->user_rid = rid;
+	info3->group_rid = 513;
+	info3->logon_time = (NTTIME)rid << 32;
+	info3->user_flgs = 0x20;
+
+	init_unistr2(&info3->uni_user_name,
+		     talloc_asprintf(mem_ctx, "user%u", rid), UNI_STR_TERMINATE);
+	init_uni_hdr(&info3->hdr_user_name, &info3->uni_user_name);
+	init_unistr2(&info3->uni_logon_dom, "SAMLOGONCACHE", UNI_STR_TERMINATE);
+	init_uni_hdr(&info3->hdr_logon_dom, &info3->uni_logon_dom);
+
+	info3->num_groups = info3->num_groups2 = SAMLOGONCACHE_NUM_GROUPS;
+	info3->buffer_groups = 1;
+	info3->gids = TALLOC_ARRAY(mem_ctx, DOM_GID, info3->num_groups);
+	for (i = 0; i < info3->num_groups; i++) {
+		info3->gids[i].g_rid = 513 + i;
+		info3->gids[i].attr = 7;
+	}
+
+	info3->num_other_sids = 2;
+	info3->buffer_other_sids = 1;
+	info3->other_sids = TALLOC_ARRAY(mem_ctx, DOM_SID2, 2);
+	info3->other_sids_attrib = TALLOC_ARRAY(mem_ctx, uint32, 2);
+	for (i = 0; i < 2; i++) {
+		string_to_sid(&sid, "S-1-5-21-4-5-6");
+		sid_append_rid(&sid, rid + i);
+		init_dom_sid2(&info3->other_sids[i], &sid);
+		info3->other_sids_attrib[i] = 7;
+	}
+}
+
+/* Store an info3 the way earlier versions did: a timestamp followed by
+   the prs marshalled info3, and no name index entry */
+
+static BOOL samlogoncache_store_old(TALLOC_CTX *mem_ctx,
+				    NET_USER_INFO_3 *info3)
+{
+	TDB_CONTEXT *tdb;
+	DOM_SID sid;
+	TDB_DATA data;
+	prs_struct ps;
+	uint32 ts = time(NULL);
+	BOOL ret = False;
+
+	netsamlogon_cache_shutdown();
+
+	tdb = tdb_open_log(lock_path("netsamlogon_cache.tdb"), 0,
+			   TDB_DEFAULT, O_RDWR | O_CREAT, 0600);
+	if (tdb == NULL) {
+		return False;
+	}
+
+	sid_copy(&sid, &info3->dom_sid.sid);
+	sid_append_rid(&sid, info3->user_rid);
+
+	prs_init(&ps, RPC_MAX_PDU_FRAG_LEN, mem_ctx, MARSHALL);
+	if (prs_uint32("timestamp", &ps, 0, &ts) &&
+	    net_io_user_info3("", info3, &ps, 0, 3, 0)) {
+		data.dsize = prs_offset(&ps);
+		data.dptr = prs_data_p(&ps);
+		ret = (tdb_store_bystring(tdb, sid_string_static(&sid), data,
+					  TDB_REPLACE) != -1);
+	}
+	prs_mem_free(&ps);
+
+	tdb_close(tdb);
+	return ret;
+}
+
+static BOOL run_local_samlogoncache(int dummy)
+{
+	TALLOC_CTX *mem_ctx;
+	NET_USER_INFO_3 info3, *cached;
+	DOM_SID sid, sid2;
+	fstring name;
+	int i, num = torture_numops * 100;
+	BOOL ret = False;
+	double t;
+
+	if ((mem_ctx = talloc_init("run_local_samlogoncache")) == NULL) {
+		return False;
+	}
+
+	for (i = 0; i < num; i++) {
+		samlogoncache_info3(mem_ctx, &info3, 1000 + i);
+		if (!netsamlogon_cache_store(NULL, &info3)) {
+			d_printf("%s: netsamlogon_cache_store() failed\n",
+				 __location__);
+			goto done;
+		}
+		talloc_free_children(mem_ctx);
+	}
+
+	start_timer();
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		cached = netsamlogon_cache_get(mem_ctx, &sid);
+		if ((cached == NULL) || (cached->user_rid != 1000 + i) ||
+		    (cached->num_groups != SAMLOGONCACHE_NUM_GROUPS) ||
+		    (cached->gids[SAMLOGONCACHE_NUM_GROUPS - 1].g_rid !=
+		     513 + SAMLOGONCACHE_NUM_GROUPS - 1) ||
+		    (cached->num_other_sids != 2) ||
+		    (cached->other_sids[1].sid.sub_auths[4] != 1000 + i + 1) ||
+		    (cached->logon_time != (NTTIME)(1000 + i) << 32)) {
+			d_printf("%s: netsamlogon_cache_get(%s) failed\n",
+				 __location__, sid_string_static(&sid));
+			goto done;
+		}
+		unistr2_to_ascii(name, &cached->uni_user_name, sizeof(name));
+		if (strcmp(name, talloc_asprintf(mem_ctx, "user%d", 1000 + i)) != 0) {
+			d_printf("%s: netsamlogon_cache_get(%s) returned "
+				 "user %s\n", __location__,
+				 sid_string_static(&sid), name);
+			goto done;
+		}
+		talloc_free_children(mem_ctx);
+	}
+	t = end_timer();
+	printf("%d netsamlogon_cache_get() calls took %.6f seconds\n", num, t);
+
+	start_timer();
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		if (!netsamlogon_cache_have(&sid)) {
+			d_printf("%s: netsamlogon_cache_have(%s) failed\n",
+				 __location__, sid_string_static(&sid));
+			goto done;
+		}
+	}
+	t = end_timer();
+	printf("%d netsamlogon_cache_have() calls took %.6f seconds\n", num, t);
+
+	start_timer();
+	for (i = 0; i < num; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		fstr_sprintf(name, "User%d", 1000 + i);
+		if (!netsamlogon_cache_sid_byname("samlogoncache", name, &sid2) ||
+		    !sid_equal(&sid, &sid2)) {
+			d_printf("%s: netsamlogon_cache_sid_byname(%s) "
+				 "failed\n", __location__, name);
+			goto done;
+		}
+	}
+	t = end_timer();
+	printf("%d netsamlogon_cache_sid_byname() calls took %.6f seconds\n",
+	       num, t);
+
+	/* a renamed user is not found under the old name any more */
+
+	samlogoncache_info3(mem_ctx, &info3, 1000);
+	init_unistr2(&info3.uni_user_name, "renamed", UNI_STR_TERMINATE);
+	init_uni_hdr(&info3.hdr_user_name, &info3.uni_user_name);
+	if (!netsamlogon_cache_store(NULL, &info3) ||
+	    netsamlogon_cache_sid_byname("SAMLOGONCACHE", "user1000", &sid2) ||
+	    !netsamlogon_cache_sid_byname("SAMLOGONCACHE", "renamed", &sid2)) {
+		d_printf("%s: rename not reflected in the name index\n",
+			 __location__);
+		goto done;
+	}
+
+	/* a new user who takes the name keeps it when the old record
+	   is stored again or deleted */
+
+	samlogoncache_info3(mem_ctx, &info3, 1000 + num);
+	init_unistr2(&info3.uni_user_name, "renamed", UNI_STR_TERMINATE);
+	init_uni_hdr(&info3.hdr_user_name, &info3.uni_user_name);
+	idmapcache_sid(&sid, 1000 + num);
+	if (!netsamlogon_cache_store(NULL, &info3) ||
+	    !netsamlogon_cache_sid_byname("SAMLOGONCACHE", "renamed", &sid2) ||
+	    !sid_equal(&sid, &sid2)) {
+		d_printf("%s: new owner of a name not indexed\n",
+			 __location__);
+		goto done;
+	}
+
+	samlogoncache_info3(mem_ctx, &info3, 1000);
+	init_unistr2(&info3.uni_user_name, "renamed2", UNI_STR_TERMINATE);
+	init_uni_hdr(&info3.hdr_user_name, &info3.uni_user_name);
+	idmapcache_sid(&sid2, 1000);
+	if (!netsamlogon_cache_store(NULL, &info3) ||
+	    !netsamlogon_cache_delete(&sid2) ||
+	    !netsamlogon_cache_sid_byname("SAMLOGONCACHE", "renamed", &sid2) ||
+	    !sid_equal(&sid, &sid2)) {
+		d_printf("%s: stale record removed the name index entry of "
+			 "another user\n", __location__);
+		goto done;
+	}
+
+	/* records written by earlier versions are converted when read,
+	   and are indexed by name from then on */
+
+	samlogoncache_info3(mem_ctx, &info3, 1001 + num);
+	idmapcache_sid(&sid, 1001 + num);
+	if (!samlogoncache_store_old(mem_ctx, &info3) ||
+	    !netsamlogon_cache_have(&sid)) {
+		d_printf("%s: netsamlogon_cache_have() of an old format "
+			 "record failed\n", __location__);
+		goto done;
+	}
+	if (!samlogoncache_store_old(mem_ctx, &info3) ||
+	    ((cached = netsamlogon_cache_get(mem_ctx, &sid)) == NULL) ||
+	    (cached->user_rid != 1001 + num) ||
+	    (cached->num_groups != SAMLOGONCACHE_NUM_GROUPS) ||
+	    (cached->num_other_sids != 2) ||
+	    (cached->other_sids[1].sid.sub_auths[4] != 1001 + num + 1)) {
+		d_printf("%s: netsamlogon_cache_get() of an old format "
+			 "record failed\n", __location__);
+		goto done;
+	}
+	fstr_sprintf(name, "user%d", 1001 + num);
+	if (!netsamlogon_cache_sid_byname("SAMLOGONCACHE", name, &sid2) ||
+	    !sid_equal(&sid, &sid2)) {
+		d_printf("%s: converted record not indexed by name\n",
+			 __location__);
+		goto done;
+	}
+	talloc_free_children(mem_ctx);
+
+	ret = True;
+
+ done:
+	for (i = 0; i < num + 2; i++) {
+		idmapcache_sid(&sid, 1000 + i);
+		netsamlogon_cache_delete(&sid);
+	}
+	if (ret && netsamlogon_cache_sid_byname("SAMLOGONCACHE", "renamed", &sid2)) {
+		d_printf("%s: name index entry survived the delete\n",
+			 __location__);
+		ret = False;
+	}
+	talloc_destroy(mem_ctx);
+	return ret;
+}
+
+#define SHARELOOKUP_NUM_SHARES 20000
+
+static BOOL run_local_sharelookup(int dummy)
+{
+	pstring fname;
+	XFILE *f;
+	int fd, i;
+	double t;
+	BOOL ret = False;
+
+	pstrcpy(fname, "/tmp/sharelookup.XXXXXX");
+	if ((fd = smb_mkstemp(fname)) == -1) {
+		d_printf("%s: smb_mkstemp failed: %s\n", __location__,
+			 strerror(errno));
+		return False;
+	}
+
+	close(fd);
+
+	if ((f = x_fopen(fname, O_WRONLY|O_TRUNC, 0600)) == NULL) {
+		d_printf("%s: x_fopen(%s) failed\n", __location__, fname);
+		goto done;
+	}
+
+	x_fprintf(f, "[global]\n\tworkgroup = %s\n", workgroup);
+	for (i = 0; i < SHARELOOKUP_NUM_SHARES; i++) {
+		x_fprintf(f, "[share%05d]\n\tpath = /tmp\n"
+			  "\tcomment = share number %d\n", i, i);
+	}
+	x_fprintf(f, "[%%U]\n\tpath = /tmp/%%U\n");
+	x_fclose(f);
+
+	start_timer();
+	if (!lp_load(fname, False, False, False, True)) {
+		d_printf("%s: lp_load(%s) failed\n", __location__, fname);
+		goto done;
+	}
+	printf("loaded %d shares in %g seconds\n", lp_numservices(),
+	       end_timer());
+
+	start_timer();
+	for (i = 0; i < SHARELOOKUP_NUM_SHARES; i++) {
+		fstring name;
+		int snum;
+
+		/* exercise the case insensitive match as well */
+		fstr_sprintf(name, (i & 1) ? "SHARE%05d" : "share%05d", i);
+		snum = lp_servicenumber(name);
+		if (snum < 0 || !strequal(lp_servicename(snum), name)) {
+			d_printf("%s: lp_servicenumber(%s) returned %d\n",
+				 __location__, name, snum);
+			goto done;
+		}
+	}
+	t = end_timer();
+	printf("%d lookups in %g seconds (%g lookups/sec)\n",
+	       SHARELOOKUP_NUM_SHARES, t, SHARELOOKUP_NUM_SHARES / t);
+
+	if (lp_servicenumber("noshare") >= 0) {
+		d_printf("%s: found non-existing share\n", __location__);
+		goto done;
+	}
+
+	/* only matches after substitution */
+	if (lp_servicenumber("%U") >= 0) {
+		d_printf("%s: found unsubstituted %%U share\n", __location__);
+		goto done;
+	}
+
+	ret = True;
+ done:
+	unlink(fname);
+	lp_load(dyn_CONFIGFILE,True,False,False,True);
+	return ret;
+}
+
+static void md5_hex(const unsigned char *buf, size_t len, fstring hex)
+{
+	struct MD5Context ctx;
+	unsigned char digest[16];
+	int i;
+
+	MD5Init(&ctx);
+	MD5Update(&ctx, buf, len);
+	MD5Final(digest, &ctx);
+
+	for (i = 0; i < 16; i++) {
+		slprintf(hex + 2*i, 3, "%02x", digest[i]);
+	}
+}
+
+static BOOL run_local_md5(int dummy)
+{
+	static const struct {
+		const char *in;
+		const char *out;
+	} vectors[] = {
+		{ "", "d41d8cd98f00b204e9800998ecf8427e" },
+		{ "a", "0cc175b9c0f1b6a831c399e269772661" },
+		{ "abc", "900150983cd24fb0d6963f7d28e17f72" },
+		{ "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+		{ "abcdefghijklmnopqrstuvwxyz",
+		  "c3fcd3d76192e4007dfb496cca67e13b" },
+		{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		  "0123456789", "d174ab98d277d9f5a5611c2c9f419d9f" },
+		{ "1234567890123456789012345678901234567890"
+		  "1234567890123456789012345678901234567890",
+		  "57edf4a22be3c955ac49da2e2107b67a" },
+	};
+	static const size_t sizes[] = { 64*1024, 128*1024, 1024*1024 };
+	const size_t total = 256*1024*1024;
+	unsigned char *buf;
+	fstring hex, hex2;
+	size_t i, j;
+	BOOL ret = False;
+
+	for (i = 0; i < ARRAY_SIZE(vectors); i++) {
+		md5_hex((const unsigned char *)vectors[i].in,
+			strlen(vectors[i].in), hex);
+		if (strcmp(hex, vectors[i].out) != 0) {
+			d_printf("%s: MD5(\"%s\") = %s, expected %s\n",
+				 __location__, vectors[i].in, hex,
+				 vectors[i].out);
+			return False;
+		}
+	}
+
+	if ((buf = SMB_MALLOC_ARRAY(unsigned char, sizes[2] + 1)) == NULL) {
+		d_printf("%s: malloc failed\n", __location__);
+		return False;
+	}
+
+	for (i = 0; i < sizes[2] + 1; i++) {
+		buf[i] = (unsigned char)random();
+	}
+
+	/* unaligned input and odd sized updates must give the same MAC */
+	memmove(buf + 1, buf, 4096);
+	md5_hex(buf + 1, 4096, hex);
+	memmove(buf, buf + 1, 4096);
+	md5_hex(buf, 4096, hex2);
+	if (strcmp(hex, hex2) != 0) {
+		d_printf("%s: unaligned MD5 %s != aligned %s\n",
+			 __location__, hex, hex2);
+		goto done;
+	}
+
+	{
+		struct MD5Context ctx;
+		unsigned char digest[16];
+
+		MD5Init(&ctx);
+		for (i = 0; i < 4096; i += j) {
+			j = MIN(4096 - i, (i % 67) + 1);
+			MD5Update(&ctx, buf + i, j);
+		}
+		MD5Final(digest, &ctx);
+		for (i = 0; i < 16; i++) {
+			slprintf(hex + 2*i, 3, "%02x", digest[i]);
+		}
+		if (strcmp(hex, hex2) != 0) {
+			d_printf("%s: incremental MD5 %s != one-shot %s\n",
+				 __location__, hex, hex2);
+			goto done;
+		}
+	}
+
+	/* the sizes of a large readX reply as it gets signed */
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		size_t n = total / sizes[i];
+		double t;
+
+		start_timer();
+		for (j = 0; j < n; j++) {
+			md5_hex(buf, sizes[i], hex);
+		}
+		t = end_timer();
+		printf("%7u byte PDUs: %g MB/sec\n", (unsigned int)sizes[i],
+		       total / t / 1.0e6);
+	}
+
+	ret = True;
+ done:
+	SAFE_FREE(buf);
+	return ret;
+}
+
+/* masktest style random strings, built from whole characters */
+static void wildcard_random(char *buf, size_t size, const char **chars,
+			    int nchars, int len)
+{
+	int i;
+
+	*buf = 0;
+	for (i = 0; i < len; i++) {
+		safe_strcat(buf, chars[random() % nchars], size - 1);
+	}
+}
+
+#define WILDCARD_NUM_NAMES 100000
+
+static BOOL run_local_wildcard(int dummy)
+{
+	static const char *maskchars[] = {
+		"<", ">", "\"", "?", "*", "a", "b", "C", ".", "\xc3\xa9"
+	};
+	static const char *fixedchars[] = {
+		"a", "B", "c", "D", ".", "x", "\xc3\xa9", "\xc3\x89"
+	};
+	static const char *filechars[] = {
+		"a", "A", "b", "B", "c", "C", "d", "D", "x", ".",
+		"\xc3\xa9", "\xc3\x89"
+	};
+	static const char *bench_masks[] = {
+		"*", "*.docx", "report*", "report00043.docx", "rep?rt*.d*"
+	};
+	fstring mask, name;
+	char fixed[sizeof(fstring) - 2];	/* room for a '*' in mask */
+	char **names;
+	int i, j, n, matches;
+	double t;
+	BOOL ret = False;
+
+	/* differential test against ms_fnmatch() */
+	for (i = 0; i < 200000; i++) {
+		struct ms_wildcard *w;
+		BOOL translate = (i & 1);
+		BOOL case_sensitive = (i & 2) != 0;
+
+		wildcard_random(fixed, sizeof(fixed), fixedchars,
+				ARRAY_SIZE(fixedchars), 1 + random() % 6);
+		switch (random() % 5) {
+		case 0:
+			wildcard_random(mask, sizeof(mask), maskchars,
+					ARRAY_SIZE(maskchars), 1 + random() % 10);
+			break;
+		case 1:
+			slprintf(mask, sizeof(mask)-1, "*%s", fixed);
+			break;
+		case 2:
+			slprintf(mask, sizeof(mask)-1, "%s*", fixed);
+			break;
+		case 3:
+			fstrcpy(mask, fixed);
+			break;
+		default:
+			fstrcpy(mask, "*");
+			break;
+		}
+
+		w = ms_wildcard_compile(NULL, mask, translate, case_sensitive);
+		if (w == NULL) {
+			d_printf("%s: ms_wildcard_compile failed\n",
+				 __location__);
+			return False;
+		}
+
+		for (j = 0; j < 20; j++) {
+			int r1, r2;
+
+			if (j == 0) {
+				fstrcpy(name, "..");
+			} else if (j < 4) {
+				/* names that end in or start with the mask */
+				wildcard_random(name, sizeof(name), filechars,
+						ARRAY_SIZE(filechars),
+						random() % 4);
+				if (j == 1) {
+					fstrcat(name, fixed);
+				} else {
+					pstring tmp;
+					pstrcpy(tmp, fixed);
+					pstrcat(tmp, name);
+					fstrcpy(name, tmp);
+				}
+			} else {
+				wildcard_random(name, sizeof(name), filechars,
+						ARRAY_SIZE(filechars),
+						1 + random() % 10);
+			}
+
+			r1 = ms_fnmatch(mask, name, translate, case_sensitive);
+			r2 = ms_wildcard_match(w, name);
+			if ((r1 == 0) != (r2 == 0)) {
+				d_printf("%s: mask [%s] name [%s] translate %d "
+					 "case %d: ms_fnmatch %d compiled %d\n",
+					 __location__, mask, name, translate,
+					 case_sensitive, r1, r2);
+				TALLOC_FREE(w);
+				return False;
+			}
+		}
+		TALLOC_FREE(w);
+	}
+
+	/* throughput over a large directory */
+	names = SMB_MALLOC_ARRAY(char *, WILDCARD_NUM_NAMES);
+	if (names == NULL) {
+		d_printf("%s: malloc failed\n", __location__);
+		return False;
+	}
+	for (i = 0; i < WILDCARD_NUM_NAMES; i++) {
+		asprintf(&names[i], "%s%05d.%s", (i % 3) ? "report" : "Budget",
+			 i, (i % 2) ? "docx" : "xlsx");
+		if (names[i] == NULL) {
+			d_printf("%s: asprintf failed\n", __location__);
+			n = i;
+			goto done;
+		}
+	}
+	n = WILDCARD_NUM_NAMES;
+
+	for (i = 0; i < ARRAY_SIZE(bench_masks); i++) {
+		struct ms_wildcard *w;
+		double t2;
+		int matches2 = 0;
+
+		matches = 0;
+		start_timer();
+		for (j = 0; j < n; j++) {
+			if (ms_fnmatch(bench_masks[i], names[j], False,
+				       False) == 0) {
+				matches++;
+			}
+		}
+		t = end_timer();
+
+		start_timer();
+		w = ms_wildcard_compile(NULL, bench_masks[i], False, False);
+		if (w == NULL) {
+			d_printf("%s: ms_wildcard_compile failed\n",
+				 __location__);
+			goto done;
+		}
+		for (j = 0; j < n; j++) {
+			if (ms_wildcard_match(w, names[j]) == 0) {
+				matches2++;
+			}
+		}
+		TALLOC_FREE(w);
+		t2 = end_timer();
+
+		if (matches != matches2) {
+			d_printf("%s: %s: %d matches with ms_fnmatch, %d "
+				 "compiled\n", __location__, bench_masks[i],
+				 matches, matches2);
+			goto done;
+		}
+
+		printf("%-18s %6d matches  ms_fnmatch %8.0f/sec  "
+		       "compiled %10.0f/sec\n", bench_masks[i], matches,
+		       n / t, n / t2);
+	}
+
+	ret = True;
+ done:
+	for (i = 0; i < n; i++) {
+		SAFE_FREE(names[i]);
+	}
+	SAFE_FREE(names);
+	return ret;
+}
+
+/* pieces of test strings, as UTF-8 and as UTF-16LE */
+static const struct {
+	const char *utf8;
+	const char *utf16;
+	size_t utf16_len;
+} charcnv_pieces[] = {
+	{ "a", "a\0", 2 },
+	{ "Documents", "D\0o\0c\0u\0m\0e\0n\0t\0s\0", 18 },
+	{ "/", "/\0", 2 },
+	{ "report-final.docx", "r\0e\0p\0o\0r\0t\0-\0f\0i\0n\0a\0l\0.\0d\0o\0c\0x\0", 34 },
+	{ "\xc3\xa9", "\xe9\0", 2 },
+	{ "\xe6\x97\xa5\xe6\x9c\xac", "\xe5\x65\x2c\x67", 4 },
+	{ "\xf0\x9f\x98\x80", "\x3d\xd8\x00\xde", 4 },
+	{ "0123456789abcdef", "0\0001\0002\0003\0004\0005\0006\0007\0008\0009\0a\0b\0c\0d\0e\0f\0", 32 },
+};
+
+#define CHARCNV_NUM_PATHS 10000
+#define CHARCNV_PASSES 50
+
+static BOOL run_local_charcnv(int dummy)
+{
+	pstring src, back;
+	char expected[sizeof(pstring)*2], out[sizeof(pstring)*2];
+	char **paths;
+	size_t elen, len, slen;
+	int i, j, k, n;
+	double t;
+	BOOL ret = False;
+
+	if (!strequal(lp_unix_charset(), "UTF-8") &&
+	    !strequal(lp_unix_charset(), "UTF8")) {
+		printf("unix charset is %s - skipping conversion checks\n",
+		       lp_unix_charset());
+		goto bench;
+	}
+
+	for (i = 0; i < 100000; i++) {
+		/* some offset so the word at a time code sees any alignment */
+		int ofs = random() % 8;
+		char *s = src + ofs;
+
+		*s = 0;
+		elen = 0;
+		n = random() % 12;
+		for (j = 0; j < n; j++) {
+			k = random() % ARRAY_SIZE(charcnv_pieces);
+			if ((i & 1) && k >= 4 && k <= 6) {
+				/* every other string is plain ASCII */
+				k = 1;
+			}
+			safe_strcat(s, charcnv_pieces[k].utf8,
+				    sizeof(src) - ofs - 1);
+			memcpy(expected + elen, charcnv_pieces[k].utf16,
+			       charcnv_pieces[k].utf16_len);
+			elen += charcnv_pieces[k].utf16_len;
+		}
+		expected[elen++] = 0;
+		expected[elen++] = 0;
+		slen = strlen(s) + 1;
+
+		len = convert_string(CH_UNIX, CH_UTF16LE, s,
+				     (i & 2) ? (size_t)-1 : slen,
+				     out + ofs, sizeof(out) - 8, False);
+		if (len != elen || memcmp(out + ofs, expected, elen) != 0) {
+			d_printf("%s: push of [%s] gave %d bytes, expected "
+				 "%d\n", __location__, s, (int)len, (int)elen);
+			goto done;
+		}
+
+		len = convert_string(CH_UTF16LE, CH_UNIX, out + ofs,
+				     (i & 4) ? (size_t)-1 : elen,
+				     back, sizeof(back), False);
+		if (len != slen || strcmp(back, s) != 0) {
+			d_printf("%s: pull of [%s] gave [%s]\n",
+				 __location__, s, back);
+			goto done;
+		}
+
+		/* too small a buffer must give a prefix */
+		k = random() % (elen + 1);
+		len = convert_string(CH_UNIX, CH_UTF16LE, s, slen,
+				     out, k, True);
+		if (len > (size_t)k ||
+		    (len != (size_t)-1 && memcmp(out, expected, len) != 0)) {
+			d_printf("%s: truncated push of [%s] to %d gave %d\n",
+				 __location__, s, k, (int)len);
+			goto done;
+		}
+	}
+
+ bench:
+	/* a share full of office documents, a few with accented names */
+	paths = SMB_MALLOC_ARRAY(char *, CHARCNV_NUM_PATHS);
+	if (paths == NULL) {
+		d_printf("%s: malloc failed\n", __location__);
+		return False;
+	}
+	for (i = 0; i < CHARCNV_NUM_PATHS; i++) {
+		asprintf(&paths[i], "Users/user%d/Documents/Projects %d/%s %05d.%s",
+			 i % 50, 2000 + i % 8,
+			 (i % 20) ? "Quarterly report" : "R\xc3\xa9sum\xc3\xa9",
+			 i, (i % 3) ? "docx" : "xlsx");
+		if (paths[i] == NULL) {
+			d_printf("%s: asprintf failed\n", __location__);
+			n = i;
+			goto free_paths;
+		}
+	}
+	n = CHARCNV_NUM_PATHS;
+
+	start_timer();
+	for (j = 0; j < CHARCNV_PASSES; j++) {
+		for (i = 0; i < n; i++) {
+			push_ucs2(NULL, out, paths[i], sizeof(out),
+				  STR_TERMINATE);
+		}
+	}
+	t = end_timer();
+	printf("push_ucs2: %g converts/sec\n", n * CHARCNV_PASSES / t);
+
+	start_timer();
+	for (j = 0; j < CHARCNV_PASSES; j++) {
+		for (i = 0; i < n; i++) {
+			len = push_ucs2(NULL, out, paths[i], sizeof(out),
+					STR_TERMINATE);
+			pull_ucs2(NULL, back, out, sizeof(back), len,
+				  STR_TERMINATE);
+		}
+	}
+	t = end_timer();
+	printf("push_ucs2+pull_ucs2: %g round trips/sec\n",
+	       n * CHARCNV_PASSES / t);
+
+	ret = True;
+ free_paths:
+	for (i = 0; i < n; i++) {
+		SAFE_FREE(paths[i]);
+	}
+	SAFE_FREE(paths);
+	return ret;
+ done:
+	return False;
+}
+
+/* the per character versions the word at a time ones must agree with */
+
+static int casecmp_ref_w(const smb_ucs2_t *a, const smb_ucs2_t *b, size_t len)
+{
+	size_t n;
+
+	for (n = 0; n < len && SVAL(b, 0) != 0; n++, a++, b++) {
+		if (toupper_w(*a) != toupper_w(*b)) {
+			break;
+		}
+	}
+	return (len - n) ? tolower_w(*a) - tolower_w(*b) : 0;
+}
+
+static int casecmp_ref(const char *s, const char *t)
+{
+	smb_ucs2_t *ws, *wt;
+	int ret;
+
+	for (; *s || *t; s++, t++) {
+		if (!*s) {
+			return -1;
+		}
+		if (!*t) {
+			return 1;
+		}
+		if ((*s & 0x80) || (*t & 0x80)) {
+			break;
+		}
+		if (toupper_ascii(*s) != toupper_ascii(*t)) {
+			return toupper_ascii(*s) < toupper_ascii(*t) ? -1 : 1;
+		}
+	}
+	if (!*s && !*t) {
+		return 0;
+	}
+	push_ucs2_allocate(&ws, s);
+	push_ucs2_allocate(&wt, t);
+	ret = casecmp_ref_w(ws, wt, (size_t)-1);
+	SAFE_FREE(ws);
+	SAFE_FREE(wt);
+	return ret;
+}
+
+static const char *casecmp_pieces[] = {
+	"a", "Z", "documents", "DOCUMENTS", "Report-Final.docx", "/", "@[`{",
+	"0123456789", "\xc3\xa9", "\xc3\x89", "\xc3\x9f", "\xe6\x97\xa5",
+};
+
+static BOOL run_local_casecmp(int dummy)
+{
+	pstring buf1, buf2;
+	smb_ucs2_t w1[sizeof(pstring) + 8], w2[sizeof(pstring) + 8];
+	smb_ucs2_t ref[sizeof(pstring) + 8];
+	int i, j, n, r1, r2;
+	size_t len;
+
+	for (i = 0; i < 100000; i++) {
+		/* independent offsets so both the co-aligned word compare
+		   and the fallback get exercised */
+		char *s1 = buf1 + random() % 8;
+		char *s2 = buf2 + random() % 8;
+		smb_ucs2_t *u1 = w1 + random() % 4;
+		smb_ucs2_t *u2 = w2 + random() % 4;
+
+		*s1 = 0;
+		n = random() % 10;
+		for (j = 0; j < n; j++) {
+			int k = random() % ARRAY_SIZE(casecmp_pieces);
+			if ((i & 1) && k >= 8) {
+				/* every other string is plain ASCII */
+				k = 2;
+			}
+			safe_strcat(s1, casecmp_pieces[k], sizeof(buf1) - 9);
+		}
+
+		/* the same name in another case, sometimes changed or cut */
+		safe_strcpy(s2, s1, sizeof(buf2) - 9);
+		for (j = 0; s2[j]; j++) {
+			if (!(s2[j] & 0x80) && (random() & 1)) {
+				s2[j] = (random() & 1) ? toupper_ascii(s2[j]) :
+					tolower_ascii(s2[j]);
+			}
+		}
+		if (j > 0 && (i % 3) == 0) {
+			s2[random() % j] = (random() & 1) ? 'q' : 0;
+		}
+
+		r1 = StrCaseCmp(s1, s2);
+		r2 = casecmp_ref(s1, s2);
+		if (r1 != r2) {
+			d_printf("%s: StrCaseCmp(%s, %s) gave %d, expected %d\n",
+				 __location__, s1, s2, r1, r2);
+			return False;
+		}
+		if (r1 == 0 && str_hash_upper(s1) != str_hash_upper(s2)) {
+			d_printf("%s: hashes of %s and %s differ\n",
+				 __location__, s1, s2);
+			return False;
+		}
+
+		push_ucs2(NULL, u1, s1, sizeof(pstring) * 2, STR_TERMINATE);
+		push_ucs2(NULL, u2, s2, sizeof(pstring) * 2, STR_TERMINATE);
+
+		if (str_hash_upper(s1) != strhash_upper_w(u1, 0)) {
+			d_printf("%s: str_hash_upper(%s) does not match "
+				 "strhash_upper_w\n", __location__, s1);
+			return False;
+		}
+
+		r1 = strcasecmp_w(u1, u2);
+		r2 = casecmp_ref_w(u1, u2, (size_t)-1);
+		if (r1 != r2) {
+			d_printf("%s: strcasecmp_w(%s, %s) gave %d, expected "
+				 "%d\n", __location__, s1, s2, r1, r2);
+			return False;
+		}
+
+		len = random() % 40;
+		r1 = strncasecmp_w(u1, u2, len);
+		r2 = casecmp_ref_w(u1, u2, len);
+		if (r1 != r2) {
+			d_printf("%s: strncasecmp_w(%s, %s, %d) gave %d, "
+				 "expected %d\n", __location__, s1, s2,
+				 (int)len, r1, r2);
+			return False;
+		}
+
+		r2 = False;
+		for (j = 0; u2[j]; j++) {
+			ref[j] = toupper_w(u2[j]);
+			if (ref[j] != u2[j]) {
+				r2 = True;
+			}
+		}
+		ref[j] = 0;
+		r1 = strupper_w(u2);
+		if (r1 != r2 ||
+		    memcmp(ref, u2, (j + 1) * sizeof(smb_ucs2_t)) != 0) {
+			d_printf("%s: strupper_w(%s) is wrong\n",
+				 __location__, s2);
+			return False;
+		}
+	}
+
+	return True;
+}
+
+/*
+ * Replay the reads of a netbench load file through the readahead
+ * logic of the prefetch VFS module and, for comparison, through the
+ * fixed boundary rule of the readahead module. No I/O is done: a read
+ * counts as covered if readahead issued earlier and not yet read or
+ * dropped includes it.
+ */
+
+#define RA_SIM_FILES 128
+#define RA_SIM_RANGES 512
+#define RA_SIM_OLD_BOUND 0x80000
+
+struct ra_sim_file {
+	int fnum;
+	struct prefetch_state state;
+	int num_ranges;
+	struct prefetch_range ranges[RA_SIM_RANGES];	/* sorted */
+};
+
+struct ra_sim_stats {
+	SMB_BIG_UINT reads, read_bytes, hit_bytes;
+	SMB_BIG_UINT ra_calls, ra_bytes, drop_calls, drop_bytes;
+};
+
+/* remove [offset, offset+len) from the pending readahead, returning
+   how much of it was pending */
+
+static SMB_OFF_T ra_sim_remove(struct ra_sim_file *f, SMB_OFF_T offset, SMB_OFF_T len)
+{
+	struct prefetch_range tmp[RA_SIM_RANGES + 1];
+	SMB_OFF_T end = offset + len, overlap = 0;
+	int i, n = 0;
+
+	for (i = 0; i < f->num_ranges; i++) {
+		SMB_OFF_T rs = f->ranges[i].offset;
+		SMB_OFF_T re = rs + f->ranges[i].len;
+
+		if (re <= offset || rs >= end) {
+			tmp[n++] = f->ranges[i];
+			continue;
+		}
+		overlap += MIN(re, end) - MAX(rs, offset);
+		if (rs < offset) {
+			tmp[n].offset = rs;
+			tmp[n++].len = offset - rs;
+		}
+		if (re > end) {
+			tmp[n].offset = end;
+			tmp[n++].len = re - end;
+		}
+	}
+	if (n > RA_SIM_RANGES) {
+		/* forget the lowest range, as if it were evicted */
+		memmove(tmp, tmp + 1, --n * sizeof(tmp[0]));
+	}
+	memcpy(f->ranges, tmp, n * sizeof(tmp[0]));
+	f->num_ranges = n;
+	return overlap;
+}
+
+static void ra_sim_add(struct ra_sim_file *f, SMB_OFF_T offset, SMB_OFF_T len)
+{
+	int i;
+
+	ra_sim_remove(f, offset, len);
+	if (f->num_ranges == RA_SIM_RANGES) {
+		memmove(f->ranges, f->ranges + 1,
+			--f->num_ranges * sizeof(f->ranges[0]));
+	}
+	for (i = f->num_ranges; i > 0 && f->ranges[i-1].offset > offset; i--) {
+		f->ranges[i] = f->ranges[i-1];
+	}
+	f->ranges[i].offset = offset;
+	f->ranges[i].len = len;
+	f->num_ranges++;
+}
+
+static void ra_sim_read(struct ra_sim_file *f, const struct prefetch_params *params,
+			SMB_OFF_T offset, size_t count, struct ra_sim_stats *st)
+{
+	struct prefetch_advice advice;
+	int i;
+
+	st->reads++;
+	st->read_bytes += count;
+	st->hit_bytes += ra_sim_remove(f, offset, count);
+
+	if (params == NULL) {
+		/* what vfs_readahead does with its defaults */
+		advice.num_ranges = 0;
+		advice.drop.len = 0;
+		if (offset % RA_SIM_OLD_BOUND == 0) {
+			advice.ranges[0].offset = offset;
+			advice.ranges[0].len = RA_SIM_OLD_BOUND;
+			advice.num_ranges = 1;
+		}
+	} else {
+		prefetch_observe(&f->state, params, offset, count, &advice);
+	}
+
+	for (i = 0; i < advice.num_ranges; i++) {
+		st->ra_calls++;
+		st->ra_bytes += advice.ranges[i].len;
+		ra_sim_add(f, advice.ranges[i].offset, advice.ranges[i].len);
+	}
+	if (advice.drop.len > 0) {
+		st->drop_calls++;
+		st->drop_bytes += advice.drop.len;
+		ra_sim_remove(f, advice.drop.offset, advice.drop.len);
+	}
+}
+
+static struct ra_sim_file *ra_sim_find(struct ra_sim_file **files, int fnum, BOOL create)
+{
+	int i, slot = -1;
+
+	for (i = 0; i < RA_SIM_FILES; i++) {
+		if (files[i] && files[i]->fnum == fnum) {
+			return files[i];
+		}
+		if (!files[i] && slot == -1) {
+			slot = i;
+		}
+	}
+	if (!create || slot == -1) {
+		return NULL;
+	}
+	files[slot] = SMB_CALLOC_ARRAY(struct ra_sim_file, 1);
+	if (files[slot]) {
+		files[slot]->fnum = fnum;
+	}
+	return files[slot];
+}
+
+/* replay the NTCreateX, ReadX and Close lines of a load file */
+
+static void ra_sim_replay(FILE *f, const struct prefetch_params *params,
+			  struct ra_sim_stats *st)
+{
+	struct ra_sim_file *files[RA_SIM_FILES];
+	struct ra_sim_file *file;
+	const char *p[20];
+	pstring line;
+	int i;
+
+	ZERO_STRUCT(files);
+	ZERO_STRUCTP(st);
+	rewind(f);
+
+	while (fgets(line, sizeof(line)-1, f)) {
+		p[0] = strtok(line, " \n");
+		i = 0;
+		while (p[i] && i < 18) p[++i] = strtok(NULL, " \n");
+
+		if (i >= 5 && !strcmp(p[0], "NTCreateX")) {
+			file = ra_sim_find(files, ival(p[4]), True);
+			if (file) {
+				int fnum = file->fnum;
+				ZERO_STRUCTP(file);
+				file->fnum = fnum;
+			}
+		} else if (i >= 4 && !strcmp(p[0], "ReadX")) {
+			file = ra_sim_find(files, ival(p[1]), True);
+			if (file && ival(p[3]) > 0) {
+				ra_sim_read(file, params, (SMB_OFF_T)ival(p[2]),
+					    (size_t)ival(p[3]), st);
+			}
+		} else if (i >= 2 && !strcmp(p[0], "Close")) {
+			for (i = 0; i < RA_SIM_FILES; i++) {
+				if (files[i] && files[i]->fnum == ival(p[1])) {
+					SAFE_FREE(files[i]);
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < RA_SIM_FILES; i++) {
+		SAFE_FREE(files[i]);
+	}
+}
+
+static void ra_sim_print(const char *name, const struct ra_sim_stats *st)
+{
+	SMB_BIG_UINT wasted = st->ra_bytes > st->hit_bytes ?
+		st->ra_bytes - st->hit_bytes : 0;
+
+	printf("%-14s reads %8llu  covered %5.1f%%  readahead %6llu calls "
+	       "%8.1f MB, %5.1f%% unused  dropped %8.1f MB\n", name,
+	       (unsigned long long)st->reads,
+	       st->read_bytes ? 100.0 * st->hit_bytes / st->read_bytes : 0.0,
+	       (unsigned long long)st->ra_calls, st->ra_bytes / 1048576.0,
+	       st->ra_bytes ? 100.0 * wasted / st->ra_bytes : 0.0,
+	       st->drop_bytes / 1048576.0);
+}
+
+/* the access patterns the adaptive readahead is meant to follow */
+
+enum ra_pattern { RA_FORWARD, RA_BACKWARD, RA_STRIDED, RA_INTERLEAVED,
+		  RA_MIXED, RA_RANDOM, RA_NUM_PATTERNS };
+
+static const char *ra_pattern_names[] = {
+	"forward", "backward", "strided", "interleaved", "mixed", "random"
+};
+
+static void ra_gen_pattern(FILE *f, enum ra_pattern pattern)
+{
+	const int mb = 1024*1024, blk = 65536, rec = 4096;
+	int i;
+
+	fprintf(f, "NTCreateX \\test.dat 0x0 0x1 1\n");
+	switch (pattern) {
+	case RA_FORWARD:
+		for (i = 0; i < 64 * mb; i += blk) {
+			fprintf(f, "ReadX 1 %d %d %d\n", i, blk, blk);
+		}
+		break;
+	case RA_BACKWARD:
+		for (i = 16 * mb - blk; i >= 0; i -= blk) {
+			fprintf(f, "ReadX 1 %d %d %d\n", i, blk, blk);
+		}
+		break;
+	case RA_STRIDED:
+		for (i = 0; i < 32 * mb; i += blk) {
+			fprintf(f, "ReadX 1 %d %d %d\n", i, rec, rec);
+		}
+		break;
+	case RA_INTERLEAVED:
+		/* two readers a little apart on one handle */
+		for (i = 0; i < 2 * mb; i += blk) {
+			fprintf(f, "ReadX 1 %d %d %d\n", i, blk, blk);
+			fprintf(f, "ReadX 1 %d %d %d\n", 2 * mb + i, blk, blk);
+		}
+		break;
+	case RA_MIXED:
+		/* a forward reader, a record walker and a backward reader */
+		for (i = 0; i < 8 * mb; i += blk) {
+			fprintf(f, "ReadX 1 %d %d %d\n", i, blk, blk);
+			fprintf(f, "ReadX 1 %d %d %d\n", 16 * mb + 4 * i, rec, rec);
+			fprintf(f, "ReadX 1 %d %d %d\n", 64 * mb - blk - i, blk, blk);
+		}
+		break;
+	case RA_RANDOM:
+		for (i = 0; i < 4096; i++) {
+			fprintf(f, "ReadX 1 %d %d %d\n",
+				(int)(random() % (64 * mb / rec)) * rec, rec, rec);
+		}
+		break;
+	default:
+		break;
+	}
+	fprintf(f, "Close 1\n");
+}
+
+static BOOL run_local_prefetch(int dummy)
+{
+	struct prefetch_params params;
+	struct ra_sim_stats st, old;
+	BOOL ret = True;
+	FILE *f;
+	int i;
+
+	params.initial_window = 128 * 1024;
+	params.max_window = 4 * 1024 * 1024;
+	params.drop_behind = True;
+
+	srandom(1);
+	for (i = 0; i < RA_NUM_PATTERNS; i++) {
+		f = tmpfile();
+		if (f == NULL) {
+			perror("tmpfile");
+			return False;
+		}
+		ra_gen_pattern(f, (enum ra_pattern)i);
+
+		ra_sim_replay(f, NULL, &old);
+		ra_sim_replay(f, &params, &st);
+		fclose(f);
+
+		printf("%s:\n", ra_pattern_names[i]);
+		ra_sim_print("  readahead", &old);
+		ra_sim_print("  prefetch", &st);
+
+		if (i == RA_RANDOM) {
+			if (st.ra_bytes > st.read_bytes / 10) {
+				printf("%s: too much readahead for random reads\n",
+				       __location__);
+				ret = False;
+			}
+		} else if (st.hit_bytes < st.read_bytes * 9 / 10) {
+			printf("%s: %s reads not followed\n", __location__,
+			       ra_pattern_names[i]);
+			ret = False;
+		}
+	}
+
+	/* and the real load file, if there is one */
+	f = fopen(client_txt, "r");
+	if (f) {
+		ra_sim_replay(f, NULL, &old);
+		ra_sim_replay(f, &params, &st);
+		fclose(f);
+
+		printf("%s:\n", client_txt);
+		ra_sim_print("  readahead", &old);
+		ra_sim_print("  prefetch", &st);
+	}
+
+	return ret;
+}
+
+/*
+ * Office style writes: many small writes to a few hot areas of a file
+ * (its header and allocation tables, a stream being rewritten out of
+ * order), appends, one byte writes past the end to check for space,
+ * and the odd large write, checking reads and the file size as it goes.
+ * Run it with and without "write cache size" set on the share to see
+ * what the cache buys.
+ */
+
+static BOOL run_randomwrite(int dummy)
+{
+	static struct cli_state *cli1;
+	const char *fname = "\\randomwrite.dat";
+	const size_t fsize = 1024*1024, maxsize = fsize + 256*1024;
+	char *shadow = NULL, *buf = NULL;
+	size_t shadow_size = 0;
+	SMB_OFF_T size;
+	int fnum1, i, ops = torture_numops * 100;
+	BOOL correct = True;
+	struct timeval start;
+	double t;
+
+	if (!torture_open_connection(&cli1, 0)) {
+		return False;
+	}
+	cli_sockopt(cli1, sockops);
+
+	shadow = SMB_CALLOC_ARRAY(char, maxsize);
+	buf = SMB_CALLOC_ARRAY(char, maxsize);
+	if (shadow == NULL || buf == NULL) {
+		printf("out of memory\n");
+		correct = False;
+		goto fail;
+	}
+
+	cli_unlink(cli1, fname);
+
+	/* an exclusive oplock lets the server cache the writes */
+	cli1->use_oplocks = True;
+	fnum1 = cli_open(cli1, fname, O_RDWR | O_CREAT | O_EXCL, DENY_NONE);
+	cli1->use_oplocks = use_oplocks;
+	if (fnum1 == -1) {
+		printf("open of %s failed (%s)\n", fname, cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+
+	GetTimeOfDay(&start);
+
+	for (i = 0; i < ops; i++) {
+		int r = random() % 100, j;
+		size_t pos, n;
+
+		if (r < 3) {
+			pos = shadow_size + random() % 8192;
+			n = 1;
+		} else if (r < 10) {
+			pos = shadow_size;
+			n = 1 + random() % 8192;
+		} else if (r < 13) {
+			pos = random() % fsize;
+			n = 16384 + random() % 49152;
+		} else if (r < 45) {
+			pos = random() % 8192;
+			n = 1 + random() % 512;
+		} else if (r < 80) {
+			pos = (i / 64) * 4096 % fsize + (random() % 32) * 512;
+			n = 512 * (1 + random() % 8);
+		} else {
+			pos = (random() % (fsize / 512)) * 512;
+			n = 1 + random() % 4096;
+		}
+		if (pos + n > maxsize) {
+			pos = maxsize - n;
+		}
+
+		if (r >= 95 && shadow_size > 0) {
+			/* read some back */
+			pos %= shadow_size;
+			n = MIN(n, shadow_size - pos);
+			if (cli_read(cli1, fnum1, buf, pos, n) != (ssize_t)n ||
+			    memcmp(buf, shadow + pos, n) != 0) {
+				printf("read of %d bytes at %d returned wrong data\n",
+				       (int)n, (int)pos);
+				correct = False;
+				goto fail;
+			}
+			continue;
+		}
+
+		for (j = 0; j < n; j++) {
+			shadow[pos + j] = random();
+		}
+		if (cli_write(cli1, fnum1, 0, shadow + pos, pos, n) != (ssize_t)n) {
+			printf("write of %d bytes at %d failed (%s)\n",
+			       (int)n, (int)pos, cli_errstr(cli1));
+			correct = False;
+			goto fail;
+		}
+		shadow_size = MAX(shadow_size, pos + n);
+
+		if (i % 100 == 0) {
+			if (!cli_qfileinfo(cli1, fnum1, NULL, &size, NULL,
+					   NULL, NULL, NULL, NULL) ||
+			    size != shadow_size) {
+				printf("file size is %.0f, expected %d\n",
+				       (double)size, (int)shadow_size);
+				correct = False;
+				goto fail;
+			}
+		}
+	}
+
+	if (!cli_close(cli1, fnum1)) {
+		printf("close failed (%s)\n", cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+
+	t = timeval_elapsed(&start);
+	printf("%d operations in %.2f seconds, %.0f/sec\n", ops, t, ops / t);
+
+	fnum1 = cli_open(cli1, fname, O_RDONLY, DENY_NONE);
+	if (fnum1 == -1) {
+		printf("reopen of %s failed (%s)\n", fname, cli_errstr(cli1));
+		correct = False;
+		goto fail;
+	}
+	for (i = 0; i < shadow_size; i += 32768) {
+		size_t n = MIN(32768, shadow_size - i);
+
+		if (cli_read(cli1, fnum1, buf + i, i, n) != (ssize_t)n) {
+			printf("read back failed (%s)\n", cli_errstr(cli1));
+			correct = False;
+			break;
+		}
+	}
+	if (correct && memcmp(buf, shadow, shadow_size) != 0) {
+		printf("file contents differ from what was written\n");
+		correct = False;
+	}
+	cli_close(cli1, fnum1);
+
+ fail:
+	cli_unlink(cli1, fname);
+	SAFE_FREE(shadow);
+	SAFE_FREE(buf);
+
+	if (!torture_close_connection(cli1)) {
+		correct = False;
+	}
+	return correct;
+}
+
 static double create_procs(BOOL (*fn)(int), BOOL *result)
 {
 	int i, status;
@@ -5046,6 +6828,9 @@ static struct {
 	{"RW1",  run_readwritetest, 0},
 	{"RW2",  run_readwritemulti, FLAG_MULTIPROC},
 	{"RW3",  run_readwritelarge, 0},
+	{"RANDOMWRITE",  run_randomwrite, 0},
+	{"ZEROWRITE",  run_zerowrite, 0},
+	{"SIGNEDREAD", run_signedread, 0},
 	{"OPEN", run_opentest, 0},
 #if 1
 	{"OPENATTR", run_openattrtest, 0},
@@ -5070,6 +6855,14 @@ static struct {
 	{ "SESSSETUP_BENCH", run_sesssetup_bench, 0},
 	{ "LOCAL-SUBSTITUTE", run_local_substitute, 0},
 	{ "LOCAL-GENCACHE", run_local_gencache, 0},
+	{ "LOCAL-IDMAPCACHE", run_local_idmapcache, 0},
+	{ "LOCAL-SAMLOGONCACHE", run_local_samlogoncache, 0},
+	{ "LOCAL-SHARELOOKUP", run_local_sharelookup, 0},
+	{ "LOCAL-MD5", run_local_md5, 0},
+	{ "LOCAL-WILDCARD", run_local_wildcard, 0},
+	{ "LOCAL-CHARCNV", run_local_charcnv, 0},
+	{ "LOCAL-CASECMP", run_local_casecmp, 0},
+	{ "LOCAL-PREFETCH", run_local_prefetch, 0},
 	{NULL, NULL, 0}};
 
 
@@ -455,6 +455,8 @@ BOOL reload_services(BOOL test)
 	
 	ret = lp_load(dyn_CONFIGFILE, False, False, True, True);
 
+	conn_refresh_share_caches();
+
 	/* perhaps the config filename is now set */
 	if (!test)
 		reload_services(True);
@@ -555,6 +557,7 @@ int main(int argc, char *argv[])
 	conn_init();
 	vfs.conn = conn_new();
 	string_set(&vfs.conn->user,"vfstest");
+	conn_set_share_cache(vfs.conn);
 	for (i=0; i < 1024; i++)
 		vfs.files[i] = NULL;
 
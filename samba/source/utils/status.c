@@ -46,11 +46,13 @@ static BOOL processes_only=False;
 static int show_brl;
 static int show_counts = 0;
 static BOOL numeric_only = False;
+static int profile_pid = 0;
 
 const char *username = NULL;
 
-extern BOOL status_profile_dump(BOOL be_verbose);
-extern BOOL status_profile_rates(BOOL be_verbose);
+extern BOOL status_profile_dump(BOOL be_verbose, pid_t pid);
+extern BOOL status_profile_rates(BOOL be_verbose, pid_t pid);
+extern BOOL status_profile_export(BOOL be_verbose, pid_t pid);
 
 /* added by OH */
 static void Ucrit_addUid(uid_t uid)
@@ -385,6 +387,8 @@ static void dump_service_stats(void)
 		{"brief",	'b', POPT_ARG_NONE, 	&brief, 'b', "Be brief" },
 		{"profile",     'P', POPT_ARG_NONE, NULL, 'P', "Do profiling" },
 		{"profile-rates", 'R', POPT_ARG_NONE, NULL, 'R', "Show call rates" },
+		{"profile-export", 'E', POPT_ARG_NONE, NULL, 'E', "Export SMB latency histograms" },
+		{"profile-pid", 'I', POPT_ARG_INT, &profile_pid, 'I', "Profile only this smbd process", "PID" },
 		{"byterange",	'B', POPT_ARG_NONE,	&show_brl, 'B', "Include byte range locks"},
 		{"numeric",	'n', POPT_ARG_NONE,	&numeric_only, 'n', "Numeric uid/gid"},
 		{"counts",	'C', POPT_ARG_NONE,	&show_counts, 'n', "Show all user op/bytes counts"},
@@ -414,6 +418,7 @@ static void dump_service_stats(void)
 			break;
 		case 'P':
 		case 'R':
+		case 'E':
 			profile_only = c;
 		}
 	}
@@ -439,10 +444,13 @@ static void dump_service_stats(void)
 	switch (profile_only) {
 		case 'P':
 			/* Dump profile data */
-			return status_profile_dump(verbose);
+			return status_profile_dump(verbose, (pid_t)profile_pid);
 		case 'R':
 			/* Continuously display rate-converted data */
-			return status_profile_rates(verbose);
+			return status_profile_rates(verbose, (pid_t)profile_pid);
+		case 'E':
+			/* Dump latency histograms for scripts */
+			return status_profile_export(verbose, (pid_t)profile_pid);
 		default:
 			break;
 	}
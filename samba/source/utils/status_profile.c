@@ -21,8 +21,9 @@
 
 #include "includes.h"
 
-BOOL status_profile_dump(BOOL be_verbose);
-BOOL status_profile_rates(BOOL be_verbose);
+BOOL status_profile_dump(BOOL be_verbose, pid_t pid);
+BOOL status_profile_rates(BOOL be_verbose, pid_t pid);
+BOOL status_profile_export(BOOL be_verbose, pid_t pid);
 
 #ifdef WITH_PROFILE
 static void profile_separator(const char * title)
@@ -39,21 +40,144 @@ static void profile_separator(const char * title)
     line[sizeof(line) - 1] = '\0';
     d_printf("%s\n", line);
 }
+
+/*******************************************************************
+ The profile area holds the counters of each smbd separately, and
+ profile_setup() gives us their totals. Swap in those of one process
+ if asked to.
+  ******************************************************************/
+
+static BOOL select_process(pid_t pid)
+{
+	if (pid != 0 && !profile_sum(profile_p, pid)) {
+		fprintf(stderr, "Process %d has no profile counters of its own\n",
+			(int)pid);
+		return False;
+	}
+	return True;
+}
+
+static void print_slabs(void)
+{
+	int i;
+
+	profile_separator("Processes");
+	for (i = 0; i < profile_h->prof_shm_slabs; i++) {
+		const struct profile_slab *slab = profile_slab(i);
+
+		if (i == PROF_SLAB_RETIRED) {
+			d_printf("%-10s", "exited");
+		} else if (i == PROF_SLAB_SHARED) {
+			d_printf("%-10s", "others");
+		} else if (slab->pid != 0) {
+			d_printf("%-10d", (int)slab->pid);
+		} else {
+			continue;
+		}
+		d_printf(" smb_count: %u uid_changes: %u sec_ctx_switches: %u\n",
+			 slab->stats.smb_count, slab->stats.uid_changes,
+			 slab->stats.sec_ctx_switches);
+	}
+}
+
+/* lowest latency in usec counted by a histogram bucket */
+static SMB_BIG_UINT bucket_floor(int b)
+{
+	return b == 0 ? 0 : (SMB_BIG_UINT)1 << (b - 1);
+}
+
+static const char *bucket_label(int b)
+{
+	static fstring label;
+
+	if (b == PR_HIST_BUCKETS - 1) {
+		fstr_sprintf(label, ">=%lluus", (unsigned long long)bucket_floor(b));
+	} else {
+		fstr_sprintf(label, "<%lluus", (unsigned long long)bucket_floor(b + 1));
+	}
+	return label;
+}
+
+/* the bucket holding the call at the given fraction of the total */
+static int bucket_percentile(const unsigned *buckets, unsigned total, double pct)
+{
+	unsigned seen = 0;
+	int b;
+
+	for (b = 0; b < PR_HIST_BUCKETS - 1; b++) {
+		seen += buckets[b];
+		if (seen >= total * pct) {
+			break;
+		}
+	}
+	return b;
+}
+
+static void print_latency(const char *title, const struct profile_latency *latency,
+			  BOOL verbose)
+{
+	int i, b, max;
+	unsigned total;
+
+	profile_separator(title);
+
+	for (i = 0; i < PR_HIST_VALUES; i++) {
+		const unsigned *buckets = latency->buckets[i];
+
+		total = 0;
+		max = 0;
+		for (b = 0; b < PR_HIST_BUCKETS; b++) {
+			if (buckets[b]) {
+				total += buckets[b];
+				max = b;
+			}
+		}
+		if (total == 0) {
+			continue;
+		}
+
+		d_printf("%-31s %10u", profile_value_name(PR_HIST_FIRST + i), total);
+		d_printf("  p50 %-9s", bucket_label(bucket_percentile(buckets, total, 0.50)));
+		d_printf("  p90 %-9s", bucket_label(bucket_percentile(buckets, total, 0.90)));
+		d_printf("  p99 %-9s", bucket_label(bucket_percentile(buckets, total, 0.99)));
+		d_printf("  max %s\n", bucket_label(max));
+
+		if (verbose) {
+			for (b = 0; b < PR_HIST_BUCKETS; b++) {
+				if (buckets[b]) {
+					d_printf("    %-12s %u\n", bucket_label(b), buckets[b]);
+				}
+			}
+		}
+	}
+}
 #endif
 
 /*******************************************************************
  dump the elements of the profile structure
   ******************************************************************/
-BOOL status_profile_dump(BOOL verbose)
+BOOL status_profile_dump(BOOL verbose, pid_t pid)
 {
 #ifdef WITH_PROFILE
+	int i;
+
 	if (!profile_setup(True)) {
 		fprintf(stderr,"Failed to initialise profile memory\n");
 		return False;
 	}
+	if (!select_process(pid)) {
+		return False;
+	}
 
 	d_printf("smb_count:                      %u\n", profile_p->smb_count);
 	d_printf("uid_changes:                    %u\n", profile_p->uid_changes);
+	d_printf("param_lookups:                  %u\n", profile_p->param_lookups);
+	d_printf("sec_ctx_switches:               %u\n", profile_p->sec_ctx_switches);
+	d_printf("sec_ctx_switches_per_smb:       %.2f\n",
+		 profile_p->smb_count ?
+		 (double)profile_p->sec_ctx_switches / profile_p->smb_count : 0.0);
+	d_printf("setgroups_calls:                %u\n", profile_p->setgroups_calls);
+	d_printf("setgroups_skipped:              %u\n", profile_p->setgroups_skipped);
 
 	profile_separator("System Calls");
 	d_printf("opendir_count:                  %u\n", profile_p->syscall_opendir_count);
@@ -129,6 +253,15 @@ BOOL status_profile_dump(BOOL verbose)
 	d_printf("misses:                         %u\n", profile_p->statcache_misses);
 	d_printf("hits:                           %u\n", profile_p->statcache_hits);
 
+	profile_separator("DOS Attribute Cache");
+	d_printf("hits:                           %u\n", profile_p->dosattr_cache_hits);
+	d_printf("misses:                         %u\n", profile_p->dosattr_cache_misses);
+
+	profile_separator("Mangle Cache");
+	d_printf("hits:                           %u\n", profile_p->mangle_cache_hits);
+	d_printf("shared_hits:                    %u\n", profile_p->mangle_cache_shared_hits);
+	d_printf("misses:                         %u\n", profile_p->mangle_cache_misses);
+
 	profile_separator("Write Cache");
 	d_printf("read_hits:                      %u\n", profile_p->writecache_read_hits);
 	d_printf("abutted_writes:                 %u\n", profile_p->writecache_abutted_writes);
@@ -144,7 +277,10 @@ BOOL status_profile_dump(BOOL verbose)
 	d_printf("flushed_writes[CLOSE]:          %u\n", profile_p->writecache_flushed_writes[CLOSE_FLUSH]);
 	d_printf("flushed_writes[SYNC]:           %u\n", profile_p->writecache_flushed_writes[SYNC_FLUSH]);
 	d_printf("flushed_writes[SIZECHANGE]:     %u\n", profile_p->writecache_flushed_writes[SIZECHANGE_FLUSH]);
+	d_printf("flushed_writes[IDLE]:           %u\n", profile_p->writecache_flushed_writes[IDLE_FLUSH]);
+	d_printf("flushed_writes[BUDGET]:         %u\n", profile_p->writecache_flushed_writes[BUDGET_FLUSH]);
 	d_printf("num_perfect_writes:             %u\n", profile_p->writecache_num_perfect_writes);
+	d_printf("gathered_writes:                %u\n", profile_p->writecache_gathered_writes);
 	d_printf("num_write_caches:               %u\n", profile_p->writecache_num_write_caches);
 	d_printf("allocated_write_caches:         %u\n", profile_p->writecache_allocated_write_caches);
 
@@ -403,6 +539,29 @@ BOOL status_profile_dump(BOOL verbose)
 	d_printf("run_elections_time:             %u\n", profile_p->run_elections_time);
 	d_printf("election_count:                 %u\n", profile_p->election_count);
 	d_printf("election_time:                  %u\n", profile_p->election_time);
+
+	print_latency("SMB Latency", &profile_p->latency, verbose);
+	d_printf("untracked_shares:               %u\n",
+		 profile_p->latency_untracked_shares);
+
+	if (pid != 0) {
+		/* the shares are only counted in total */
+		return True;
+	}
+	for (i = 0; i < PR_HIST_SHARES; i++) {
+		const struct profile_share_latency *s = &profile_h->share_latency[i];
+		fstring title;
+
+		if (s->name[0] == '\0') {
+			continue;
+		}
+		fstr_sprintf(title, "SMB Latency on [%s]", s->name);
+		print_latency(title, &s->latency, verbose);
+	}
+
+	if (verbose) {
+		print_slabs();
+	}
 #else /* WITH_PROFILE */
 	fprintf(stderr, "Profile data unavailable\n");
 #endif /* WITH_PROFILE */
@@ -410,6 +569,62 @@ BOOL status_profile_dump(BOOL verbose)
 	return True;
 }
 
+/*******************************************************************
+ print the latency histograms one bucket per line, for scripts:
+ share ("*" for all shares), call, lowest usec of the bucket, count
+  ******************************************************************/
+
+#ifdef WITH_PROFILE
+static void export_latency(const char *share, const struct profile_latency *latency)
+{
+	int i, b;
+
+	for (i = 0; i < PR_HIST_VALUES; i++) {
+		for (b = 0; b < PR_HIST_BUCKETS; b++) {
+			if (latency->buckets[i][b] == 0) {
+				continue;
+			}
+			d_printf("%s\t%s\t%llu\t%u\n", share,
+				 profile_value_name(PR_HIST_FIRST + i),
+				 (unsigned long long)bucket_floor(b),
+				 latency->buckets[i][b]);
+		}
+	}
+}
+#endif
+
+BOOL status_profile_export(BOOL verbose, pid_t pid)
+{
+#ifdef WITH_PROFILE
+	const struct profile_share_latency *s;
+	int i;
+
+	if (!profile_setup(True)) {
+		fprintf(stderr,"Failed to initialise profile memory\n");
+		return False;
+	}
+	if (!select_process(pid)) {
+		return False;
+	}
+
+	if (verbose) {
+		d_printf("# share\tcall\tusec\tcount\n");
+	}
+	export_latency("*", &profile_p->latency);
+	for (i = 0; pid == 0 && i < PR_HIST_SHARES; i++) {
+		s = &profile_h->share_latency[i];
+		if (s->name[0] != '\0') {
+			export_latency(s->name, &s->latency);
+		}
+	}
+
+	return True;
+#else /* WITH_PROFILE */
+	fprintf(stderr, "Profile data unavailable\n");
+	return False;
+#endif /* WITH_PROFILE */
+}
+
 #ifdef WITH_PROFILE
 
 /* Convert microseconds to milliseconds. */
@@ -472,7 +687,7 @@ static int print_count_samples(
 static struct profile_stats	sample_data[2];
 static SMB_BIG_UINT		sample_time[2];
 
-BOOL status_profile_rates(BOOL verbose)
+BOOL status_profile_rates(BOOL verbose, pid_t pid)
 {
 	SMB_BIG_UINT remain_usec;
 	SMB_BIG_UINT next_usec;
@@ -492,13 +707,17 @@ BOOL status_profile_rates(BOOL verbose)
 		return False;
 	}
 
+	if (!select_process(pid)) {
+		return False;
+	}
+
 	memcpy(&sample_data[last], profile_p, sizeof(*profile_p));
 	for (;;) {
 		sample_time[current] = profile_timestamp();
 		next_usec = sample_time[current] + sample_interval_usec;
 
 		/* Take a sample. */
-		memcpy(&sample_data[current], profile_p, sizeof(*profile_p));
+		profile_sum(&sample_data[current], pid);
 
 		/* Rate convert some values and print results. */
 		delta_usec = sample_time[current] - sample_time[last];
@@ -534,7 +753,7 @@ BOOL status_profile_rates(BOOL verbose)
 
 #else /* WITH_PROFILE */
 
-BOOL status_profile_rates(BOOL verbose)
+BOOL status_profile_rates(BOOL verbose, pid_t pid)
 {
 	fprintf(stderr, "Profile data unavailable\n");
 	return False;